@@ -91,6 +91,7 @@ namespace net_utils
   private:
     //----------------- i_service_endpoint ---------------------
     virtual bool do_send(const void* ptr, size_t cb);
+    virtual bool do_send_shared(const boost::shared_ptr<const std::string>& buff);
     virtual bool close();
     virtual bool call_run_once_service_io();
     virtual bool request_callback();
@@ -120,7 +121,7 @@ namespace net_utils
     volatile uint32_t m_want_close_connection;
     std::atomic<bool> m_was_shutdown;
     critical_section m_send_que_lock;
-    std::list<std::string> m_send_que;
+    std::list<boost::shared_ptr<const std::string> > m_send_que;
     volatile uint32_t& m_ref_sockets_count;
     i_connection_filter* &m_pfilter;
     volatile bool m_is_multithreaded;
@@ -32,6 +32,7 @@
 #include <boost/uuid/random_generator.hpp>
 #include <boost/chrono.hpp>
 #include <boost/utility/value_init.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/asio/deadline_timer.hpp>
 #include <string>
 #include "misc_language.h"
@@ -308,6 +309,14 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
   bool connection<t_protocol_handler>::do_send(const void* ptr, size_t cb)
+  {
+    TRY_ENTRY();
+    return do_send_shared(boost::make_shared<const std::string>((const char*)ptr, cb));
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::do_send_shared(const boost::shared_ptr<const std::string>& buff)
   {
     TRY_ENTRY();
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
@@ -317,9 +326,9 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     if(m_was_shutdown)
       return false;
 
-    LOG_PRINT("[sock " << socket_.native_handle() << "] SEND " << cb, LOG_LEVEL_4);
+    LOG_PRINT("[sock " << socket_.native_handle() << "] SEND " << buff->size(), LOG_LEVEL_4);
     context.m_last_send = time(NULL);
-    context.m_send_cnt += cb;
+    context.m_send_cnt += buff->size();
     //some data should be wrote to stream
     //request complete
     
@@ -332,8 +341,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return false;
     }
 
-    m_send_que.resize(m_send_que.size()+1);
-    m_send_que.back().assign((const char*)ptr, cb);
+    m_send_que.push_back(buff);
     
     if(m_send_que.size() > 1)
     {
@@ -347,18 +355,18 @@ PRAGMA_WARNING_DISABLE_VS(4355)
         return false;
       }
 
-      boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), m_send_que.front().size()),
+      boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front()->data(), m_send_que.front()->size()),
         //strand_.wrap(
         boost::bind(&connection<t_protocol_handler>::handle_write, self, _1, _2)
         //)
         );
       
-      LOG_PRINT_L4("[sock " << socket_.native_handle() << "] Async send requested " << m_send_que.front().size());
+      LOG_PRINT_L4("[sock " << socket_.native_handle() << "] Async send requested " << m_send_que.front()->size());
     }
 
     return true;
 
-    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send_shared", false);
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
@@ -422,7 +430,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     }else
     {
       //have more data to send
-      boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), m_send_que.front().size()),
+      boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front()->data(), m_send_que.front()->size()),
         //strand_.wrap(
           boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), _1, _2));
         //);
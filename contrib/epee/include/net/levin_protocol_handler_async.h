@@ -32,6 +32,8 @@
 #include <boost/asio/deadline_timer.hpp>
 
 #include <atomic>
+#include <cstring>
+#include <list>
 
 #include "levin_base.h"
 #include "misc_language.h"
@@ -74,6 +76,7 @@ public:
   int invoke_async(int command, const std::string& in_buff, boost::uuids::uuid connection_id, callback_t cb, size_t timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED);
 
   int notify(int command, const std::string& in_buff, boost::uuids::uuid connection_id);
+  int relay_notify(int command, const std::string& in_buff, const std::list<boost::uuids::uuid>& connections);
   bool close(boost::uuids::uuid connection_id);
   bool update_connection_context(const t_connection_context& contxt);
   bool request_callback(boost::uuids::uuid connection_id);
@@ -325,7 +328,14 @@ public:
       return false;
     }
 
-    m_cache_in_buffer.append((const char*)ptr, cb);
+    // packets are split straight out of the read buffer while nothing is left over from the previous read,
+    // only an incomplete packet at the end gets copied into m_cache_in_buffer to wait for more data
+    bool from_cache = !m_cache_in_buffer.empty();
+    if(from_cache)
+      m_cache_in_buffer.append((const char*)ptr, cb);
+    const char* data = from_cache ? m_cache_in_buffer.data() : (const char*)ptr;
+    size_t size = from_cache ? m_cache_in_buffer.size() : cb;
+    size_t offset = 0;
 
     bool is_continue = true;
     while(is_continue)
@@ -333,19 +343,24 @@ public:
       switch(m_state)
       {
       case stream_state_body:
-        if(m_cache_in_buffer.size() < m_current_head.m_cb)
+        if(size - offset < m_current_head.m_cb)
         {
           is_continue = false;
           break;
         }
         {
           std::string buff_to_invoke;
-          if(m_cache_in_buffer.size()  == m_current_head.m_cb)
+          if(from_cache && offset == 0 && size == m_current_head.m_cb)
+          {
+            //the body filled the cache over several reads, take it without copying
             buff_to_invoke.swap(m_cache_in_buffer);
+            data = m_cache_in_buffer.data();
+            size = 0;
+          }
           else
           {
-            buff_to_invoke.assign(m_cache_in_buffer, 0, (std::string::size_type)m_current_head.m_cb);
-            m_cache_in_buffer.erase(0, (std::string::size_type)m_current_head.m_cb);
+            buff_to_invoke.assign(data + offset, (std::string::size_type)m_current_head.m_cb);
+            offset += (size_t)m_current_head.m_cb;
           }
 
           bool is_response = (m_oponent_protocol_ver == LEVIN_PROTOCOL_VER_1 && m_current_head.m_flags&LEVIN_PACKET_RESPONSE);
@@ -424,26 +439,31 @@ public:
         break;
       case stream_state_head:
         {
-          if(m_cache_in_buffer.size() < sizeof(bucket_head2))
+          //headers can start at any offset of the read buffer, so they're copied out rather than cast in place
+          if(size - offset < sizeof(bucket_head2))
           {
-            if(m_cache_in_buffer.size() >= sizeof(uint64_t) && *((uint64_t*)m_cache_in_buffer.data()) != LEVIN_SIGNATURE)
+            if(size - offset >= sizeof(uint64_t))
             {
-              LOG_ERROR_CC(m_connection_context, "Signature mismatch, connection will be closed");
-              return false;
+              uint64_t signature;
+              memcpy(&signature, data + offset, sizeof(signature));
+              if(signature != LEVIN_SIGNATURE)
+              {
+                LOG_ERROR_CC(m_connection_context, "Signature mismatch, connection will be closed");
+                return false;
+              }
             }
             is_continue = false;
             break;
           }
 
-          bucket_head2* phead = (bucket_head2*)m_cache_in_buffer.data();
-          if(LEVIN_SIGNATURE != phead->m_signature)
+          memcpy(&m_current_head, data + offset, sizeof(bucket_head2));
+          if(LEVIN_SIGNATURE != m_current_head.m_signature)
           {
             LOG_ERROR_CC(m_connection_context, "Signature mismatch, connection will be closed");
             return false;
           }
-          m_current_head = *phead;
 
-          m_cache_in_buffer.erase(0, sizeof(bucket_head2));
+          offset += sizeof(bucket_head2);
           m_state = stream_state_body;
           m_oponent_protocol_ver = m_current_head.m_protocol_version;
           if(m_current_head.m_cb > m_config.m_max_packet_size)
@@ -461,6 +481,12 @@ public:
       }
     }
 
+    //keep the incomplete tail for the next read, dropping everything handled in one go
+    if(from_cache)
+      m_cache_in_buffer.erase(0, offset);
+    else
+      m_cache_in_buffer.assign(data + offset, size - offset);
+
     return true;
   }
 
@@ -614,6 +640,30 @@ public:
   }
 
   int notify(int command, const std::string& in_buff)
+  {
+    return notify_framed(make_notify_packet(command, in_buff));
+  }
+  //------------------------------------------------------------------------------------------
+  // header and body of a notification in one buffer, the same for every connection it goes to
+  static boost::shared_ptr<const std::string> make_notify_packet(int command, const std::string& in_buff)
+  {
+    bucket_head2 head = {0};
+    head.m_signature = LEVIN_SIGNATURE;
+    head.m_have_to_return_data = false;
+    head.m_cb = in_buff.size();
+
+    head.m_command = command;
+    head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+    head.m_flags = LEVIN_PACKET_REQUEST;
+
+    boost::shared_ptr<std::string> packet = boost::make_shared<std::string>();
+    packet->reserve(sizeof(head) + in_buff.size());
+    packet->append((const char*)&head, sizeof(head));
+    packet->append(in_buff);
+    return packet;
+  }
+  //------------------------------------------------------------------------------------------
+  int notify_framed(const boost::shared_ptr<const std::string>& packet)
   {
     misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
                           boost::bind(&async_protocol_handler::finish_outer_call, this));
@@ -626,27 +676,15 @@ public:
     if(m_deletion_initiated)
       return LEVIN_ERROR_CONNECTION_DESTROYED;
 
-    bucket_head2 head = {0};
-    head.m_signature = LEVIN_SIGNATURE;
-    head.m_have_to_return_data = false;
-    head.m_cb = in_buff.size();
-
-    head.m_command = command;
-    head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
-    head.m_flags = LEVIN_PACKET_REQUEST;
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
+    if(!m_pservice_endpoint->do_send_shared(packet))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send()");
       return -1;
     }
-
-    if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
-    {
-      LOG_ERROR("Failed to do_send()");
-      return -1;
-    }
     CRITICAL_REGION_END();
+
+    const bucket_head2& head = *reinterpret_cast<const bucket_head2*>(packet->data());
     LOG_PRINT_CC_L4(m_connection_context, "LEVIN_PACKET_SENT. [len=" << head.m_cb << 
       ", f=" << head.m_flags << 
       ", r?=" << head.m_have_to_return_data <<
@@ -743,6 +781,21 @@ int async_protocol_handler_config<t_connection_context>::notify(int command, con
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context>
+int async_protocol_handler_config<t_connection_context>::relay_notify(int command, const std::string& in_buff, const std::list<boost::uuids::uuid>& connections)
+{
+  //framed once, every connection queues the same buffer
+  boost::shared_ptr<const std::string> packet = async_protocol_handler<t_connection_context>::make_notify_packet(command, in_buff);
+  int sent = 0;
+  for(const auto& connection_id: connections)
+  {
+    async_protocol_handler<t_connection_context>* aph;
+    if(LEVIN_OK == find_and_lock_connection(connection_id, aph) && aph->notify_framed(packet) > 0)
+      ++sent;
+  }
+  return sent;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
 bool async_protocol_handler_config<t_connection_context>::close(boost::uuids::uuid connection_id)
 {
   CRITICAL_REGION_LOCAL(m_connects_lock);
@@ -0,0 +1,585 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "misc_log_ex.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_bin.h"
+#include "portable_storage_from_bin.h"
+#include "portable_storage_val_converters.h"
+
+namespace epee
+{
+  namespace serialization
+  {
+    template<class t_value> struct bin_type_code;
+    template<> struct bin_type_code<int64_t>     { static const uint8_t value = SERIALIZE_TYPE_INT64; };
+    template<> struct bin_type_code<int32_t>     { static const uint8_t value = SERIALIZE_TYPE_INT32; };
+    template<> struct bin_type_code<int16_t>     { static const uint8_t value = SERIALIZE_TYPE_INT16; };
+    template<> struct bin_type_code<int8_t>      { static const uint8_t value = SERIALIZE_TYPE_INT8; };
+    template<> struct bin_type_code<uint64_t>    { static const uint8_t value = SERIALIZE_TYPE_UINT64; };
+    template<> struct bin_type_code<uint32_t>    { static const uint8_t value = SERIALIZE_TYPE_UINT32; };
+    template<> struct bin_type_code<uint16_t>    { static const uint8_t value = SERIALIZE_TYPE_UINT16; };
+    template<> struct bin_type_code<uint8_t>     { static const uint8_t value = SERIALIZE_TYPE_UINT8; };
+    template<> struct bin_type_code<double>      { static const uint8_t value = SERIALIZE_TYPE_DUOBLE; };
+    template<> struct bin_type_code<bool>        { static const uint8_t value = SERIALIZE_TYPE_BOOL; };
+    template<> struct bin_type_code<std::string> { static const uint8_t value = SERIALIZE_TYPE_STRING; };
+
+    /************************************************************************/
+    /* Writes the portable_storage binary format straight from a kv map,   */
+    /* without building sections first                                      */
+    /************************************************************************/
+    // entries come out in the order the map declares them rather than sorted by name, readers don't mind.
+    // the entry count of a section or an array isn't known until the map moves on, so a byte is reserved
+    // for it and widened on the rare occasion it doesn't fit.
+    class portable_storage_bin_writer
+    {
+    public:
+      struct frame
+      {
+        size_t count_pos;
+        size_t count;
+      };
+      typedef frame* hsection;
+      typedef frame* harray;
+      typedef storage_entry meta_entry;
+
+      portable_storage_bin_writer():m_failed(false)
+      {
+        uint32_t signature_a = PORTABLE_STORAGE_SIGNATUREA;
+        uint32_t signature_b = PORTABLE_STORAGE_SIGNATUREB;
+        uint8_t ver = PORTABLE_STORAGE_FORMAT_VER;
+        write((const char*)&signature_a, sizeof(signature_a));
+        write((const char*)&signature_b, sizeof(signature_b));
+        write((const char*)&ver, sizeof(ver));
+        push_frame();
+      }
+
+      //stream interface for pack_varint() and friends
+      void write(const char* data, size_t size)
+      {
+        m_buff.append(data, size);
+      }
+
+      template<class t_value>
+      bool set_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+      {
+        if(!put_name(value_name, hparent_section))
+          return false;
+        put_type(bin_type_code<t_value>::value);
+        put_value(v);
+        return true;
+      }
+
+      bool set_value(const std::string& value_name, const storage_entry& v, hsection hparent_section)
+      {
+        if(!put_name(value_name, hparent_section))
+          return false;
+        return pack_entry_to_buff(*this, v);
+      }
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist = false)
+      {
+        if(!put_name(section_name, hparent_section))
+          return nullptr;
+        put_type(SERIALIZE_TYPE_OBJECT);
+        return push_frame();
+      }
+
+      template<class t_value>
+      harray insert_first_value(const std::string& value_name, const t_value& target, hsection hparent_section)
+      {
+        if(!put_name(value_name, hparent_section))
+          return nullptr;
+        put_type(bin_type_code<t_value>::value | SERIALIZE_FLAG_ARRAY);
+        harray hval_array = push_frame();
+        insert_next_value(hval_array, target);
+        return hval_array;
+      }
+
+      template<class t_value>
+      bool insert_next_value(harray hval_array, const t_value& target)
+      {
+        if(!enter(hval_array))
+          return false;
+        ++hval_array->count;
+        put_value(target);
+        return true;
+      }
+
+      harray insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section)
+      {
+        if(!put_name(section_name, hparent_section))
+          return nullptr;
+        put_type(SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY);
+        harray hsec_array = push_frame();
+        insert_next_section(hsec_array, hinserted_childsection);
+        return hsec_array;
+      }
+
+      bool insert_next_section(harray hsec_array, hsection& hinserted_childsection)
+      {
+        if(!enter(hsec_array))
+          return false;
+        ++hsec_array->count;
+        hinserted_childsection = push_frame();
+        return true;
+      }
+
+      //closes what's still open, the writer is done after this
+      bool store_to_binary(binarybuffer& target)
+      {
+        while(!m_frames.empty())
+          pop_frame();
+        CHECK_AND_ASSERT_MES(!m_failed, false, "portable_storage_bin_writer: failed to store");
+        target.swap(m_buff);
+        m_buff.clear();
+        return true;
+      }
+
+    private:
+      frame* push_frame()
+      {
+        frame f = {m_buff.size(), 0};
+        m_frames.push_back(f);
+        m_buff.push_back(0);
+        return &m_frames.back();
+      }
+
+      void pop_frame()
+      {
+        const frame& f = m_frames.back();
+        if(f.count <= 63)
+        {
+          m_buff[f.count_pos] = static_cast<char>((f.count << 2) | PORTABLE_RAW_SIZE_MARK_BYTE);
+        }
+        else
+        {
+          std::stringstream ss;
+          pack_varint(ss, f.count);
+          m_buff.replace(f.count_pos, 1, ss.str());
+        }
+        m_frames.pop_back();
+      }
+
+      //writes go to the innermost open section or array, so whatever was opened inside it is complete
+      bool enter(frame* f)
+      {
+        if(!f && !m_frames.empty())
+          f = &m_frames.front();
+        while(!m_frames.empty() && &m_frames.back() != f)
+          pop_frame();
+        if(m_frames.empty())
+        {
+          m_failed = true;
+          LOG_ERROR("portable_storage_bin_writer: write to a closed section");
+          return false;
+        }
+        return true;
+      }
+
+      bool put_name(const std::string& name, hsection hparent_section)
+      {
+        if(name.size() >= std::numeric_limits<uint8_t>::max())
+        {
+          m_failed = true;
+          LOG_ERROR("storage_entry_name is too long: " << name.size() << ", val: " << name);
+          return false;
+        }
+        if(!enter(hparent_section))
+          return false;
+        ++m_frames.back().count;
+        uint8_t len = static_cast<uint8_t>(name.size());
+        write((const char*)&len, sizeof(len));
+        write(name.data(), len);
+        return true;
+      }
+
+      void put_type(uint8_t type)
+      {
+        write((const char*)&type, sizeof(type));
+      }
+
+      template<class t_value>
+      void put_value(const t_value& v)
+      {
+        write((const char*)&v, sizeof(v));
+      }
+
+      void put_value(const std::string& v)
+      {
+        put_string(*this, v);
+      }
+
+      std::string m_buff;
+      std::deque<frame> m_frames;
+      bool m_failed;
+    };
+
+    /************************************************************************/
+    /* Reads the portable_storage binary format straight into a kv map,    */
+    /* without building sections first                                      */
+    /************************************************************************/
+    // a section's entries are indexed by name when it's opened and values are decoded from the buffer when
+    // the map asks for them. the whole tree is still walked on load, so malformed data fails there like it
+    // does with portable_storage. the buffer has to outlive the reader.
+    class portable_storage_bin_reader
+    {
+    public:
+      struct entry
+      {
+        const uint8_t* name;
+        size_t name_len;
+        const uint8_t* value; //type code followed by the value
+      };
+      struct section_index
+      {
+        size_t first;
+        size_t count;
+      };
+      struct array_cursor
+      {
+        uint8_t type;
+        size_t left;
+        const uint8_t* next;
+      };
+      typedef section_index* hsection;
+      typedef array_cursor* harray;
+      typedef storage_entry meta_entry;
+
+      portable_storage_bin_reader():m_end(nullptr)
+      {
+        m_empty_section.first = 0;
+        m_empty_section.count = 0;
+      }
+
+      bool load_from_binary(const binarybuffer& source)
+      {
+        return load_from_binary(source.data(), source.size());
+      }
+
+      bool load_from_binary(const void* data, size_t size)
+      {
+        m_entries.clear();
+        m_sections.clear();
+        m_arrays.clear();
+
+        const size_t header_size = 2 * sizeof(uint32_t) + sizeof(uint8_t);
+        if(size < header_size)
+        {
+          LOG_ERROR("portable_storage: wrong binary format, packet size = " << size << " less than expected sizeof(storage_block_header)=" << header_size);
+          return false;
+        }
+        const uint8_t* p = (const uint8_t*)data;
+        uint32_t signature_a, signature_b;
+        memcpy(&signature_a, p, sizeof(signature_a));
+        memcpy(&signature_b, p + sizeof(signature_a), sizeof(signature_b));
+        if(signature_a != PORTABLE_STORAGE_SIGNATUREA || signature_b != PORTABLE_STORAGE_SIGNATUREB)
+        {
+          LOG_ERROR("portable_storage: wrong binary format - signature missmatch");
+          return false;
+        }
+        uint8_t ver = p[2 * sizeof(uint32_t)];
+        if(ver != PORTABLE_STORAGE_FORMAT_VER)
+        {
+          LOG_ERROR("portable_storage: wrong binary format - unknown format ver = " << ver);
+          return false;
+        }
+        TRY_ENTRY();
+        p += header_size;
+        m_end = (const uint8_t*)data + size;
+        CHECK_AND_ASSERT_THROW_MES(p != m_end, "portable_storage_bin_reader: empty storage");
+        index_section(p);
+        return true;
+        CATCH_ENTRY("portable_storage_bin_reader::load_from_binary", false);
+      }
+
+      template<class t_value>
+      bool get_value(const std::string& value_name, t_value& val, hsection hparent_section)
+      {
+        const entry* e = find_entry(value_name, hparent_section);
+        if(!e)
+          return false;
+        const uint8_t* p = e->value;
+        read_value(read<uint8_t>(p), p, val);
+        return true;
+      }
+
+      bool get_value(const std::string& value_name, storage_entry& val, hsection hparent_section)
+      {
+        const entry* e = find_entry(value_name, hparent_section);
+        if(!e)
+          return false;
+        throwable_buffer_reader reader(e->value, m_end - e->value);
+        val = reader.load_storage_entry();
+        return true;
+      }
+
+      //like portable_storage, a missing section reads as an empty one when the caller would have created it
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist = false)
+      {
+        const entry* e = find_entry(section_name, hparent_section);
+        if(e && *e->value == SERIALIZE_TYPE_OBJECT)
+        {
+          const uint8_t* p = e->value + 1;
+          return index_section(p);
+        }
+        return create_if_notexist ? &m_empty_section : nullptr;
+      }
+
+      template<class t_value>
+      harray get_first_value(const std::string& value_name, t_value& target, hsection hparent_section)
+      {
+        harray hval_array = open_array(value_name, hparent_section);
+        if(!hval_array || !get_next_value(hval_array, target))
+          return nullptr;
+        return hval_array;
+      }
+
+      template<class t_value>
+      bool get_next_value(harray hval_array, t_value& target)
+      {
+        CHECK_AND_ASSERT(hval_array, false);
+        if(!hval_array->left)
+          return false;
+        --hval_array->left;
+        read_value(hval_array->type, hval_array->next, target);
+        return true;
+      }
+
+      harray get_first_section(const std::string& section_name, hsection& h_child_section, hsection hparent_section)
+      {
+        harray hsec_array = open_array(section_name, hparent_section);
+        if(!hsec_array || !get_next_section(hsec_array, h_child_section))
+          return nullptr;
+        return hsec_array;
+      }
+
+      bool get_next_section(harray hsec_array, hsection& h_child_section)
+      {
+        CHECK_AND_ASSERT(hsec_array, false);
+        if(hsec_array->type != SERIALIZE_TYPE_OBJECT || !hsec_array->left)
+          return false;
+        --hsec_array->left;
+        h_child_section = index_section(hsec_array->next);
+        return true;
+      }
+
+    private:
+      void need(const uint8_t* p, size_t count) const
+      {
+        CHECK_AND_ASSERT_THROW_MES(size_t(m_end - p) >= count, " attempt to read " << count << " bytes from buffer with " << size_t(m_end - p) << " bytes remained");
+      }
+
+      template<class t_pod_type>
+      t_pod_type read(const uint8_t*& p) const
+      {
+        need(p, sizeof(t_pod_type));
+        t_pod_type v;
+        memcpy(&v, p, sizeof(t_pod_type));
+        p += sizeof(t_pod_type);
+        return v;
+      }
+
+      size_t read_varint(const uint8_t*& p) const
+      {
+        need(p, 1);
+        size_t v = 0;
+        switch(*p & PORTABLE_RAW_SIZE_MARK_MASK)
+        {
+        case PORTABLE_RAW_SIZE_MARK_BYTE: v = read<uint8_t>(p);break;
+        case PORTABLE_RAW_SIZE_MARK_WORD: v = read<uint16_t>(p);break;
+        case PORTABLE_RAW_SIZE_MARK_DWORD: v = read<uint32_t>(p);break;
+        case PORTABLE_RAW_SIZE_MARK_INT64: v = read<uint64_t>(p);break;
+        }
+        return v >> 2;
+      }
+
+      size_t read_string_len(const uint8_t*& p) const
+      {
+        size_t len = read_varint(p);
+        CHECK_AND_ASSERT_THROW_MES(len < MAX_STRING_LEN_POSSIBLE, "to big string len value in storage: " << len);
+        need(p, len);
+        return len;
+      }
+
+      static size_t pod_size(uint8_t type)
+      {
+        switch(type)
+        {
+        case SERIALIZE_TYPE_INT64: case SERIALIZE_TYPE_UINT64: case SERIALIZE_TYPE_DUOBLE: return 8;
+        case SERIALIZE_TYPE_INT32: case SERIALIZE_TYPE_UINT32: return 4;
+        case SERIALIZE_TYPE_INT16: case SERIALIZE_TYPE_UINT16: return 2;
+        case SERIALIZE_TYPE_INT8: case SERIALIZE_TYPE_UINT8: return 1;
+        case SERIALIZE_TYPE_BOOL: return sizeof(bool);
+        default: return 0;
+        }
+      }
+
+      //indexes the entries of the section at p and moves p past it
+      hsection index_section(const uint8_t*& p)
+      {
+        //entries of nested sections aren't indexed until those are opened, so a section's entries stay together
+        section_index s;
+        s.first = m_entries.size();
+        s.count = read_varint(p);
+        for(size_t i = 0; i != s.count; ++i)
+        {
+          entry e;
+          e.name_len = read<uint8_t>(p);
+          need(p, e.name_len);
+          e.name = p;
+          p += e.name_len;
+          e.value = p;
+          uint8_t type = read<uint8_t>(p);
+          skip_value(type, p, 0);
+          m_entries.push_back(e);
+        }
+        m_sections.push_back(s);
+        return &m_sections.back();
+      }
+
+      void skip_value(uint8_t type, const uint8_t*& p, size_t depth) const
+      {
+        CHECK_AND_ASSERT_THROW_MES(depth < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+        if(type & SERIALIZE_FLAG_ARRAY)
+        {
+          type &= ~SERIALIZE_FLAG_ARRAY;
+          size_t count = read_varint(p);
+          size_t size = pod_size(type);
+          if(size)
+          {
+            CHECK_AND_ASSERT_THROW_MES(count <= size_t(m_end - p) / size, " attempt to read " << count << " values of " << size << " bytes from buffer with " << size_t(m_end - p) << " bytes remained");
+            p += count * size;
+            return;
+          }
+          CHECK_AND_ASSERT_THROW_MES(type == SERIALIZE_TYPE_STRING || type == SERIALIZE_TYPE_OBJECT || type == SERIALIZE_TYPE_ARRAY, "unknown entry_type code = " << type);
+          while(count--)
+            skip_value(type, p, depth + 1);
+          return;
+        }
+
+        switch(type)
+        {
+        case SERIALIZE_TYPE_STRING:
+          p += read_string_len(p);
+          break;
+        case SERIALIZE_TYPE_OBJECT:
+          {
+            size_t count = read_varint(p);
+            while(count--)
+            {
+              size_t name_len = read<uint8_t>(p);
+              need(p, name_len);
+              p += name_len;
+              uint8_t entry_type = read<uint8_t>(p);
+              skip_value(entry_type, p, depth + 1);
+            }
+          }
+          break;
+        case SERIALIZE_TYPE_ARRAY:
+          {
+            uint8_t array_type = read<uint8_t>(p);
+            CHECK_AND_ASSERT_THROW_MES(array_type & SERIALIZE_FLAG_ARRAY, "wrong type sequenses");
+            skip_value(array_type, p, depth + 1);
+          }
+          break;
+        default:
+          {
+            size_t size = pod_size(type);
+            CHECK_AND_ASSERT_THROW_MES(size, "unknown entry_type code = " << type);
+            need(p, size);
+            p += size;
+          }
+        }
+      }
+
+      const entry* find_entry(const std::string& name, hsection hparent_section) const
+      {
+        const section_index& s = hparent_section ? *hparent_section : m_sections.front();
+        for(size_t i = s.first; i != s.first + s.count; ++i)
+        {
+          const entry& e = m_entries[i];
+          if(e.name_len == name.size() && !memcmp(e.name, name.data(), e.name_len))
+            return &e;
+        }
+        return nullptr;
+      }
+
+      harray open_array(const std::string& value_name, hsection hparent_section)
+      {
+        const entry* e = find_entry(value_name, hparent_section);
+        if(!e)
+          return nullptr;
+        const uint8_t* p = e->value;
+        uint8_t type = read<uint8_t>(p);
+        if(type == SERIALIZE_TYPE_ARRAY)
+          type = read<uint8_t>(p);
+        if(!(type & SERIALIZE_FLAG_ARRAY))
+          return nullptr;
+
+        array_cursor a;
+        a.type = type & ~SERIALIZE_FLAG_ARRAY;
+        a.left = read_varint(p);
+        a.next = p;
+        m_arrays.push_back(a);
+        return &m_arrays.back();
+      }
+
+      //decodes a value of the stored type and converts it the way portable_storage::get_value() does
+      template<class t_value>
+      void read_value(uint8_t type, const uint8_t*& p, t_value& val) const
+      {
+        switch(type)
+        {
+        case SERIALIZE_TYPE_INT64:  convert_t(read<int64_t>(p), val); break;
+        case SERIALIZE_TYPE_INT32:  convert_t(read<int32_t>(p), val); break;
+        case SERIALIZE_TYPE_INT16:  convert_t(read<int16_t>(p), val); break;
+        case SERIALIZE_TYPE_INT8:   convert_t(read<int8_t>(p), val); break;
+        case SERIALIZE_TYPE_UINT64: convert_t(read<uint64_t>(p), val); break;
+        case SERIALIZE_TYPE_UINT32: convert_t(read<uint32_t>(p), val); break;
+        case SERIALIZE_TYPE_UINT16: convert_t(read<uint16_t>(p), val); break;
+        case SERIALIZE_TYPE_UINT8:  convert_t(read<uint8_t>(p), val); break;
+        case SERIALIZE_TYPE_DUOBLE: convert_t(read<double>(p), val); break;
+        case SERIALIZE_TYPE_BOOL:   convert_t(read<bool>(p), val); break;
+        case SERIALIZE_TYPE_STRING:
+          {
+            std::string s;
+            read_value(type, p, s);
+            convert_t(s, val);
+          }
+          break;
+        default:
+          ASSERT_MES_AND_THROW("WRONG DATA CONVERSION: from type code=" << (int)type << " to type " << typeid(t_value).name());
+        }
+      }
+
+      void read_value(uint8_t type, const uint8_t*& p, std::string& val) const
+      {
+        if(type != SERIALIZE_TYPE_STRING)
+        {
+          read_value<std::string>(type, p, val);
+          return;
+        }
+        size_t len = read_string_len(p);
+        val.assign((const char*)p, len);
+        p += len;
+      }
+
+      const uint8_t* m_end;
+      std::vector<entry> m_entries;
+      std::deque<section_index> m_sections;
+      std::deque<array_cursor> m_arrays;
+      section_index m_empty_section;
+    };
+  }
+}
@@ -14,6 +14,7 @@ namespace sqlite3
 #include <cstdint>
 #include <memory>
 #include <functional>
+#include <vector>
 
 
 namespace sqlite3 {
@@ -28,6 +29,8 @@ namespace sqlite3 {
    *  - all iterators must be destructed before reopen()ing or destructing the map, or an exception
    *    will be thrown
    *  - find() returns iterator that only points to that element, not any others
+   *  - load(key, value) and visit() are the cheap way to do point lookups: they reuse one
+   *    prepared statement and read straight out of sqlite's buffer
    */
   template <class K, class V>
   class sqlite3_map
@@ -38,6 +41,8 @@ namespace sqlite3 {
     typedef std::pair<K, V> value_type;
     
     typedef std::unique_ptr<sqlite3_stmt, std::function<void(sqlite3_stmt*)>> stmt_ptr;
+    /// deserializes a value directly from a buffer owned by sqlite
+    typedef std::function<V(const char *, size_t)> value_view_loader;
     
   public:
     /// bare-minimum iterator to be able to loop through all entries
@@ -111,12 +116,14 @@ namespace sqlite3 {
     typedef iterator const_iterator;
   
   public:
-    /// create an sqlite3 map. if filename is nullptr, an in-memory database is created
+    /// create an sqlite3 map. if filename is nullptr, an in-memory database is created.
+    /// if load_value_view is given, load() uses it instead of copying the value into a string for load_value
     sqlite3_map(const char *filename,
                 std::function<K(const std::string&)> load_key,
                 std::function<std::string(const K&)> store_key,
                 std::function<V(const std::string&)> load_value,
-                std::function<std::string(const V&)> store_value);
+                std::function<std::string(const V&)> store_value,
+                value_view_loader load_value_view = nullptr);
     sqlite3_map(sqlite3_map&& o);
     sqlite3_map& operator=(sqlite3_map&& o);
     ~sqlite3_map();
@@ -135,6 +142,13 @@ namespace sqlite3 {
     /// get the autocommit behavior
     void get_autocommit(bool& per_modification, bool& on_close) const;
     
+    /// with deferred sync, file databases keep a write-ahead log and commit() doesn't sync it, so
+    /// committing is cheap but isn't durable until checkpoint_file() runs on the file. takes effect
+    /// on the next reopen(). default is false
+    void set_deferred_sync(bool deferred_sync);
+    /// the database file, or an empty string for an in-memory database
+    std::string filename() const;
+    
     /// commit whatever changes. only necessary if autocommit is disabled
     void commit();
     /// rollback to previous commit. invalidates all iterators
@@ -142,8 +156,24 @@ namespace sqlite3 {
     
     /// load the value at a given key. if the key doesn't exist, returns a value-initialized value
     V load(const K& key) const;
+    /// load the value at a given key. returns false, leaving value untouched, if the key doesn't exist
+    bool load(const K& key, V& value) const;
+    /// call f(const char *data, size_t size) with the serialized value at a given key, without
+    /// copying it. the buffer is only valid during the call. returns false if the key doesn't exist
+    template <class F>
+    bool visit(const K& key, F f) const;
+    /// load the values of many keys at once. keys are looked up in sorted order, a batch per
+    /// statement. afterwards found[i] tells whether values[i] was loaded for keys[i]. returns # found
+    size_t multi_load(const std::vector<K>& keys, std::vector<V>& values, std::vector<bool>& found) const;
+    /// like visit() for many keys: calls f(size_t key_index, const char *data, size_t size) for each
+    /// key that exists, in sorted key order rather than the order given. returns # found
+    template <class F>
+    size_t multi_visit(const std::vector<K>& keys, F f) const;
     /// store a value to a key
     void store(const K& key, const V& value);
+    /// store many values, in sorted key order. if a key is given more than once, the last one wins.
+    /// with per-modification autocommit on, commits once at the end
+    void multi_store(const std::vector<value_type>& items);
     /// insert if key doesn't exist. return pair(iterator to element, whether insertion took place)
     std::pair<iterator, bool> insert(const value_type& value);
     /// count of a key, either 0 or 1
@@ -180,11 +210,18 @@ namespace sqlite3 {
 
   private:
     void checked(int rc, const std::string& op="") const;
-    void checked_exec(stmt_ptr& stmt) const; // execute statement fully
+    void checked_exec(const stmt_ptr& stmt) const; // execute statement fully
     void checked_exec(const char *query) const; // execute query fully
     
     stmt_ptr prepare_stmt(const char *query) const;
     stmt_ptr prepare_find_key_blob(const std::string& key_blob) const;
+    void bind_key_blob(const stmt_ptr& stmt, const std::string& key_blob, const char *op) const;
+    /// serialized keys paired with their index into items, sorted the way sqlite orders blobs
+    template <class T, class GetKey>
+    std::vector<std::pair<std::string, size_t> > sorted_key_blobs(const std::vector<T>& items, GetKey get_key) const;
+    
+    /// # of keys looked up by each multi_load() statement
+    static const size_t multi_load_batch = 64;
     
   private:
     sqlite3 *pDb;
@@ -193,9 +230,11 @@ namespace sqlite3 {
     std::function<std::string(const K&)> store_key;
     std::function<V(const std::string&)> load_value;
     std::function<std::string(const V&)> store_value;
+    value_view_loader load_value_view;
     
     bool autocommit_per_modification;
     bool autocommit_on_close;
+    bool deferred_sync;
     
     const char *db_filename;
     
@@ -203,6 +242,9 @@ namespace sqlite3 {
     stmt_ptr _opt_count_stmt;
     stmt_ptr _opt_count_key_stmt;
     stmt_ptr _opt_insert_stmt;
+    stmt_ptr _opt_find_value_stmt;
+    stmt_ptr _opt_erase_stmt;
+    stmt_ptr _opt_multi_find_stmt;
     
   public:
     friend void swap(sqlite3_map& first, sqlite3_map& second)
@@ -215,15 +257,29 @@ namespace sqlite3 {
       swap(first.store_key, second.store_key);
       swap(first.load_value, second.load_value);
       swap(first.store_value, second.store_value);
+      swap(first.load_value_view, second.load_value_view);
 
       swap(first.autocommit_per_modification, second.autocommit_per_modification);
       swap(first.autocommit_on_close, second.autocommit_on_close);
+      swap(first.deferred_sync, second.deferred_sync);
 
       swap(first.db_filename, second.db_filename);
 
       swap(first._opt_count_stmt, second._opt_count_stmt);
       swap(first._opt_count_key_stmt, second._opt_count_key_stmt);
       swap(first._opt_insert_stmt, second._opt_insert_stmt);
+      swap(first._opt_find_value_stmt, second._opt_find_value_stmt);
+      swap(first._opt_erase_stmt, second._opt_erase_stmt);
+      swap(first._opt_multi_find_stmt, second._opt_multi_find_stmt);
     }
   };
+  
+  /// passive never waits and can leave frames a reader still uses in the log. truncate waits a while
+  /// for readers and empties the log, it only works while no connection is reading the file
+  enum checkpoint_mode { CHECKPOINT_PASSIVE, CHECKPOINT_TRUNCATE };
+  
+  /// make everything committed to a deferred-sync database file durable. uses its own connection,
+  /// so it can run on another thread while the map keeps being used. returns false if some of the log
+  /// couldn't be copied back because a reader was using it, throws on error
+  bool checkpoint_file(const std::string& filename, checkpoint_mode mode = CHECKPOINT_PASSIVE);
 }
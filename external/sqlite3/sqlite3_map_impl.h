@@ -12,6 +12,8 @@ namespace sqlite3 {
   }
 }
 
+#include <algorithm>
+
 #include <boost/utility/value_init.hpp>
 
 //#define SQLITE3_MAP_DEBUG
@@ -29,24 +31,37 @@ inline void log_cursor(void *pCursor, const std::string& msg, const std::string&
 #endif
 
 namespace sqlite3 {
+  /// resets a cached statement when going out of scope
+  struct stmt_reset_guard {
+    sqlite3_stmt *pStmt;
+    stmt_reset_guard(sqlite3_stmt *pStmt) : pStmt(pStmt) { }
+    ~stmt_reset_guard() { sqlite3_reset(pStmt); }
+  };
+  
   template <class K, class V>
   sqlite3_map<K, V>::sqlite3_map(const char *filename,
                                  std::function<K(const std::string&)> load_key,
                                  std::function<std::string(const K&)> store_key,
                                  std::function<V(const std::string&)> load_value,
-                                 std::function<std::string(const V&)> store_value)
+                                 std::function<std::string(const V&)> store_value,
+                                 value_view_loader load_value_view)
       : pDb(nullptr)
       , which_db(0)
       , load_key(load_key)
       , store_key(store_key)
       , load_value(load_value)
       , store_value(store_value)
+      , load_value_view(load_value_view)
       , autocommit_per_modification(false)
       , autocommit_on_close(true)
+      , deferred_sync(false)
       , db_filename(nullptr)
       , _opt_count_stmt(nullptr)
       , _opt_count_key_stmt(nullptr)
       , _opt_insert_stmt(nullptr)
+      , _opt_find_value_stmt(nullptr)
+      , _opt_erase_stmt(nullptr)
+      , _opt_multi_find_stmt(nullptr)
   {
     reopen(filename);
   }
@@ -87,6 +102,9 @@ namespace sqlite3 {
     _opt_count_stmt.reset(nullptr);
     _opt_count_key_stmt.reset(nullptr);
     _opt_insert_stmt.reset(nullptr);
+    _opt_find_value_stmt.reset(nullptr);
+    _opt_erase_stmt.reset(nullptr);
+    _opt_multi_find_stmt.reset(nullptr);
     
     checked(sqlite3_close(pDb), "close, maybe not all iterators destructed?");
     pDb = nullptr;
@@ -99,6 +117,12 @@ namespace sqlite3 {
     close();
     checked(sqlite3_open(filename == nullptr ? ":memory:" : filename, &pDb), "open db");
     checked_exec("CREATE TABLE IF NOT EXISTS the_table (key BLOB PRIMARY KEY, value BLOB);");
+    if (deferred_sync && filename != nullptr) {
+      // commits only append to the log, checkpoints sync it and are left to checkpoint_file()
+      checked_exec("PRAGMA journal_mode=WAL;");
+      checked_exec("PRAGMA synchronous=NORMAL;");
+      checked_exec("PRAGMA wal_autocheckpoint=0;");
+    }
     // begin transaction to disable autocommit
     checked_exec("BEGIN TRANSACTION;");
     db_filename = filename;
@@ -107,6 +131,15 @@ namespace sqlite3 {
     _opt_count_stmt = prepare_stmt("SELECT COUNT(*) FROM the_table;");
     _opt_count_key_stmt = prepare_stmt("SELECT COUNT(*) FROM the_table WHERE key = ?");
     _opt_insert_stmt = prepare_stmt("INSERT OR REPLACE INTO the_table (key, value) VALUES (?, ?);");
+    _opt_find_value_stmt = prepare_stmt("SELECT value FROM the_table WHERE key = ?;");
+    _opt_erase_stmt = prepare_stmt("DELETE FROM the_table WHERE key = ?;");
+    
+    std::string multi_find_query = "SELECT key, value FROM the_table WHERE key IN (?";
+    for (size_t i=1; i < multi_load_batch; i++) {
+      multi_find_query += ", ?";
+    }
+    multi_find_query += ");";
+    _opt_multi_find_stmt = prepare_stmt(multi_find_query.c_str());
   }
   
   template <class K, class V>
@@ -123,6 +156,19 @@ namespace sqlite3 {
     on_close = autocommit_on_close;
   }
   
+  template <class K, class V>
+  void sqlite3_map<K, V>::set_deferred_sync(bool deferred_sync_in)
+  {
+    deferred_sync = deferred_sync_in;
+  }
+  
+  template <class K, class V>
+  std::string sqlite3_map<K, V>::filename() const
+  {
+    const char *res = pDb ? sqlite3_db_filename(pDb, "main") : nullptr;
+    return res ? res : "";
+  }
+  
   template <class K, class V>
   void sqlite3_map<K, V>::commit()
   {
@@ -140,11 +186,48 @@ namespace sqlite3 {
   template <class K, class V>
   V sqlite3_map<K, V>::load(const K& key) const
   {
-    auto it = find(key);
-    if (it == end()) {
-      return boost::value_initialized<V>();
+    V res = boost::value_initialized<V>();
+    load(key, res);
+    return res;
+  }
+  
+  template <class K, class V>
+  bool sqlite3_map<K, V>::load(const K& key, V& value) const
+  {
+    return visit(key, [this, &value](const char *data, size_t size) {
+      if (load_value_view) {
+        value = load_value_view(data, size);
+      } else {
+        value = load_value(std::string(data, size));
+      }
+    });
+  }
+  
+  template <class K, class V>
+  template <class F>
+  bool sqlite3_map<K, V>::visit(const K& key, F f) const
+  {
+    auto key_blob = store_key(key);
+    bind_key_blob(_opt_find_value_stmt, key_blob, "bind visit() key");
+    
+    // the statement is reused, so reset it however this exits
+    stmt_reset_guard reset(_opt_find_value_stmt.get());
+    
+#ifdef SQLITE3_MAP_DEBUG
+    log_cursor(_opt_find_value_stmt.get(), "sqlite3_step()...");
+#endif
+    int rc = sqlite3_step(_opt_find_value_stmt.get());
+    if (rc == SQLITE_DONE) {
+      return false;
+    }
+    if (rc != SQLITE_ROW) {
+      checked(rc, "step visit()");
     }
-    return it->second;
+    
+    // blob pointer is only valid until the statement is stepped or reset
+    f((const char *)sqlite3_column_blob(_opt_find_value_stmt.get(), 0),
+      (size_t)sqlite3_column_bytes(_opt_find_value_stmt.get(), 0));
+    return true;
   }
   
   template <class K, class V>
@@ -174,6 +257,92 @@ namespace sqlite3 {
     }
   }
   
+  template <class K, class V>
+  size_t sqlite3_map<K, V>::multi_load(const std::vector<K>& keys, std::vector<V>& values, std::vector<bool>& found) const
+  {
+    values.clear();
+    values.resize(keys.size());
+    found.assign(keys.size(), false);
+    
+    return multi_visit(keys, [this, &values, &found](size_t i, const char *data, size_t size) {
+      if (load_value_view) {
+        values[i] = load_value_view(data, size);
+      } else {
+        values[i] = load_value(std::string(data, size));
+      }
+      found[i] = true;
+    });
+  }
+  
+  template <class K, class V>
+  template <class F>
+  size_t sqlite3_map<K, V>::multi_visit(const std::vector<K>& keys, F f) const
+  {
+    // walk the b-tree in order instead of jumping around it
+    auto sorted = sorted_key_blobs(keys, [](const K& key) -> const K& { return key; });
+    
+    auto by_blob = [](const std::pair<std::string, size_t>& a, const std::pair<std::string, size_t>& b) {
+      return a.first < b.first;
+    };
+    
+    size_t num_found = 0;
+    sqlite3_stmt *pStmt = _opt_multi_find_stmt.get();
+    for (size_t batch_start = 0; batch_start < sorted.size(); batch_start += multi_load_batch)
+    {
+      size_t batch_end = std::min(batch_start + multi_load_batch, sorted.size());
+      // a short last batch repeats its last key in the unused parameters
+      for (size_t p=0; p < multi_load_batch; p++) {
+        const auto& key_blob = sorted[std::min(batch_start + p, batch_end - 1)].first;
+        checked(sqlite3_bind_blob(pStmt, p + 1, key_blob.data(), key_blob.size(), SQLITE_STATIC),
+                "bind multi_visit() key");
+      }
+      
+      stmt_reset_guard reset(pStmt);
+      int rc;
+      while ((rc = sqlite3_step(pStmt)) == SQLITE_ROW)
+      {
+        std::pair<std::string, size_t> row_key(std::string((const char *)sqlite3_column_blob(pStmt, 0),
+                                                           sqlite3_column_bytes(pStmt, 0)), 0);
+        const char *data = (const char *)sqlite3_column_blob(pStmt, 1);
+        size_t size = sqlite3_column_bytes(pStmt, 1);
+        
+        // same key may have been asked for more than once
+        auto range = std::equal_range(sorted.begin() + batch_start, sorted.begin() + batch_end, row_key, by_blob);
+        for (auto it = range.first; it != range.second; ++it) {
+          f(it->second, data, size);
+          num_found++;
+        }
+      }
+      if (rc != SQLITE_DONE) {
+        checked(rc, "step multi_visit()");
+      }
+    }
+    
+    return num_found;
+  }
+  
+  template <class K, class V>
+  void sqlite3_map<K, V>::multi_store(const std::vector<value_type>& items)
+  {
+    // ties sort by index, so later duplicates are stored last and win
+    auto sorted = sorted_key_blobs(items, [](const value_type& item) -> const K& { return item.first; });
+    
+    for (const auto& key_item : sorted)
+    {
+      auto val_str = store_value(items[key_item.second].second);
+      checked(sqlite3_bind_blob(_opt_insert_stmt.get(), 1, key_item.first.data(), key_item.first.size(), SQLITE_STATIC),
+              "bind multi_store() key");
+      checked(sqlite3_bind_blob(_opt_insert_stmt.get(), 2, val_str.data(), val_str.size(), SQLITE_STATIC),
+              "bind multi_store() value");
+      checked_exec(_opt_insert_stmt);
+      checked(sqlite3_reset(_opt_insert_stmt.get()), "reset insert stmt");
+    }
+    
+    if (autocommit_per_modification && !items.empty()) {
+      commit();
+    }
+  }
+  
   template <class K, class V>
   std::pair<typename sqlite3_map<K, V>::iterator, bool> sqlite3_map<K, V>::insert(const value_type& v)
   {
@@ -191,8 +360,7 @@ namespace sqlite3 {
   {
     // bind key blob value
     auto key_blob = store_key(key);
-    checked(sqlite3_bind_blob(_opt_count_key_stmt.get(), 1, key_blob.data(), key_blob.size(), SQLITE_STATIC),
-            "bind find() key");
+    bind_key_blob(_opt_count_key_stmt, key_blob, "bind count() key");
     
     // execute it
     if (sqlite3_step(_opt_count_key_stmt.get()) != SQLITE_ROW) {
@@ -247,14 +415,17 @@ namespace sqlite3 {
   template <class K, class V>
   size_t sqlite3_map<K, V>::erase(const K& key)
   {
-    auto it = find(key);
-    if (it == end()) {
-      return 0;
-    }
+    auto key_blob = store_key(key);
+    bind_key_blob(_opt_erase_stmt, key_blob, "bind erase() key");
+    checked_exec(_opt_erase_stmt);
+    size_t res = sqlite3_changes(pDb) > 0 ? 1 : 0;
+    checked(sqlite3_reset(_opt_erase_stmt.get()), "reset erase stmt");
     
-    erase(it);
+    if (res && autocommit_per_modification) {
+      commit();
+    }
     
-    return 1;
+    return res;
   }
   
   template <class K, class V>
@@ -283,7 +454,7 @@ namespace sqlite3 {
   }
   
   template <class K, class V>
-  void sqlite3_map<K, V>::checked_exec(stmt_ptr& stmt) const {
+  void sqlite3_map<K, V>::checked_exec(const stmt_ptr& stmt) const {
     // ignore all values returned, execute statement until it's done
     int rc;
 #ifdef SQLITE3_MAP_DEBUG
@@ -336,6 +507,31 @@ namespace sqlite3 {
             "bind find() key");
     return pStmt;
   }
+  
+  template <class K, class V>
+  template <class T, class GetKey>
+  std::vector<std::pair<std::string, size_t> > sqlite3_map<K, V>::sorted_key_blobs(const std::vector<T>& items,
+                                                                                    GetKey get_key) const
+  {
+    std::vector<std::pair<std::string, size_t> > res;
+    res.reserve(items.size());
+    for (size_t i=0; i < items.size(); i++) {
+      res.push_back(std::make_pair(store_key(get_key(items[i])), i));
+    }
+    // std::string compares like memcmp, same as sqlite does for blobs
+    std::sort(res.begin(), res.end());
+    return res;
+  }
+  
+  template <class K, class V>
+  void sqlite3_map<K, V>::bind_key_blob(const stmt_ptr& stmt, const std::string& key_blob, const char *op) const
+  {
+#ifdef SQLITE3_MAP_DEBUG
+    log_cursor(stmt.get(), "binding key", key_blob);
+#endif
+    // key_blob must outlive the statement's execution
+    checked(sqlite3_bind_blob(stmt.get(), 1, key_blob.data(), key_blob.size(), SQLITE_STATIC), op);
+  }
   /// ------------------------------------------------------
   /// iterator
   
@@ -587,13 +783,9 @@ namespace sqlite3 {
       throw std::runtime_error("deleting invalid iterator");
     }
     
-    auto delStmt = parent.prepare_stmt("DELETE FROM the_table WHERE key = ?;");
-#ifdef SQLITE3_MAP_DEBUG
-    log_cursor(pStmt.get(), "binding key", getKey());
-#endif
-    parent.checked(sqlite3_bind_blob(delStmt.get(), 1, getKey().data(), getKey().size(), SQLITE_STATIC),
-                   "bind erase() key");
-    parent.checked_exec(delStmt);
+    parent.bind_key_blob(parent._opt_erase_stmt, getKey(), "bind erase() key");
+    parent.checked_exec(parent._opt_erase_stmt);
+    parent.checked(sqlite3_reset(parent._opt_erase_stmt.get()), "reset erase stmt");
     
     invalidateCache();
     is_past_the_end = true; // done with this
@@ -657,3 +849,38 @@ namespace sqlite3 {
     return it;
   }
 }
+
+namespace sqlite3 {
+  inline bool checkpoint_file(const std::string& filename, checkpoint_mode mode)
+  {
+    if (filename.empty())
+      return true;
+    
+    sqlite3 *pDb = nullptr;
+    int log_frames = 0, checkpointed_frames = 0;
+    int rc = sqlite3_open_v2(filename.c_str(), &pDb, SQLITE_OPEN_READWRITE, nullptr);
+    if (rc == SQLITE_OK) {
+      // passive doesn't wait for or block the map's own connection
+      if (mode == CHECKPOINT_TRUNCATE)
+        sqlite3_busy_timeout(pDb, 10000);
+      // a connection only opens the log once it reads, until then checkpoints do nothing
+      rc = sqlite3_exec(pDb, "PRAGMA schema_version;", nullptr, nullptr, nullptr);
+    }
+    if (rc == SQLITE_OK) {
+      rc = sqlite3_wal_checkpoint_v2(pDb, nullptr, mode == CHECKPOINT_TRUNCATE ? SQLITE_CHECKPOINT_TRUNCATE : SQLITE_CHECKPOINT_PASSIVE,
+                                     &log_frames, &checkpointed_frames);
+    }
+    std::string err = pDb ? sqlite3_errmsg(pDb) : "out of memory";
+    sqlite3_close(pDb);
+    if (rc != SQLITE_OK) {
+      throw std::runtime_error("sqlite3 error " + std::to_string(rc) + " when checkpointing " + filename + ": " + err);
+    }
+    
+    if (log_frames < 0) {
+      throw std::runtime_error("sqlite3 error when checkpointing " + filename + ": not in WAL mode");
+    }
+    
+    // frames a reader still needs are left in the log
+    return checkpointed_frames == log_frames;
+  }
+}
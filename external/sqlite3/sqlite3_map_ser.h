@@ -4,10 +4,13 @@
 
 #pragma once
 
+#include <cstring>
+#include <string>
+
 namespace sqlite3 {
   /// strings go through as-is
-  std::string store_string(const std::string& s) { return s; }
-  std::string load_string(const std::string& s) { return s; }
+  inline std::string store_string(const std::string& s) { return s; }
+  inline std::string load_string(const std::string& s) { return s; }
   
   /// simple pod serialization
   template<typename T>
@@ -19,12 +22,19 @@ namespace sqlite3 {
   }
   template<typename T>
   typename std::enable_if<std::is_pod<T>::value, T>::type
-  load_pod(const std::string& buff) {
-    if (buff.size() != sizeof(T)) {
-      throw std::runtime_error("Invalid-sized string " + std::to_string(buff.size()) +
+  load_pod_view(const char *data, size_t size) {
+    if (size != sizeof(T)) {
+      throw std::runtime_error("Invalid-sized string " + std::to_string(size) +
                                " in database for POD of size " + std::to_string(sizeof(T)));
     }
     
-    return *reinterpret_cast<const T*>(buff.data());
+    T res;
+    memcpy(&res, data, sizeof(T));
+    return res;
+  }
+  template<typename T>
+  typename std::enable_if<std::is_pod<T>::value, T>::type
+  load_pod(const std::string& buff) {
+    return load_pod_view<T>(buff.data(), buff.size());
   }
 }
@@ -6,6 +6,8 @@
 
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
+#include <cstring>
+#include <streambuf>
 
 #include "misc_log_ex.h"
 
@@ -101,24 +103,50 @@ namespace tools
     }
   }
   
+  // read-only streambuf over a buffer someone else owns, so it doesn't need to be copied
+  class buffer_view_streambuf : public std::streambuf
+  {
+  public:
+    buffer_view_streambuf(const char *data, size_t size)
+    {
+      char *p = const_cast<char *>(data);
+      setg(p, p, p + size);
+    }
+  };
+  
+  // whether the buffer starts like something written by boost::archive::binary_oarchive
+  inline bool is_boost_binary_archive(const char *data, size_t size)
+  {
+    // the archive signature string, preceded by its length as a 64-bit little-endian integer
+    static const char header[] = "\x16\0\0\0\0\0\0\0serialization::archive";
+    const size_t header_size = sizeof(header) - 1;
+    return size >= header_size && memcmp(data, header, header_size) == 0;
+  }
+  
   template <typename T>
-  T boost_unserialize_from_string(const std::string& str)
+  T boost_unserialize_from_buffer(const char *data, size_t size)
   {
     try {
       
-      std::stringstream ss(str);
+      buffer_view_streambuf buf(data, size);
       
-      boost::archive::binary_iarchive i(ss);
+      boost::archive::binary_iarchive i(buf);
       T loaded_val;
       i >> loaded_val;
       
       return loaded_val;
       
     } catch (...) {
-      LOG_ERROR("error in boost_unserialize_from_string()");
+      LOG_ERROR("error in boost_unserialize_from_buffer()");
       throw;
     }
   }
+  
+  template <typename T>
+  T boost_unserialize_from_string(const std::string& str)
+  {
+    return boost_unserialize_from_buffer<T>(str.data(), str.size());
+  }
 }
 
 #include <tuple>
@@ -0,0 +1,132 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/exceptions.hpp>
+
+#include "include_base_utils.h"
+
+#include "mapped_file.h"
+
+namespace tools
+{
+  mapped_file::mapped_file()
+      : m_size(0)
+  {
+  }
+
+  mapped_file::~mapped_file()
+  {
+    close();
+  }
+
+  bool mapped_file::open(const std::string& path, size_t min_size)
+  {
+    close();
+    m_path = path;
+
+    boost::system::error_code ec;
+    if (!boost::filesystem::exists(path, ec))
+    {
+      std::ofstream create(path.c_str(), std::ios::binary);
+      if (!create)
+      {
+        LOG_ERROR("mapped_file: couldn't create " << path);
+        return false;
+      }
+    }
+
+    uint64_t cur_size = boost::filesystem::file_size(path, ec);
+    if (ec)
+    {
+      LOG_ERROR("mapped_file: couldn't get size of " << path << ": " << ec.message());
+      return false;
+    }
+
+    m_size = cur_size;
+    if (m_size < min_size)
+    {
+      boost::filesystem::resize_file(path, min_size, ec);
+      if (ec)
+      {
+        LOG_ERROR("mapped_file: couldn't grow " << path << " to " << min_size << " bytes: " << ec.message());
+        return false;
+      }
+      m_size = min_size;
+    }
+
+    return map();
+  }
+
+  bool mapped_file::map()
+  {
+    m_pregion.reset();
+    m_pmapping.reset();
+
+    try
+    {
+      m_pmapping.reset(new boost::interprocess::file_mapping(m_path.c_str(), boost::interprocess::read_write));
+      m_pregion.reset(new boost::interprocess::mapped_region(*m_pmapping, boost::interprocess::read_write, 0, m_size));
+    }
+    catch (const boost::interprocess::interprocess_exception& e)
+    {
+      LOG_ERROR("mapped_file: couldn't map " << m_path << ": " << e.what());
+      m_pregion.reset();
+      m_pmapping.reset();
+      return false;
+    }
+
+    return true;
+  }
+
+  void mapped_file::close()
+  {
+    if (m_pregion)
+      m_pregion->flush();
+    m_pregion.reset();
+    m_pmapping.reset();
+    m_size = 0;
+  }
+
+  bool mapped_file::resize(size_t new_size)
+  {
+    CHECK_AND_ASSERT_MES(is_open(), false, "mapped_file: resizing a file that isn't open");
+    if (new_size == m_size)
+      return true;
+
+    // unmap first, some platforms can't resize a mapped file
+    m_pregion->flush();
+    m_pregion.reset();
+    m_pmapping.reset();
+
+    boost::system::error_code ec;
+    boost::filesystem::resize_file(m_path, new_size, ec);
+    if (ec)
+    {
+      LOG_ERROR("mapped_file: couldn't resize " << m_path << " to " << new_size << " bytes: " << ec.message());
+      map(); // keep the old mapping usable
+      return false;
+    }
+
+    m_size = new_size;
+    return map();
+  }
+
+  bool mapped_file::flush(size_t offset, size_t length)
+  {
+    CHECK_AND_ASSERT_MES(is_open(), false, "mapped_file: flushing a file that isn't open");
+    // msync wants a page-aligned start
+    size_t aligned = offset - offset % boost::interprocess::mapped_region::get_page_size();
+    if (length != 0)
+      length += offset - aligned;
+    if (!m_pregion->flush(aligned, length, false))
+    {
+      LOG_ERROR("mapped_file: couldn't flush " << m_path);
+      return false;
+    }
+    return true;
+  }
+}
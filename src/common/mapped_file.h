@@ -0,0 +1,45 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <string>
+#include <memory>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace tools
+{
+  // a file mapped read/write into memory, which can be grown.
+  // growing remaps the file, so pointers into data() don't survive resize()
+  class mapped_file
+  {
+  public:
+    mapped_file();
+    ~mapped_file();
+
+    // opens (creating if needed) the file, growing it to at least min_size bytes
+    bool open(const std::string& path, size_t min_size);
+    void close();
+    bool is_open() const { return m_pregion != nullptr; }
+
+    bool resize(size_t new_size);
+    // synchronously write dirty pages back to the file
+    bool flush(size_t offset = 0, size_t length = 0);
+
+    char *data() { return static_cast<char *>(m_pregion->get_address()); }
+    const char *data() const { return static_cast<const char *>(m_pregion->get_address()); }
+    size_t size() const { return m_size; }
+    const std::string& path() const { return m_path; }
+
+  private:
+    bool map();
+
+    std::string m_path;
+    size_t m_size;
+    std::unique_ptr<boost::interprocess::file_mapping> m_pmapping;
+    std::unique_ptr<boost::interprocess::mapped_region> m_pregion;
+  };
+}
@@ -0,0 +1,303 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "include_base_utils.h"
+#include "packing.h"
+
+#include "mapped_file.h"
+#include "types.h"
+
+namespace tools
+{
+  // a vector of PODs backed by a mapped file, for data that's appended and read back by index.
+  // the file holds a header with the committed count followed by the elements. changes since the last
+  // commit() are kept in memory and commit() writes and syncs the new tail, then the count. a tail that
+  // replaces popped committed elements overwrites them in place, and dirty pages can reach the disk before
+  // the count does, so the elements it overwrites are first saved to <path>.undo. open() puts them back
+  // if the commit didn't finish. commit() is write_tail() followed by sync(); the two can be split so the
+  // slow sync runs on another thread, as long as nothing else calls write_tail(), open() or close() until it
+  // finishes. without open() it's a plain in-memory vector.
+  template<class T>
+  class mapped_vector
+  {
+    static_assert(std::is_pod<T>::value, "mapped_vector only holds PODs");
+
+  public:
+    static const uint64_t MAGIC = 0x314345564d584250ULL; // "PBXMVEC1"
+    static const uint32_t VERSION = 1;
+
+    mapped_vector() : m_tail_start(0), m_written(0), m_unsynced_from(0) { }
+
+    // opens (creating if needed) the file, replacing the current contents with what was committed to it
+    bool open(const std::string& path)
+    {
+      close();
+      if (!m_file.open(path, sizeof(header) + INITIAL_CAPACITY * sizeof(T)))
+        return false;
+
+      header& h = hdr();
+      if (h.magic == 0 && h.count == 0)
+      {
+        h.magic = MAGIC;
+        h.version = VERSION;
+        h.elem_size = sizeof(T);
+        if (!m_file.flush(0, sizeof(header)))
+        {
+          m_file.close();
+          return false;
+        }
+      }
+
+      if (h.magic != MAGIC || h.version != VERSION || h.elem_size != sizeof(T))
+      {
+        LOG_ERROR("mapped_vector: " << path << " has wrong magic/version/element size");
+        m_file.close();
+        return false;
+      }
+      if (!restore_overwritten())
+      {
+        close();
+        return false;
+      }
+      if (sizeof(header) + h.count * sizeof(T) > m_file.size())
+      {
+        LOG_ERROR("mapped_vector: " << path << " claims " << h.count << " elements but is only "
+                  << m_file.size() << " bytes");
+        m_file.close();
+        return false;
+      }
+
+      m_tail_start = h.count;
+      m_written = h.count;
+      m_unsynced_from = h.count;
+      return true;
+    }
+
+    // uncommitted changes are dropped
+    void close()
+    {
+      m_file.close();
+      m_undo.close();
+      m_tail.clear();
+      m_tail_start = 0;
+      m_written = 0;
+      m_unsynced_from = 0;
+    }
+
+    bool is_open() const { return m_file.is_open(); }
+
+    // deletes a closed file along with its undo file, e.g. to start over when open() fails
+    static bool remove(const std::string& path)
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove(path + ".undo", ec);
+      if (!ec)
+        boost::filesystem::remove(path, ec);
+      return !ec;
+    }
+
+    // writes the elements added since the last commit, then the new count
+    bool commit()
+    {
+      return write_tail() && sync();
+    }
+
+    // copies the elements added since the last commit into the file without syncing it or touching the
+    // committed count. afterwards the whole vector is read from the file.
+    bool write_tail()
+    {
+      CHECK_AND_ASSERT_MES(is_open(), false, "mapped_vector: committing without a file");
+
+      size_t count = size();
+      size_t needed = sizeof(header) + count * sizeof(T);
+      if (needed > m_file.size())
+      {
+        size_t grown = std::max(needed, sizeof(header) + 2 * capacity() * sizeof(T));
+        if (!m_file.resize(grown))
+          return false;
+      }
+
+      size_t overwritten_end = std::min<size_t>(hdr().count, count);
+      if (m_tail_start < overwritten_end && !save_overwritten(m_tail_start, overwritten_end))
+        return false;
+
+      if (!m_tail.empty())
+        memcpy(m_file.data() + sizeof(header) + m_tail_start * sizeof(T), &m_tail[0], m_tail.size() * sizeof(T));
+
+      m_unsynced_from = std::min(m_unsynced_from, m_tail_start);
+      m_written = count;
+      m_tail_start = count;
+      m_tail.clear();
+      return true;
+    }
+
+    // flushes what write_tail() wrote, then stores the count it wrote as the committed one
+    bool sync()
+    {
+      CHECK_AND_ASSERT_MES(is_open(), false, "mapped_vector: syncing without a file");
+
+      if (m_unsynced_from < m_written)
+      {
+        size_t offset = sizeof(header) + m_unsynced_from * sizeof(T);
+        if (!m_file.flush(offset, (m_written - m_unsynced_from) * sizeof(T)))
+          return false;
+      }
+
+      hdr().count = m_written;
+      if (!m_file.flush(0, sizeof(header)))
+        return false;
+
+      m_unsynced_from = m_written;
+      return clear_undo();
+    }
+
+    size_t size() const { return m_tail_start + m_tail.size(); }
+    bool empty() const { return size() == 0; }
+
+    const T& operator[](size_t i) const
+    {
+      return i < m_tail_start ? elements()[i] : m_tail[i - m_tail_start];
+    }
+    const T& back() const { return (*this)[size() - 1]; }
+
+    void push_back(const T& v) { m_tail.push_back(v); }
+
+    // popping committed elements leaves them in the file until the next commit() overwrites them
+    void pop_back()
+    {
+      if (!m_tail.empty())
+        m_tail.pop_back();
+      else
+        --m_tail_start;
+    }
+
+    void clear()
+    {
+      m_tail.clear();
+      m_tail_start = 0;
+    }
+
+  private:
+    static const size_t INITIAL_CAPACITY = 1024;
+    static const uint64_t UNDO_MAGIC = 0x4f444e554d584250ULL; // "PBXMUNDO"
+    static const size_t UNDO_RECORD_SIZE = sizeof(uint64_t) + sizeof(T); // index, then the element
+
+    PACK(POD_CLASS header
+    {
+    public:
+      uint64_t magic;
+      uint32_t version;
+      uint32_t elem_size;
+      uint64_t count;
+    });
+
+    PACK(POD_CLASS undo_header
+    {
+    public:
+      uint64_t magic;
+      uint64_t count;    // the committed count the saved elements belong to
+      uint64_t entries;  // saved elements after the header, 0 when there's nothing to undo
+    });
+
+    std::string undo_path() const { return m_file.path() + ".undo"; } // as in remove()
+
+    // appends the committed elements [first, last) to the undo file before write_tail() overwrites them.
+    // they're synced before the header counts them, and the header before anything is overwritten.
+    bool save_overwritten(size_t first, size_t last)
+    {
+      if (!m_undo.is_open() && !m_undo.open(undo_path(), sizeof(undo_header)))
+        return false;
+
+      if (uhdr().magic != UNDO_MAGIC || uhdr().entries == 0)
+      {
+        uhdr().magic = UNDO_MAGIC;
+        uhdr().count = hdr().count;
+        uhdr().entries = 0;
+      }
+      uint64_t entries = uhdr().entries;
+
+      size_t offset = sizeof(undo_header) + entries * UNDO_RECORD_SIZE;
+      size_t length = (last - first) * UNDO_RECORD_SIZE;
+      if (offset + length > m_undo.size() && !m_undo.resize(std::max(offset + length, 2 * m_undo.size())))
+        return false;
+
+      char *rec = m_undo.data() + offset;
+      for (uint64_t i = first; i < last; i++, rec += UNDO_RECORD_SIZE)
+      {
+        memcpy(rec, &i, sizeof(i));
+        memcpy(rec + sizeof(i), elements() + i, sizeof(T));
+      }
+      if (!m_undo.flush(offset, length))
+        return false;
+
+      uhdr().entries = entries + (last - first);
+      return m_undo.flush(0, sizeof(undo_header));
+    }
+
+    // after a write_tail() whose sync() didn't finish, puts back the elements it overwrote and the count
+    bool restore_overwritten()
+    {
+      boost::system::error_code ec;
+      if (!boost::filesystem::exists(undo_path(), ec))
+        return true;
+      if (!m_undo.open(undo_path(), sizeof(undo_header)))
+        return false;
+
+      const undo_header& uh = uhdr();
+      if (uh.magic != UNDO_MAGIC || uh.entries == 0)
+        return true;
+
+      CHECK_AND_ASSERT_MES(sizeof(undo_header) + uh.entries * UNDO_RECORD_SIZE <= m_undo.size()
+                           && sizeof(header) + uh.count * sizeof(T) <= m_file.size(), false,
+                           "mapped_vector: " << undo_path() << " doesn't fit " << m_file.path());
+      LOG_PRINT_L0("mapped_vector: restoring " << uh.entries << " elements of " << m_file.path() << " from an unfinished commit");
+
+      // an element can be saved more than once, the first copy is the committed one
+      for (uint64_t e = uh.entries; e-- > 0; )
+      {
+        const char *rec = m_undo.data() + sizeof(undo_header) + e * UNDO_RECORD_SIZE;
+        uint64_t i;
+        memcpy(&i, rec, sizeof(i));
+        CHECK_AND_ASSERT_MES(i < uh.count, false, "mapped_vector: " << undo_path() << " has element " << i << " past the count " << uh.count);
+        memcpy(m_file.data() + sizeof(header) + i * sizeof(T), rec + sizeof(i), sizeof(T));
+      }
+      hdr().count = uh.count;
+      if (!m_file.flush())
+        return false;
+
+      return clear_undo();
+    }
+
+    bool clear_undo()
+    {
+      if (!m_undo.is_open() || uhdr().entries == 0)
+        return true;
+
+      uhdr().entries = 0;
+      return m_undo.flush(0, sizeof(undo_header));
+    }
+
+    header& hdr() { return *reinterpret_cast<header *>(m_file.data()); }
+    undo_header& uhdr() { return *reinterpret_cast<undo_header *>(m_undo.data()); }
+    const T *elements() const { return reinterpret_cast<const T *>(m_file.data() + sizeof(header)); }
+    size_t capacity() const { return (m_file.size() - sizeof(header)) / sizeof(T); }
+
+    mapped_file m_file;
+    mapped_file m_undo;   // opened the first time committed elements are overwritten
+    size_t m_tail_start;  // elements below this are read from the file
+    std::vector<T> m_tail;
+    size_t m_written;       // count as of the last write_tail()
+    size_t m_unsynced_from; // first element written but not yet flushed
+  };
+}
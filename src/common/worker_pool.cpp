@@ -0,0 +1,97 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <thread>
+#include <list>
+
+#include <boost/bind.hpp>
+#define BOOST_THREAD_DONT_PROVIDE_FUTURE
+#include <boost/thread/future.hpp>
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+
+#include "include_base_utils.h"
+
+#include "worker_pool.h"
+
+namespace tools
+{
+  //------------------------------------------------------------------
+  worker_pool::worker_pool(const std::string& name)
+      : m_name(name)
+      , m_num_workers(0)
+      , m_pwork(NULL)
+  {
+  }
+  //------------------------------------------------------------------
+  worker_pool::~worker_pool()
+  {
+    stop_workers();
+  }
+  //------------------------------------------------------------------
+  bool worker_pool::start_workers()
+  {
+    CRITICAL_REGION_LOCAL(m_lock);
+    if (m_pwork)
+      return true;
+
+    size_t nthreads = std::thread::hardware_concurrency();
+    if (nthreads < 2)
+      return false;
+
+    m_pwork = new boost::asio::io_service::work(m_io_service);
+    for (size_t i=0; i < nthreads; i++)
+    {
+      m_workers.create_thread(boost::bind(&boost::asio::io_service::run, &m_io_service));
+    }
+    m_num_workers = nthreads;
+
+    LOG_PRINT_L1("Started " << nthreads << " " << m_name << " worker threads");
+    return true;
+  }
+  //------------------------------------------------------------------
+  void worker_pool::stop_workers()
+  {
+    CRITICAL_REGION_LOCAL(m_lock);
+    if (!m_pwork)
+      return;
+
+    m_io_service.stop();
+    delete m_pwork;
+    m_pwork = NULL;
+    m_workers.join_all();
+    m_num_workers = 0;
+  }
+  //------------------------------------------------------------------
+  bool worker_pool::run(size_t count, const std::function<bool(size_t, size_t)>& work)
+  {
+    if (count < 2 || !start_workers())
+      return work(0, count);
+
+    // one chunk per worker, the calling thread just waits. batches from several threads share the workers
+    size_t num_chunks = std::min(count, m_num_workers);
+    size_t chunk_size = (count + num_chunks - 1) / num_chunks;
+
+    std::list<boost::shared_future<bool> > futures;
+    for (size_t start_i = 0; start_i < count; start_i += chunk_size)
+    {
+      size_t end_i = std::min(start_i + chunk_size, count);
+      // shared_ptr work-around for packaged_task not being CopyConstructible
+      auto ptask = boost::make_shared<boost::packaged_task<bool> >(boost::bind(boost::cref(work), start_i, end_i));
+      futures.push_back(ptask->get_future());
+      m_io_service.post(boost::bind(&boost::packaged_task<bool>::operator(), ptask));
+    }
+
+    bool all_ok = true;
+    BOOST_FOREACH(auto& result, futures)
+    {
+      result.wait();
+      if (!result.get())
+        all_ok = false;
+    }
+
+    return all_ok;
+  }
+  //------------------------------------------------------------------
+}
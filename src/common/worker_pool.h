@@ -0,0 +1,41 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "syncobj.h"
+
+namespace tools
+{
+  // worker threads to split a batch of independent work across the cores. the threads are only started the
+  // first time a batch is big enough to be worth splitting up, and are kept until the pool is destroyed.
+  class worker_pool
+  {
+  public:
+    // name is only for logging
+    explicit worker_pool(const std::string& name);
+    ~worker_pool();
+
+    // calls work(begin, end) for ranges covering [0, count), one per worker, and waits for all of them.
+    // runs on the calling thread if there's only one item or one core. false if any call returned false
+    bool run(size_t count, const std::function<bool(size_t, size_t)>& work);
+
+  private:
+    bool start_workers();
+    void stop_workers();
+
+    std::string m_name;
+    epee::critical_section m_lock;
+    size_t m_num_workers;
+    boost::asio::io_service m_io_service;
+    boost::asio::io_service::work *m_pwork;
+    boost::thread_group m_workers;
+  };
+}
@@ -3,6 +3,16 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <thread>
+#include <cstring>
+#include <cerrno>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 
 #include <boost/asio/io_service.hpp>
 #include <boost/bind.hpp>
@@ -27,6 +37,14 @@ namespace
   boost::asio::io_service::work *pwork;
   uint32_t states_per_thread = 1;
   
+  // how boulderhash states are allocated
+  bool f_state_huge_pages = true;
+  bool f_state_prefault = false;
+  bool f_state_numa = false;
+  
+  const size_t STATE_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+  const size_t STATE_PAGE_SIZE = 4096;
+  
   void check_init_threads(const boost::program_options::variables_map& vm)
   {
     if (f_threads_inited)
@@ -123,11 +141,147 @@ namespace
   }
 }
 
+namespace
+{
+  // kept in front of the state pointers, the state options and sizes can change before the state is freed
+  struct state_ptrs_header
+  {
+    size_t count;
+    size_t region_size;
+  };
+  
+  uint64_t **alloc_state_ptrs(size_t count, size_t region_size)
+  {
+    state_ptrs_header *header = (state_ptrs_header *)malloc(sizeof(state_ptrs_header) + sizeof(uint64_t *)*count);
+    header->count = count;
+    header->region_size = region_size;
+    return (uint64_t **)(header + 1);
+  }
+  
+#ifndef WIN32
+  // all the states are in one mapping, rounded up so explicit huge pages can back it
+  size_t state_region_size()
+  {
+    size_t size = crypto::get_boulderhash_states() * crypto::get_boulderhash_state_size() * sizeof(uint64_t);
+    return (size + STATE_HUGE_PAGE_SIZE - 1) & ~(STATE_HUGE_PAGE_SIZE - 1);
+  }
+  
+  void *map_state_region(size_t region_size)
+  {
+    void *region = MAP_FAILED;
+    
+#ifdef MAP_HUGETLB
+    if (f_state_huge_pages)
+    {
+      region = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (region == MAP_FAILED)
+      {
+        LOG_PRINT_L1("Couldn't map boulderhash state with explicit huge pages (" << strerror(errno) << "), using normal pages");
+      }
+      else
+      {
+        LOG_PRINT_L0("Boulderhash state is backed by explicit huge pages");
+        return region;
+      }
+    }
+#endif
+    
+    region = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+    {
+      LOG_ERROR("Couldn't map " << region_size << " bytes for boulderhash state: " << strerror(errno));
+      return NULL;
+    }
+    
+#ifdef MADV_HUGEPAGE
+    // ask for transparent huge pages instead
+    if (f_state_huge_pages && madvise(region, region_size, MADV_HUGEPAGE) != 0)
+    {
+      LOG_PRINT_L1("Couldn't madvise boulderhash state to use transparent huge pages: " << strerror(errno));
+    }
+#endif
+    
+    return region;
+  }
+  
+  // must happen before the region is first touched
+  void bind_state_region(void *region, size_t region_size, int numa_node)
+  {
+    if (numa_node < 0)
+      return;
+    
+#if defined(__linux__) && defined(SYS_mbind)
+    static const int MPOL_BIND_ = 2;
+    unsigned long nodemask[4] = { 0 };
+    const size_t bits_per_word = 8 * sizeof(unsigned long);
+    if ((size_t)numa_node >= bits_per_word * sizeof(nodemask) / sizeof(nodemask[0]))
+    {
+      LOG_ERROR("Can't bind boulderhash state to NUMA node " << numa_node);
+      return;
+    }
+    nodemask[numa_node / bits_per_word] |= 1UL << (numa_node % bits_per_word);
+    
+    if (syscall(SYS_mbind, region, region_size, MPOL_BIND_, nodemask, bits_per_word * 4, 0) != 0)
+    {
+      LOG_PRINT_L0("Couldn't bind boulderhash state to NUMA node " << numa_node << ": " << strerror(errno));
+    }
+    else
+    {
+      LOG_PRINT_L0("Bound boulderhash state to NUMA node " << numa_node);
+    }
+#else
+    LOG_PRINT_L0("NUMA binding not supported on this platform");
+#endif
+  }
+  
+  void prefault_state_region(void *region, size_t region_size)
+  {
+    LOG_PRINT_L0("Prefaulting " << region_size / (1024 * 1024) << " MiB of boulderhash state...");
+    volatile char *p = (volatile char *)region;
+    for (size_t i=0; i < region_size; i += STATE_PAGE_SIZE)
+    {
+      p[i] = 0;
+    }
+  }
+#endif
+}
+
 namespace crypto
 {
   uint64_t **g_boulderhash_state = NULL;
   
-  uint64_t **pc_malloc_state()
+  void pc_set_state_options(const boost::program_options::variables_map& vm)
+  {
+    f_state_huge_pages = !command_line::get_arg(vm, hashing_opt::arg_state_no_huge_pages);
+    f_state_prefault = command_line::get_arg(vm, hashing_opt::arg_state_prefault);
+    f_state_numa = command_line::get_arg(vm, hashing_opt::arg_state_numa);
+  }
+  
+  int pc_numa_nodes()
+  {
+#if defined(__linux__)
+    int nodes = 0;
+    while (nodes < 256 && access(("/sys/devices/system/node/node" + std::to_string(nodes)).c_str(), F_OK) == 0)
+      nodes++;
+    return nodes;
+#else
+    return 0;
+#endif
+  }
+  
+  int pc_state_numa_node(uint32_t thread_index)
+  {
+    if (!f_state_numa)
+      return -1;
+    
+    int nodes = pc_numa_nodes();
+    if (nodes < 2)
+      return -1;
+    
+    return thread_index % nodes;
+  }
+  
+  uint64_t **pc_malloc_state(int numa_node)
   {
     if (!cryptonote::config::do_boulderhash)
     {
@@ -135,22 +289,46 @@ namespace crypto
       return NULL;
     }
     
+#ifdef WIN32
     LOG_PRINT_L0("Malloc'ing " << get_boulderhash_states() << " boulderhash states...");
-    uint64_t **state = (uint64_t **)malloc(sizeof(uint64_t *)*get_boulderhash_states());
+    uint64_t **state = alloc_state_ptrs(get_boulderhash_states(), 0);
     for (size_t i=0; i < crypto::get_boulderhash_states(); i++) {
       state[i] = (uint64_t *)malloc(sizeof(uint64_t)*crypto::get_boulderhash_state_size());
     }
     return state;
+#else
+    LOG_PRINT_L0("Mapping " << get_boulderhash_states() << " boulderhash states...");
+    size_t region_size = state_region_size();
+    void *region = map_state_region(region_size);
+    if (region == NULL)
+      return NULL;
+    
+    bind_state_region(region, region_size, numa_node);
+    
+    if (f_state_prefault)
+      prefault_state_region(region, region_size);
+    
+    uint64_t **state = alloc_state_ptrs(get_boulderhash_states(), region_size);
+    for (size_t i=0; i < crypto::get_boulderhash_states(); i++) {
+      state[i] = (uint64_t *)region + i*crypto::get_boulderhash_state_size();
+    }
+    return state;
+#endif
   }
   
   void pc_free_state(uint64_t **state) {
     if (state == NULL)
       return;
     
-    for (size_t i=0; i < crypto::get_boulderhash_states(); i++) {
+    state_ptrs_header *header = (state_ptrs_header *)state - 1;
+#ifdef WIN32
+    for (size_t i=0; i < header->count; i++) {
       free(state[i]);
     }
-    free(state);
+#else
+    munmap(state[0], header->region_size);
+#endif
+    free(header);
   }
   
   void pc_init_threadpool(const boost::program_options::variables_map& vm)
@@ -179,6 +357,13 @@ namespace crypto
 
   static epee::critical_section g_boulderhash_state_lock;
   void pc_boulderhash(int version, const void *data, std::size_t length, hash& hash, uint64_t **state) {
+    if (version == BOULDERHASH_VERSION_REGULAR_1)
+    {
+      // v1 states never need to be filled, so state isn't used and may be NULL
+      pc_boulderhash_v1_light(data, length, reinterpret_cast<char *>(&hash));
+      return;
+    }
+    
     if (state == NULL)
     {
       if (state == g_boulderhash_state)
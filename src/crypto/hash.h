@@ -45,7 +45,13 @@ namespace crypto {
   
   extern uint64_t **g_boulderhash_state;
   
-  uint64_t **pc_malloc_state();
+  // reads the --boulderhash-* allocation options, call before pc_malloc_state
+  void pc_set_state_options(const boost::program_options::variables_map& vm);
+  int pc_numa_nodes();
+  // NUMA node the state for the given mining thread should be bound to, or -1 for none
+  int pc_state_numa_node(uint32_t thread_index);
+  
+  uint64_t **pc_malloc_state(int numa_node = -1);
   void pc_free_state(uint64_t **state);
   
   void pc_init_threadpool(const boost::program_options::variables_map& vm);
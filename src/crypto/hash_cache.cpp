@@ -12,10 +12,51 @@
 #include "crypto/crypto.h"
 #include "serialization/binary_utils.h"
 
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+
 #include "file_io_utils.h"
 #include "string_tools.h"
 
 
+namespace
+{
+  const uint64_t HASH_CACHE_RECORDS_MAGIC = 0x7263656863687361ULL;
+  const uint64_t HASH_CACHE_INDEX_MAGIC = 0x7863656863687361ULL;
+  const uint64_t HASH_CACHE_FILE_VERSION = 2;
+  const uint64_t HASH_CACHE_INITIAL_RECORDS = 4096;
+  const uint64_t HASH_CACHE_INITIAL_SLOTS = 8192;
+  
+  // the format hash_cache used to be stored in, as one serialized blob
+  struct legacy_hash_cache
+  {
+    std::unordered_map<crypto::hash, crypto::hash> m_hash_cache;
+    std::unordered_map<crypto::hash, crypto::hash_cache::signed_hash_entry> m_signed_hash_cache;
+    
+    BEGIN_SERIALIZE_OBJECT()
+      FIELD(m_hash_cache)
+      FIELD(m_signed_hash_cache)
+    END_SERIALIZE()
+  };
+  
+  template<class t_record>
+  uint64_t record_check(const t_record& rec)
+  {
+    crypto::hash h = crypto::cn_fast_hash(&rec, offsetof(t_record, check));
+    uint64_t check;
+    memcpy(&check, &h, sizeof(check));
+    return check;
+  }
+  
+  uint64_t slot_for(const crypto::hash& block_id, uint64_t type, uint64_t capacity)
+  {
+    // block ids are already uniformly distributed
+    uint64_t h;
+    memcpy(&h, &block_id, sizeof(h));
+    return (h ^ (type * 0x9e3779b97f4a7c15ULL)) & (capacity - 1);
+  }
+}
+
 namespace crypto
 {
   bool hash_cache::init(const std::string& config_folder)
@@ -23,24 +64,32 @@ namespace crypto
     m_config_folder = config_folder;
     LOG_PRINT_L0("Loading hash cache...");
     
-    const std::string filename = m_config_folder + "/" + CRYPTONOTE_HASHCACHEDATA_FILENAME;
+    CRITICAL_REGION_LOCAL(m_hashes_lock);
+    if (!open_files())
+    {
+      LOG_ERROR("Failed to open hash cache files in " << m_config_folder);
+      return false;
+    }
     
-    bool r = false;
+    // anything added before the files were opened
+    std::unordered_map<crypto::hash, crypto::hash> mem_hashes;
+    std::unordered_map<crypto::hash, signed_hash_entry> mem_signed_hashes;
+    mem_hashes.swap(m_hash_cache);
+    mem_signed_hashes.swap(m_signed_hash_cache);
+    BOOST_FOREACH(const auto& item, mem_hashes)
     {
-      CRITICAL_REGION_LOCAL(m_hashes_lock);
-      std::string buf;
-      r = epee::file_io_utils::load_file_to_string(filename, buf);
-      if (r)
-      {
-        r = ::serialization::parse_binary(buf, *this);
-      }
+      add_cached_longhash(item.first, item.second);
+    }
+    BOOST_FOREACH(const auto& item, mem_signed_hashes)
+    {
+      add_signed_longhash(item.second);
     }
     
-    if (!r)
+    if (rheader().count == 0)
     {
-      if (GENESIS_BLOCK_ID_HEX && GENESIS_WORK_HASH_HEX && GENESIS_HASH_SIGNATURE_HEX)
+      if (!import_legacy_file() && GENESIS_BLOCK_ID_HEX && GENESIS_WORK_HASH_HEX && GENESIS_HASH_SIGNATURE_HEX)
       {
-        LOG_PRINT_L0("Can't load hash cache from file " << filename << ", initializing with genesis block");
+        LOG_PRINT_L0("Hash cache is empty, initializing with genesis block");
         
         signed_hash_entry entry;
         
@@ -53,44 +102,296 @@ namespace crypto
           LOG_ERROR("Failed to add signed genesis block work hash");
         }
       }
-      else
-      {
-        LOG_PRINT_L0("Can't load hash cache from file " << filename << ", no genesis block hashes provided");        
-      }
     }
     
-    LOG_PRINT_GREEN("Hash cache initialized, have " << m_hash_cache.size() << " hashes and " << m_signed_hash_cache.size() << " signed hashes", LOG_LEVEL_0);
+    LOG_PRINT_GREEN("Hash cache initialized, have " << hashes_count() << " hashes and " << signed_hashes_count() << " signed hashes", LOG_LEVEL_0);
     
     return true;
   }
   
-  bool hash_cache::store() const
+  bool hash_cache::open_files()
   {
-    LOG_PRINT_L0("Storing hash cache...");
     if (!tools::create_directories_if_necessary(m_config_folder))
     {
       LOG_PRINT_L0("Failed to create data directory: " << m_config_folder);
       return false;
     }
     
+    const std::string records_filename = m_config_folder + "/" + CRYPTONOTE_HASHCACHE_RECORDS_FILENAME;
+    const std::string index_filename = m_config_folder + "/" + CRYPTONOTE_HASHCACHE_INDEX_FILENAME;
+    
+    if (!m_records_file.open(records_filename, sizeof(records_header) + HASH_CACHE_INITIAL_RECORDS * sizeof(record)))
+      return false;
+    
+    records_header& rh = rheader();
+    if (rh.magic != HASH_CACHE_RECORDS_MAGIC || rh.version != HASH_CACHE_FILE_VERSION)
+    {
+      if (rh.magic != 0)
+      {
+        LOG_ERROR("Hash cache records file " << records_filename << " has wrong magic/version, starting over");
+      }
+      memset(&rh, 0, sizeof(rh));
+      rh.magic = HASH_CACHE_RECORDS_MAGIC;
+      rh.version = HASH_CACHE_FILE_VERSION;
+    }
+    if (rh.count > records_capacity())
+    {
+      LOG_ERROR("Hash cache records file claims " << rh.count << " records but only has room for " << records_capacity());
+      rh.count = records_capacity();
+    }
+    bool records_cut = !check_unstored_records();
+    
+    if (!m_index_file.open(index_filename, sizeof(index_header) + HASH_CACHE_INITIAL_SLOTS * sizeof(uint64_t)))
+      return false;
+    
+    const index_header& ih = iheader();
+    bool index_valid = ih.magic == HASH_CACHE_INDEX_MAGIC && ih.version == HASH_CACHE_FILE_VERSION
+        && ih.capacity != 0 && (ih.capacity & (ih.capacity - 1)) == 0
+        && sizeof(index_header) + ih.capacity * sizeof(uint64_t) <= m_index_file.size()
+        && ih.indexed_count <= rh.count;
+    if (!index_valid || records_cut)
+    {
+      LOG_PRINT_L0("Rebuilding hash cache index...");
+      if (!rebuild_index(std::max<uint64_t>(HASH_CACHE_INITIAL_SLOTS, rh.count * 4)))
+        return false;
+      if (records_cut)
+        recount_records();
+      return true;
+    }
+    
+    // records appended after the index was last written
+    for (uint64_t i = ih.indexed_count; i < rh.count; i++)
+    {
+      if (!index_record(i))
+        return false;
+    }
+    
+    return true;
+  }
+  
+  // false if records that were never stored turned out to be partly written, and were dropped
+  bool hash_cache::check_unstored_records()
+  {
+    records_header& rh = rheader();
+    if (rh.stored_count > rh.count)
+      rh.stored_count = rh.count;
+    
+    const record *recs = records();
+    for (uint64_t i = rh.stored_count; i < rh.count; i++)
+    {
+      if ((recs[i].type != WORK_HASH_RECORD && recs[i].type != SIGNED_HASH_RECORD) || recs[i].check != record_check(recs[i]))
+      {
+        LOG_ERROR("Hash cache record " << i << " of " << rh.count << " wasn't completely written, dropping it and the ones after it");
+        rh.count = i;
+        return false;
+      }
+    }
+    
+    return true;
+  }
+  
+  // only the newest record for a block counts, needs the index
+  void hash_cache::recount_records()
+  {
+    records_header& rh = rheader();
+    const record *recs = records();
+    rh.work_hash_count = 0;
+    rh.signed_hash_count = 0;
+    for (uint64_t i = 0; i < rh.count; i++)
+    {
+      if (find_record((record_type)recs[i].type, recs[i].block_id) != &recs[i])
+        continue;
+      if (recs[i].type == WORK_HASH_RECORD)
+        rh.work_hash_count++;
+      else
+        rh.signed_hash_count++;
+    }
+  }
+  
+  bool hash_cache::import_legacy_file()
+  {
     const std::string filename = m_config_folder + "/" + CRYPTONOTE_HASHCACHEDATA_FILENAME;
     
+    std::string buf;
+    if (!epee::file_io_utils::load_file_to_string(filename, buf))
+      return false;
+    
+    legacy_hash_cache legacy;
+    if (!::serialization::parse_binary(buf, legacy))
+    {
+      LOG_ERROR("Failed to parse old hash cache file " << filename);
+      return false;
+    }
+    
+    LOG_PRINT_L0("Importing " << legacy.m_hash_cache.size() << " hashes and " << legacy.m_signed_hash_cache.size()
+                 << " signed hashes from " << filename);
+    BOOST_FOREACH(const auto& item, legacy.m_hash_cache)
+    {
+      if (!add_cached_longhash(item.first, item.second))
+        return false;
+    }
+    BOOST_FOREACH(const auto& item, legacy.m_signed_hash_cache)
+    {
+      add_signed_longhash(item.second);
+    }
+    
+    if (!store())
+      return false;
+    
+    boost::system::error_code ec;
+    boost::filesystem::remove(filename, ec);
+    if (ec)
+    {
+      LOG_PRINT_L0("Couldn't remove old hash cache file " << filename << ": " << ec.message());
+    }
+    return true;
+  }
+  
+  uint64_t hash_cache::records_capacity() const
+  {
+    return (m_records_file.size() - sizeof(records_header)) / sizeof(record);
+  }
+  
+  const hash_cache::record *hash_cache::find_record(record_type type, const crypto::hash& block_id) const
+  {
+    const index_header& ih = iheader();
+    const uint64_t *s = slots();
+    const record *recs = records();
+    uint64_t count = rheader().count;
+    
+    for (uint64_t slot = slot_for(block_id, type, ih.capacity); s[slot] != 0; slot = (slot + 1) & (ih.capacity - 1))
+    {
+      uint64_t i = s[slot] - 1;
+      if (i < count && recs[i].type == (uint64_t)type && recs[i].block_id == block_id)
+        return &recs[i];
+    }
+    
+    return NULL;
+  }
+  
+  bool hash_cache::index_record(uint64_t i)
+  {
+    index_header& ih = iheader();
+    if ((i + 1) * 2 > ih.capacity)
+      return rebuild_index(ih.capacity * 2);
+    
+    uint64_t *s = slots();
+    const record *recs = records();
+    const record& rec = recs[i];
+    uint64_t count = rheader().count;
+    
+    uint64_t slot = slot_for(rec.block_id, rec.type, ih.capacity);
+    for (; s[slot] != 0; slot = (slot + 1) & (ih.capacity - 1))
+    {
+      uint64_t j = s[slot] - 1;
+      // newer record for the same block replaces the old one
+      if (j < count && recs[j].type == rec.type && recs[j].block_id == rec.block_id)
+        break;
+    }
+    s[slot] = i + 1;
+    
+    if (ih.indexed_count < i + 1)
+      ih.indexed_count = i + 1;
+    return true;
+  }
+  
+  bool hash_cache::rebuild_index(uint64_t capacity)
+  {
+    uint64_t rounded = HASH_CACHE_INITIAL_SLOTS;
+    while (rounded < capacity)
+      rounded *= 2;
+    
+    if (!m_index_file.resize(sizeof(index_header) + rounded * sizeof(uint64_t)))
+      return false;
+    
+    memset(m_index_file.data(), 0, m_index_file.size());
+    index_header& ih = iheader();
+    ih.magic = HASH_CACHE_INDEX_MAGIC;
+    ih.version = HASH_CACHE_FILE_VERSION;
+    ih.capacity = rounded;
+    ih.indexed_count = 0;
+    
+    for (uint64_t i = 0; i < rheader().count; i++)
+    {
+      if (!index_record(i))
+        return false;
+    }
+    
+    return true;
+  }
+  
+  bool hash_cache::add_record(const record& rec)
+  {
+    records_header& rh = rheader();
+    if (rh.count == records_capacity())
+    {
+      if (!m_records_file.resize(sizeof(records_header) + 2 * records_capacity() * sizeof(record)))
+      {
+        LOG_ERROR("Failed to grow hash cache records file");
+        return false;
+      }
+    }
+    
+    bool replaces = find_record((record_type)rec.type, rec.block_id) != NULL;
+    
+    // pages aren't written back in order, the check lets a load spot a record whose page didn't make it
+    record& added = records()[rheader().count];
+    added = rec;
+    added.check = record_check(added);
+    rheader().count++;
+    if (!replaces)
+    {
+      if (rec.type == WORK_HASH_RECORD)
+        rheader().work_hash_count++;
+      else
+        rheader().signed_hash_count++;
+    }
+    
+    return index_record(rheader().count - 1);
+  }
+  
+  bool hash_cache::store()
+  {
     CRITICAL_REGION_LOCAL(m_hashes_lock);
+    if (!m_records_file.is_open())
+      return true;
     
-    std::string buf;
-    bool r = ::serialization::dump_binary(*this, buf);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to serialize hash_cache");
-    r = r && epee::file_io_utils::save_string_to_file(filename, buf);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to save hashcache to file: " << filename);
+    LOG_PRINT_L0("Storing hash cache...");
+    // records before the index, the index can be rebuilt from them
+    CHECK_AND_ASSERT_MES(m_records_file.flush(), false, "Failed to flush hash cache records");
+    rheader().stored_count = rheader().count;
+    CHECK_AND_ASSERT_MES(m_records_file.flush(0, sizeof(records_header)), false, "Failed to flush hash cache records header");
+    CHECK_AND_ASSERT_MES(m_index_file.flush(), false, "Failed to flush hash cache index");
     return true;
   }
   
-  bool hash_cache::deinit() const
+  bool hash_cache::deinit()
   {
-    return store();
+    bool r = store();
+    CRITICAL_REGION_LOCAL(m_hashes_lock);
+    m_records_file.close();
+    m_index_file.close();
+    return r;
+  }
+  
+  size_t hash_cache::hashes_count() const
+  {
+    CRITICAL_REGION_LOCAL(m_hashes_lock);
+    if (!m_records_file.is_open())
+      return m_hash_cache.size();
+    
+    return rheader().work_hash_count;
+  }
+  
+  size_t hash_cache::signed_hashes_count() const
+  {
+    CRITICAL_REGION_LOCAL(m_hashes_lock);
+    if (!m_records_file.is_open())
+      return m_signed_hash_cache.size();
+    
+    return rheader().signed_hash_count;
   }
   
-
   bool hash_cache::set_hash_signing_key(crypto::secret_key& prvk)
   {
     public_key pub_from_prvk;
@@ -119,6 +420,16 @@ namespace crypto
   bool hash_cache::get_cached_longhash(const crypto::hash& block_id, crypto::hash& work_hash) const
   {
     CRITICAL_REGION_LOCAL(m_hashes_lock);
+    if (m_records_file.is_open())
+    {
+      const record *prec = find_record(WORK_HASH_RECORD, block_id);
+      if (!prec)
+        return false;
+      
+      work_hash = prec->work_hash;
+      return true;
+    }
+    
     const auto& mi = m_hash_cache.find(block_id);
     if (mi == m_hash_cache.end())
       return false;
@@ -130,6 +441,19 @@ namespace crypto
   bool hash_cache::add_cached_longhash(const crypto::hash& block_id, const crypto::hash& work_hash)
   {
     CRITICAL_REGION_LOCAL(m_hashes_lock);
+    if (m_records_file.is_open())
+    {
+      const record *prec = find_record(WORK_HASH_RECORD, block_id);
+      if (prec && prec->work_hash == work_hash)
+        return true;
+      
+      record rec = AUTO_VAL_INIT(rec);
+      rec.type = WORK_HASH_RECORD;
+      rec.block_id = block_id;
+      rec.work_hash = work_hash;
+      return add_record(rec);
+    }
+    
     m_hash_cache[block_id] = work_hash;
     return true;
   }
@@ -137,6 +461,18 @@ namespace crypto
   bool hash_cache::get_signed_longhash_entry(const crypto::hash& block_id, signed_hash_entry& entry) const
   {
     CRITICAL_REGION_LOCAL(m_hashes_lock);
+    if (m_records_file.is_open())
+    {
+      const record *prec = find_record(SIGNED_HASH_RECORD, block_id);
+      if (!prec)
+        return false;
+      
+      entry.block_id = prec->block_id;
+      entry.work_hash = prec->work_hash;
+      entry.sig = prec->sig;
+      return true;
+    }
+    
     const auto& mi = m_signed_hash_cache.find(block_id);
     
     if (mi == m_signed_hash_cache.end())
@@ -160,6 +496,9 @@ namespace crypto
   bool hash_cache::have_signed_longhash_for(const crypto::hash& block_id) const
   {
     CRITICAL_REGION_LOCAL(m_hashes_lock);
+    if (m_records_file.is_open())
+      return find_record(SIGNED_HASH_RECORD, block_id) != NULL;
+    
     return m_signed_hash_cache.find(block_id) != m_signed_hash_cache.end();
   }
 
@@ -176,6 +515,20 @@ namespace crypto
     }
     
     CRITICAL_REGION_LOCAL(m_hashes_lock);
+    if (m_records_file.is_open())
+    {
+      const record *prec = find_record(SIGNED_HASH_RECORD, entry.block_id);
+      if (prec && prec->work_hash == entry.work_hash && prec->sig == entry.sig)
+        return true;
+      
+      record rec = AUTO_VAL_INIT(rec);
+      rec.type = SIGNED_HASH_RECORD;
+      rec.block_id = entry.block_id;
+      rec.work_hash = entry.work_hash;
+      rec.sig = entry.sig;
+      return add_record(rec);
+    }
+    
     m_signed_hash_cache[entry.block_id] = entry;
     return true;
   }
@@ -9,8 +9,12 @@
 #include "serialization/serialization.h"
 
 #include "syncobj.h"
+#include "packing.h"
 #include "serialization/keyvalue_serialization.h"
 
+#include "common/mapped_file.h"
+#include "common/types.h"
+
 #include <string>
 #include <unordered_map>
 
@@ -52,8 +56,8 @@ namespace crypto {
     inline bool is_hash_signing_key_set() const { return m_priv_key_set; }
     
     bool init(const std::string& config_folder);
-    bool store() const;
-    bool deinit() const;
+    bool store();
+    bool deinit();
     
     bool get_cached_longhash(const crypto::hash& block_id, crypto::hash& work_hash) const;
     bool add_cached_longhash(const crypto::hash& block_id, const crypto::hash& work_hash);
@@ -64,19 +68,77 @@ namespace crypto {
     bool add_signed_longhash(const crypto::hash_cache::signed_hash_entry& entry);
     bool create_signed_hash(const crypto::hash& block_id, const crypto::hash& work_hash, crypto::signature& sig);
     
-    BEGIN_SERIALIZE_OBJECT()
-      FIELD(m_hash_cache)
-      FIELD(m_signed_hash_cache)
-    END_SERIALIZE()
+    size_t hashes_count() const;
+    size_t signed_hashes_count() const;
     
   private:
+    // on disk the cache is an append-only file of fixed-size records, plus a hash table of
+    // record indexes that is updated in place. only the pages that are touched get loaded,
+    // and storing only has to write back what changed. the table can always be rebuilt from the records.
+    // dirty pages can reach the disk in any order, so records past the last store() are checked on load
+    // and the file is cut at the first one that didn't make it.
+    enum record_type { WORK_HASH_RECORD = 1, SIGNED_HASH_RECORD = 2 };
+    
+    PACK(POD_CLASS record
+    {
+    public:
+      uint64_t type;
+      crypto::hash block_id;
+      crypto::hash work_hash;
+      crypto::signature sig; // only for SIGNED_HASH_RECORD
+      uint64_t check;        // from the fields above, see record_check()
+    });
+    
+    PACK(POD_CLASS records_header
+    {
+    public:
+      uint64_t magic;
+      uint64_t version;
+      uint64_t count;
+      uint64_t work_hash_count;
+      uint64_t signed_hash_count;
+      uint64_t stored_count;   // records [0, stored_count) were flushed by store()
+    });
+    
+    PACK(POD_CLASS index_header
+    {
+    public:
+      uint64_t magic;
+      uint64_t version;
+      uint64_t capacity;       // # of slots, power of 2
+      uint64_t indexed_count;  // records [0, indexed_count) are in the table
+    });
+    
+    bool open_files();
+    bool check_unstored_records();
+    void recount_records();
+    bool import_legacy_file();
+    bool add_record(const record& rec);
+    const record *find_record(record_type type, const crypto::hash& block_id) const;
+    bool index_record(uint64_t i);
+    bool rebuild_index(uint64_t capacity);
+    uint64_t records_capacity() const;
+    
+    records_header& rheader() { return *reinterpret_cast<records_header *>(m_records_file.data()); }
+    const records_header& rheader() const { return *reinterpret_cast<const records_header *>(m_records_file.data()); }
+    record *records() { return reinterpret_cast<record *>(m_records_file.data() + sizeof(records_header)); }
+    const record *records() const { return reinterpret_cast<const record *>(m_records_file.data() + sizeof(records_header)); }
+    index_header& iheader() { return *reinterpret_cast<index_header *>(m_index_file.data()); }
+    const index_header& iheader() const { return *reinterpret_cast<const index_header *>(m_index_file.data()); }
+    uint64_t *slots() { return reinterpret_cast<uint64_t *>(m_index_file.data() + sizeof(index_header)); }
+    const uint64_t *slots() const { return reinterpret_cast<const uint64_t *>(m_index_file.data() + sizeof(index_header)); }
+    
     bool m_priv_key_set;
     secret_key m_hash_signing_priv_key;
     
+    // until init() opens the files, hashes are only kept in memory here
     std::unordered_map<crypto::hash, crypto::hash> m_hash_cache;
     std::unordered_map<crypto::hash, signed_hash_entry> m_signed_hash_cache;
     mutable epee::critical_section m_hashes_lock;
     
+    tools::mapped_file m_records_file;
+    tools::mapped_file m_index_file;
+    
     std::string m_config_folder;
   };
   
@@ -17,6 +17,9 @@ namespace hashing_opt
   const command_line::arg_descriptor<std::string> arg_hash_signing_priv_key = {"hash-signing-key", "Provide private key to sign proof-of-work hashes", "", true};
   const command_line::arg_descriptor<uint32_t>    arg_worker_threads =  {"worker-threads", "Specify boulderhash worker threadpool size (default: nproc)", 0, true};
   const command_line::arg_descriptor<uint32_t>    arg_states_per_thread =  {"states-per-thread", "Specify number of boulderhash states each worker thread should generate (default: 1)", 0, true};
+  const command_line::arg_descriptor<bool>        arg_state_no_huge_pages = {"boulderhash-no-huge-pages", "Don't try to back boulderhash states with huge pages", false};
+  const command_line::arg_descriptor<bool>        arg_state_prefault = {"boulderhash-prefault", "Fault in all boulderhash state pages when allocating instead of while hashing", false};
+  const command_line::arg_descriptor<bool>        arg_state_numa = {"boulderhash-numa", "Bind each mining thread's boulderhash state to a NUMA node, round-robin", false};
   
 }
 using namespace hashing_opt;
@@ -31,6 +34,9 @@ namespace crypto
     command_line::add_arg(desc, arg_hash_signing_priv_key);
     command_line::add_arg(desc, arg_worker_threads);
     command_line::add_arg(desc, arg_states_per_thread);
+    command_line::add_arg(desc, arg_state_no_huge_pages);
+    command_line::add_arg(desc, arg_state_prefault);
+    command_line::add_arg(desc, arg_state_numa);
   }
   
   static bool set_hash_signing_key(boost::program_options::variables_map& vm)
@@ -50,6 +56,8 @@ namespace crypto
   
   bool process_options(boost::program_options::variables_map& vm, bool is_mining)
   {
+    pc_set_state_options(vm);
+    
     if (cryptonote::config::testnet)
     {
       // always enable small boulderhash for testnet
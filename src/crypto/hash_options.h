@@ -13,6 +13,9 @@ namespace hashing_opt
   extern const command_line::arg_descriptor<std::string> arg_hash_signing_priv_key;
   extern const command_line::arg_descriptor<uint32_t>    arg_worker_threads;
   extern const command_line::arg_descriptor<uint32_t>    arg_states_per_thread;
+  extern const command_line::arg_descriptor<bool>        arg_state_no_huge_pages;
+  extern const command_line::arg_descriptor<bool>        arg_state_prefault;
+  extern const command_line::arg_descriptor<bool>        arg_state_numa;
 }
 
 namespace crypto {
@@ -95,6 +95,60 @@ void pc_boulderhash_calc_result(int version, uint64_t *result, uint64_t extra, u
   }
 }
 
+// for version 1 each state word only depends on the one before it through boulderhash_transform,
+// which is affine, so word j is transform^j(word 0) = mul*word0 + add for some (mul, add).
+// square-and-multiply gets (mul, add) for any j in log2(j) steps, so the words that
+// pc_boulderhash_calc_result looks at can be computed without filling the states.
+uint64_t pc_boulderhash_v1_state_word(uint64_t state0, uint64_t j)
+{
+  uint64_t mul = 1, add = 0;                  // transform^(bits of j handled so far)
+  uint64_t step_mul = UINT64_C(0x5851f42d4c957f2d); // transform^(2^k)
+  uint64_t step_add = UINT64_C(0x14057b7ef767814f);
+  
+  while (j) {
+    if (j & 1) {
+      mul *= step_mul;
+      add = add * step_mul + step_add;
+    }
+    step_add = step_add * step_mul + step_add;
+    step_mul *= step_mul;
+    j >>= 1;
+  }
+  
+  return mul * state0 + add;
+}
+
+void pc_boulderhash_v1_light(const void *data, size_t length, char *hash)
+{
+  static const int result_size_m1 = HASH_SIZE / sizeof(uint64_t) - 1;
+  uint64_t result[HASH_SIZE / sizeof(uint64_t)];
+  uint64_t extra;
+  uint64_t state0[BOULDERHASH_REGULAR_STATES];
+  uint64_t *state[BOULDERHASH_REGULAR_STATES];
+  size_t i, num_states, states_m1, state_size_m1;
+  int k, c;
+  
+  num_states = get_boulderhash_states();
+  for (i=0; i < num_states; i++) {
+    state[i] = &state0[i];
+  }
+  
+  // only writes the first word of each state
+  pc_boulderhash_init(data, length, state, &result[0], &extra);
+  
+  states_m1 = num_states - 1;
+  state_size_m1 = get_boulderhash_state_size() - 1;
+  
+  // same as pc_boulderhash_calc_result, but jumping to each word
+  for (k=0, c=0; k < BOULDERHASH_ITERATIONS; k++, c=(c+1)&result_size_m1) {
+    result[c] = extra ^ pc_boulderhash_v1_state_word(state0[(result[c]>>32) & states_m1], result[c] & state_size_m1);
+    extra = boulderhash_transform(extra);
+  }
+  
+  // final hash
+  cn_fast_hash(result, HASH_SIZE, hash);
+}
+
 void pc_boulderhash(int version, const void *data, size_t length, char *hash,
                     uint64_t **state) {
   uint64_t result[HASH_SIZE / sizeof(uint64_t)];
@@ -81,4 +81,7 @@ void pc_boulderhash_init(const void *data, size_t length,
 void pc_boulderhash_fill_state(int version, uint64_t *cur_state);
 void pc_boulderhash_calc_result(int version, uint64_t *result, uint64_t extra, uint64_t **state);
 void pc_boulderhash(int version, const void *data, size_t length, char *hash, uint64_t **state);
+// version 1 only, computes only the state words that are used instead of filling the states
+uint64_t pc_boulderhash_v1_state_word(uint64_t state0, uint64_t j);
+void pc_boulderhash_v1_light(const void *data, size_t length, char *hash);
 
@@ -17,13 +17,21 @@ const char *CRYPTONOTE_BLOCKCHAINDATA_TEMP_FILENAME = "blockchain.bin.tmp";
 const char *P2P_NET_DATA_FILENAME                   = "p2pstate.bin";
 const char *MINER_CONFIG_FILE_NAME                  = "miner_conf.json";
 const char *CRYPTONOTE_HASHCACHEDATA_FILENAME       = "hashcache.bin";
+const char *CRYPTONOTE_HASHCACHE_RECORDS_FILENAME   = "hashcache_records.bin";
+const char *CRYPTONOTE_HASHCACHE_INDEX_FILENAME     = "hashcache_index.bin";
 
 const char *CRYPTONOTE_BLOCKCHAINDB_ENTRIES_FILENAME = "blockchaindb_entries.bin";
+const char *CRYPTONOTE_BLOCKCHAINDB_MAPPED_ENTRIES_FILENAME = "blockchaindb_entries_mapped.bin";
 const char *CRYPTONOTE_BLOCKCHAINDB_ALT_ENTRIES_FILENAME = "blockchaindb_alt_entries.bin";
 const char *CRYPTONOTE_BLOCKCHAINDB_INVALID_ENTRIES_FILENAME = "blockchaindb_invalid_entries.bin";
 const char *CRYPTONOTE_BLOCKCHAINDB_BLOCKS_FILENAME = "blockchaindb_blocks.bin";
 const char *CRYPTONOTE_BLOCKCHAINDB_INDEX_FILENAME = "blockchaindb_index.bin";
 const char *CRYPTONOTE_BLOCKCHAINDB_TXS_FILENAME = "blockchaindb_txs.bin";
+const char *CRYPTONOTE_BLOCKCHAINDB_OUTPUTS_FILENAME = "blockchaindb_outputs.bin";
+const char *CRYPTONOTE_BLOCKCHAINDB_MAPPED_OUTPUTS_FILENAME = "blockchaindb_outputs_mapped.bin";
+const char *CRYPTONOTE_BLOCKCHAINDB_SPENT_KEYS_FILENAME = "blockchaindb_spent_keys.bin";
+const char *CRYPTONOTE_BLOCKCHAINDB_SPENT_KEY_SET_FILENAME = "blockchaindb_spent_key_set.bin";
+const char *CRYPTONOTE_BLOCKCHAINDB_VOTES_FILENAME = "blockchaindb_votes.bin";
 
 uint64_t DEFAULT_FEE = UINT64_C(10000000); // 0.10 XPB
 
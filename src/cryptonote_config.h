@@ -49,8 +49,14 @@
 
 #define BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT          10000  //by default, blocks ids count in synchronizing
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              200    //by default, blocks count in blocks downloading
+#define BLOCKS_SYNCHRONIZING_SPAN_TIMEOUT               120    //seconds another connection waits before re-requesting blocks one reserved
 #define SIGNED_HASHES_SYNCHRONIZING_DEFAULT_COUNT       200    //by default, signed hash count in signed hashes downloading
 #define CRYPTONOTE_PROTOCOL_HOP_RELAX_COUNT             3      //value of hop, after which we use only announce of new block
+#define CRYPTONOTE_PROTOCOL_KNOWN_TXS_MAX_COUNT         5000   //tx ids remembered per connection as already known to the peer
+#define CRYPTONOTE_POOL_LOCKED_TX_RECHECK_INTERVAL      30     //seconds before pool txs left out of the block template are checked again, inputs can unlock by time
+#define CRYPTONOTE_PROTOCOL_TX_REQUEST_TIMEOUT          30     //seconds to wait for an announced tx before asking another peer
+#define CRYPTONOTE_PROTOCOL_REQUESTED_TXS_MAX_COUNT     1000   //announced txs asked from one connection and not received yet
+#define CRYPTONOTE_PROTOCOL_TX_ANNOUNCERS_MAX_COUNT     8      //other peers remembered per requested tx to ask if the first doesn't send it
 
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT           1000
@@ -71,6 +77,8 @@
 
 #define THREAD_STACK_SIZE                       (5 * 1024 * 1024)
 
+#define BLOCKCHAIN_BACKGROUND_STORE_MAX_FAILURES        3            //then store in the foreground
+
 const char HASH_SIGNING_TRUSTED_PUB_KEY[]     = "0c4ef29b338e69495b13519797dc49c2fef499c004154a8045b850bb320bf6dd";
 
 extern const bool ALLOW_DEBUG_COMMANDS;
@@ -82,6 +90,8 @@ extern const char *CRYPTONOTE_BLOCKCHAINDATA_TEMP_FILENAME;
 extern const char *P2P_NET_DATA_FILENAME;
 extern const char *MINER_CONFIG_FILE_NAME;
 extern const char *CRYPTONOTE_HASHCACHEDATA_FILENAME;
+extern const char *CRYPTONOTE_HASHCACHE_RECORDS_FILENAME;
+extern const char *CRYPTONOTE_HASHCACHE_INDEX_FILENAME;
 
 extern uint64_t DEFAULT_FEE;
 
@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <fstream>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/range/adaptor/transformed.hpp>
@@ -34,9 +35,11 @@
 #include "cryptonote_core/account_boost_serialization.h"
 #include "cryptonote_core/cryptonote_boost_serialization.h"
 #include "cryptonote_core/blockchain_storage_boost_serialization.h"
+#include "cryptonote_core/blockchain_storage_db_serialization.h"
 #include "cryptonote_core/miner.h"
 #include "cryptonote_core/visitors.h"
 #include "cryptonote_core/contract_grading.h"
+#include "cryptonote_core/decoy_sampler.h"
 #include "cryptonote_core/delegate_auto_vote.h"
 
 using namespace std;
@@ -47,67 +50,64 @@ using tools::const_get;
 DISABLE_VS_WARNINGS(4267)
 
 extern const char *CRYPTONOTE_BLOCKCHAINDB_ENTRIES_FILENAME;
+extern const char *CRYPTONOTE_BLOCKCHAINDB_MAPPED_ENTRIES_FILENAME;
 extern const char *CRYPTONOTE_BLOCKCHAINDB_ALT_ENTRIES_FILENAME;
 extern const char *CRYPTONOTE_BLOCKCHAINDB_INVALID_ENTRIES_FILENAME;
 extern const char *CRYPTONOTE_BLOCKCHAINDB_BLOCKS_FILENAME;
 extern const char *CRYPTONOTE_BLOCKCHAINDB_INDEX_FILENAME;
 extern const char *CRYPTONOTE_BLOCKCHAINDB_TXS_FILENAME;
+extern const char *CRYPTONOTE_BLOCKCHAINDB_OUTPUTS_FILENAME;
+extern const char *CRYPTONOTE_BLOCKCHAINDB_MAPPED_OUTPUTS_FILENAME;
+extern const char *CRYPTONOTE_BLOCKCHAINDB_SPENT_KEYS_FILENAME;
+extern const char *CRYPTONOTE_BLOCKCHAINDB_SPENT_KEY_SET_FILENAME;
+extern const char *CRYPTONOTE_BLOCKCHAINDB_VOTES_FILENAME;
 
 //------------------------------------------------------------------
 //------------------------------------------------------------------
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_check_count() const
 {
-  return m_spent_keys.size() + m_outputs.size() + m_current_block_cumul_sz_limit + m_currencies.size() + m_used_currency_descriptions.size() + m_contracts.size() + m_delegates.size() + m_vote_histories.size();
+  return m_output_positions.size() + m_current_block_cumul_sz_limit + m_currencies.size() + m_used_currency_descriptions.size() + m_contracts.size() + m_delegates.size();
 }
 //------------------------------------------------------------------
 void blockchain_storage::print_sizes() const
 {
   LOG_PRINT_L0("Blockchain storage:" << ENDL <<
-               "m_spent_keys: " << m_spent_keys.size() << ENDL  <<
-               "m_outputs: " << m_outputs.size() << ENDL  <<
+               "m_output_positions: " << m_output_positions.size() << ENDL  <<
                "m_current_block_cumul_sz_limit: " << m_current_block_cumul_sz_limit << ENDL <<
                "m_currencies: " << m_currencies.size() << ENDL <<
                "m_contracts: " << m_contracts.size() << ENDL <<
                "m_used_currency_descriptions: " << m_used_currency_descriptions.size() << ENDL <<
-               "m_delegates:" << m_delegates.size() << ENDL <<
-               "m_vote_histories:" << m_vote_histories.size() << ENDL);
-}
-//------------------------------------------------------------------
-//------------------------------------------------------------------
-static void config_stxxl()
-{
-  static bool configed = false;
-  if (!configed) {
-    // config stxxl to not allocate much at all, should only need to use the vector on disk
-    stxxl::config::get_instance()->add_disk(stxxl::disk_config("stxxl.tmp", 1, "memory autogrow"));
-    configed = true;
-  }
+               "m_delegates:" << m_delegates.size() << ENDL);
 }
 //------------------------------------------------------------------
 //------------------------------------------------------------------
 blockchain_storage::blockchain_storage(tx_memory_pool& tx_pool, tools::ntp_time& ntp_time_in)
     : m_tx_pool(tx_pool)
 
-    , m_pstxxl_file(nullptr)
-    , m_pblockchain_entries(nullptr)
+    // in memory until load_blockchain() maps the file in the config folder
+    , m_pblockchain_entries(new blockchain_entries())
 
     // start with in-memory blocks, change to file-backed on config
     , m_blocks_by_hash(nullptr,
                        sqlite3::load_pod<crypto::hash>, sqlite3::store_pod<crypto::hash>,
-                       tools::boost_unserialize_from_string<block>,
-                       tools::boost_serialize_to_string<block>)
+                       block_from_db, block_to_db, block_from_db_view)
     , m_blocks_index(nullptr,
                      sqlite3::load_pod<crypto::hash>, sqlite3::store_pod<crypto::hash>,
-                     sqlite3::load_pod<size_t>, sqlite3::store_pod<size_t>)
+                     sqlite3::load_pod<size_t>, sqlite3::store_pod<size_t>,
+                     sqlite3::load_pod_view<size_t>)
     , m_transactions(nullptr,
                      sqlite3::load_pod<crypto::hash>, sqlite3::store_pod<crypto::hash>,
-                     tools::boost_unserialize_from_string<transaction_chain_entry>,
-                     tools::boost_serialize_to_string<transaction_chain_entry>)
-    , m_spent_keys()
+                     tx_chain_entry_from_db, tx_chain_entry_to_db, tx_chain_entry_from_db_view)
+    , m_poutput_records(new output_records_container())
+    , m_spent_keys_db(nullptr,
+                   sqlite3::load_pod<crypto::key_image>, sqlite3::store_pod<crypto::key_image>,
+                   sqlite3::load_pod<bool>, sqlite3::store_pod<bool>,
+                   sqlite3::load_pod_view<bool>)
 
     , m_current_block_cumul_sz_limit(0)
     , m_popping_block(false)
+    , m_rebuild_output_index(false)
 
     /*, m_alternative_chain_entries(blockchain_entry_by_hash::node_block_type::raw_size*3,
                                   blockchain_entry_by_hash::leaf_block_type::raw_size*3)
@@ -116,17 +116,26 @@ blockchain_storage::blockchain_storage(tx_memory_pool& tx_pool, tools::ntp_time&
 
     , m_alternative_chain_entries(nullptr,
                                   sqlite3::load_pod<crypto::hash>, sqlite3::store_pod<crypto::hash>,
-                                  sqlite3::load_pod<blockchain_entry>, sqlite3::store_pod<blockchain_entry>)
+                                  sqlite3::load_pod<blockchain_entry>, sqlite3::store_pod<blockchain_entry>,
+                                  sqlite3::load_pod_view<blockchain_entry>)
     , m_invalid_block_entries(nullptr,
                               sqlite3::load_pod<crypto::hash>, sqlite3::store_pod<crypto::hash>,
-                              sqlite3::load_pod<blockchain_entry>, sqlite3::store_pod<blockchain_entry>)
+                              sqlite3::load_pod<blockchain_entry>, sqlite3::store_pod<blockchain_entry>,
+                              sqlite3::load_pod_view<blockchain_entry>)
+
+    , m_vote_histories(nullptr,
+                       sqlite3::load_pod<crypto::key_image>, sqlite3::store_pod<crypto::key_image>,
+                       vote_history_from_db, vote_history_to_db, vote_history_from_db_view)
 
     , m_is_in_checkpoint_zone(false)
     , m_is_blockchain_storing(false)
     , m_stop_catchup(false)
     , m_ntp_time(ntp_time_in)
     , m_changes_since_store(0)
+    , m_store_in_progress(false)
+    , m_failed_stores(0)
     , m_cached_block_fees(17500) // enough for max # of blocks in past day during DPOS era
+    , m_pdeferred_ring_sigs(NULL)
 
     , m_v15_ram_converter(*this)
 {
@@ -134,56 +143,47 @@ blockchain_storage::blockchain_storage(tx_memory_pool& tx_pool, tools::ntp_time&
   m_blocks_by_hash.set_autocommit(false, false);
   m_blocks_index.set_autocommit(false, false);
   m_transactions.set_autocommit(false, false);
+  m_spent_keys_db.set_autocommit(false, false);
+  m_vote_histories.set_autocommit(false, false);
   m_alternative_chain_entries.set_autocommit(false, false);
   m_invalid_block_entries.set_autocommit(false, false);
   
-  config_stxxl();
-  
-  m_blockchain_entries_file = boost::filesystem::unique_path("blockchain_entries_%%%%-%%%%-%%%%-%%%%.tmp").string();
-  m_pstxxl_file.reset(new stxxl::syscall_file(m_blockchain_entries_file,
-                                              stxxl::file::RDWR | stxxl::file::CREAT | stxxl::file::TRUNC));
-  m_pblockchain_entries.reset(new blockchain_entries(m_pstxxl_file.get()));
-}
-//------------------------------------------------------------------
-void blockchain_storage::close_blockchain_entries()
-{
-  m_pblockchain_entries.reset(nullptr);
-  // delete the file that was created
-  m_pstxxl_file->close_remove();
-  m_pstxxl_file.reset(nullptr);
-  try {
-    boost::filesystem::remove(m_blockchain_entries_file);
-  } catch (...) {
-    LOG_ERROR("Couldn't remove blockchain entries file " << m_blockchain_entries_file);
-  }
+  // commits only write the WAL, the fsync happens when a background store checkpoints it
+  m_blocks_by_hash.set_deferred_sync(true);
+  m_blocks_index.set_deferred_sync(true);
+  m_transactions.set_deferred_sync(true);
+  m_spent_keys_db.set_deferred_sync(true);
+  m_vote_histories.set_deferred_sync(true);
+  m_alternative_chain_entries.set_deferred_sync(true);
+  m_invalid_block_entries.set_deferred_sync(true);
 }
 //------------------------------------------------------------------
 blockchain_storage::~blockchain_storage()
 {
-  close_blockchain_entries();
+  wait_for_background_store();
 }
 //------------------------------------------------------------------
 //------------------------------------------------------------------
 bool blockchain_storage::have_tx(const crypto::hash &id) const
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  return m_transactions.find(id) != m_transactions.end();
+  return m_transactions.contains(id);
 }
 //------------------------------------------------------------------
 bool blockchain_storage::have_tx_keyimg_as_spent(const crypto::key_image &key_im) const
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  return m_spent_keys.find(key_im) != m_spent_keys.end();
+  return m_spent_keys.contains(key_im);
 }
 //------------------------------------------------------------------
 blockchain_storage::transaction_chain_entry blockchain_storage::get_tx_chain_entry(const crypto::hash &id) const
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  auto it = m_transactions.find(id);
-  if (it == m_transactions.end())
+  transaction_chain_entry res;
+  if (!m_transactions.load(id, res))
     throw std::runtime_error("get_tx_chain_entry: No such tx");
 
-  return it->second;
+  return res;
 }
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_current_blockchain_height() const
@@ -202,9 +202,89 @@ bool blockchain_storage::get_delegate_address(const delegate_id_t& delegate_id,
   return true;
 }
 //------------------------------------------------------------------
+bool blockchain_storage::import_old_blockchain_entries(const std::string& filename)
+{
+  // the old stxxl file is just the packed entries back to back, truncated to the vector's size
+  std::ifstream in(filename, std::ios::binary);
+  CHECK_AND_ASSERT_MES(in, false, "Couldn't open " << filename);
+
+  in.seekg(0, std::ios::end);
+  uint64_t file_size = in.tellg();
+  in.seekg(0, std::ios::beg);
+  CHECK_AND_ASSERT_MES(file_size % sizeof(blockchain_entry) == 0, false,
+                       filename << " has size " << file_size << ", not a multiple of the entry size");
+
+  LOG_PRINT_L0("Importing " << file_size / sizeof(blockchain_entry) << " blockchain entries from " << filename << "...");
+  std::vector<blockchain_entry> buf(1024);
+  for (uint64_t left = file_size / sizeof(blockchain_entry); left > 0; )
+  {
+    size_t n = std::min<uint64_t>(left, buf.size());
+    in.read(reinterpret_cast<char *>(&buf[0]), n * sizeof(blockchain_entry));
+    CHECK_AND_ASSERT_MES(in, false, "Failed to read from " << filename);
+    for (size_t i = 0; i < n; i++)
+      m_pblockchain_entries->push_back(buf[i]);
+    left -= n;
+  }
+  in.close();
+
+  CHECK_AND_ASSERT_MES(m_pblockchain_entries->commit(), false, "Failed to commit imported blockchain entries");
+  boost::system::error_code ec;
+  boost::filesystem::remove(filename, ec);
+  if (ec)
+    LOG_ERROR("Couldn't remove old blockchain entries file " << filename);
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::import_old_ram_state(const old_ram_state& state)
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  
+  LOG_PRINT_L0("Moving " << state.spent_keys.size() << " spent keys to the database...");
+  m_spent_keys_db.clear();
+  m_spent_keys.clear();
+  m_spent_keys.reserve(state.spent_keys.size());
+  std::vector<std::pair<crypto::key_image, bool> > spent_batch;
+  for (const auto& ki : state.spent_keys)
+  {
+    m_spent_keys.insert(ki);
+    spent_batch.push_back(std::make_pair(ki, true));
+    if (spent_batch.size() >= 10000)
+    {
+      m_spent_keys_db.multi_store(spent_batch);
+      spent_batch.clear();
+    }
+  }
+  m_spent_keys_db.multi_store(spent_batch);
+  CHECK_AND_ASSERT_MES(m_spent_keys_db.size() == state.spent_keys.size(), false, "Failed to store spent keys");
+  
+  // the output index is rebuilt from the transactions
+  m_output_positions.clear();
+  m_output_amounts.clear();
+  m_output_amount_ids.clear();
+  for (const auto& item : state.outputs)
+  {
+    m_output_positions[item.first];
+  }
+  m_rebuild_output_index = true;
+  
+  LOG_PRINT_L0("Moving vote histories to the database...");
+  m_vote_histories.clear();
+  std::vector<std::pair<crypto::key_image, vote_history> > votes_batch;
+  for (const auto& item : state.vote_histories)
+  {
+    // older versions kept an empty history for every spent key image
+    if (!item.second.empty())
+      votes_batch.push_back(item);
+  }
+  m_vote_histories.multi_store(votes_batch);
+  
+  return true;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::load_blockchain()
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  wait_for_background_store();
   m_changes_since_store = 0;
   CHECK_AND_ASSERT_MES(tools::create_directories_if_necessary(m_config_folder), false,
                        "Could not create directories when loading blockchain");
@@ -213,43 +293,91 @@ bool blockchain_storage::load_blockchain()
   
   auto path = [&](const std::string& str) { return m_config_folder + "/" + str; };
   
-  // blockchain entries
+  // blockchain entries are mapped in place, the file only ever holds what was last stored
+  if (!m_pblockchain_entries->open(path(CRYPTONOTE_BLOCKCHAINDB_MAPPED_ENTRIES_FILENAME)))
   {
-    // copy blockchain entries on disk to tmp file and associate with that temp file
-    auto new_blockchain_entries_file = path(boost::filesystem::unique_path("blockchain_entries_%%%%-%%%%-%%%%-%%%%.tmp").string());
-    try {
-      boost::filesystem::copy_file(path(CRYPTONOTE_BLOCKCHAINDB_ENTRIES_FILENAME), new_blockchain_entries_file,
-                                   boost::filesystem::copy_option::overwrite_if_exists);
-    } catch (...) {
-      LOG_PRINT_L0("Couldn't copy blockchain_entries file, will have new blockhain entries");
+    LOG_ERROR("load_blockchain(): Couldn't open blockchain entries file");
+    return false;
+  }
+  if (m_pblockchain_entries->empty() && boost::filesystem::exists(path(CRYPTONOTE_BLOCKCHAINDB_ENTRIES_FILENAME)))
+  {
+    if (!import_old_blockchain_entries(path(CRYPTONOTE_BLOCKCHAINDB_ENTRIES_FILENAME)))
+    {
+      LOG_ERROR("load_blockchain(): Couldn't import old blockchain entries file, should start over...");
+      m_pblockchain_entries->clear();
+      return false;
+    }
+  }
+  
+  if (!m_poutput_records->open(path(CRYPTONOTE_BLOCKCHAINDB_MAPPED_OUTPUTS_FILENAME)))
+  {
+    // the records can be built again from the transactions, e.g. if they were stored with an older layout
+    LOG_PRINT_YELLOW("Couldn't open output records file, starting a new one", LOG_LEVEL_0);
+    if (!output_records_container::remove(path(CRYPTONOTE_BLOCKCHAINDB_MAPPED_OUTPUTS_FILENAME)) ||
+        !m_poutput_records->open(path(CRYPTONOTE_BLOCKCHAINDB_MAPPED_OUTPUTS_FILENAME)))
+    {
+      LOG_ERROR("load_blockchain(): Couldn't open output records file");
+      return false;
     }
-    // close existing entries
-    close_blockchain_entries();
-    // open new entries
-    m_blockchain_entries_file = new_blockchain_entries_file;
-    m_pstxxl_file.reset(new stxxl::syscall_file(m_blockchain_entries_file,
-                                                stxxl::file::RDWR | stxxl::file::CREAT));
-    m_pblockchain_entries.reset(new blockchain_entries(m_pstxxl_file.get()));
   }
   
   // re-open all sqlite3_maps to stuff in the folder
   m_blocks_by_hash.reopen(path(CRYPTONOTE_BLOCKCHAINDB_BLOCKS_FILENAME).c_str());
   m_blocks_index.reopen(path(CRYPTONOTE_BLOCKCHAINDB_INDEX_FILENAME).c_str());
   m_transactions.reopen(path(CRYPTONOTE_BLOCKCHAINDB_TXS_FILENAME).c_str());
+  m_spent_keys_db.reopen(path(CRYPTONOTE_BLOCKCHAINDB_SPENT_KEYS_FILENAME).c_str());
+  m_vote_histories.reopen(path(CRYPTONOTE_BLOCKCHAINDB_VOTES_FILENAME).c_str());
   m_alternative_chain_entries.reopen(path(CRYPTONOTE_BLOCKCHAINDB_ALT_ENTRIES_FILENAME).c_str());
   m_invalid_block_entries.reopen(path(CRYPTONOTE_BLOCKCHAINDB_INVALID_ENTRIES_FILENAME).c_str());
   m_cached_block_fees.clear();
   
-  // load the rest: spent keys, outputs, etc.
-  if (!tools::unserialize_obj_from_file(*this, path(CRYPTONOTE_BLOCKCHAINDATA_FILENAME))) {
-    LOG_ERROR("load_blockchain(): Couldn't unserialize from file, should start over...");
+  std::string data;
+  if (!epee::file_io_utils::load_file_to_string(path(CRYPTONOTE_BLOCKCHAINDATA_FILENAME), data)) {
+    LOG_ERROR("load_blockchain(): Couldn't read blockchain data file, should start over...");
     return false;
   }
   
-  if (m_v15_ram_converter.requires_conversion) {
+  // spent key lookups go through an in-memory set. the last foreground store saved it, if nothing was
+  // stored since then it can be used as is, otherwise build it from the database
+  if (!m_spent_keys.load_from_file(path(CRYPTONOTE_BLOCKCHAINDB_SPENT_KEY_SET_FILENAME), spent_key_set_stamp(data)))
+  {
+    LOG_PRINT_L0("Building spent key set from the database...");
+    m_spent_keys.clear();
+    m_spent_keys.reserve(m_spent_keys_db.size());
+    for (auto it = m_spent_keys_db.begin(); it != m_spent_keys_db.end(); ++it)
+    {
+      m_spent_keys.insert(it->first);
+    }
+  }
+  
+  // load the rest: output amounts, currencies, delegates, etc.
+  m_rebuild_output_index = false;
+  try
+  {
+    tools::buffer_view_streambuf buf(data.data(), data.size());
+    boost::archive::binary_iarchive a(buf);
+    a >> *this;
+  }
+  catch (const std::exception& e)
+  {
+    LOG_ERROR("load_blockchain(): Couldn't unserialize from file, should start over... " << e.what());
+    return false;
+  }
+  
+  bool converted = m_v15_ram_converter.requires_conversion;
+  if (converted) {
     if (!m_v15_ram_converter.process_conversion()) {
       throw std::runtime_error("old->new blockchain conversion failed! report error to the developer. delete blockchain.bin to start sync from scratch");
     }
+  }
+  
+  // index the output records, or build them again if they don't go with the rest
+  if (!rebuild_output_index()) {
+    LOG_ERROR("load_blockchain(): Couldn't build output index, should start over...");
+    return false;
+  }
+  
+  if (converted) {
     // store right away so don't have to convert again
     LOG_PRINT_YELLOW("Storing blockchain to finalize conversion...", LOG_LEVEL_0);
     if (!store_blockchain()) {
@@ -309,12 +437,117 @@ bool blockchain_storage::init(const std::string& config_folder)
 }
 //------------------------------------------------------------------
 bool blockchain_storage::store_blockchain()
+{
+  while (true)
+  {
+    // don't hold up block processing while a background store finishes
+    wait_for_background_store();
+    
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    if (m_store_in_progress)
+      continue; // another one started in between
+    
+    // nothing reads the indices while the lock is held, so their logs can be emptied
+    store_snapshot snapshot;
+    if (!take_store_snapshot(snapshot, sqlite3::CHECKPOINT_TRUNCATE) || !write_store_snapshot(snapshot))
+    {
+      ++m_failed_stores;
+      return false;
+    }
+    m_failed_stores = 0;
+    
+    // the spent key set changes as soon as the lock is released, so only foreground stores save it.
+    // it's tied to this blockchain.bin, after a later background store it's built from the database again
+    LOG_PRINT_L0("Storing spent key set...");
+    if (!m_spent_keys.store_to_file(m_config_folder + "/" + CRYPTONOTE_BLOCKCHAINDB_SPENT_KEY_SET_FILENAME,
+                                    spent_key_set_stamp(snapshot.data)))
+    {
+      LOG_ERROR("Failed to store spent key set, it will be built from the database on the next start");
+    }
+    return true;
+  }
+}
+//------------------------------------------------------------------
+// the blockchain data alone can come out the same after a reorg, the top block pins down the spent keys
+crypto::hash blockchain_storage::spent_key_set_stamp(const std::string& data) const
+{
+  std::string buf = data;
+  crypto::hash top_id = get_tail_id();
+  buf.append(reinterpret_cast<const char *>(&top_id), sizeof(top_id));
+  return crypto::cn_fast_hash(buf.data(), buf.size());
+}
+//------------------------------------------------------------------
+bool blockchain_storage::store_blockchain_in_background()
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  
+  // leave m_changes_since_store alone so a later block tries again
+  if (m_store_in_progress)
+  {
+    LOG_PRINT_L1("Previous blockchain store still running, storing later");
+    return false;
+  }
+  
+  boost::unique_lock<boost::mutex> thread_lock(m_store_thread_lock, boost::try_to_lock);
+  if (!thread_lock.owns_lock())
+  {
+    LOG_PRINT_L1("Blockchain store being waited for, storing later");
+    return false;
+  }
+  
+  // passive checkpoints can keep failing while the indices are read, which lets their logs grow.
+  // after a few in a row store in the foreground, where the logs can be emptied
+  if (m_failed_stores >= BLOCKCHAIN_BACKGROUND_STORE_MAX_FAILURES)
+  {
+    LOG_PRINT_RED_L0("Last " << m_failed_stores << " blockchain stores failed, storing in the foreground");
+    thread_lock.unlock();
+    return store_blockchain();
+  }
+  
+  // already done, the thread clears m_store_in_progress last
+  if (m_store_thread.joinable())
+    m_store_thread.join();
+  
+  auto psnapshot = std::make_shared<store_snapshot>();
+  if (!take_store_snapshot(*psnapshot, sqlite3::CHECKPOINT_PASSIVE))
+  {
+    ++m_failed_stores;
+    return false;
+  }
+  
+  m_store_in_progress = true;
+  m_store_thread = boost::thread([this, psnapshot]() {
+    if (write_store_snapshot(*psnapshot))
+    {
+      m_failed_stores = 0;
+    }
+    else
+    {
+      ++m_failed_stores;
+      LOG_PRINT_RED_L0("Background blockchain store failed (" << m_failed_stores << " in a row)");
+    }
+    m_store_in_progress = false;
+  });
+  return true;
+}
+//------------------------------------------------------------------
+void blockchain_storage::wait_for_background_store()
+{
+  boost::lock_guard<boost::mutex> thread_lock(m_store_thread_lock);
+  if (m_store_thread.joinable())
+    m_store_thread.join();
+}
+//------------------------------------------------------------------
+bool blockchain_storage::take_store_snapshot(store_snapshot& snapshot, sqlite3::checkpoint_mode checkpoint_mode)
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   
   CHECK_AND_ASSERT_MES(!m_v15_ram_converter.requires_conversion, false,
                        "Can't store unconverted blockchain");
   
+  // the previous store has to be durable before this one writes on top of it
+  CHECK_AND_ASSERT_MES(!m_store_in_progress, false, "Previous blockchain store still running");
+  
   m_changes_since_store = 0;
   m_is_blockchain_storing = true;
   misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler([&](){m_is_blockchain_storing=false;});
@@ -332,45 +565,26 @@ bool blockchain_storage::store_blockchain()
   }
 
   // serialize blockchain data first
-  LOG_PRINT_L0("Storing blockchain data to tmp file...");
-  const std::string temp_filename = m_config_folder + "/" + CRYPTONOTE_BLOCKCHAINDATA_TEMP_FILENAME;
-  // There is a chance that temp_filename and filename are hardlinks to the same file
-  std::remove(temp_filename.c_str());
-  // save to temporary file in case something goes wrong
-  if(!tools::serialize_obj_to_file(*this, temp_filename))
+  try
   {
-    //achtung!
-    LOG_ERROR("Failed to save blockchain data to file: " << temp_filename);
+    snapshot.data = tools::boost_serialize_to_string(*this);
+  }
+  catch (const std::exception& e)
+  {
+    LOG_ERROR("Failed to serialize blockchain data: " << e.what());
     return false;
   }
   
-  // flush entries and copy where it's on disk to the target - shouldn't fail
-  LOG_PRINT_L0("Storing blockchain entries...");
-  m_pblockchain_entries->flush();
-  
+  // copy the entries and outputs added since the last store into their files - shouldn't fail
+  if (!m_pblockchain_entries->write_tail())
   {
-    // temporarily close it to make sure everything is written or whatever
-    m_pblockchain_entries.reset(nullptr);
-    m_pstxxl_file.reset(nullptr);
-
-    // copy the file
-    bool success;
-    try {
-      boost::filesystem::copy_file(m_blockchain_entries_file, m_config_folder + "/" + CRYPTONOTE_BLOCKCHAINDB_ENTRIES_FILENAME,
-                                   boost::filesystem::copy_option::overwrite_if_exists);
-      success = true;
-    } catch (...) {
-      LOG_ERROR("Failed to copy blockchain entries to destination");
-      success = false;
-    }
-    
-    // re-open it as it was
-    m_pstxxl_file.reset(new stxxl::syscall_file(m_blockchain_entries_file, stxxl::file::RDWR));
-    m_pblockchain_entries.reset(new blockchain_entries(m_pstxxl_file.get()));
-    
-    if (!success) {
-      return false;
-    }
+    LOG_ERROR("Failed to store blockchain entries");
+    return false;
+  }
+  if (!m_poutput_records->write_tail())
+  {
+    LOG_ERROR("Failed to store output records");
+    return false;
   }
   
   // commit the sqlite3 maps - shouldn't fail. if some of these work but not others it
@@ -379,8 +593,70 @@ bool blockchain_storage::store_blockchain()
   m_blocks_by_hash.commit();
   m_blocks_index.commit();
   m_transactions.commit();
+  m_spent_keys_db.commit();
+  m_vote_histories.commit();
   m_alternative_chain_entries.commit();
   m_invalid_block_entries.commit();
+  
+  snapshot.checkpoint_mode = checkpoint_mode;
+  snapshot.db_filenames.clear();
+  snapshot.db_filenames.push_back(m_blocks_by_hash.filename());
+  snapshot.db_filenames.push_back(m_blocks_index.filename());
+  snapshot.db_filenames.push_back(m_transactions.filename());
+  snapshot.db_filenames.push_back(m_spent_keys_db.filename());
+  snapshot.db_filenames.push_back(m_vote_histories.filename());
+  snapshot.db_filenames.push_back(m_alternative_chain_entries.filename());
+  snapshot.db_filenames.push_back(m_invalid_block_entries.filename());
+  
+  return true;
+}
+//------------------------------------------------------------------
+// doesn't touch anything the next snapshot changes, so it runs without the blockchain lock.
+// blockchain.bin is only replaced once everything it refers to is on disk.
+bool blockchain_storage::write_store_snapshot(const store_snapshot& snapshot)
+{
+  LOG_PRINT_L0("Storing blockchain data to tmp file...");
+  const std::string temp_filename = m_config_folder + "/" + CRYPTONOTE_BLOCKCHAINDATA_TEMP_FILENAME;
+  // There is a chance that temp_filename and filename are hardlinks to the same file
+  std::remove(temp_filename.c_str());
+  // save to temporary file in case something goes wrong
+  if (!epee::file_io_utils::save_string_to_file(temp_filename, snapshot.data))
+  {
+    //achtung!
+    LOG_ERROR("Failed to save blockchain data to file: " << temp_filename);
+    return false;
+  }
+  
+  LOG_PRINT_L0("Syncing blockchain entries...");
+  if (!m_pblockchain_entries->sync())
+  {
+    LOG_ERROR("Failed to sync blockchain entries");
+    return false;
+  }
+  if (!m_poutput_records->sync())
+  {
+    LOG_ERROR("Failed to sync output records");
+    return false;
+  }
+  
+  LOG_PRINT_L0("Checkpointing indices...");
+  try
+  {
+    BOOST_FOREACH(const auto& db_filename, snapshot.db_filenames)
+    {
+      // the part left in the log isn't synced, so the old blockchain.bin has to stay
+      if (!sqlite3::checkpoint_file(db_filename, snapshot.checkpoint_mode))
+      {
+        LOG_ERROR("Failed to checkpoint all of " << db_filename << ", keeping previous blockchain data file");
+        return false;
+      }
+    }
+  }
+  catch (const std::exception& e)
+  {
+    LOG_ERROR("Failed to checkpoint indices: " << e.what());
+    return false;
+  }
 
   LOG_PRINT_L0("Replacing main file...");
   // replace main file - if this fails we are screwed
@@ -398,7 +674,6 @@ bool blockchain_storage::store_blockchain()
 //------------------------------------------------------------------
 bool blockchain_storage::deinit()
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
   m_stop_catchup = true;
   
   return store_blockchain();
@@ -431,7 +706,7 @@ bool blockchain_storage::pop_block_from_blockchain()
   // undo missing delegate block stats
   if (m_pblockchain_entries->size() > 2)
   {
-    block block_prev = get_block_by_hash(m_pblockchain_entries->end()[-2].hash);
+    block block_prev = get_block_by_hash((*m_pblockchain_entries)[m_pblockchain_entries->size() - 2].hash);
     if (is_pos_block(bl) && is_pos_block(block_prev)) // skip for non-pos and first pos block
     {
       uint64_t seconds_since_prev = bl.timestamp - block_prev.timestamp;
@@ -474,10 +749,14 @@ void blockchain_storage::reset()
   m_blocks_by_hash.clear();
   m_blocks_index.clear();
   m_transactions.clear();
+  m_poutput_records->clear();
+  m_spent_keys_db.clear();
   m_spent_keys.clear();
   m_alternative_chain_entries.clear();
   m_invalid_block_entries.clear();
-  m_outputs.clear();
+  m_output_positions.clear();
+  m_output_amounts.clear();
+  m_output_amount_ids.clear();
   m_currencies.clear();
   m_contracts.clear();
   m_used_currency_descriptions.clear();
@@ -509,19 +788,18 @@ namespace bs_visitor_detail {
     bool operator()(const txin_to_key& inp) const
     {
       //const crypto::key_image& ki = inp.k_image;
-      auto r = b.m_spent_keys.find(inp.k_image);
-      if (r == b.m_spent_keys.end())
+      if (b.m_spent_keys.erase(inp.k_image) == 0)
       {
         LOG_ERROR("purge_transaction_data_from_blockchain: key image in transaction not found");
         return false;
       }
-      
-      b.m_spent_keys.erase(r);
+      b.m_spent_keys_db.erase(inp.k_image);
       
       // re-do votes from this key_image if there were any
-      if (!b.m_vote_histories[inp.k_image].empty())
+      const auto hist = b.get_vote_history(inp.k_image);
+      if (!hist.empty())
       {
-        CHECK_AND_ASSERT_MES(b.reapply_votes(b.m_vote_histories[inp.k_image].back()), false,
+        CHECK_AND_ASSERT_MES(b.reapply_votes(hist.back()), false,
                              "purge_transaction_data_from_blockchain: could not re-apply key image votes");
       }
       
@@ -715,16 +993,17 @@ namespace bs_visitor_detail {
     
     bool operator()(const txin_vote& inp) const
     {
-      if (b.m_vote_histories[inp.ink.k_image].empty())
+      auto hist = b.get_vote_history(inp.ink.k_image);
+      if (hist.empty())
       {
         LOG_ERROR("purge_block_data_from_blockchain: vote histories contain no votes for " << inp.ink.k_image);
         return false;
       }
       
-      CHECK_AND_ASSERT_MES(inp.seq == b.m_vote_histories[inp.ink.k_image].size() - 1, false,
+      CHECK_AND_ASSERT_MES(inp.seq == hist.size() - 1, false,
                            "purge_block_data_from_blockchain: inp.seq/vote_history size mismach");
         
-      const auto& latest_votes_inst = b.m_vote_histories[inp.ink.k_image].back();
+      const auto& latest_votes_inst = hist.back();
       CHECK_AND_ASSERT_MES(latest_votes_inst.expected_vote == inp.ink.amount, false,
                            "purge_block_data_from_blockchain: vote amount doesn't match recorded amount");
       
@@ -752,12 +1031,13 @@ namespace bs_visitor_detail {
                            "purge_block_data_from_blockchain: could not undo votes");
       
       // remove the vote history
-      b.m_vote_histories[inp.ink.k_image].pop_back();
+      hist.pop_back();
+      b.set_vote_history(inp.ink.k_image, hist);
       
       // re-apply the vote history before it
-      if (!b.m_vote_histories[inp.ink.k_image].empty())
+      if (!hist.empty())
       {
-        CHECK_AND_ASSERT_MES(b.reapply_votes(b.m_vote_histories[inp.ink.k_image].back()), false,
+        CHECK_AND_ASSERT_MES(b.reapply_votes(hist.back()), false,
                              "purge_block_data_from_blockchain: could not reapply previous votes");
       }
       
@@ -911,14 +1191,7 @@ bool blockchain_storage::get_block_by_hash(const crypto::hash &h, block &blk) co
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   
-  auto it = m_blocks_by_hash.find(h);
-  
-  if (it == m_blocks_by_hash.end()) {
-    return false;
-  }
-  
-  blk = it->second;
-  return true;
+  return m_blocks_by_hash.load(h, blk);
 }
 //------------------------------------------------------------------
 block blockchain_storage::get_block_by_hash(const crypto::hash& h) const
@@ -931,6 +1204,22 @@ block blockchain_storage::get_block_by_hash(const crypto::hash& h) const
   return res;
 }
 //------------------------------------------------------------------
+bool blockchain_storage::get_blocks_by_hash(const std::vector<crypto::hash>& hashes, std::list<block>& blocks) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  
+  std::vector<block> loaded;
+  std::vector<bool> found;
+  m_blocks_by_hash.multi_load(hashes, loaded, found);
+  
+  for (size_t i=0; i < hashes.size(); i++)
+  {
+    CHECK_AND_ASSERT_MES(found[i], false, "No block by hash " << hashes[i]);
+    blocks.push_back(std::move(loaded[i]));
+  }
+  return true;
+}
+//------------------------------------------------------------------
 void blockchain_storage::get_all_known_block_ids(std::list<crypto::hash> &main, std::list<crypto::hash> &alt,
                                                  std::list<crypto::hash> &invalid) const
 {
@@ -1248,10 +1537,22 @@ bool blockchain_storage::create_block_template(block& b, const account_public_ad
 
   CRITICAL_REGION_END();
 
+  // the pool keeps its tx pick for the tip up to date itself
   size_t txs_size;
   if (!m_tx_pool.fill_block_template(b, median_size, already_generated_coins, txs_size, fee_pow)) {
     return false;
   }
+
+  CRITICAL_REGION_LOCAL1(m_template_cache_lock);
+  block_template_cache& tc = m_template_cache;
+  bool same_txs = tc.prev_id == b.prev_id && tc.median_size == median_size && tc.tx_hashes == b.tx_hashes;
+  if (!same_txs)
+  {
+    tc.prev_id = b.prev_id;
+    tc.median_size = median_size;
+    tc.tx_hashes = b.tx_hashes;
+    tc.has_miner_tx = false;
+  }
   
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
   size_t real_txs_size = 0;
@@ -1298,6 +1599,30 @@ bool blockchain_storage::create_block_template(block& b, const account_public_ad
                                               b.timestamp, b.signing_delegate_id),
                          false, "Could not get_signing_delegate");
   }
+  // same txs, reward and payout make the same miner tx
+  if (same_txs && tc.has_miner_tx && tc.miner_fee == fee && tc.miner_address == miner_address && tc.ex_nonce == ex_nonce)
+  {
+    b.miner_tx = tc.miner_tx;
+    return true;
+  }
+  
+  if (!construct_block_template_miner_tx(b, height, median_size, already_generated_coins, txs_size, fee,
+                                         miner_address, ex_nonce))
+    return false;
+  
+  tc.has_miner_tx = true;
+  tc.miner_fee = fee;
+  tc.miner_address = miner_address;
+  tc.ex_nonce = ex_nonce;
+  tc.miner_tx = b.miner_tx;
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::construct_block_template_miner_tx(block& b, uint64_t height, size_t median_size,
+                                                           uint64_t already_generated_coins, size_t txs_size,
+                                                           uint64_t fee, const account_public_address& miner_address,
+                                                           const blobdata& ex_nonce) const
+{
   /*
      two-phase miner transaction generation: we don't know exact block size until we prepare block, but we don't know reward until we know
      block size, so first miner transaction generated with fake amount of money, and with phase we know think we know expected block size
@@ -1332,10 +1657,12 @@ bool blockchain_storage::create_block_template(block& b, const account_public_ad
         " is less then before, adding " << delta << " zero bytes");
 #endif
       b.miner_tx.extra.insert(b.miner_tx.extra.end(), delta, 0);
+      b.miner_tx.invalidate_hashes();
       //here  could be 1 byte difference, because of extra field counter is varint, and it can become from 1-byte len to 2-bytes len.
       if (cumulative_size != txs_size + get_object_blobsize(b.miner_tx)) {
         CHECK_AND_ASSERT_MES(cumulative_size + 1 == txs_size + get_object_blobsize(b.miner_tx), false, "unexpected case: cumulative_size=" << cumulative_size << " + 1 is not equal txs_cumulative_size=" << txs_size << " + get_object_blobsize(b.miner_tx)=" << get_object_blobsize(b.miner_tx));
         b.miner_tx.extra.resize(b.miner_tx.extra.size() - 1);
+        b.miner_tx.invalidate_hashes();
         if (cumulative_size != txs_size + get_object_blobsize(b.miner_tx)) {
           //fuck, not lucky, -1 makes varint-counter size smaller, in that case we continue to grow with cumulative_size
           LOG_PRINT_RED("Miner tx creation have no luck with delta_extra size = " << delta << " and " << delta - 1 , LOG_LEVEL_2);
@@ -1543,15 +1870,26 @@ bool blockchain_storage::get_blocks(uint64_t start_offset, size_t count,
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   if(start_offset >= m_pblockchain_entries->size())
     return false;
+  
+  std::vector<crypto::hash> block_ids;
   for(size_t i = start_offset; i < start_offset + count && i < m_pblockchain_entries->size();i++)
   {
-    auto bl = get_block_by_hash((*m_pblockchain_entries)[i].hash);
-    blocks.push_back(bl);
-    std::list<crypto::hash> missed_ids;
-    get_transactions(bl.tx_hashes, txs, missed_ids);
-    CHECK_AND_ASSERT_MES(!missed_ids.size(), false, "have missed transactions in own block in main blockchain");
+    block_ids.push_back((*m_pblockchain_entries)[i].hash);
   }
-
+  
+  std::list<block> new_blocks;
+  CHECK_AND_ASSERT_MES(get_blocks_by_hash(block_ids, new_blocks), false, "failed to load blocks in main blockchain");
+  
+  std::vector<crypto::hash> tx_ids;
+  BOOST_FOREACH(const auto& bl, new_blocks)
+  {
+    tx_ids.insert(tx_ids.end(), bl.tx_hashes.begin(), bl.tx_hashes.end());
+  }
+  std::list<crypto::hash> missed_ids;
+  get_transactions(tx_ids, txs, missed_ids);
+  CHECK_AND_ASSERT_MES(!missed_ids.size(), false, "have missed transactions in own block in main blockchain");
+  
+  blocks.splice(blocks.end(), new_blocks);
   return true;
 }
 //------------------------------------------------------------------
@@ -1561,9 +1899,36 @@ bool blockchain_storage::get_blocks(uint64_t start_offset, size_t count, std::li
   if(start_offset >= m_pblockchain_entries->size())
     return false;
 
+  std::vector<crypto::hash> block_ids;
   for(size_t i = start_offset; i < start_offset + count && i < m_pblockchain_entries->size();i++)
   {
-    blocks.push_back(get_block_by_hash((*m_pblockchain_entries)[i].hash));
+    block_ids.push_back((*m_pblockchain_entries)[i].hash);
+  }
+  return get_blocks_by_hash(block_ids, blocks);
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_main_chain_block_ids(const std::list<crypto::hash>& block_ids,
+                                                  std::vector<crypto::hash>& found_ids,
+                                                  std::list<crypto::hash>& missed_bs) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  std::vector<crypto::hash> requested_ids(block_ids.begin(), block_ids.end());
+  std::vector<size_t> heights;
+  std::vector<bool> found;
+  m_blocks_index.multi_load(requested_ids, heights, found);
+  
+  for (size_t i=0; i < requested_ids.size(); i++)
+  {
+    const auto& bl_id = requested_ids[i];
+    if(!found[i])
+      missed_bs.push_back(bl_id);
+    else
+    {
+      CHECK_AND_ASSERT_MES(heights[i] < m_pblockchain_entries->size(), false, "Internal error: bl_id=" << epee::string_tools::pod_to_hex(bl_id)
+        << " have index record with offset="<<heights[i]<< ", bigger then m_pblockchain_entries->size()=" << m_pblockchain_entries->size());
+      found_ids.push_back((*m_pblockchain_entries)[heights[i]].hash);
+    }
   }
   return true;
 }
@@ -1574,16 +1939,105 @@ bool blockchain_storage::get_blocks(const std::list<crypto::hash>& block_ids,
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  BOOST_FOREACH(const auto& bl_id, block_ids)
+  std::vector<crypto::hash> found_ids;
+  CHECK_AND_ASSERT(get_main_chain_block_ids(block_ids, found_ids, missed_bs), false);
+  return get_blocks_by_hash(found_ids, blocks);
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_block_blobs_by_hash(const std::vector<crypto::hash>& hashes,
+                                                 std::vector<blobdata>& blobs) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  
+  blobs.clear();
+  blobs.resize(hashes.size());
+  std::vector<bool> found(hashes.size(), false);
+  bool ok = true;
+  m_blocks_by_hash.multi_visit(hashes, [&](size_t i, const char *data, size_t size) {
+    found[i] = block_blob_from_db(data, size, blobs[i]);
+    ok = ok && found[i];
+  });
+  
+  for (size_t i=0; i < hashes.size(); i++)
   {
-    auto it = m_blocks_index.find(bl_id);
-    if(it == m_blocks_index.end())
-      missed_bs.push_back(bl_id);
+    CHECK_AND_ASSERT_MES(found[i], false, "No block blob by hash " << hashes[i]);
+  }
+  return ok;
+}
+//------------------------------------------------------------------
+void blockchain_storage::load_tx_blobs(const std::vector<crypto::hash>& txs_ids, std::vector<blobdata>& blobs,
+                                       std::vector<bool>& found) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  
+  blobs.clear();
+  blobs.resize(txs_ids.size());
+  found.assign(txs_ids.size(), false);
+  m_transactions.multi_visit(txs_ids, [&](size_t i, const char *data, size_t size) {
+    found[i] = tx_blob_from_db(data, size, blobs[i]);
+  });
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_transaction_blobs(const std::vector<crypto::hash>& txs_ids,
+                                               std::list<blobdata>& txs,
+                                               std::list<crypto::hash>& missed_txs) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  
+  std::vector<blobdata> blobs;
+  std::vector<bool> found;
+  load_tx_blobs(txs_ids, blobs, found);
+  
+  for (size_t i=0; i < txs_ids.size(); i++)
+  {
+    if (found[i])
+    {
+      txs.push_back(std::move(blobs[i]));
+      continue;
+    }
+    
+    transaction tx;
+    if (m_tx_pool.get_transaction(txs_ids[i], tx))
+      txs.push_back(tx_to_blob(tx));
     else
+      missed_txs.push_back(txs_ids[i]);
+  }
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_block_complete_entries(const std::vector<crypto::hash>& block_ids,
+                                                    std::list<block_complete_entry>& entries) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  
+  std::vector<blobdata> block_blobs;
+  CHECK_AND_ASSERT(get_block_blobs_by_hash(block_ids, block_blobs), false);
+  
+  // only need the blocks for their tx hashes
+  std::vector<crypto::hash> tx_ids;
+  std::vector<size_t> tx_counts;
+  BOOST_FOREACH(const auto& blob, block_blobs)
+  {
+    block bl;
+    CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(blob, bl), false, "Internal error: failed to parse stored block");
+    tx_ids.insert(tx_ids.end(), bl.tx_hashes.begin(), bl.tx_hashes.end());
+    tx_counts.push_back(bl.tx_hashes.size());
+  }
+  
+  std::vector<blobdata> tx_blobs;
+  std::vector<bool> found;
+  load_tx_blobs(tx_ids, tx_blobs, found);
+  
+  size_t tx_i = 0;
+  for (size_t i=0; i < block_blobs.size(); i++)
+  {
+    entries.push_back(block_complete_entry());
+    block_complete_entry& e = entries.back();
+    e.block = std::move(block_blobs[i]);
+    for (size_t j=0; j < tx_counts[i]; j++, tx_i++)
     {
-      CHECK_AND_ASSERT_MES(it->second < m_pblockchain_entries->size(), false, "Internal error: bl_id=" << epee::string_tools::pod_to_hex(bl_id)
-        << " have index record with offset="<<it->second<< ", bigger then m_pblockchain_entries->size()=" << m_pblockchain_entries->size());
-        blocks.push_back(get_block_by_hash((*m_pblockchain_entries)[it->second].hash));
+      CHECK_AND_ASSERT_MES(found[tx_i], false, "Internal error: transaction " << tx_ids[tx_i] << " from block not found");
+      e.txs.push_back(std::move(tx_blobs[tx_i]));
     }
   }
   return true;
@@ -1594,14 +2048,37 @@ bool blockchain_storage::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request&
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   rsp.current_blockchain_height = get_current_blockchain_height();
-  std::list<block> blocks;
-  get_blocks(arg.blocks, blocks, rsp.missed_ids);
+  
+  // blocks and txs are sent as they're stored, they're only parsed to find the tx hashes and heights
+  std::vector<crypto::hash> block_ids;
+  get_main_chain_block_ids(arg.blocks, block_ids, rsp.missed_ids);
+  std::vector<blobdata> block_blobs;
+  CHECK_AND_ASSERT_MES(get_block_blobs_by_hash(block_ids, block_blobs), false, "Internal error: failed to load blocks");
+  
+  std::vector<block> blocks(block_blobs.size());
+  std::vector<crypto::hash> block_tx_ids;
+  for (size_t i=0; i < block_blobs.size(); i++)
+  {
+    CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(block_blobs[i], blocks[i]), false,
+                         "Internal error: failed to parse stored block " << block_ids[i]);
+    block_tx_ids.insert(block_tx_ids.end(), blocks[i].tx_hashes.begin(), blocks[i].tx_hashes.end());
+  }
+  
+  // load the transactions of all the blocks at once
+  std::vector<blobdata> block_tx_blobs;
+  std::vector<bool> block_txs_found;
+  load_tx_blobs(block_tx_ids, block_tx_blobs, block_txs_found);
+  size_t block_tx_i = 0;
 
   bool no_more_blocks = false;
   
-  BOOST_FOREACH(const auto& bl, blocks)
+  for (size_t bl_i=0; bl_i < blocks.size(); bl_i++)
   {
-    crypto::hash block_id = get_block_hash(bl);
+    const block& bl = blocks[bl_i];
+    size_t bl_tx_start = block_tx_i;
+    block_tx_i += bl.tx_hashes.size();
+    
+    const crypto::hash& block_id = block_ids[bl_i];
    
     //pack signed hashes
     crypto::hash_cache::signed_hash_entry sigent;
@@ -1616,26 +2093,29 @@ bool blockchain_storage::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request&
       continue;
     }
     
-    std::list<crypto::hash> missed_tx_id;
-    std::list<transaction> txs;
-    get_transactions(bl.tx_hashes, txs, rsp.missed_ids);
-    CHECK_AND_ASSERT_MES(!missed_tx_id.size(), false, "Internal error: have missed missed_tx_id.size()=" << missed_tx_id.size()
-      << ENDL << "for block id = " << block_id);
     rsp.blocks.push_back(block_complete_entry());
     block_complete_entry& e = rsp.blocks.back();
     //pack block
-    e.block = t_serializable_object_to_blob(bl);
+    e.block = std::move(block_blobs[bl_i]);
     //pack transactions
-    BOOST_FOREACH(transaction& tx, txs)
-      e.txs.push_back(t_serializable_object_to_blob(tx));
+    for (size_t i = bl_tx_start; i < block_tx_i; i++)
+    {
+      if (block_txs_found[i])
+      {
+        e.txs.push_back(std::move(block_tx_blobs[i]));
+        continue;
+      }
+      
+      transaction tx;
+      if (m_tx_pool.get_transaction(block_tx_ids[i], tx))
+        e.txs.push_back(t_serializable_object_to_blob(tx));
+      else
+        rsp.missed_ids.push_back(block_tx_ids[i]);
+    }
   }
   //get another transactions, if need
-  std::list<transaction> txs;
   // stupid conversion needed from list to vector
-  get_transactions(std::vector<crypto::hash>(arg.txs.begin(), arg.txs.end()), txs, rsp.missed_ids);
-  //pack aside transactions
-  BOOST_FOREACH(const auto& tx, txs)
-    rsp.txs.push_back(t_serializable_object_to_blob(tx));
+  get_transaction_blobs(std::vector<crypto::hash>(arg.txs.begin(), arg.txs.end()), rsp.txs, rsp.missed_ids);
   //pack extra signed hashes
   BOOST_FOREACH(const auto& block_id, arg.signed_hashes)
   {
@@ -1666,87 +2146,79 @@ size_t blockchain_storage::get_alternative_blocks_count() const
   return m_alternative_chain_entries.size();
 }
 //------------------------------------------------------------------
-bool blockchain_storage::add_out_to_get_random_outs(const std::vector<std::pair<crypto::hash, size_t> >& amount_outs,
+bool blockchain_storage::add_out_to_get_random_outs(coin_type type,
                                                     COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs,
                                                     uint64_t amount, size_t i) const
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  const auto tx_it = m_transactions.find(amount_outs[i].first);
-  CHECK_AND_ASSERT_MES(tx_it != m_transactions.end(), false, "internal error: transaction with id " << amount_outs[i].first << ENDL <<
-    ", used in mounts global index for amount=" << amount << ": i=" << i << "not found in transactions index");
-  CHECK_AND_ASSERT_MES(tx_it->second.tx.outs().size() > amount_outs[i].second, false, "internal error: in global outs index, transaction out index="
-    << amount_outs[i].second << " more than transaction outputs = " << tx_it->second.tx.outs().size() << ", for tx id = " << amount_outs[i].first);
-  const auto& tx = tx_it->second.tx;
-  CHECK_AND_ASSERT_MES(tx.outs()[amount_outs[i].second].target.type() == typeid(txout_to_key), false, "unknown tx out type");
+  output_record rec;
+  CHECK_AND_ASSERT_MES(get_output_record(type, amount, i, rec), false, "internal error: output record for amount="
+    << amount << ", i=" << i << " not found in output records");
 
   //check if transaction is unlocked
-  if(!is_tx_spendtime_unlocked(tx.unlock_time))
+  if(!is_tx_spendtime_unlocked(rec.unlock_time))
     return false;
 
   COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry& oen = *result_outs.outs.insert(result_outs.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry());
   oen.global_amount_index = i;
-  oen.out_key = boost::get<txout_to_key>(tx.outs()[amount_outs[i].second].target).key;
+  oen.out_key = rec.key;
   return true;
 }
 //------------------------------------------------------------------
-size_t blockchain_storage::find_end_of_allowed_index(const std::vector<std::pair<crypto::hash, size_t> >& amount_outs) const
+size_t blockchain_storage::find_end_of_allowed_index(coin_type type, uint64_t amount, size_t outs_count) const
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  if(!amount_outs.size())
+  auto it = m_output_positions.find(std::make_pair(type, amount));
+  if(it == m_output_positions.end())
     return 0;
-  size_t i = amount_outs.size();
-  do
-  {
-    --i;
-    const auto it = m_transactions.find(amount_outs[i].first);
-    CHECK_AND_ASSERT_MES(it != m_transactions.end(), 0, "internal error: failed to find transaction from outputs index with tx_id=" << amount_outs[i].first);
-    if(it->second.m_keeper_block_height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW <= get_current_blockchain_height() )
-      return i+1;
-  } while (i != 0);
-  return 0;
+  CHECK_AND_ASSERT_MES(outs_count <= it->second.size(), 0, "internal error: outs_count=" << outs_count
+    << " for amount=" << amount << " is more than the " << it->second.size() << " outputs known");
+
+  // an amount's outputs are created in chain order, so the old enough ones are a prefix
+  uint64_t height = get_current_blockchain_height();
+  auto end = std::partition_point(it->second.begin(), it->second.begin() + outs_count, [&](uint64_t position) {
+    return (*m_poutput_records)[position].keeper_block_height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW <= height;
+  });
+  return end - it->second.begin();
 }
 //------------------------------------------------------------------
 bool blockchain_storage::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req,
                                                      COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res) const
 {
-  srand(static_cast<unsigned int>(get_adjusted_time()));
   coin_type typ = CP_XPB; //res.type = req.type;
+  decoy_sampler sampler;
   
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   BOOST_FOREACH(uint64_t amount, req.amounts)
   {
     COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs = *res.outs.insert(res.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount());
     result_outs.amount = amount;
-    auto it = m_outputs.find(std::make_pair(typ /*req.type*/, amount));
-    if(it == m_outputs.end())
+    auto it = m_output_positions.find(std::make_pair(typ /*req.type*/, amount));
+    if(it == m_output_positions.end())
     {
       LOG_ERROR("COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS: not outs for amount " << amount << ", wallet should use some real outs when it lookup for some mix, so, at least one out for this amount should exist");
       continue;//actually this is strange situation, wallet should use some real outs when it lookup for some mix, so, at least one out for this amount should exist
     }
-    const auto & amount_outs  = it->second;
+    uint64_t amount_outs_count = it->second.size();
     //it is not good idea to use top fresh outs, because it increases possibility of transaction canceling on split
     //lets find upper bound of not fresh outs
-    size_t up_index_limit = find_end_of_allowed_index(amount_outs);
-    CHECK_AND_ASSERT_MES(up_index_limit <= amount_outs.size(), false, "internal error: find_end_of_allowed_index returned wrong index=" << up_index_limit << ", with amount_outs.size = " << amount_outs.size());
-    if(amount_outs.size() > req.outs_count)
+    size_t up_index_limit = find_end_of_allowed_index(typ, amount, amount_outs_count);
+    CHECK_AND_ASSERT_MES(up_index_limit <= amount_outs_count, false, "internal error: find_end_of_allowed_index returned wrong index=" << up_index_limit << ", with amount_outs_count = " << amount_outs_count);
+    if(amount_outs_count > req.outs_count)
     {
-      std::set<size_t> used;
-      size_t try_count = 0;
-      for(uint64_t j = 0; j != req.outs_count && try_count < up_index_limit;)
-      {
-        size_t i = rand()%up_index_limit;
-        if(used.count(i))
-          continue;
-        bool added = add_out_to_get_random_outs(amount_outs, result_outs, amount, i);
-        used.insert(i);
-        if(added)
-          ++j;
-        ++try_count;
-      }
+      // ages are counted back from the youngest block whose outputs are allowed
+      uint64_t top_height = get_current_blockchain_height() - std::min<uint64_t>(get_current_blockchain_height(),
+                                                                                 CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW);
+      const std::vector<uint64_t>& positions = it->second;
+      sampler.sample_by_age(up_index_limit, top_height, config::difficulty_target(), req.outs_count, [&](size_t i) {
+        return (*m_poutput_records)[positions[i]].keeper_block_height;
+      }, [&](size_t i) {
+        return add_out_to_get_random_outs(typ, result_outs, amount, i);
+      });
     }else
     {
       for(size_t i = 0; i != up_index_limit; i++)
-        add_out_to_get_random_outs(amount_outs, result_outs, amount, i);
+        add_out_to_get_random_outs(typ, result_outs, amount, i);
     }
   }
   return true;
@@ -1761,12 +2233,29 @@ bool blockchain_storage::get_key_image_seqs(const COMMAND_RPC_GET_KEY_IMAGE_SEQS
   for (const auto& image : req.images)
   {
     // default to vector of size 0, which is correct for no vote history
-    res.image_seqs[image] = const_get(m_vote_histories, image).size();
+    res.image_seqs[image] = get_vote_history(image).size();
   }
   
   return true;
 }
 //------------------------------------------------------------------
+blockchain_storage::vote_history blockchain_storage::get_vote_history(const crypto::key_image& ki) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  vote_history res;
+  m_vote_histories.load(ki, res);
+  return res;
+}
+//------------------------------------------------------------------
+void blockchain_storage::set_vote_history(const crypto::key_image& ki, const vote_history& hist)
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  if (hist.empty())
+    m_vote_histories.erase(ki);
+  else
+    m_vote_histories.store(ki, hist);
+}
+//------------------------------------------------------------------
 bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids,
                                                     uint64_t& starter_offset) const
 {
@@ -1844,11 +2333,11 @@ uint64_t blockchain_storage::get_block_fees(uint64_t block_height) const
   uint64_t sum_fees = 0;
   
   BOOST_FOREACH(const auto& tx_id, bl.tx_hashes) {
-    if (!m_transactions.contains(tx_id)) {
+    transaction_chain_entry txce;
+    if (!m_transactions.load(tx_id, txce)) {
       LOG_ERROR("Inconsistency, block in chain has unknown transaction " << tx_id);
       throw std::runtime_error("Inconsistency in blockchain");
     }
-    auto txce = m_transactions.load(tx_id);
     sum_fees += get_tx_fee(txce.tx);
   }
   m_cached_block_fees.put(block_hash, sum_fees);
@@ -1925,16 +2414,18 @@ void blockchain_storage::print_blockchain_outs(const std::string& file) const
 {
   std::stringstream ss;
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  BOOST_FOREACH(const outputs_container::value_type& v, m_outputs)
+  BOOST_FOREACH(const output_positions_container::value_type& v, m_output_positions)
   {
-    const outputs_vector& vals = v.second;
-    if(vals.size())
+    if(v.second.size())
     {
       ss << "(coin_type, amount): ("
          << v.first.first << v.first.second << ")"
          << ENDL;
-      for(size_t i = 0; i != vals.size(); i++)
-        ss << "\t" << vals[i].first << ": " << vals[i].second << ENDL;
+      for(uint64_t i = 0; i != v.second.size(); i++)
+      {
+        const output_record& rec = (*m_poutput_records)[v.second[i]];
+        ss << "\t" << i << ": " << rec.key << ", unlock time " << rec.unlock_time << ", height " << rec.keeper_block_height << ENDL;
+      }
     }
   }
   if(file_io_utils::save_string_to_file(file, ss.str()))
@@ -1982,6 +2473,23 @@ bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash
   return true;
 }
 //------------------------------------------------------------------
+bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids,
+                                                    std::list<block_complete_entry>& blocks,
+                                                    uint64_t& total_height, uint64_t& start_height, size_t max_count) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  if(!find_blockchain_supplement(qblock_ids, start_height))
+    return false;
+
+  total_height = get_current_blockchain_height();
+  std::vector<crypto::hash> block_ids;
+  for(size_t i = start_height; i != m_pblockchain_entries->size() && block_ids.size() < max_count; i++)
+  {
+    block_ids.push_back((*m_pblockchain_entries)[i].hash);
+  }
+  return get_block_complete_entries(block_ids, blocks);
+}
+//------------------------------------------------------------------
 bool blockchain_storage::add_block_as_invalid(const block& bl, const crypto::hash& h)
 {
   blockchain_entry bent = AUTO_VAL_INIT(bent);
@@ -2016,16 +2524,15 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, block_verif
 }
 //------------------------------------------------------------------
 bool blockchain_storage::push_transaction_to_global_outs_index(const transaction& tx, const crypto::hash& tx_id,
-                                                               std::vector<uint64_t>& global_indexes)
+                                                               uint64_t bl_height, std::vector<uint64_t>& global_indexes)
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  size_t i = 0;
-  BOOST_FOREACH(const auto& ot, tx.outs())
+  for (size_t i = 0; i < tx.outs().size(); i++)
   {
-    outputs_vector& amount_index = m_outputs[std::make_pair(tx.out_cp(i), ot.amount)];
-    amount_index.push_back(std::pair<crypto::hash, size_t>(tx_id, i));
-    global_indexes.push_back(amount_index.size()-1);
-    ++i;
+    std::vector<uint64_t>& positions = m_output_positions[std::make_pair(tx.out_cp(i), tx.outs()[i].amount)];
+    global_indexes.push_back(positions.size());
+    CHECK_AND_ASSERT_MES(store_output_record(tx, i, bl_height, positions), false,
+                         "failed to store output record for output " << i << " of tx " << tx_id);
   }
   return true;
 }
@@ -2040,18 +2547,13 @@ bool blockchain_storage::get_outs(coin_type type, uint64_t amount,
                                   std::list<crypto::public_key>& pkeys) const
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  auto it = m_outputs.find(std::make_pair(type, amount));
-  if(it == m_outputs.end())
+  auto it = m_output_positions.find(std::make_pair(type, amount));
+  if(it == m_output_positions.end())
     return true;
 
-  BOOST_FOREACH(const auto& out_entry, it->second)
+  BOOST_FOREACH(uint64_t pos, it->second)
   {
-    auto tx_it = m_transactions.find(out_entry.first);
-    CHECK_AND_ASSERT_MES(tx_it != m_transactions.end(), false, "transactions outs global index consistency broken: wrong tx id in index");
-    CHECK_AND_ASSERT_MES(tx_it->second.tx.outs().size() > out_entry.second, false, "transactions outs global index consistency broken: index in tx_outx more then size");
-    CHECK_AND_ASSERT_MES(tx_it->second.tx.outs()[out_entry.second].target.type() == typeid(txout_to_key), false, "transactions outs global index consistency broken: tx_outx is not a txout_to_key");
-    CHECK_AND_ASSERT_MES(tx_it->second.tx.out_cp(out_entry.second) == type, false, "transactions outs global index consistency broken: tx coin_type mismatch");
-    pkeys.push_back(boost::get<txout_to_key>(tx_it->second.tx.outs()[out_entry.second].target).key);
+    pkeys.push_back((*m_poutput_records)[pos].key);
   }
 
   return true;
@@ -2063,17 +2565,156 @@ bool blockchain_storage::pop_transaction_from_global_index(const transaction& tx
   size_t i = tx.outs().size()-1;
   BOOST_REVERSE_FOREACH(const auto& ot, tx.outs())
   {
-    auto it = m_outputs.find(std::make_pair(tx.out_cp(i), ot.amount));
-    CHECK_AND_ASSERT_MES(it != m_outputs.end(), false, "transactions outs global index consistency broken");
+    auto it = m_output_positions.find(std::make_pair(tx.out_cp(i), ot.amount));
+    CHECK_AND_ASSERT_MES(it != m_output_positions.end(), false, "transactions outs global index consistency broken");
     CHECK_AND_ASSERT_MES(it->second.size(), false, "transactions outs global index: empty index for amount: " << ot.amount);
-    CHECK_AND_ASSERT_MES(it->second.back().first == tx_id , false, "transactions outs global index consistency broken: tx id missmatch");
-    CHECK_AND_ASSERT_MES(it->second.back().second == i, false, "transactions outs global index consistency broken: in transaction index missmatch");
+    
+    // outputs come off in the reverse order they went on, so this is always the last record
+    CHECK_AND_ASSERT_MES(it->second.back() + 1 == m_poutput_records->size(), false,
+                         "transactions outs global index consistency broken: output of tx " << tx_id << " is not the last one added");
+    output_record expected_rec;
+    const output_record& rec = m_poutput_records->back();
+    CHECK_AND_ASSERT(make_output_record(tx, i, rec.keeper_block_height, expected_rec), false);
+    CHECK_AND_ASSERT_MES(rec.key == expected_rec.key && rec.unlock_time == expected_rec.unlock_time, false,
+                         "transactions outs global index consistency broken: output record of tx " << tx_id << " missmatch");
+    m_poutput_records->pop_back();
     it->second.pop_back();
     --i;
   }
   return true;
 }
 //------------------------------------------------------------------
+bool blockchain_storage::make_output_record(const transaction& tx, size_t out_i, uint64_t keeper_block_height,
+                                            output_record& rec) const
+{
+  CHECK_AND_ASSERT_MES(out_i < tx.outs().size(), false, "make_output_record: out index " << out_i << " out of range");
+  const auto& out = tx.outs()[out_i];
+  CHECK_AND_ASSERT_MES(out.target.type() == typeid(txout_to_key), false,
+                       "make_output_record: output have wrong type id, expected txout_to_key, which=" << out.target.which());
+  
+  output_record res = AUTO_VAL_INIT(res);
+  res.key = boost::get<txout_to_key>(out.target).key;
+  res.unlock_time = tx.unlock_time;
+  res.keeper_block_height = keeper_block_height;
+  rec = res;
+  return true;
+}
+//------------------------------------------------------------------
+// positions is the output's amount's entry in m_output_positions
+bool blockchain_storage::store_output_record(const transaction& tx, size_t out_i, uint64_t keeper_block_height,
+                                             std::vector<uint64_t>& positions)
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  output_record rec;
+  if (!make_output_record(tx, out_i, keeper_block_height, rec))
+    return false;
+  
+  output_key key = std::make_pair(tx.out_cp(out_i), tx.outs()[out_i].amount);
+  auto id_it = m_output_amount_ids.find(key);
+  if (id_it == m_output_amount_ids.end())
+  {
+    id_it = m_output_amount_ids.insert(std::make_pair(key, m_output_amounts.size())).first;
+    m_output_amounts.push_back(key);
+  }
+  rec.amount_id = id_it->second;
+  
+  m_poutput_records->push_back(rec);
+  positions.push_back(m_poutput_records->size() - 1);
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_output_record(coin_type type, uint64_t amount, uint64_t global_index,
+                                           output_record& rec) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  auto it = m_output_positions.find(std::make_pair(type, amount));
+  if (it == m_output_positions.end() || global_index >= it->second.size())
+    return false;
+  
+  rec = (*m_poutput_records)[it->second[global_index]];
+  return true;
+}
+//------------------------------------------------------------------
+// the records are in the order the outputs were added, so each amount's positions come out in global index order
+bool blockchain_storage::index_output_records()
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  
+  std::vector<std::vector<uint64_t> *> positions_by_id;
+  BOOST_FOREACH(const auto& key, m_output_amounts)
+  {
+    positions_by_id.push_back(&m_output_positions[key]);
+    positions_by_id.back()->clear();
+  }
+  
+  for (size_t pos = 0; pos < m_poutput_records->size(); pos++)
+  {
+    uint32_t amount_id = (*m_poutput_records)[pos].amount_id;
+    CHECK_AND_ASSERT_MES(amount_id < positions_by_id.size(), false,
+                         "index_output_records: output record " << pos << " has amount id " << amount_id
+                         << " but only " << positions_by_id.size() << " amounts are known");
+    positions_by_id[amount_id]->push_back(pos);
+  }
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::rebuild_output_index()
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  
+  if (!m_rebuild_output_index)
+  {
+    if (index_output_records())
+      return true;
+    LOG_ERROR("Couldn't index output records, rebuilding them");
+  }
+  
+  // records have to be in the order the outputs were added, so go through the main chain in order
+  LOG_PRINT_YELLOW("Building output index for " << m_pblockchain_entries->size() << " blocks, this may take a few minutes...", LOG_LEVEL_0);
+  m_poutput_records->clear();
+  m_output_positions.clear();
+  m_output_amounts.clear();
+  m_output_amount_ids.clear();
+  
+  for (size_t height = 0; height < m_pblockchain_entries->size(); height++)
+  {
+    block bl;
+    CHECK_AND_ASSERT_MES(m_blocks_by_hash.load((*m_pblockchain_entries)[height].hash, bl), false,
+                         "rebuild_output_index: no block at height " << height);
+    
+    std::vector<crypto::hash> tx_ids;
+    tx_ids.push_back(get_transaction_hash(bl.miner_tx));
+    tx_ids.insert(tx_ids.end(), bl.tx_hashes.begin(), bl.tx_hashes.end());
+    
+    BOOST_FOREACH(const auto& tx_id, tx_ids)
+    {
+      transaction_chain_entry ce;
+      CHECK_AND_ASSERT_MES(m_transactions.load(tx_id, ce), false,
+                           "rebuild_output_index: tx " << tx_id << " of block at height " << height << " not found");
+      CHECK_AND_ASSERT_MES(ce.m_global_output_indexes.size() == ce.tx.outs().size(), false,
+                           "rebuild_output_index: tx " << tx_id << " has " << ce.m_global_output_indexes.size()
+                           << " global output indexes but " << ce.tx.outs().size() << " outputs");
+      for (size_t i = 0; i < ce.tx.outs().size(); i++)
+      {
+        std::vector<uint64_t>& positions = m_output_positions[std::make_pair(ce.tx.out_cp(i), ce.tx.outs()[i].amount)];
+        CHECK_AND_ASSERT_MES(positions.size() == ce.m_global_output_indexes[i], false,
+                             "rebuild_output_index: output " << i << " of tx " << tx_id << " has global index "
+                             << ce.m_global_output_indexes[i] << ", expected " << positions.size());
+        CHECK_AND_ASSERT(store_output_record(ce.tx, i, ce.m_keeper_block_height, positions), false);
+      }
+    }
+  }
+  
+  m_rebuild_output_index = false;
+  
+  // the output records used to be in a database
+  boost::system::error_code ec;
+  boost::filesystem::remove(m_config_folder + "/" + CRYPTONOTE_BLOCKCHAINDB_OUTPUTS_FILENAME, ec);
+  
+  LOG_PRINT_YELLOW("Output index built", LOG_LEVEL_0);
+  return true;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::check_tx_in_to_key(const transaction& tx, size_t i, const txin_to_key& inp,
                                             const crypto::hash& tx_prefix_hash_, uint64_t* pmax_related_block_height) const
 {
@@ -2093,30 +2734,21 @@ bool blockchain_storage::check_tx_in_to_key(const transaction& tx, size_t i, con
   
   struct outputs_visitor
   {
-    std::vector<crypto::public_key> m_keys; // store keys since transaction references aren't necessarily persisted in memory
+    std::vector<crypto::public_key> m_keys;
     const blockchain_storage& m_bch;
-    coin_type m_type;
     
-    outputs_visitor(const blockchain_storage& bch, coin_type ct)
-        : m_bch(bch), m_type(ct) { }
+    outputs_visitor(const blockchain_storage& bch) : m_bch(bch) { }
     
-    bool handle_output(const transaction& tx, size_t out_i, const tx_out& out)
+    bool handle_output(const output_record& rec)
     {
-      CHECK_AND_ASSERT_MES(tx.out_cp(out_i) == m_type, false,
-                           "INCONSISTENCY: outputs_visitor::handle_output given out with wrong coin_type");
-      
       //check tx unlock time
-      if (!m_bch.is_tx_spendtime_unlocked(tx.unlock_time))
+      if (!m_bch.is_tx_spendtime_unlocked(rec.unlock_time))
       {
-        LOG_PRINT_L0("One of outputs for one of inputs have wrong tx.unlock_time = " << tx.unlock_time);
+        LOG_PRINT_L0("One of outputs for one of inputs have wrong tx.unlock_time = " << rec.unlock_time);
         return false;
       }
       
-      CHECK_AND_ASSERT_MES(out.target.type() == typeid(txout_to_key), false,
-                           "Output have wrong type id, expected txout_to_key, which=" << out.target.which());
-      
-      const auto& outp = boost::get<txout_to_key>(out.target);
-      m_keys.push_back(outp.key);
+      m_keys.push_back(rec.key);
       
       return true;
     }
@@ -2124,7 +2756,7 @@ bool blockchain_storage::check_tx_in_to_key(const transaction& tx, size_t i, con
 
   //check ring signature
   coin_type type = tx.in_cp(i);
-  outputs_visitor vi(*this, type);
+  outputs_visitor vi(*this);
   
   if (!scan_outputkeys_for_indexes(inp, type, vi, pmax_related_block_height))
   {
@@ -2147,15 +2779,21 @@ bool blockchain_storage::check_tx_in_to_key(const transaction& tx, size_t i, con
   if (m_is_in_checkpoint_zone)
     return true;
   
-  crypto::hash tx_prefix_hash = (tx_prefix_hash_ == null_hash) ? get_transaction_prefix_hash(tx) : tx_prefix_hash_;
-  // need vector of addresses for check_ring_signature, so ...
-  std::vector<const crypto::public_key*> vec_pkeys;
-  for (auto& key : vi.m_keys) {
-    vec_pkeys.push_back(&key);
+  ring_signature_job job;
+  job.tx_id = get_transaction_hash(tx);
+  job.input_index = i;
+  job.prefix_hash = (tx_prefix_hash_ == null_hash) ? get_transaction_prefix_hash(tx) : tx_prefix_hash_;
+  job.k_image = inp.k_image;
+  job.keys.swap(vi.m_keys);
+  job.sigs = tx.signatures[i];
+  
+  if (m_pdeferred_ring_sigs)
+  {
+    m_pdeferred_ring_sigs->push_back(job);
+    return true;
   }
-  CHECK_AND_ASSERT_MES(crypto::check_ring_signature(tx_prefix_hash, inp.k_image, vec_pkeys, tx.signatures[i].data()),
-                       false, "Ring signature check failed");
-  return true;
+  
+  return ring_signature_verifier::verify_one(job);
 }
 //------------------------------------------------------------------
 bool blockchain_storage::check_tx_in_mint(const transaction& tx, size_t i, const txin_mint& inp) const
@@ -2447,11 +3085,11 @@ bool blockchain_storage::check_tx_in_vote(const transaction& tx, size_t i, const
                        << ", can vote for at most " << config::dpos_num_delegates);
   
   // check not voting with spent image
-  CHECK_AND_ASSERT_MES(m_spent_keys.find(inp.ink.k_image) == m_spent_keys.end(), false,
+  CHECK_AND_ASSERT_MES(!m_spent_keys.contains(inp.ink.k_image), false,
                        "check_tx_in_vote: voting with spent key image");
 
   // check 'seq' matches
-  size_t hists_size = const_get(m_vote_histories, inp.ink.k_image).size();
+  size_t hists_size = get_vote_history(inp.ink.k_image).size();
   CHECK_AND_ASSERT_MES(inp.seq == hists_size, false, "check_tx_in_vote: invalid 'seq' of " << inp.seq << ", but hists.size()=" << hists_size);
   
   // check votes are for existing delegates and that would be no overflow
@@ -2504,18 +3142,20 @@ namespace bs_visitor_detail {
       const auto& ki = inp.k_image;
       
       // unapply this key image's votes
-      if (!b.m_vote_histories[ki].empty())
+      const auto hist = b.get_vote_history(ki);
+      if (!hist.empty())
       {
         // don't enforce effective amounts since other factors could have lowered the delegate votes
-        CHECK_AND_ASSERT_MES(b.unapply_votes(b.m_vote_histories[ki].back(), false), false,
+        CHECK_AND_ASSERT_MES(b.unapply_votes(hist.back(), false), false,
                              "internal error: could not remove latest votes ");
       }
       
-      auto r = b.m_spent_keys.insert(ki);
       // double spend check, should never happen since inputs were already checked
-      CHECK_AND_ASSERT_MES(r.second, false,
+      CHECK_AND_ASSERT_MES(!b.m_spent_keys.contains(ki), false,
                            "tx with id: " << m_tx_id << " in block id: " << m_bl_id
                            << " have input marked as spent with key image: " << ki << ", block declined");
+      b.m_spent_keys.insert(ki);
+      b.m_spent_keys_db.store(ki, true);
       
       return true;
     }
@@ -2637,14 +3277,15 @@ namespace bs_visitor_detail {
     
     bool operator()(const txin_vote& inp)
     {
-      CHECK_AND_ASSERT_MES(b.m_spent_keys.find(inp.ink.k_image) == b.m_spent_keys.end(), false,
+      CHECK_AND_ASSERT_MES(!b.m_spent_keys.contains(inp.ink.k_image), false,
                            "internal error: trying to vote with spent key");
       
       // remove latest vote
-      if (!b.m_vote_histories[inp.ink.k_image].empty())
+      auto hist = b.get_vote_history(inp.ink.k_image);
+      if (!hist.empty())
       {
         // don't enforce effective amounts
-        CHECK_AND_ASSERT_MES(b.unapply_votes(b.m_vote_histories[inp.ink.k_image].back(), false), false,
+        CHECK_AND_ASSERT_MES(b.unapply_votes(hist.back(), false), false,
                              "internal error: could not remove previous votes");
       }
       
@@ -2652,7 +3293,8 @@ namespace bs_visitor_detail {
       blockchain_storage::vote_instance vote_record;
       CHECK_AND_ASSERT_MES(b.apply_votes(inp.ink.amount, inp.votes, vote_record), false,
                            "internal error: could not apply new votes");
-      b.m_vote_histories[inp.ink.k_image].push_back(vote_record);
+      hist.push_back(vote_record);
+      b.set_vote_history(inp.ink.k_image, hist);
       
       /*std::stringstream ss;
       ss << "Effective votes: " << ENDL;
@@ -2693,7 +3335,7 @@ bool blockchain_storage::add_transaction_from_block(const transaction& tx, const
     LOG_PRINT_L0("tx with id: " << tx_id << " in block id: " << bl_id << " already in blockchain");
     return false;
   }
-  bool r = push_transaction_to_global_outs_index(tx, tx_id, ch_e.m_global_output_indexes);
+  bool r = push_transaction_to_global_outs_index(tx, tx_id, bl_height, ch_e.m_global_output_indexes);
   CHECK_AND_ASSERT_MES(r, false, "failed to return push_transaction_to_global_outs_index tx id " << tx_id);
   m_transactions.store(tx_id, ch_e);
   
@@ -2747,15 +3389,15 @@ bool blockchain_storage::add_transaction_from_block(const transaction& tx, const
 bool blockchain_storage::get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs) const
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  auto it = m_transactions.find(tx_id);
-  if(it == m_transactions.end())
+  transaction_chain_entry txce;
+  if(!m_transactions.load(tx_id, txce))
   {
     LOG_PRINT_RED_L0("warning: get_tx_outputs_gindexs failed to find transaction with id = " << tx_id);
     return false;
   }
 
-  CHECK_AND_ASSERT_MES(it->second.m_global_output_indexes.size(), false, "internal error: global indexes for transaction " << tx_id << " is empty");
-  indexs = it->second.m_global_output_indexes;
+  CHECK_AND_ASSERT_MES(txce.m_global_output_indexes.size(), false, "internal error: global indexes for transaction " << tx_id << " is empty");
+  indexs.swap(txce.m_global_output_indexes);
   return true;
 }
 //------------------------------------------------------------------
@@ -2826,8 +3468,32 @@ bool blockchain_storage::check_tx_inputs(const transaction& tx, uint64_t* pmax_u
   if(pmax_used_block_height)
     *pmax_used_block_height = 0;
   
-  bs_visitor_detail::check_tx_input_visitor visitor(*this, tx, get_transaction_prefix_hash(tx), pmax_used_block_height);
-  return tools::all_apply_visitor(visitor, tx.ins());
+  // check this tx's ring signatures together at the end, unless a whole block's worth is already being collected
+  std::vector<ring_signature_job> ring_sigs;
+  bool collect_ring_sigs = m_pdeferred_ring_sigs == NULL;
+  if (collect_ring_sigs)
+    m_pdeferred_ring_sigs = &ring_sigs;
+  
+  bool inputs_valid;
+  {
+    misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler([&](){
+      if (collect_ring_sigs)
+        m_pdeferred_ring_sigs = NULL;
+    });
+    bs_visitor_detail::check_tx_input_visitor visitor(*this, tx, get_transaction_prefix_hash(tx), pmax_used_block_height);
+    inputs_valid = tools::all_apply_visitor(visitor, tx.ins());
+  }
+  
+  if (!inputs_valid)
+    return false;
+  
+  if (collect_ring_sigs && !m_ring_sig_verifier.verify(ring_sigs))
+  {
+    LOG_PRINT_L0("Ring signature check failed for tx " << get_transaction_hash(tx));
+    return false;
+  }
+  
+  return true;
 }
 //------------------------------------------------------------------
 namespace {
@@ -3135,6 +3801,14 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
   }
   size_t tx_processed_count = 0;
   uint64_t fee_summary = 0;
+  
+  // collect the ring signatures of all the block's txs and check them all at once after the loop.
+  // only collect while validating, txs put back into the pool on failure must be fully checked
+  std::vector<ring_signature_job> block_ring_sigs;
+  misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler([&](){
+    m_pdeferred_ring_sigs = NULL;
+  });
+  
   BOOST_FOREACH(const crypto::hash& tx_id, bl.tx_hashes)
   {
     transaction tx;
@@ -3148,7 +3822,10 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
       bvc.m_verifivation_failed = true;
       return false;
     }
-    if(!validate_tx(tx, false))
+    m_pdeferred_ring_sigs = &block_ring_sigs;
+    bool tx_valid = validate_tx(tx, false);
+    m_pdeferred_ring_sigs = NULL;
+    if(!tx_valid)
     {
       LOG_PRINT_L0("Block with id: " << id  << " have at least one transaction (id: " << tx_id << ") with wrong inputs.");
       cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
@@ -3175,6 +3852,20 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
     cumulative_block_size += blob_size;
     ++tx_processed_count;
   }
+  
+  TIME_MEASURE_START(ring_sig_time);
+  bool ring_sigs_valid = m_ring_sig_verifier.verify(block_ring_sigs);
+  TIME_MEASURE_FINISH(ring_sig_time);
+  LOG_PRINT_L2("Checked " << block_ring_sigs.size() << " ring signatures in " << ring_sig_time << "ms");
+  if (!ring_sigs_valid)
+  {
+    LOG_PRINT_L0("Block with id: " << id << " have at least one transaction with an invalid ring signature");
+    purge_block_data_from_blockchain(bl, tx_processed_count);
+    add_block_as_invalid(bl, id);
+    LOG_PRINT_L0("Block with id " << id << " added as invalid becouse of wrong inputs in transactions");
+    bvc.m_verifivation_failed = true;
+    return false;
+  }
   uint64_t base_reward = 0;
   uint64_t already_generated_coins = m_pblockchain_entries->size() ? m_pblockchain_entries->back().already_generated_coins : 0;
   uint64_t fee_reward = is_pow_block(bl) ? fee_summary : average_past_block_fees(get_block_height(bl));
@@ -3240,13 +3931,12 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
   }
 
   m_pblockchain_entries->push_back(bent);
-  m_pblockchain_entries->flush();
   ++m_changes_since_store;
   
   // update missing delegate block stats
   if (m_pblockchain_entries->size() > 2)
   {
-    auto block_prev = get_block_by_hash(m_pblockchain_entries->end()[-2].hash);
+    auto block_prev = get_block_by_hash((*m_pblockchain_entries)[m_pblockchain_entries->size() - 2].hash);
     if (is_pos_block(bl) && is_pos_block(block_prev)) // skip for non-pos and first pos block
     {
       uint64_t seconds_since_prev = bl.timestamp - block_prev.timestamp;
@@ -3343,7 +4033,7 @@ bool blockchain_storage::add_new_block(const block& bl_, block_verification_cont
   
   if (success && m_changes_since_store >= 10000) {
     LOG_PRINT_CYAN("Storing blockchain since many changes happened...", LOG_LEVEL_0);
-    store_blockchain();
+    store_blockchain_in_background();
   }
   
   return success;
@@ -3750,10 +4440,14 @@ bool blockchain_storage::get_transactions(const std::vector<crypto::hash>& txs_i
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  BOOST_FOREACH(const auto& tx_id, txs_ids)
+  std::vector<transaction_chain_entry> txces;
+  std::vector<bool> found;
+  m_transactions.multi_load(txs_ids, txces, found);
+  
+  for (size_t i=0; i < txs_ids.size(); i++)
   {
-    auto it = m_transactions.find(tx_id);
-    if(it == m_transactions.end())
+    const auto& tx_id = txs_ids[i];
+    if(!found[i])
     {
       transaction tx;
       if(!m_tx_pool.get_transaction(tx_id, tx))
@@ -3762,7 +4456,7 @@ bool blockchain_storage::get_transactions(const std::vector<crypto::hash>& txs_i
         txs.push_back(tx);
     }
     else
-      txs.push_back(it->second.tx);
+      txs.push_back(txces[i].tx);
   }
   return true;
 }
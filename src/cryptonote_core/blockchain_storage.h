@@ -20,14 +20,12 @@
 
 #include "sqlite3/sqlite3_map.h"
 
-#include "stxxl/vector"
-#include "stxxl/io"
-
 #include "syncobj.h"
 #include "string_tools.h"
 #include "packing.h"
 
 #include "common/util.h"
+#include "common/mapped_vector.h"
 #include "common/ntp_time.h"
 #include "common/types.h"
 #include "common/lru_cache.h"
@@ -42,6 +40,8 @@
 #include "verification_context.h"
 #include "checkpoints.h"
 #include "nulls.h"
+#include "ring_signature_verifier.h"
+#include "key_image_set.h"
 
 namespace bs_visitor_detail {
   struct purge_transaction_visitor;
@@ -115,6 +115,16 @@ namespace cryptonote
       difficulty_type cumulative_difficulty;
       uint64_t already_generated_coins;
     });
+    
+    // everything needed to use an output as a ring member, so don't have to load its whole transaction
+    PACK(POD_CLASS output_record
+    {
+    public:
+      crypto::public_key key;
+      uint64_t unlock_time;
+      uint64_t keeper_block_height;
+      uint32_t amount_id; // which (coin_type, amount) the output is, index into m_output_amounts
+    });
 
     struct currency_info
     {
@@ -167,6 +177,10 @@ namespace cryptonote
     crypto::hash get_block_id_by_height(uint64_t height) const;
     bool get_block_by_hash(const crypto::hash &h, block &blk) const;
     block get_block_by_hash(const crypto::hash& h) const;
+    // all of the blocks must exist
+    bool get_blocks_by_hash(const std::vector<crypto::hash>& hashes, std::list<block>& blocks) const;
+    // blobs straight from storage, without going through block objects. all of the blocks must exist
+    bool get_block_blobs_by_hash(const std::vector<crypto::hash>& hashes, std::vector<blobdata>& blobs) const;
     void get_all_known_block_ids(std::list<crypto::hash> &main, std::list<crypto::hash> &alt,
                                  std::list<crypto::hash> &invalid) const;
 
@@ -201,6 +215,8 @@ namespace cryptonote
     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids,
                                     std::list<std::pair<block, std::list<transaction> > >& blocks,
                                     uint64_t& total_height, uint64_t& start_height, size_t max_count) const;
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<block_complete_entry>& blocks,
+                                    uint64_t& total_height, uint64_t& start_height, size_t max_count) const;
     bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp) const;
     bool handle_get_objects(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req,
                             COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res) const;
@@ -211,6 +227,7 @@ namespace cryptonote
     bool get_backward_blocks_sizes(size_t from_height, std::vector<size_t>& sz, size_t count) const;
     bool get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs) const;
     bool store_blockchain();
+    bool store_blockchain_in_background();
     bool check_tx_in_to_key(const transaction& tx, size_t i, const txin_to_key& txin,
                             const crypto::hash& tx_prefix_hash=null_hash,
                             uint64_t* pmax_related_block_height = NULL) const;
@@ -244,6 +261,9 @@ namespace cryptonote
     bool get_transactions(const std::vector<crypto::hash>& txs_ids,
                           std::list<transaction>& txs,
                           std::list<crypto::hash>& missed_txs) const;
+    bool get_transaction_blobs(const std::vector<crypto::hash>& txs_ids,
+                               std::list<blobdata>& txs,
+                               std::list<crypto::hash>& missed_txs) const;
     
     uint64_t currency_decimals(coin_type type) const;
     
@@ -262,8 +282,7 @@ namespace cryptonote
     std::vector<cryptonote::bs_delegate_info> get_delegate_infos() const;
     
   private:
-    // 1024 entries per block, 4 blocks per page, cache of 8 pages = 32,768 blocks in memory cache at once
-    typedef stxxl::VECTOR_GENERATOR<blockchain_entry, 4, 8, sizeof(blockchain_entry)*1024>::result blockchain_entries;
+    typedef tools::mapped_vector<blockchain_entry> blockchain_entries;
     
     /*// use compare greater since we have easier access to null_hash
     struct CryptoHashCompareGreater
@@ -277,7 +296,9 @@ namespace cryptonote
     typedef sqlite3::sqlite3_map<crypto::hash, block> blocks_by_hash;
     typedef sqlite3::sqlite3_map<crypto::hash, size_t> blocks_by_id_index;
     typedef sqlite3::sqlite3_map<crypto::hash, transaction_chain_entry> transactions_container;
-    typedef std::unordered_set<crypto::key_image> key_images_container;
+    // every output's record, in the order the outputs were added to the main chain
+    typedef tools::mapped_vector<output_record> output_records_container;
+    typedef sqlite3::sqlite3_map<crypto::key_image, bool> key_images_container; // value is unused
     // outputs_vector: [(tx_hash, vout_index)]
     typedef std::vector<std::pair<crypto::hash, size_t> > outputs_vector;
     // old_outputs_container : {amount: outputs_vector}
@@ -290,24 +311,38 @@ namespace cryptonote
     // 2nd part of pair is the amount
     typedef std::pair<coin_type, uint64_t> output_key;
     typedef std::map<output_key, outputs_vector> outputs_container;
+    // output_counts_container : {(coin_type, amount) : # of outputs}
+    typedef std::map<output_key, uint64_t> output_counts_container;
+    // output_positions_container : {(coin_type, amount) : [position in m_poutput_records of each global index]}
+    typedef std::map<output_key, std::vector<uint64_t> > output_positions_container;
+    // output_amounts_vector : [(coin_type, amount)], in the order they first got an output
+    typedef std::vector<output_key> output_amounts_vector;
     typedef std::unordered_map<uint64_t, currency_info> currency_by_id;
     typedef std::unordered_map<uint64_t, contract_info> contract_by_id;
     typedef std::unordered_set<std::string> descriptions_container;
     typedef std::map<delegate_id_t, delegate_info> delegate_info_container;
     typedef std::vector<vote_instance> vote_history;
-    typedef std::unordered_map<crypto::key_image, vote_history> vote_history_container;
+    typedef sqlite3::sqlite3_map<crypto::key_image, vote_history> vote_history_container;
+    
+    // spent keys, outputs and vote histories as archives up to v16 kept them in memory
+    struct old_ram_state
+    {
+      std::unordered_set<crypto::key_image> spent_keys;
+      outputs_container outputs;
+      std::unordered_map<crypto::key_image, vote_history> vote_histories;
+    };
 
     tx_memory_pool& m_tx_pool;
     mutable epee::critical_section m_blockchain_lock;
 
     // main chain
-    std::string m_blockchain_entries_file;              // the temporary filename where the blockchain entries are
-    std::unique_ptr<stxxl::syscall_file> m_pstxxl_file; // the stxxl::file using the above filename
-    std::unique_ptr<blockchain_entries> m_pblockchain_entries; // block height -> blockchain_entry, using the above stxxl::file
+    std::unique_ptr<blockchain_entries> m_pblockchain_entries; // block height -> blockchain_entry, mapped from the config folder
     blocks_by_hash m_blocks_by_hash;         // block id -> block
     blocks_by_id_index m_blocks_index;       // block id -> height
     transactions_container m_transactions;   // transaction id -> transaction chain entry
-    key_images_container m_spent_keys;
+    std::unique_ptr<output_records_container> m_poutput_records; // output position -> output record, mapped from the config folder
+    key_images_container m_spent_keys_db;    // spent key image -> unused
+    key_image_set m_spent_keys;              // same key images, for lookups. saved by foreground stores, else built from m_spent_keys_db
     size_t m_current_block_cumul_sz_limit;
     bool m_popping_block;
     // all alternative chains
@@ -316,7 +351,10 @@ namespace cryptonote
     blockchain_entry_by_hash m_invalid_block_entries;
 
     // outputs
-    outputs_container m_outputs;
+    output_positions_container m_output_positions; // not serialized, indexed from m_poutput_records on load
+    output_amounts_vector m_output_amounts;
+    std::map<output_key, uint32_t> m_output_amount_ids; // not serialized, from m_output_amounts
+    bool m_rebuild_output_index; // not serialized, set when the output records can't be indexed as they are
 
     // currencies/contracts
     currency_by_id m_currencies;
@@ -325,7 +363,7 @@ namespace cryptonote
     
     // dpos
     delegate_info_container m_delegates;
-    vote_history_container m_vote_histories;
+    vote_history_container m_vote_histories; // key image -> its votes, oldest first
     delegate_votes m_top_delegates; // not serialized
     delegate_votes m_autovote_delegates; // not serialized
     
@@ -339,9 +377,48 @@ namespace cryptonote
     
     size_t m_changes_since_store;
     
+    // what a store needs once the lock is released: the serialized data and the db files to checkpoint
+    struct store_snapshot
+    {
+      std::string data;
+      std::vector<std::string> db_filenames;
+      sqlite3::checkpoint_mode checkpoint_mode;
+    };
+    bool take_store_snapshot(store_snapshot& snapshot, sqlite3::checkpoint_mode checkpoint_mode);
+    bool write_store_snapshot(const store_snapshot& snapshot);
+    void wait_for_background_store();
+    crypto::hash spent_key_set_stamp(const std::string& data) const;
+    boost::thread m_store_thread;
+    boost::mutex m_store_thread_lock; // guards m_store_thread, never held while waiting for m_blockchain_lock
+    std::atomic<bool> m_store_in_progress;
+    std::atomic<size_t> m_failed_stores; // in a row
+    
     // not serialized, just in-mem caches
     mutable cache::lru_cache <crypto::hash, uint64_t> m_cached_block_fees;
     
+    // the miner tx of the last block template, which only changes with the tip, the txs or the payout
+    struct block_template_cache
+    {
+      crypto::hash prev_id;
+      size_t median_size;
+      std::vector<crypto::hash> tx_hashes;
+      
+      bool has_miner_tx;
+      uint64_t miner_fee;
+      account_public_address miner_address;
+      blobdata ex_nonce;
+      transaction miner_tx;
+      
+      block_template_cache() : prev_id(null_hash), median_size(0), has_miner_tx(false), miner_fee(0) { }
+    };
+    mutable epee::critical_section m_template_cache_lock;
+    mutable block_template_cache m_template_cache;
+    
+    // ring signatures are collected here instead of being checked right away when non-NULL,
+    // so a whole block's (or tx's) worth can be checked in parallel
+    mutable std::vector<ring_signature_job> *m_pdeferred_ring_sigs;
+    mutable ring_signature_verifier m_ring_sig_verifier;
+    
     bool switch_to_alternative_blockchain(std::list<crypto::hash>& alt_chain, bool discard_disconnected_chain);
     bool pop_block_from_blockchain();
     bool purge_block_data_from_blockchain(const block& b, size_t processed_tx_count);
@@ -354,24 +431,40 @@ namespace cryptonote
     difficulty_type get_next_difficulty_for_alternative_chain(const std::list<crypto::hash>& alt_chain,
                                                               blockchain_entry& bent) const;
     bool prevalidate_miner_transaction(const block& b, uint64_t height) const;
+    bool construct_block_template_miner_tx(block& b, uint64_t height, size_t median_size,
+                                           uint64_t already_generated_coins, size_t txs_size, uint64_t fee,
+                                           const account_public_address& miner_address,
+                                           const blobdata& ex_nonce) const;
     bool validate_miner_transaction(const block& b, size_t cumulative_block_size, uint64_t fee, uint64_t& base_reward,
                                     uint64_t already_generated_coins) const;
     bool validate_transaction(const block& b, uint64_t height, const transaction& tx) const;
     bool rollback_blockchain_switching(std::list<block>& original_chain, size_t rollback_height);
     bool add_transaction_from_block(const transaction& tx, const crypto::hash& tx_id, const crypto::hash& bl_id,
                                     uint64_t bl_height);
-    bool push_transaction_to_global_outs_index(const transaction& tx, const crypto::hash& tx_id,
+    bool push_transaction_to_global_outs_index(const transaction& tx, const crypto::hash& tx_id, uint64_t bl_height,
                                                std::vector<uint64_t>& global_indexes);
     bool pop_transaction_from_global_index(const transaction& tx, const crypto::hash& tx_id);
+    bool make_output_record(const transaction& tx, size_t out_i, uint64_t keeper_block_height, output_record& rec) const;
+    bool store_output_record(const transaction& tx, size_t out_i, uint64_t keeper_block_height,
+                             std::vector<uint64_t>& positions);
+    bool get_output_record(coin_type type, uint64_t amount, uint64_t global_index, output_record& rec) const;
+    bool index_output_records();
+    bool rebuild_output_index();
+    bool get_main_chain_block_ids(const std::list<crypto::hash>& block_ids, std::vector<crypto::hash>& found_ids,
+                                  std::list<crypto::hash>& missed_bs) const;
+    // blockchain txs only. found[i] tells whether blobs[i] was loaded
+    void load_tx_blobs(const std::vector<crypto::hash>& txs_ids, std::vector<blobdata>& blobs,
+                       std::vector<bool>& found) const;
+    bool get_block_complete_entries(const std::vector<crypto::hash>& block_ids,
+                                    std::list<block_complete_entry>& entries) const;
     bool get_last_n_blocks_sizes(std::vector<size_t>& sz, size_t count) const;
-    bool add_out_to_get_random_outs(const std::vector<std::pair<crypto::hash, size_t> >& amount_outs,
-                                    COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs,
+    bool add_out_to_get_random_outs(coin_type type, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs,
                                     uint64_t amount, size_t i) const;
     bool is_tx_spendtime_unlocked(uint64_t unlock_time) const;
     bool is_contract_resolved(uint64_t contract) const;
     bool add_block_as_invalid(const block& bl, const crypto::hash& h);
     bool add_block_as_invalid(const blockchain_entry& bent, const block& bl, const crypto::hash& h);
-    size_t find_end_of_allowed_index(const std::vector<std::pair<crypto::hash, size_t> >& amount_outs) const;
+    size_t find_end_of_allowed_index(coin_type type, uint64_t amount, size_t outs_count) const;
     bool check_block_timestamp_main(const block& b) const;
     bool check_block_timestamp(std::vector<uint64_t> timestamps, const block& b) const;
     bool complete_timestamps_vector(uint64_t start_height, std::vector<uint64_t>& timestamps) const;
@@ -397,7 +490,13 @@ namespace cryptonote
     
     bool load_blockchain();
     void reset();
-    void close_blockchain_entries();
+    bool import_old_blockchain_entries(const std::string& filename);
+    bool import_old_ram_state(const old_ram_state& state);
+    template <class archive_t>
+    void load_v16(archive_t& ar);
+    
+    vote_history get_vote_history(const crypto::key_image& ki) const;
+    void set_vote_history(const crypto::key_image& ki, const vote_history& hist);
     
     /// -------------------------------------------------------
     /// isolate all the code to do the ram conversion
@@ -441,6 +540,7 @@ namespace cryptonote
       transactions_container m_transactions;
       blocks_ext_by_hash m_alternative_chains;
       blocks_ext_by_hash m_invalid_blocks;
+      old_ram_state m_old_state;
       
       // -------------------------------------
       template <class archive_t>
@@ -452,17 +552,11 @@ namespace cryptonote
     friend void process_check_count(archive_t& ar, obj_t& obj);
   };
 
-  // required for stxxl's verbose logging
-  inline std::ostream &operator <<(std::ostream &o, const blockchain_storage::blockchain_entry &bent) {
-    o << "blockchain_entry";
-    return o;
-  }
-  
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
   
-  #define CURRENT_BLOCKCHAIN_STORAGE_ARCHIVE_VER    16
+  #define CURRENT_BLOCKCHAIN_STORAGE_ARCHIVE_VER    19
 
   template<class archive_t, class obj_t>
   void process_check_count(archive_t& ar, obj_t& obj)
@@ -499,16 +593,51 @@ namespace cryptonote
       return;
     }
     
-    /* if (archive_t::is_saving::value)
+    if (version == 16) {
+      load_v16(ar);
+      return;
+    }
+    
+    // blocks, block index, transactions, spent keys, output records, alternative chains, invalid blocks and
+    // vote histories are in other files
+    if (version == 17)
     {
-      throw std::runtime_error("Not ready to save new version yet");
-    } */
-    
-    // blocks, block index, transactions loaded from other files
-    ar & m_spent_keys;
-    // alternative chains from other files
-    ar & m_outputs;
-    // invalid blocks from other files
+      // only had the counts, the positions are rebuilt from the transactions once loaded
+      output_counts_container output_counts;
+      ar & output_counts;
+      m_output_positions.clear();
+      for (const auto& item : output_counts)
+      {
+        m_output_positions[item.first];
+      }
+      m_rebuild_output_index = true;
+    }
+    else if (version == 18)
+    {
+      // had the positions, but the output records didn't say which amount they belong to yet
+      ar & m_output_positions;
+      m_rebuild_output_index = true;
+    }
+    else
+    {
+      // the positions come from the output records, which are only indexed once everything is loaded
+      ar & m_output_amounts;
+      uint64_t output_record_count = m_poutput_records->size();
+      ar & output_record_count;
+      if (archive_t::is_loading::value)
+      {
+        m_output_positions.clear();
+        m_output_amount_ids.clear();
+        for (size_t i = 0; i < m_output_amounts.size(); i++)
+        {
+          m_output_positions[m_output_amounts[i]];
+          m_output_amount_ids[m_output_amounts[i]] = i;
+        }
+        // a store that synced the records but didn't get to replace blockchain.bin
+        if (output_record_count != m_poutput_records->size())
+          m_rebuild_output_index = true;
+      }
+    }
     ar & m_current_block_cumul_sz_limit;
     
     ar & m_currencies;
@@ -517,12 +646,45 @@ namespace cryptonote
     ar & m_contracts;
     
     ar & m_delegates;
-    ar & m_vote_histories;
     
     process_check_count(ar, *this);
     print_sizes();
   }
   
+  template <class archive_t>
+  void blockchain_storage::load_v16(archive_t& ar)
+  {
+    LOG_PRINT_YELLOW("Loading v16 blockchain, will move spent keys, outputs and votes to the database...", LOG_LEVEL_0);
+    
+    old_ram_state state;
+    ar & state.spent_keys;
+    ar & state.outputs;
+    ar & m_current_block_cumul_sz_limit;
+    
+    ar & m_currencies;
+    ar & m_used_currency_descriptions;
+    
+    ar & m_contracts;
+    
+    ar & m_delegates;
+    ar & state.vote_histories;
+    
+    uint64_t total_check_count_loaded = 0;
+    ar & total_check_count_loaded;
+    uint64_t total_check_count = state.spent_keys.size() + state.outputs.size() + m_current_block_cumul_sz_limit
+        + m_currencies.size() + m_used_currency_descriptions.size() + m_contracts.size() + m_delegates.size()
+        + state.vote_histories.size();
+    if (total_check_count != total_check_count_loaded)
+    {
+      LOG_ERROR("Data corruption detected. total_count loaded from file = " << total_check_count_loaded << ", expected = " << total_check_count);
+      throw std::runtime_error("Old blockchain data corruption");
+    }
+    
+    if (!import_old_ram_state(state))
+      throw std::runtime_error("Couldn't move v16 blockchain data to the database");
+    print_sizes();
+  }
+  
   template <class archive_t>
   void blockchain_storage::v15_ram_converter::load_old_version(archive_t& ar, const unsigned int version)
   {
@@ -531,7 +693,7 @@ namespace cryptonote
     ar & m_blocks;
     ar & m_blocks_index;
     ar & m_transactions;
-    ar & bs.m_spent_keys;
+    ar & m_old_state.spent_keys;
     ar & m_alternative_chains;
     
     if (version < 13)
@@ -539,16 +701,16 @@ namespace cryptonote
       // load old version
       old_outputs_container old_outputs;
       ar & old_outputs;
-      bs.m_outputs.clear();
+      m_old_state.outputs.clear();
       txout_target_v bah = txout_to_key();
       BOOST_FOREACH(const auto& item, old_outputs)
       {
-        bs.m_outputs[std::make_pair(CP_XPB, item.first)] = item.second;
+        m_old_state.outputs[std::make_pair(CP_XPB, item.first)] = item.second;
       }
     }
     else
     {
-      ar & bs.m_outputs;
+      ar & m_old_state.outputs;
     }
     
     ar & m_invalid_blocks;
@@ -568,7 +730,7 @@ namespace cryptonote
     if (version >= 15)
     {
       ar & bs.m_delegates;
-      ar & bs.m_vote_histories;
+      ar & m_old_state.vote_histories;
     }
     
     if (version > 11)
@@ -584,30 +746,27 @@ namespace cryptonote
                                                        visitor_t& vis, uint64_t* pmax_related_block_height) const
   {
     CRITICAL_REGION_LOCAL(m_blockchain_lock);
-    auto it = m_outputs.find(std::make_pair(type, tx_in_to_key.amount));
-    if (it == m_outputs.end() || !tx_in_to_key.key_offsets.size())
+    auto it = m_output_positions.find(std::make_pair(type, tx_in_to_key.amount));
+    if (it == m_output_positions.end() || !tx_in_to_key.key_offsets.size())
       return false;
 
     std::vector<uint64_t> absolute_offsets = relative_output_offsets_to_absolute(tx_in_to_key.key_offsets);
 
-    const auto & amount_outs_vec = it->second;
+    const std::vector<uint64_t>& positions = it->second;
+    uint64_t amount_outs_count = positions.size();
     size_t count = 0;
     BOOST_FOREACH(uint64_t i, absolute_offsets)
     {
-      if (i >= amount_outs_vec.size())
+      if (i >= amount_outs_count)
       {
-        LOG_ERROR("Wrong index in transaction inputs: " << i << ", expected maximum " << amount_outs_vec.size() - 1
+        LOG_ERROR("Wrong index in transaction inputs: " << i << ", expected maximum " << amount_outs_count - 1
                   << ", (type, amount)=(" << type << ", " << tx_in_to_key.amount << ")");
         return false;
       }
       
-      const auto tx_it = m_transactions.find(amount_outs_vec[i].first);
-      CHECK_AND_ASSERT_MES(tx_it != m_transactions.end(), false, "Wrong transaction id in output indexes: " << epee::string_tools::pod_to_hex(amount_outs_vec[i].first));
-      CHECK_AND_ASSERT_MES(amount_outs_vec[i].second < tx_it->second.tx.outs().size(), false,
-                           "Wrong index in transaction outputs: " << amount_outs_vec[i].second
-                           << ", expected less then " << tx_it->second.tx.outs().size());
+      const output_record& rec = (*m_poutput_records)[positions[i]];
       
-      if (!vis.handle_output(tx_it->second.tx, amount_outs_vec[i].second, tx_it->second.tx.outs()[amount_outs_vec[i].second]))
+      if (!vis.handle_output(rec))
       {
         LOG_ERROR("Failed to handle_output for output no = " << count << ", with absolute offset " << i);
         return false;
@@ -615,8 +774,8 @@ namespace cryptonote
       
       if (count++ == absolute_offsets.size() - 1 && pmax_related_block_height)
       {
-        if (*pmax_related_block_height < tx_it->second.m_keeper_block_height)
-          *pmax_related_block_height = tx_it->second.m_keeper_block_height;
+        if (*pmax_related_block_height < rec.keeper_block_height)
+          *pmax_related_block_height = rec.keeper_block_height;
       }
     }
 
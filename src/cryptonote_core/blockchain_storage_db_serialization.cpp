@@ -0,0 +1,193 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <iterator>
+
+#include "include_base_utils.h"
+
+#include "cryptonote_core/blockchain_storage.h"
+#include "common/boost_serialization_helper.h"
+#include "common/varint.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "cryptonote_core/account_boost_serialization.h"
+#include "cryptonote_core/cryptonote_boost_serialization.h"
+#include "cryptonote_core/blockchain_storage_boost_serialization.h"
+
+#include "blockchain_storage_db_serialization.h"
+
+namespace cryptonote
+{
+  namespace
+  {
+    const char TX_CHAIN_ENTRY_DB_VERSION = 1;
+    const char VOTE_HISTORY_DB_VERSION = 1;
+
+    bool read_db_varint(const char *& p, const char *end, uint64_t& v)
+    {
+      int read = tools::read_varint<std::numeric_limits<uint64_t>::digits>(p, end, v);
+      // read_varint stops quietly at the end of input, even mid-varint
+      return read > 0 && (static_cast<unsigned char>(p[-1]) & 0x80) == 0;
+    }
+
+    // parses the header of a stored tx chain entry, leaving p at the start of the tx blob
+    bool read_tx_chain_entry_header(const char *& p, const char *end, blockchain_storage::transaction_chain_entry& ce)
+    {
+      CHECK_AND_ASSERT_MES(p != end && *p == TX_CHAIN_ENTRY_DB_VERSION, false,
+                           "Unknown tx chain entry format in database");
+      ++p;
+
+      uint64_t blob_size, num_indexes;
+      CHECK_AND_ASSERT_MES(read_db_varint(p, end, ce.m_keeper_block_height) && read_db_varint(p, end, blob_size)
+                           && read_db_varint(p, end, num_indexes), false, "Truncated tx chain entry in database");
+      CHECK_AND_ASSERT_MES(num_indexes <= (uint64_t)(end - p), false, "Invalid tx chain entry in database");
+      ce.m_blob_size = blob_size;
+
+      ce.m_global_output_indexes.resize(num_indexes);
+      for (auto& index : ce.m_global_output_indexes)
+      {
+        CHECK_AND_ASSERT_MES(read_db_varint(p, end, index), false, "Truncated tx chain entry in database");
+      }
+      return true;
+    }
+  }
+  //---------------------------------------------------------------
+  std::string block_to_db(const block& b)
+  {
+    return block_to_blob(b);
+  }
+  //---------------------------------------------------------------
+  block block_from_db_view(const char *data, size_t size)
+  {
+    if (tools::is_boost_binary_archive(data, size))
+      return tools::boost_unserialize_from_buffer<block>(data, size);
+
+    block b;
+    if (!t_serializable_object_from_blob(data, size, b))
+      throw std::runtime_error("Failed to parse block from database");
+    return b;
+  }
+  //---------------------------------------------------------------
+  block block_from_db(const std::string& buf)
+  {
+    return block_from_db_view(buf.data(), buf.size());
+  }
+  //---------------------------------------------------------------
+  bool block_blob_from_db(const char *data, size_t size, blobdata& blob)
+  {
+    if (tools::is_boost_binary_archive(data, size))
+      return block_to_blob(tools::boost_unserialize_from_buffer<block>(data, size), blob);
+
+    blob.assign(data, size);
+    return true;
+  }
+  //---------------------------------------------------------------
+  std::string tx_chain_entry_to_db(const blockchain_storage::transaction_chain_entry& ce)
+  {
+    std::string res;
+    res.push_back(TX_CHAIN_ENTRY_DB_VERSION);
+    tools::write_varint(std::back_inserter(res), ce.m_keeper_block_height);
+    tools::write_varint(std::back_inserter(res), (uint64_t)ce.m_blob_size);
+    tools::write_varint(std::back_inserter(res), (uint64_t)ce.m_global_output_indexes.size());
+    BOOST_FOREACH(auto index, ce.m_global_output_indexes)
+    {
+      tools::write_varint(std::back_inserter(res), index);
+    }
+
+    blobdata tx_blob;
+    if (!tx_to_blob(ce.tx, tx_blob))
+      throw std::runtime_error("Failed to serialize tx for database");
+    res.append(tx_blob);
+    return res;
+  }
+  //---------------------------------------------------------------
+  blockchain_storage::transaction_chain_entry tx_chain_entry_from_db_view(const char *data, size_t size)
+  {
+    if (tools::is_boost_binary_archive(data, size))
+      return tools::boost_unserialize_from_buffer<blockchain_storage::transaction_chain_entry>(data, size);
+
+    blockchain_storage::transaction_chain_entry ce;
+    const char *p = data, *end = data + size;
+    if (!read_tx_chain_entry_header(p, end, ce))
+      throw std::runtime_error("Invalid tx chain entry in database");
+    if (!parse_and_validate_tx_from_blob(p, end - p, ce.tx))
+      throw std::runtime_error("Failed to parse tx from database");
+    return ce;
+  }
+  //---------------------------------------------------------------
+  blockchain_storage::transaction_chain_entry tx_chain_entry_from_db(const std::string& buf)
+  {
+    return tx_chain_entry_from_db_view(buf.data(), buf.size());
+  }
+  //---------------------------------------------------------------
+  bool tx_blob_from_db(const char *data, size_t size, blobdata& blob)
+  {
+    if (tools::is_boost_binary_archive(data, size))
+      return tx_to_blob(tools::boost_unserialize_from_buffer<blockchain_storage::transaction_chain_entry>(data, size).tx, blob);
+
+    blockchain_storage::transaction_chain_entry ce;
+    const char *p = data, *end = data + size;
+    CHECK_AND_ASSERT(read_tx_chain_entry_header(p, end, ce), false);
+    blob.assign(p, end);
+    return true;
+  }
+  //---------------------------------------------------------------
+  std::string vote_history_to_db(const std::vector<blockchain_storage::vote_instance>& hist)
+  {
+    std::string res;
+    res.push_back(VOTE_HISTORY_DB_VERSION);
+    tools::write_varint(std::back_inserter(res), (uint64_t)hist.size());
+    BOOST_FOREACH(const auto& vi, hist)
+    {
+      tools::write_varint(std::back_inserter(res), vi.voting_for_height);
+      tools::write_varint(std::back_inserter(res), vi.expected_vote);
+      tools::write_varint(std::back_inserter(res), (uint64_t)vi.votes.size());
+      BOOST_FOREACH(const auto& item, vi.votes)
+      {
+        tools::write_varint(std::back_inserter(res), (uint64_t)item.first);
+        tools::write_varint(std::back_inserter(res), item.second);
+      }
+    }
+    return res;
+  }
+  //---------------------------------------------------------------
+  std::vector<blockchain_storage::vote_instance> vote_history_from_db_view(const char *data, size_t size)
+  {
+    const char *p = data, *end = data + size;
+    if (p == end || *p != VOTE_HISTORY_DB_VERSION)
+      throw std::runtime_error("Unknown vote history format in database");
+    ++p;
+
+    uint64_t num_instances;
+    // each instance takes at least 3 bytes
+    if (!read_db_varint(p, end, num_instances) || num_instances > (uint64_t)(end - p) / 3)
+      throw std::runtime_error("Invalid vote history in database");
+
+    std::vector<blockchain_storage::vote_instance> hist(num_instances);
+    BOOST_FOREACH(auto& vi, hist)
+    {
+      uint64_t num_votes;
+      if (!read_db_varint(p, end, vi.voting_for_height) || !read_db_varint(p, end, vi.expected_vote)
+          || !read_db_varint(p, end, num_votes))
+        throw std::runtime_error("Truncated vote history in database");
+      for (uint64_t i = 0; i < num_votes; i++)
+      {
+        uint64_t delegate_id, amount;
+        if (!read_db_varint(p, end, delegate_id) || !read_db_varint(p, end, amount))
+          throw std::runtime_error("Truncated vote history in database");
+        if (delegate_id > std::numeric_limits<delegate_id_t>::max())
+          throw std::runtime_error("Invalid delegate id in vote history in database");
+        vi.votes[(delegate_id_t)delegate_id] = amount;
+      }
+    }
+    if (p != end)
+      throw std::runtime_error("Trailing data after vote history in database");
+    return hist;
+  }
+  //---------------------------------------------------------------
+  std::vector<blockchain_storage::vote_instance> vote_history_from_db(const std::string& buf)
+  {
+    return vote_history_from_db_view(buf.data(), buf.size());
+  }
+  //---------------------------------------------------------------
+}
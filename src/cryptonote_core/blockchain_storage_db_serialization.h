@@ -0,0 +1,42 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "cryptonote_protocol/blobdatatype.h"
+#include "cryptonote_core/cryptonote_basic.h"
+#include "cryptonote_core/blockchain_storage.h"
+
+namespace cryptonote
+{
+  /* How blocks and transactions are kept in the blockchain database.
+   *
+   * Blocks are stored as their regular blob, and transaction chain entries as a small header
+   * followed by the regular tx blob, so both can be served to peers and wallets straight from the
+   * database without deserializing and serializing them again.
+   *
+   * Databases written by older versions hold boost archives instead. Those are still read, and
+   * get rewritten in the new format whenever they are stored again.
+   */
+
+  std::string block_to_db(const block& b);
+  block block_from_db(const std::string& buf);
+  block block_from_db_view(const char *data, size_t size);
+  // the block's blob, copied as-is when possible
+  bool block_blob_from_db(const char *data, size_t size, blobdata& blob);
+
+  std::string tx_chain_entry_to_db(const blockchain_storage::transaction_chain_entry& ce);
+  blockchain_storage::transaction_chain_entry tx_chain_entry_from_db(const std::string& buf);
+  blockchain_storage::transaction_chain_entry tx_chain_entry_from_db_view(const char *data, size_t size);
+  // the transaction's blob, copied as-is when possible
+  bool tx_blob_from_db(const char *data, size_t size, blobdata& blob);
+
+  // a key image's vote history, as a version byte followed by varints
+  std::string vote_history_to_db(const std::vector<blockchain_storage::vote_instance>& hist);
+  std::vector<blockchain_storage::vote_instance> vote_history_from_db(const std::string& buf);
+  std::vector<blockchain_storage::vote_instance> vote_history_from_db_view(const char *data, size_t size);
+}
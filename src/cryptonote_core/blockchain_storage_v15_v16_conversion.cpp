@@ -25,7 +25,7 @@ DISABLE_VS_WARNINGS(4267)
 //------------------------------------------------------------------
 uint64_t blockchain_storage::v15_ram_converter::get_check_count() const
 {
-  return m_blocks.size() + m_blocks_index.size() + m_transactions.size() + bs.m_spent_keys.size() + m_alternative_chains.size() + bs.m_outputs.size() + m_invalid_blocks.size() + bs.m_current_block_cumul_sz_limit + bs.m_currencies.size() + bs.m_used_currency_descriptions.size() + bs.m_contracts.size() + bs.m_delegates.size() + bs.m_vote_histories.size();
+  return m_blocks.size() + m_blocks_index.size() + m_transactions.size() + m_old_state.spent_keys.size() + m_alternative_chains.size() + m_old_state.outputs.size() + m_invalid_blocks.size() + bs.m_current_block_cumul_sz_limit + bs.m_currencies.size() + bs.m_used_currency_descriptions.size() + bs.m_contracts.size() + bs.m_delegates.size() + m_old_state.vote_histories.size();
 }
 //------------------------------------------------------------------
 void blockchain_storage::v15_ram_converter::print_sizes() const
@@ -34,16 +34,16 @@ void blockchain_storage::v15_ram_converter::print_sizes() const
                "m_blocks: " << m_blocks.size() << ENDL  <<
                "m_blocks_index: " << m_blocks_index.size() << ENDL  <<
                "m_transactions: " << m_transactions.size() << ENDL  <<
-               "m_spent_keys: " << bs.m_spent_keys.size() << ENDL  <<
+               "m_spent_keys: " << m_old_state.spent_keys.size() << ENDL  <<
                "m_alternative_chains: " << m_alternative_chains.size() << ENDL  <<
-               "m_outputs: " << bs.m_outputs.size() << ENDL  <<
+               "m_outputs: " << m_old_state.outputs.size() << ENDL  <<
                "m_invalid_blocks: " << m_invalid_blocks.size() << ENDL  <<
                "m_current_block_cumul_sz_limit: " << bs.m_current_block_cumul_sz_limit << ENDL <<
                "m_currencies: " << bs.m_currencies.size() << ENDL <<
                "m_contracts: " << bs.m_contracts.size() << ENDL <<
                "m_used_currency_descriptions: " << bs.m_used_currency_descriptions.size() << ENDL <<
                "m_delegates:" << bs.m_delegates.size() << ENDL <<
-               "m_vote_histories:" << bs.m_vote_histories.size() << ENDL);
+               "m_vote_histories:" << m_old_state.vote_histories.size() << ENDL);
 }
 //------------------------------------------------------------------
 static void log_pct(size_t i, size_t total) {
@@ -129,6 +129,11 @@ bool blockchain_storage::v15_ram_converter::process_conversion()
   } END_FOR_ENUM_PAIR()
   
   
+  LOG_PRINT_YELLOW("Converting spent keys, outputs and vote histories...", LOG_LEVEL_0);
+  
+  CHECK_AND_ASSERT_MES(bs.import_old_ram_state(m_old_state), false, "Couldn't convert spent keys, outputs and vote histories");
+  
+  
   LOG_PRINT_YELLOW("Clearing now-unused RAM...", LOG_LEVEL_0);
   
   m_blocks.clear();
@@ -136,6 +141,7 @@ bool blockchain_storage::v15_ram_converter::process_conversion()
   m_transactions.clear();
   m_alternative_chains.clear();
   m_invalid_blocks.clear();
+  m_old_state = old_ram_state();
   requires_conversion = false;
   
   
@@ -7,6 +7,8 @@
 #include <atomic>
 #include "net/net_utils_base.h"
 #include "copyable_atomic.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "cryptonote_protocol/known_inventory.h"
 
 namespace cryptonote
 {
@@ -29,6 +31,11 @@ namespace cryptonote
     uint64_t m_remote_blockchain_height;
     uint64_t m_last_response_height;
     epee::copyable_atomic m_callback_request_count; //in debug purpose: problem with double callback rise
+    epee::copyable_atomic m_waiting_for_blocks; //all needed blocks are being downloaded by other connections
+    bool m_supports_compact_blocks;
+    bool m_supports_tx_announcements;
+    known_inventory m_known_txs; //txs the peer has, so they aren't announced or sent to it again
+    NOTIFY_NEW_COMPACT_BLOCK::request m_pending_compact_block; //waiting for the txs we asked the peer for
     //size_t m_score;  TODO: add score calculations
     
     void enter_idle_state()
@@ -37,6 +44,7 @@ namespace cryptonote
       m_needed_objects.clear();
       m_needed_signed_hashes.clear();
       m_requested_objects.clear();
+      m_waiting_for_blocks.store(0);
       LOG_PRINT_CC_L1((*this), "Connection set to idle state.");
     }
   };
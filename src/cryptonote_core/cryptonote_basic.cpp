@@ -102,18 +102,21 @@ namespace cryptonote {
 
   void transaction_prefix::clear_ins()
   {
+    invalidate_hashes();
     vin.clear();
     vin_coin_types.clear();
   }
   
   void transaction_prefix::clear_outs()
   {
+    invalidate_hashes();
     vout.clear();
     vout_coin_types.clear();
   }
 
   void transaction_prefix::replace_vote_seqs(const std::map<crypto::key_image, uint64_t> &key_image_seqs)
   {
+    invalidate_hashes();
     for (auto& inp : vin)
     {
       if (inp.type() == typeid(txin_vote))
@@ -147,6 +150,7 @@ namespace cryptonote {
     clear_outs();
     extra.clear();
     signatures.clear();
+    invalidate_hashes();
   }
 
   size_t transaction::get_signature_size(const txin_v& tx_in)
@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <vector>
 
 #include <boost/variant.hpp>
@@ -309,6 +310,70 @@ namespace cryptonote
   size_t inp_minimum_tx_version(const txin_v& inp);
   size_t outp_minimum_tx_version(const tx_out& outp);
   
+  // a value derived from an object, remembered until it's invalidated. copies carry it along.
+  // once disabled it's never remembered again, for objects that are modified without being told.
+  template <class T>
+  class cached_value
+  {
+  public:
+    cached_value() : m_valid(false), m_disabled(false), m_value() { }
+    cached_value(const cached_value& other) : m_valid(false), m_disabled(false), m_value() { *this = other; }
+    
+    cached_value& operator=(const cached_value& other)
+    {
+      m_disabled = m_disabled || other.m_disabled;
+      T v;
+      if (other.get(v))
+        set(v);
+      else
+        invalidate();
+      return *this;
+    }
+    
+    bool get(T& v) const
+    {
+      if (!m_valid.load(std::memory_order_acquire))
+        return false;
+      v = m_value;
+      return true;
+    }
+    void set(const T& v) const
+    {
+      if (m_disabled)
+        return;
+      m_value = v;
+      m_valid.store(true, std::memory_order_release);
+    }
+    void invalidate() const { m_valid.store(false, std::memory_order_release); }
+    void disable() { m_disabled = true; invalidate(); }
+    
+  private:
+    mutable std::atomic<bool> m_valid;
+    bool m_disabled;
+    mutable T m_value;
+  };
+  
+  // hashes and size of a serialized tx, filled in by the format utils as they're computed
+  struct tx_hash_cache
+  {
+    cached_value<crypto::hash> prefix_hash;
+    cached_value<crypto::hash> hash;
+    cached_value<size_t> blob_size;
+    
+    void invalidate() const
+    {
+      prefix_hash.invalidate();
+      hash.invalidate();
+      blob_size.invalidate();
+    }
+    void disable()
+    {
+      prefix_hash.disable();
+      hash.disable();
+      blob_size.disable();
+    }
+  };
+  
   class tx_tester;
   class transaction_prefix
   {
@@ -334,6 +399,7 @@ namespace cryptonote
 
     void add_in(const txin_v& inp, const coin_type& ct)
     {
+      invalidate_hashes();
       vin.push_back(inp);
       vin_coin_types.push_back(ct);
       
@@ -343,6 +409,7 @@ namespace cryptonote
     }
     void add_out(const tx_out& outp, const coin_type& ct)
     {
+      invalidate_hashes();
       vout.push_back(outp);
       vout_coin_types.push_back(ct);
       
@@ -379,9 +446,20 @@ namespace cryptonote
     
     void replace_vote_seqs(const std::map<crypto::key_image, uint64_t>& key_image_seqs);
     
+    // code building a tx must call invalidate_hashes() after modifying its public fields in place.
+    // tests modify txs through tx_tester, which turns the cache off for the tx.
+    const tx_hash_cache& hash_cache() const { return m_hash_cache; }
+    void invalidate_hashes() const { m_hash_cache.invalidate(); }
+    
+  private:
+    tx_hash_cache m_hash_cache;
+    
   public:
     BEGIN_SERIALIZE()
       // NOTE: serialization code must be updated both here and in boost_serialize() below
+      if (!typename Archive<W>::is_saving())
+        invalidate_hashes();
+      
       // -- vanilla --
       VARINT_FIELD(version)
     
@@ -531,6 +609,9 @@ namespace cryptonote
     bool boost_serialize(Archive& a)
     {
       // NOTE: serialization code must be updated both here and in BEGIN_SERIALIZE() above
+      if (!typename Archive::is_saving())
+        invalidate_hashes();
+      
       // -- vanilla --
       a & version;
       a & unlock_time;
@@ -364,6 +364,11 @@ namespace cryptonote
     return m_blockchain_storage.find_blockchain_supplement(qblock_ids, blocks, total_height, start_height, max_count);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<block_complete_entry>& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count)
+  {
+    return m_blockchain_storage.find_blockchain_supplement(qblock_ids, blocks, total_height, start_height, max_count);
+  }
+  //-----------------------------------------------------------------------------------------------
   void core::print_blockchain(uint64_t start_index, uint64_t end_index)
   {
     m_blockchain_storage.print_blockchain(start_index, end_index);
@@ -528,6 +533,11 @@ namespace cryptonote
     return m_mempool.get_transactions_count();
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::have_pool_transaction(const crypto::hash& id)
+  {
+    return m_mempool.have_tx(id);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::have_block(const crypto::hash& id)
   {
     return m_blockchain_storage.have_block(id);
@@ -558,6 +568,35 @@ namespace cryptonote
     return m_blockchain_storage.handle_get_objects(arg, rsp);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::handle_get_block_txs(NOTIFY_REQUEST_BLOCK_TXS::request& arg, NOTIFY_RESPONSE_BLOCK_TXS::request& rsp, cryptonote_connection_context& context)
+  {
+    rsp.block_id = arg.block_id;
+    std::list<crypto::hash> missed_txs;
+    if (!m_blockchain_storage.get_transaction_blobs(std::vector<crypto::hash>(arg.txs.begin(), arg.txs.end()), rsp.txs, missed_txs))
+      return false;
+
+    // the block may not be in our chain yet or any more, its txs can still be in the pool.
+    // any we don't have at all are left out, the peer then asks for the whole block
+    BOOST_FOREACH(const auto& tx_hash, missed_txs)
+    {
+      transaction tx;
+      if (m_mempool.get_transaction(tx_hash, tx))
+        rsp.txs.push_back(tx_to_blob(tx));
+    }
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::handle_get_pool_transactions(NOTIFY_REQUEST_TRANSACTIONS::request& arg, NOTIFY_NEW_TRANSACTIONS::request& rsp, cryptonote_connection_context& context)
+  {
+    BOOST_FOREACH(const auto& tx_hash, arg.txs)
+    {
+      transaction tx;
+      if (m_mempool.get_transaction(tx_hash, tx))
+        rsp.txs.push_back(tx_to_blob(tx));
+    }
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
   crypto::hash core::get_block_id_by_height(uint64_t height)
   {
     return m_blockchain_storage.get_block_id_by_height(height);
@@ -598,7 +637,7 @@ namespace cryptonote
       m_starter_message_showed = true;
     }
 
-    m_store_blockchain_interval.do_call(boost::bind(&blockchain_storage::store_blockchain, &m_blockchain_storage));
+    m_store_blockchain_interval.do_call(boost::bind(&blockchain_storage::store_blockchain_in_background, &m_blockchain_storage));
     m_miner.on_idle();
     return true;
   }
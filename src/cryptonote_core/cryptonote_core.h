@@ -44,6 +44,8 @@ namespace cryptonote
      core(i_cryptonote_protocol* pprotocol, tools::ntp_time& ntp_time_in);
      ~core();
      bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote_connection_context& context);
+     bool handle_get_block_txs(NOTIFY_REQUEST_BLOCK_TXS::request& arg, NOTIFY_RESPONSE_BLOCK_TXS::request& rsp, cryptonote_connection_context& context);
+     bool handle_get_pool_transactions(NOTIFY_REQUEST_TRANSACTIONS::request& arg, NOTIFY_NEW_TRANSACTIONS::request& rsp, cryptonote_connection_context& context);
      bool on_idle();
      bool handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool keeped_by_block);
      bool handle_incoming_block(const blobdata& block_blob, block_verification_context& bvc, bool update_miner_blocktemplate = true);
@@ -80,12 +82,14 @@ namespace cryptonote
 
      bool get_pool_transactions(std::list<transaction>& txs);
      size_t get_pool_transactions_count();
+     bool have_pool_transaction(const crypto::hash& id);
      size_t get_blockchain_total_transactions();
      bool get_outs(coin_type type, uint64_t amount, std::list<crypto::public_key>& pkeys);
      bool have_block(const crypto::hash& id);
      bool get_short_chain_history(std::list<crypto::hash>& ids);
      bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp);
      bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count);
+     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<block_complete_entry>& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count);
      bool get_stat_info(core_stat_info& st_inf);
      bool get_backward_blocks_sizes(uint64_t from_height, std::vector<size_t>& sizes, size_t count);
      bool get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs);
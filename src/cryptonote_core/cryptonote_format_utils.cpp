@@ -37,10 +37,14 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool get_transaction_prefix_hash(const transaction_prefix& tx, crypto::hash& h)
   {
+    if (tx.hash_cache().prefix_hash.get(h))
+      return true;
+    
     blobdata prefix_blob;
     CHECK_AND_ASSERT_MES(t_serializable_object_to_blob(tx, prefix_blob), false,
                          "Could not blob-serialize transaction prefix");
     crypto::cn_fast_hash(prefix_blob.data(), prefix_blob.size(), h);
+    tx.hash_cache().prefix_hash.set(h);
     return true;
   }
   //---------------------------------------------------------------
@@ -52,9 +56,27 @@ namespace cryptonote
     return h;
   }
   //---------------------------------------------------------------
+  bool parse_and_validate_tx_from_blob(const char *data, size_t size, transaction& tx)
+  {
+    ::serialization::blob_istream iss(data, size);
+    binary_blob_archive<false> ar(iss);
+    bool r = ::serialization::serialize(ar, tx);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
+    
+    // a canonically encoded tx serializes back to the same blob, so its hash and size come for free
+    if (ar.canonical())
+    {
+      crypto::hash h;
+      crypto::cn_fast_hash(data, size, h);
+      tx.hash_cache().hash.set(h);
+      tx.hash_cache().blob_size.set(size);
+    }
+    return true;
+  }
+  //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx)
   {
-    return t_serializable_object_from_blob(tx_blob, tx);
+    return parse_and_validate_tx_from_blob(tx_blob.data(), tx_blob.size(), tx);
   }
   //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefix_hash)
@@ -200,9 +222,8 @@ namespace cryptonote
     if(tx_extra.empty())
       return true;
 
-    std::string extra_str(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size());
-    std::istringstream iss(extra_str);
-    binary_archive<false> ar(iss);
+    ::serialization::blob_istream iss(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size());
+    binary_blob_archive<false> ar(iss);
 
     bool eof = false;
     while (!eof)
@@ -243,6 +264,7 @@ namespace cryptonote
     tx.extra.resize(tx.extra.size() + 1 + sizeof(crypto::public_key));
     tx.extra[tx.extra.size() - 1 - sizeof(crypto::public_key)] = TX_EXTRA_TAG_PUBKEY;
     *reinterpret_cast<crypto::public_key*>(&tx.extra[tx.extra.size() - sizeof(crypto::public_key)]) = tx_pub_key;
+    tx.invalidate_hashes();
     return true;
   }
   //---------------------------------------------------------------
@@ -663,7 +685,15 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool get_transaction_hash(const transaction& t, crypto::hash& res, size_t& blob_size)
   {
-    return get_object_hash(t, res, blob_size);
+    if (t.hash_cache().hash.get(res) && t.hash_cache().blob_size.get(blob_size))
+      return true;
+    
+    if (!get_object_hash(t, res, blob_size))
+      return false;
+    
+    t.hash_cache().hash.set(res);
+    t.hash_cache().blob_size.set(blob_size);
+    return true;
   }
   //---------------------------------------------------------------
   bool get_transaction_hash(const transaction& t, crypto::hash& res)
@@ -680,6 +710,18 @@ namespace cryptonote
     return h;
   }
   //---------------------------------------------------------------
+  size_t get_object_blobsize(const transaction& t)
+  {
+    size_t blob_size;
+    if (t.hash_cache().blob_size.get(blob_size))
+      return blob_size;
+    
+    crypto::hash h;
+    if (!get_transaction_hash(t, h, blob_size))
+      throw std::runtime_error("Failed to get_object_blobsize");
+    return blob_size;
+  }
+  //---------------------------------------------------------------
   bool get_tx_tree_hash(const std::vector<crypto::hash>& tx_hashes, crypto::hash& h)
   {
     tree_hash(tx_hashes.data(), tx_hashes.size(), h);
@@ -875,18 +917,19 @@ namespace cryptonote
         return true;
     }
     
-    if (state == NULL)
-    {
-      LOG_ERROR("get_block_longhash: No boulderhash state (boulderhash disabled)");
-      return false;
-    }
-    
     if (height >= BOULDERHASH_2_SWITCH_BLOCK)
     {
+      if (state == NULL)
+      {
+        LOG_ERROR("get_block_longhash: No boulderhash state (boulderhash disabled)");
+        return false;
+      }
+      
       crypto::pc_boulderhash(BOULDERHASH_VERSION_REGULAR_2, bd.data(), bd.size(), res, state);
     }
     else
     {
+      // v1 is computed without the state, so works even when boulderhash is disabled
       crypto::pc_boulderhash(BOULDERHASH_VERSION_REGULAR_1, bd.data(), bd.size(), res, state);
     }
     
@@ -935,12 +978,19 @@ namespace cryptonote
   //---------------------------------------------------------------
   blobdata tx_to_blob(const transaction& tx)
   {
-    return t_serializable_object_to_blob(tx);
+    blobdata b;
+    if (!tx_to_blob(tx, b))
+      throw std::runtime_error("Failed to tx_to_blob");
+    return b;
   }
   //---------------------------------------------------------------
   bool tx_to_blob(const transaction& tx, blobdata& b_blob)
   {
-    return t_serializable_object_to_blob(tx, b_blob);
+    if (!t_serializable_object_to_blob(tx, b_blob))
+      return false;
+    
+    tx.hash_cache().blob_size.set(b_blob.size());
+    return true;
   }
   //---------------------------------------------------------------
   bool check_dpos_block_sig(const block& b, const account_public_address& delegate_addr)
@@ -17,6 +17,7 @@
 #include "crypto/crypto.h"
 #include "crypto/hash.h"
 #include "cryptonote_protocol/blobdatatype.h"
+#include "serialization/binary_blob_archive.h"
 
 //#include "cryptonote_core/tx_builder.h"
 //#include "cryptonote_core/cryptonote_basic_impl.h"
@@ -37,6 +38,7 @@ namespace cryptonote
   crypto::hash get_transaction_prefix_hash(const transaction_prefix& tx);
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefix_hash);
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx);
+  bool parse_and_validate_tx_from_blob(const char *data, size_t size, transaction& tx);
   bool construct_miner_tx(size_t height, size_t median_size, uint64_t already_generated_coins, size_t current_block_size, uint64_t fee, const account_public_address &miner_address, transaction& tx, const blobdata& extra_nonce = blobdata(), size_t max_outs = 1);
   
   bool get_block_prefix_hash(const block& b, crypto::hash& res);
@@ -112,6 +114,8 @@ namespace cryptonote
   crypto::hash get_transaction_hash(const transaction& t);
   bool get_transaction_hash(const transaction& t, crypto::hash& res);
   bool get_transaction_hash(const transaction& t, crypto::hash& res, size_t& blob_size);
+  // cached on the tx like its hash, unlike the generic get_object_blobsize
+  size_t get_object_blobsize(const transaction& t);
   bool get_block_hash(const block& b, crypto::hash& res);
   crypto::hash get_block_hash(const block& b);
   bool get_block_longhash(const block& b, crypto::hash& res, uint64_t height, uint64_t **state, bool use_cache);
@@ -165,11 +169,7 @@ namespace cryptonote
   template<class t_object>
   bool t_serializable_object_to_blob(const t_object& to, blobdata& b_blob)
   {
-    std::stringstream ss;
-    binary_archive<true> ba(ss);
-    bool r = ::serialization::serialize(ba, to);
-    b_blob = ss.str();
-    return r;
+    return ::serialization::dump_blob(to, b_blob);
   }
   //---------------------------------------------------------------
   template<class t_object>
@@ -182,17 +182,20 @@ namespace cryptonote
   }
   //---------------------------------------------------------------
   template<class t_object>
-  bool t_serializable_object_from_blob(const blobdata& b_blob, t_object& to)
+  bool t_serializable_object_from_blob(const char *data, size_t size, t_object& to)
   {
-    std::stringstream ss;
-    ss << b_blob;
-    binary_archive<false> ba(ss);
-    bool r = ::serialization::serialize(ba, to);
+    bool r = ::serialization::parse_blob(data, size, to);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse object from blob");
     return r;
   }
   //---------------------------------------------------------------
   template<class t_object>
+  bool t_serializable_object_from_blob(const blobdata& b_blob, t_object& to)
+  {
+    return t_serializable_object_from_blob(b_blob.data(), b_blob.size(), to);
+  }
+  //---------------------------------------------------------------
+  template<class t_object>
   size_t get_object_blobsize(const t_object& o)
   {
     blobdata b = t_serializable_object_to_blob(o);
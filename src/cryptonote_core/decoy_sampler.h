@@ -0,0 +1,117 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "crypto/crypto.h"
+
+namespace cryptonote
+{
+  // picks distinct random output indexes to use as mixins. sample() draws them uniformly without replacement
+  // by a Fisher-Yates shuffle that only remembers the swapped slots, so the cost depends on how many are
+  // drawn and not on how many outputs there are. sample_by_age() weights them by output age instead.
+  class decoy_sampler
+  {
+  public:
+    // the log of a spent output's age in seconds is roughly gamma distributed with these parameters,
+    // as measured on monero, whose wallets pick decoys the same way
+    static constexpr double AGE_GAMMA_SHAPE = 19.28;
+    static constexpr double AGE_GAMMA_SCALE = 1 / 1.61;
+    // age draws per wanted decoy before the rest are picked uniformly
+    static const size_t AGE_TRIES_PER_DECOY = 10;
+
+    decoy_sampler() : m_rng(crypto::rand<uint64_t>()) { }
+    explicit decoy_sampler(uint64_t seed) : m_rng(seed) { }
+
+    // offers distinct random indexes in [0, limit) to accept() until it returned true count times or
+    // every index was offered once. returns how many were accepted.
+    template<class accept_t>
+    size_t sample(size_t limit, size_t count, accept_t accept)
+    {
+      std::unordered_map<size_t, size_t> swapped;
+      auto slot = [&](size_t i) {
+        auto it = swapped.find(i);
+        return it == swapped.end() ? i : it->second;
+      };
+
+      size_t accepted = 0;
+      for (size_t k = 0; k < limit && accepted < count; k++)
+      {
+        size_t j = std::uniform_int_distribution<size_t>(k, limit - 1)(m_rng);
+        size_t picked = slot(j);
+        swapped[j] = slot(k);
+        if (accept(picked))
+          ++accepted;
+      }
+      return accepted;
+    }
+
+    // like sample(), but favours recent outputs the way real spends do, so the real output doesn't stand out
+    // as the youngest of its ring. an age is drawn from the gamma distribution above and turned into a block
+    // height below top_height, and one of the outputs from the last block at or before it with an output is
+    // offered. height_of(i) is the height output i was created at, and doesn't decrease with i. if the draws
+    // run out before count were accepted, the remaining indexes are offered uniformly.
+    template<class height_of_t, class accept_t>
+    size_t sample_by_age(size_t limit, uint64_t top_height, uint64_t seconds_per_block, size_t count,
+                         height_of_t height_of, accept_t accept)
+    {
+      std::gamma_distribution<double> log_age(AGE_GAMMA_SHAPE, AGE_GAMMA_SCALE);
+      std::unordered_set<size_t> offered;
+      size_t accepted = 0;
+
+      for (size_t tries = 0; tries < count * AGE_TRIES_PER_DECOY && accepted < count && offered.size() < limit; tries++)
+      {
+        double age = std::exp(log_age(m_rng)) / seconds_per_block;
+        if (!(age <= top_height))
+          continue;
+        uint64_t height = top_height - static_cast<uint64_t>(age);
+
+        // outputs [first, end) are the ones from the block
+        size_t end = partition_point(0, limit, [&](size_t i) { return height_of(i) <= height; });
+        if (end == 0)
+          continue;
+        uint64_t block_height = height_of(end - 1);
+        size_t first = partition_point(0, end - 1, [&](size_t i) { return height_of(i) < block_height; });
+
+        size_t picked = std::uniform_int_distribution<size_t>(first, end - 1)(m_rng);
+        if (!offered.insert(picked).second)
+          continue;
+        if (accept(picked))
+          ++accepted;
+      }
+
+      if (accepted < count && offered.size() < limit)
+      {
+        accepted += sample(limit, count - accepted, [&](size_t i) {
+          return !offered.count(i) && accept(i);
+        });
+      }
+      return accepted;
+    }
+
+  private:
+    // first index in [first, last) where pred is false, pred being true up to some point and false after
+    template<class pred_t>
+    static size_t partition_point(size_t first, size_t last, pred_t pred)
+    {
+      while (first < last)
+      {
+        size_t mid = first + (last - first) / 2;
+        if (pred(mid))
+          first = mid + 1;
+        else
+          last = mid;
+      }
+      return first;
+    }
+
+    std::mt19937_64 m_rng;
+  };
+}
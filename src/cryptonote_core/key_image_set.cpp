@@ -0,0 +1,308 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KEY_IMAGE_SET_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "include_base_utils.h"
+#include "packing.h"
+#include "common/util.h"
+#include "key_image_set.h"
+
+namespace cryptonote
+{
+  namespace
+  {
+    const size_t GROUP_SIZE = 16;
+    const size_t MIN_CAPACITY = GROUP_SIZE;
+
+    const uint64_t FILE_MAGIC = 0x5445534b58425050ULL; // "PPBXKSET"
+    const uint32_t FILE_VERSION = 1;
+
+    // keep at most 7/8 of the slots full
+    bool over_max_load(size_t count, size_t capacity)
+    {
+      return count * 8 > capacity * 7;
+    }
+
+    unsigned lowest_bit(uint32_t bits)
+    {
+#if defined(_MSC_VER)
+      unsigned long i;
+      _BitScanForward(&i, bits);
+      return i;
+#else
+      return __builtin_ctz(bits);
+#endif
+    }
+
+    // bit i of matches is set if tags[i] == tag, bit i of empties if tags[i] is empty
+    void match_group(const uint8_t *tags, uint8_t tag, uint32_t& matches, uint32_t& empties)
+    {
+#ifdef KEY_IMAGE_SET_SSE2
+      __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tags));
+      matches = _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(tag))));
+      empties = _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_setzero_si128()));
+#else
+      matches = empties = 0;
+      for (size_t i = 0; i < GROUP_SIZE; i++)
+      {
+        matches |= static_cast<uint32_t>(tags[i] == tag) << i;
+        empties |= static_cast<uint32_t>(tags[i] == 0) << i;
+      }
+#endif
+    }
+
+    PACK(struct file_header
+    {
+      uint64_t magic;
+      uint32_t version;
+      crypto::hash stamp;
+      uint64_t capacity;
+      uint64_t size;
+      uint8_t has_null;
+    });
+  }
+  //------------------------------------------------------------------
+  key_image_set::key_image_set()
+      : m_size(0)
+      , m_has_null(false)
+  {
+  }
+  //------------------------------------------------------------------
+  bool key_image_set::is_null(const crypto::key_image& ki)
+  {
+    static const crypto::key_image null_ki = crypto::key_image();
+    return memcmp(&ki, &null_ki, sizeof(ki)) == 0;
+  }
+  //------------------------------------------------------------------
+  uint8_t key_image_set::tag(const crypto::key_image& ki)
+  {
+    // byte 8 isn't part of the home slot, the high bit keeps it from looking empty
+    return 0x80 | reinterpret_cast<const uint8_t *>(&ki)[8];
+  }
+  //------------------------------------------------------------------
+  size_t key_image_set::home_slot(const crypto::key_image& ki) const
+  {
+    uint64_t h;
+    memcpy(&h, &ki, sizeof(h));
+    return static_cast<size_t>(h) & (m_slots.size() - 1);
+  }
+  //------------------------------------------------------------------
+  size_t key_image_set::find_slot(const crypto::key_image& ki) const
+  {
+    size_t mask = m_slots.size() - 1;
+    uint8_t ki_tag = tag(ki);
+    for (size_t i = home_slot(ki); ; i = (i + GROUP_SIZE) & mask)
+    {
+      uint32_t matches, empties;
+      match_group(&m_tags[i], ki_tag, matches, empties);
+      // the cluster ends at the first empty slot
+      if (empties)
+        matches &= (empties & (0 - empties)) - 1;
+
+      for (; matches; matches &= matches - 1)
+      {
+        size_t j = (i + lowest_bit(matches)) & mask;
+        if (memcmp(&m_slots[j], &ki, sizeof(ki)) == 0)
+          return j;
+      }
+      if (empties)
+        return (i + lowest_bit(empties)) & mask;
+    }
+  }
+  //------------------------------------------------------------------
+  void key_image_set::set_slot(size_t i, const crypto::key_image& ki)
+  {
+    uint8_t slot_tag = is_null(ki) ? 0 : tag(ki);
+    m_slots[i] = ki;
+    m_tags[i] = slot_tag;
+    if (i < GROUP_SIZE - 1)
+      m_tags[m_slots.size() + i] = slot_tag;
+  }
+  //------------------------------------------------------------------
+  bool key_image_set::contains(const crypto::key_image& ki) const
+  {
+    if (is_null(ki))
+      return m_has_null;
+    if (m_slots.empty())
+      return false;
+    return !is_null(m_slots[find_slot(ki)]);
+  }
+  //------------------------------------------------------------------
+  bool key_image_set::insert(const crypto::key_image& ki)
+  {
+    if (is_null(ki))
+    {
+      bool inserted = !m_has_null;
+      m_has_null = true;
+      return inserted;
+    }
+
+    if (m_slots.empty() || over_max_load(m_size + 1, m_slots.size()))
+      rehash(std::max(MIN_CAPACITY, m_slots.size() * 2));
+
+    size_t i = find_slot(ki);
+    if (!is_null(m_slots[i]))
+      return false;
+
+    set_slot(i, ki);
+    ++m_size;
+    return true;
+  }
+  //------------------------------------------------------------------
+  size_t key_image_set::erase(const crypto::key_image& ki)
+  {
+    if (is_null(ki))
+    {
+      size_t erased = m_has_null ? 1 : 0;
+      m_has_null = false;
+      return erased;
+    }
+    if (m_slots.empty())
+      return 0;
+
+    size_t hole = find_slot(ki);
+    if (is_null(m_slots[hole]))
+      return 0;
+
+    // move back any later entry of the cluster whose home slot is at or before the hole
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = (hole + 1) & mask; m_tags[i] != 0; i = (i + 1) & mask)
+    {
+      size_t home = home_slot(m_slots[i]);
+      if (((i - home) & mask) >= ((i - hole) & mask))
+      {
+        set_slot(hole, m_slots[i]);
+        hole = i;
+      }
+    }
+
+    set_slot(hole, crypto::key_image());
+    --m_size;
+    return 1;
+  }
+  //------------------------------------------------------------------
+  void key_image_set::clear()
+  {
+    std::vector<crypto::key_image>().swap(m_slots);
+    std::vector<uint8_t>().swap(m_tags);
+    m_size = 0;
+    m_has_null = false;
+  }
+  //------------------------------------------------------------------
+  void key_image_set::reserve(size_t n)
+  {
+    size_t capacity = std::max(MIN_CAPACITY, m_slots.size());
+    while (over_max_load(n, capacity))
+      capacity *= 2;
+    if (capacity != m_slots.size())
+      rehash(capacity);
+  }
+  //------------------------------------------------------------------
+  void key_image_set::rehash(size_t new_capacity)
+  {
+    std::vector<crypto::key_image> old_slots(new_capacity);
+    old_slots.swap(m_slots);
+    std::vector<uint8_t>(new_capacity + GROUP_SIZE - 1).swap(m_tags);
+
+    for (const auto& ki : old_slots)
+    {
+      if (!is_null(ki))
+        set_slot(find_slot(ki), ki);
+    }
+  }
+  //------------------------------------------------------------------
+  bool key_image_set::store_to_file(const std::string& filename, const crypto::hash& stamp) const
+  {
+    const std::string temp_filename = filename + ".tmp";
+    {
+      std::ofstream out(temp_filename, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+      if (out.fail())
+      {
+        LOG_ERROR("Couldn't open " << temp_filename << " to store key images");
+        return false;
+      }
+
+      file_header header = {FILE_MAGIC, FILE_VERSION, stamp, m_slots.size(), m_size, m_has_null};
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      out.write(reinterpret_cast<const char *>(m_slots.data()), m_slots.size() * sizeof(crypto::key_image));
+      out.flush();
+      if (out.fail())
+      {
+        LOG_ERROR("Couldn't write key images to " << temp_filename);
+        return false;
+      }
+    }
+
+    std::error_code ec = tools::replace_file(temp_filename, filename);
+    if (ec)
+    {
+      LOG_ERROR("Couldn't rename " << temp_filename << " to " << filename << ": " << ec.message());
+      return false;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------
+  bool key_image_set::load_from_file(const std::string& filename, const crypto::hash& stamp)
+  {
+    clear();
+
+    std::ifstream in(filename, std::ios_base::binary | std::ios_base::in);
+    if (in.fail())
+      return false;
+
+    file_header header;
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (in.fail() || header.magic != FILE_MAGIC || header.version != FILE_VERSION || header.stamp != stamp)
+      return false;
+    // a set that never held a key image has no slots at all
+    if ((header.capacity != 0 && header.capacity < MIN_CAPACITY) || (header.capacity & (header.capacity - 1)) != 0 ||
+        over_max_load(header.size, header.capacity))
+    {
+      LOG_ERROR("Key image set in " << filename << " has a bad size");
+      return false;
+    }
+
+    m_slots.resize(header.capacity);
+    in.read(reinterpret_cast<char *>(m_slots.data()), m_slots.size() * sizeof(crypto::key_image));
+    if (in.fail())
+    {
+      LOG_ERROR("Key image set in " << filename << " is cut short");
+      clear();
+      return false;
+    }
+
+    // the tags aren't stored, they follow from the slots
+    if (!m_slots.empty())
+      m_tags.assign(m_slots.size() + GROUP_SIZE - 1, 0);
+    for (size_t i = 0; i < m_slots.size(); i++)
+    {
+      if (!is_null(m_slots[i]))
+      {
+        set_slot(i, m_slots[i]);
+        ++m_size;
+      }
+    }
+    m_has_null = header.has_null != 0;
+
+    if (m_size != header.size)
+    {
+      LOG_ERROR("Key image set in " << filename << " holds " << m_size << " key images instead of " << header.size);
+      clear();
+      return false;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  // a set of key images kept in one flat array with open addressing (linear probing). key images
+  // are already uniformly distributed, so their first bytes are the hash. the all-zero key image marks
+  // an empty slot and is tracked separately. erase() shifts the rest of the cluster back instead of
+  // leaving tombstones, so lookups never slow down as keys are removed during reorgs.
+  //
+  // each slot also has a one-byte tag taken from other bits of the key image, and probing compares the
+  // tags of 16 slots at once, so a full key image is only compared when its tag matches. that keeps
+  // probing cheap enough to fill the table up to 7/8: with 33 bytes per slot a key image costs 38 bytes
+  // when the table is full and 75 right after it doubled.
+  class key_image_set
+  {
+  public:
+    key_image_set();
+
+    size_t size() const { return m_size + (m_has_null ? 1 : 0); }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return m_slots.size(); }
+
+    bool contains(const crypto::key_image& ki) const;
+    // false if it was already there
+    bool insert(const crypto::key_image& ki);
+    // number of key images removed, 0 or 1
+    size_t erase(const crypto::key_image& ki);
+    void clear();
+    // make room for n key images without growing
+    void reserve(size_t n);
+
+    // write the table as it is, so loading it back doesn't have to insert every key image again.
+    // stamp says which state of the blockchain the set belongs to
+    bool store_to_file(const std::string& filename, const crypto::hash& stamp) const;
+    // false, leaving the set empty, if the file is missing, damaged or was stored with another stamp
+    bool load_from_file(const std::string& filename, const crypto::hash& stamp);
+
+  private:
+    static bool is_null(const crypto::key_image& ki);
+    static uint8_t tag(const crypto::key_image& ki);
+    size_t home_slot(const crypto::key_image& ki) const;
+    // the slot holding ki, or the empty slot where it would go
+    size_t find_slot(const crypto::key_image& ki) const;
+    void set_slot(size_t i, const crypto::key_image& ki);
+    void rehash(size_t new_capacity);
+
+    std::vector<crypto::key_image> m_slots; // power of two in size, null = empty
+    std::vector<uint8_t> m_tags;            // tag per slot, 0 = empty. the first 15 repeat at the end
+                                            // so the 16 tags from any slot can be read in one go
+    size_t m_size;                          // non-null key images in m_slots
+    bool m_has_null;
+  };
+}
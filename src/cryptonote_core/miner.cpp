@@ -464,7 +464,7 @@ namespace cryptonote
       if (m_dont_share_state || th_local_index > 0)
       {
         LOG_PRINT_L0("Mallocing boulderhash state...");
-        state = crypto::pc_malloc_state();
+        state = crypto::pc_malloc_state(crypto::pc_state_numa_node(th_local_index));
         allocated_state = true;
       }
       else
@@ -0,0 +1,66 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/foreach.hpp>
+
+#include "include_base_utils.h"
+
+#include "crypto/crypto_basic_impl.h"
+
+#include "ring_signature_verifier.h"
+
+namespace cryptonote
+{
+  //------------------------------------------------------------------
+  ring_signature_verifier::ring_signature_verifier()
+      : m_workers("ring signature")
+  {
+  }
+  //------------------------------------------------------------------
+  bool ring_signature_verifier::verify_one(const ring_signature_job& job)
+  {
+    if (job.keys.size() != job.sigs.size())
+    {
+      LOG_ERROR("Ring signature job for input " << job.input_index << " of tx " << job.tx_id << " has "
+                << job.keys.size() << " keys but " << job.sigs.size() << " signatures");
+      return false;
+    }
+
+    // need vector of addresses for check_ring_signature, so ...
+    std::vector<const crypto::public_key*> vec_pkeys;
+    BOOST_FOREACH(const auto& key, job.keys)
+    {
+      vec_pkeys.push_back(&key);
+    }
+
+    if (!crypto::check_ring_signature(job.prefix_hash, job.k_image, vec_pkeys, job.sigs.data()))
+    {
+      LOG_PRINT_L0("Ring signature check failed for input " << job.input_index << " of tx " << job.tx_id);
+      return false;
+    }
+
+    return true;
+  }
+  //------------------------------------------------------------------
+  bool ring_signature_verifier::verify_range(const std::vector<ring_signature_job>& jobs,
+                                             size_t start_i, size_t end_i)
+  {
+    bool all_valid = true;
+    for (size_t i=start_i; i < end_i; i++)
+    {
+      // keep going so every bad input gets logged
+      if (!verify_one(jobs[i]))
+        all_valid = false;
+    }
+    return all_valid;
+  }
+  //------------------------------------------------------------------
+  bool ring_signature_verifier::verify(const std::vector<ring_signature_job>& jobs)
+  {
+    return m_workers.run(jobs.size(), [&](size_t start_i, size_t end_i) {
+      return verify_range(jobs, start_i, end_i);
+    });
+  }
+  //------------------------------------------------------------------
+}
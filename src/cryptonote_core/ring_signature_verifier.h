@@ -0,0 +1,43 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <vector>
+
+#include "common/worker_pool.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  // one ring signature to check. everything is copied out of the blockchain/transaction, so
+  // it can be checked on any thread without holding the blockchain lock
+  struct ring_signature_job
+  {
+    crypto::hash tx_id;
+    size_t input_index;
+    crypto::hash prefix_hash;
+    crypto::key_image k_image;
+    std::vector<crypto::public_key> keys;
+    std::vector<crypto::signature> sigs;
+  };
+
+  // checks batches of ring signatures on a pool of worker threads
+  class ring_signature_verifier
+  {
+  public:
+    ring_signature_verifier();
+
+    // check every job, returns false if any one of them fails
+    bool verify(const std::vector<ring_signature_job>& jobs);
+
+    static bool verify_one(const ring_signature_job& job);
+
+  private:
+    static bool verify_range(const std::vector<ring_signature_job>& jobs, size_t start_i, size_t end_i);
+
+    tools::worker_pool m_workers;
+  };
+}
@@ -104,7 +104,11 @@ namespace cryptonote
   
   void tx_builder::update_version_to(size_t min_version)
   {
-    if (m_tx.version < min_version) m_tx.version = min_version;
+    if (m_tx.version < min_version)
+    {
+      m_tx.version = min_version;
+      m_tx.invalidate_hashes();
+    }
   }
   
   void tx_builder::update_version_to(const txin_v& inp, const coin_type& cp)
@@ -708,6 +712,8 @@ namespace cryptonote
       ss_ring_s << "prefix_hash:" << tx_prefix_hash << ENDL << "in_ephemeral_key: " << m_in_contexts[source_index].in_ephemeral.sec << ENDL << "real_output: " << src_entr.real_output;
       source_index++;
     }
+    // signatures were filled in place
+    m_tx.invalidate_hashes();
 
     crypto::hash tx_hash;
     CHECK_AND_ASSERT(get_transaction_hash(m_tx, tx_hash), false);
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "serialization/binary_archive.h"
+#include "serialization/binary_blob_archive.h"
 
 #define TX_EXTRA_PADDING_MAX_COUNT          255
 #define TX_EXTRA_NONCE_MAX_COUNT            255
@@ -111,23 +112,21 @@ namespace cryptonote
       if(!::do_serialize(ar, field))
         return false;
 
-      std::istringstream iss(field);
-      binary_archive<false> iar(iss);
       serialize_helper helper(*this);
-      return ::serialization::serialize(iar, helper);
+      return ::serialization::parse_blob(field.data(), field.size(), helper);
     }
 
     // store
     template <template <bool> class Archive>
     bool do_serialize(Archive<true>& ar)
     {
-      std::ostringstream oss;
-      binary_archive<true> oar(oss);
+      std::string field;
+      ::serialization::blob_ostream oss(field);
+      binary_blob_archive<true> oar(oss);
       serialize_helper helper(*this);
       if(!::do_serialize(oar, helper))
         return false;
 
-      std::string field = oss.str();
       return ::serialization::serialize(ar, field);
     }
   };
@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <boost/filesystem.hpp>
+#include <cstring>
 #include <unordered_set>
 #include <vector>
 
@@ -74,6 +75,51 @@ namespace cryptonote
       }
       return true;
     }
+    
+    struct has_grade_visitor: tx_input_visitor_base_opt<bool, false, false>
+    {
+      using tx_input_visitor_base_opt<bool, false, false>::operator();
+      
+      bool operator()(const txin_grade_contract& inp) const
+      {
+        return true;
+      }
+    };
+    
+    // true only if every input is a txin_to_key whose key image the chain hasn't spent yet
+    struct key_images_unspent_visitor: tx_input_visitor_base_opt<bool, false, false>
+    {
+      using tx_input_visitor_base_opt<bool, false, false>::operator();
+      
+      const blockchain_storage& b;
+      
+      key_images_unspent_visitor(const blockchain_storage& b_in) : b(b_in) { }
+      
+      bool operator()(const txin_to_key& inp) const
+      {
+        return !b.have_tx_keyimg_as_spent(inp.k_image);
+      }
+    };
+    
+    bool tx_priority_less::operator()(const tx_priority_key& a, const tx_priority_key& b) const
+    {
+      if (a.grading != b.grading)
+        return a.grading;
+      
+      // a.fee / a.blob_size > b.fee / b.blob_size, cross-multiplied so it can't overflow
+      uint64_t a_hi, b_hi;
+      uint64_t a_lo = mul128(a.fee, b.blob_size, &a_hi);
+      uint64_t b_lo = mul128(b.fee, a.blob_size, &b_hi);
+      if (a_hi != b_hi)
+        return a_hi > b_hi;
+      if (a_lo != b_lo)
+        return a_lo > b_lo;
+      
+      // same rate: smaller first, then by id so distinct txs never compare equal
+      if (a.blob_size != b.blob_size)
+        return a.blob_size < b.blob_size;
+      return memcmp(&a.id, &b.id, sizeof(crypto::hash)) < 0;
+    }
   }
   //---------------------------------------------------------------------------------
   tx_memory_pool::tx_memory_pool(blockchain_storage& bchs): m_blockchain(bchs), m_callback(0)
@@ -202,6 +248,13 @@ namespace cryptonote
         txd_p.first->second.max_used_block_id = null_hash;
         txd_p.first->second.max_used_block_height = 0;
         txd_p.first->second.kept_by_block = kept_by_block;
+        txd_p.first->second.last_failed_height = 0;
+        txd_p.first->second.last_failed_id = null_hash;
+        txd_p.first->second.last_verified_height = 0;
+        txd_p.first->second.last_verified_id = null_hash;
+        m_priority_index.insert(get_priority_key(id, txd_p.first->second));
+        if (m_template_txs.valid)
+          m_template_txs.added.push_back(id);
         tvc.m_verifivation_impossible = true;
         tvc.m_added_to_pool = true;
       }else
@@ -223,6 +276,11 @@ namespace cryptonote
       txd_p.first->second.max_used_block_height = max_used_block_height;
       txd_p.first->second.last_failed_height = 0;
       txd_p.first->second.last_failed_id = null_hash;
+      txd_p.first->second.last_verified_height = 0;
+      txd_p.first->second.last_verified_id = null_hash;
+      m_priority_index.insert(get_priority_key(id, txd_p.first->second));
+      if (m_template_txs.valid)
+        m_template_txs.added.push_back(id);
       tvc.m_added_to_pool = true;
 
       if(txd_p.first->second.fee >= DEFAULT_FEE)
@@ -281,7 +339,10 @@ namespace cryptonote
     {
       LOG_ERROR("Could not remove transaction data for tx " << id);
     }
+    auto key = get_priority_key(id, it->second);
+    m_priority_index.erase(key);
     m_transactions.erase(it);
+    on_block_template_tx_taken(key);
     if (0 != m_callback)
       m_callback->on_tx_removed(id, tx);
     return true;
@@ -381,13 +442,29 @@ namespace cryptonote
       }
     }
     
+    // if the inputs passed at a tip that's still on the main chain, blocks added since then can only have
+    // spent their key images, so check those instead of the ring signatures. anything else gets the full check.
+    if (txd.last_verified_id != null_hash
+        && m_blockchain.get_block_id_by_height(txd.last_verified_height) == txd.last_verified_id
+        && tools::all_apply_visitor(detail::key_images_unspent_visitor(m_blockchain), txd.tx.ins()))
+    {
+      return true;
+    }
+    
+    // take the tip first, so blocks added during the check get their key images checked next time
+    uint64_t tip_height = m_blockchain.get_current_blockchain_height()-1;
+    crypto::hash tip_id = m_blockchain.get_block_id_by_height(tip_height);
+    
     //always check the inputs, there may be txs that can't be added because of keeped by block txs
     if (!m_blockchain.validate_tx(txd.tx, false, &txd.max_used_block_height))
     {
       txd.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
       txd.last_failed_id = m_blockchain.get_block_id_by_height(txd.last_failed_height);
+      txd.last_verified_id = null_hash;
       return false;
     }
+    txd.last_verified_height = tip_height;
+    txd.last_verified_id = tip_id;
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -407,7 +484,9 @@ namespace cryptonote
           << "max_used_block_height: " << txd.max_used_block_height << ENDL
           << "max_used_block_id: " << txd.max_used_block_id << ENDL
           << "last_failed_height: " << txd.last_failed_height << ENDL
-          << "last_failed_id: " << txd.last_failed_id << ENDL;
+          << "last_failed_id: " << txd.last_failed_id << ENDL
+          << "last_verified_height: " << txd.last_verified_height << ENDL
+          << "last_verified_id: " << txd.last_verified_id << ENDL;
       }else
       {
         auto& txd = txe.second;
@@ -419,74 +498,171 @@ namespace cryptonote
           << "max_used_block_height: " << txd.max_used_block_height << ENDL
           << "max_used_block_id: " << txd.max_used_block_id << ENDL
           << "last_failed_height: " << txd.last_failed_height << ENDL
-          << "last_failed_id: " << txd.last_failed_id << ENDL;
+          << "last_failed_id: " << txd.last_failed_id << ENDL
+          << "last_verified_height: " << txd.last_verified_height << ENDL
+          << "last_verified_id: " << txd.last_verified_id << ENDL;
       }
 
     }
     return ss.str();
   }
   //---------------------------------------------------------------------------------
-  namespace detail
+  detail::tx_priority_key tx_memory_pool::get_priority_key(const crypto::hash& id, const tx_details& txd) const
   {
-    struct has_grade_visitor: tx_input_visitor_base_opt<bool, false, false>
-    {
-      using tx_input_visitor_base_opt<bool, false, false>::operator();
-      
-      bool operator()(const txin_grade_contract& inp) const
-      {
-        return true;
-      }
-    };
+    bool grading = tools::any_apply_visitor(detail::has_grade_visitor(), txd.tx.ins());
+    return detail::tx_priority_key(grading, txd.fee, txd.blob_size, id);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::rebuild_priority_index()
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    m_priority_index.clear();
+    BOOST_FOREACH(const auto& txe, m_transactions)
+      m_priority_index.insert(get_priority_key(txe.first, txe.second));
+    m_template_txs.valid = false;
   }
-  
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::fill_block_template(block &bl, size_t median_size, uint64_t already_generated_coins,
                                            size_t &total_size, uint64_t &fee)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-
-    total_size = 0;
-    fee = 0;
     
-    tx_input_compat_checker icc;
-
-    size_t max_total_size = 2 * median_size - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    std::unordered_set<crypto::hash> added_txs;
+    block_template_txs& tt = m_template_txs;
+    if (!tt.valid || tt.prev_id != bl.prev_id || tt.median_size != median_size || !update_block_template_txs(bl.timestamp))
+    {
+      if (!select_block_template_txs(bl.prev_id, median_size, bl.timestamp))
+        return false;
+    }
     
-    // first pass: prioritize grading txs so people can't mint & fuse to prevent a contract from being graded
-    // second pass: proceed as usual
-    int pass = 0;
-    while (true)
+    BOOST_FOREACH(const auto& key, tt.picked)
+      bl.tx_hashes.push_back(key.id);
+    total_size = tt.total_size;
+    fee = tt.fee;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::select_block_template_txs(const crypto::hash& prev_id, size_t median_size, uint64_t now)
+  {
+    block_template_txs& tt = m_template_txs;
+    tt = block_template_txs();
+    tt.prev_id = prev_id;
+    tt.median_size = median_size;
+    tt.not_ready_checked_time = now;
+    
+    // grading txs come first in the index, the rest by fee per byte, so a single walk fills the block greedily
+    BOOST_FOREACH(const auto& key, m_priority_index)
     {
-      bool only_grading = pass == 0;
-      BOOST_FOREACH(auto& txe, m_transactions)
+      auto it = m_transactions.find(key.id);
+      CHECK_AND_ASSERT_MES(it != m_transactions.end(), false,
+                           "internal error: tx " << key.id << " in priority index but not in pool");
+      
+      pick_block_template_tx(key, it->second);
+    }
+    
+    tt.valid = true;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::update_block_template_txs(uint64_t now)
+  {
+    // as long as every ready tx was picked, the greedy walk would pick the same txs plus whichever new ones
+    // are ready and fit. once one was left out, a new or freed up tx could change what fits, so walk again
+    block_template_txs& tt = m_template_txs;
+    if (tt.inputs_stale)
+    {
+      tt.picked_inputs.reset(new tx_input_compat_checker());
+      BOOST_FOREACH(const auto& key, tt.picked)
+        tt.picked_inputs->add_tx(m_transactions.find(key.id)->second.tx);
+      tt.inputs_stale = false;
+    }
+    
+    // inputs locked until a certain time unlock without the tip or the pool changing
+    if (!tt.not_ready.empty() && now >= tt.not_ready_checked_time + CRYPTONOTE_POOL_LOCKED_TX_RECHECK_INTERVAL)
+    {
+      BOOST_FOREACH(const auto& id, tt.not_ready)
       {
-        if (added_txs.count(txe.first) > 0) //already added it
-          continue;
-        
-        if (max_total_size < total_size + txe.second.blob_size)
-          continue;
-        
-        if (only_grading && !tools::any_apply_visitor(detail::has_grade_visitor(), txe.second.tx.ins()))
+        auto it = m_transactions.find(id);
+        if (it == m_transactions.end())
           continue;
-
-        if (!is_transaction_ready_to_go(txe.second) ||!icc.can_add_tx(txe.second.tx))
-          continue;
-
-        bl.tx_hashes.push_back(txe.first);
-        added_txs.insert(txe.first);
-        total_size += txe.second.blob_size;
-        fee += txe.second.fee;
-        icc.add_tx(txe.second.tx);
+        it->second.last_failed_id = null_hash; // so it's checked again instead of failing at the same tip
+        tt.added.push_back(id);
       }
+      tt.not_ready.clear();
+      tt.not_ready_checked_time = now;
+    }
+    
+    std::vector<crypto::hash> added;
+    added.swap(tt.added);
+    BOOST_FOREACH(const auto& id, added)
+    {
+      auto it = m_transactions.find(id);
+      if (it == m_transactions.end())
+        continue;
       
-      pass++;
-      if (pass == 2)
-        break;
+      pick_block_template_tx(get_priority_key(id, it->second), it->second);
+      if (tt.skipped_ready)
+        return false;
     }
-
     return true;
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::pick_block_template_tx(const detail::tx_priority_key& key, tx_details& txd)
+  {
+    block_template_txs& tt = m_template_txs;
+    if (tt.picked.count(key))
+      return;
+    
+    size_t max_total_size = 2 * tt.median_size - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+    if (max_total_size < tt.total_size + key.blob_size)
+    {
+      tt.skipped_ready = true;
+      return;
+    }
+    
+    if (!is_transaction_ready_to_go(txd))
+    {
+      tt.not_ready.insert(key.id);
+      return;
+    }
+    
+    if (!tt.picked_inputs->can_add_tx(txd.tx))
+    {
+      tt.skipped_ready = true;
+      return;
+    }
+    
+    tt.picked.insert(key);
+    tt.total_size += key.blob_size;
+    tt.fee += key.fee;
+    tt.picked_inputs->add_tx(txd.tx);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::on_block_template_tx_taken(const detail::tx_priority_key& key)
+  {
+    block_template_txs& tt = m_template_txs;
+    if (!tt.valid)
+      return;
+    
+    tt.not_ready.erase(key.id);
+    tt.added.erase(std::remove(tt.added.begin(), tt.added.end(), key.id), tt.added.end());
+    
+    auto it = tt.picked.find(key);
+    if (it == tt.picked.end())
+      return;
+    
+    // a tx left out before may fit now
+    if (tt.skipped_ready)
+    {
+      tt.valid = false;
+      return;
+    }
+    
+    tt.total_size -= key.blob_size;
+    tt.fee -= key.fee;
+    tt.picked.erase(it);
+    tt.inputs_stale = true;
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::init(const std::string& config_folder)
   {
     m_config_folder = config_folder;
@@ -8,6 +8,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <functional>
+#include <memory>
 
 #include <boost/serialization/version.hpp>
 #include <boost/utility.hpp>
@@ -26,7 +27,9 @@
 #include "cryptonote_basic.h"
 #include "cryptonote_basic_impl.h"
 #include "verification_context.h"
+#include "nulls.h"
 #include "i_tx_pool_callback.h"
+#include "tx_input_compat_checker.h"
 
 namespace cryptonote
 {
@@ -187,6 +190,25 @@ namespace cryptonote
       boost::apply_visitor(add_txin_info_descr_visitor(o), v);
       return o;
     }
+    
+    // position of a tx in the block template order: grading txs first, so people can't mint & fuse to prevent
+    // a contract from being graded, then highest fee per byte first
+    struct tx_priority_key
+    {
+      bool grading;
+      uint64_t fee;
+      size_t blob_size;
+      crypto::hash id;
+      
+      tx_priority_key() { }
+      tx_priority_key(bool grading_in, uint64_t fee_in, size_t blob_size_in, const crypto::hash& id_in)
+          : grading(grading_in), fee(fee_in), blob_size(blob_size_in), id(id_in) { }
+    };
+    
+    struct tx_priority_less
+    {
+      bool operator()(const tx_priority_key& a, const tx_priority_key& b) const;
+    };
   }
     
 }
@@ -219,6 +241,7 @@ namespace cryptonote
     // load/store operations
     bool init(const std::string& config_folder);
     bool deinit();
+    // picks the txs for a block on bl.prev_id at bl.timestamp
     bool fill_block_template(block &bl, size_t median_size, uint64_t already_generated_coins,
                              size_t &total_size, uint64_t &fee);
     bool get_transactions(std::list<transaction>& txs) const;
@@ -238,6 +261,8 @@ namespace cryptonote
       CRITICAL_REGION_LOCAL(m_transactions_lock);
       a & m_transactions;
       a & m_txin_infos;
+      if (archive_t::is_loading::value)
+        rebuild_priority_index();
     }
 
     struct tx_details
@@ -251,6 +276,9 @@ namespace cryptonote
       //
       uint64_t last_failed_height;
       crypto::hash last_failed_id;
+      //tip at which the inputs last passed validate_tx, not persisted
+      uint64_t last_verified_height;
+      crypto::hash last_verified_id;
     };
     
     i_tx_pool_callback* callback() const { return m_callback; }
@@ -262,13 +290,47 @@ namespace cryptonote
     bool check_can_add_inp(const txin_v& inp) const;
     
     bool is_transaction_ready_to_go(tx_details& txd) const;
+    
+    detail::tx_priority_key get_priority_key(const crypto::hash& id, const tx_details& txd) const;
+    void rebuild_priority_index();
+    
+    bool select_block_template_txs(const crypto::hash& prev_id, size_t median_size, uint64_t now);
+    bool update_block_template_txs(uint64_t now);
+    void pick_block_template_tx(const detail::tx_priority_key& key, tx_details& txd);
+    void on_block_template_tx_taken(const detail::tx_priority_key& key);
+    
     typedef std::unordered_map<crypto::hash, tx_details > transactions_container;
     typedef std::unordered_map<detail::txin_info, std::unordered_set<crypto::hash>,
                                boost::hash<detail::txin_info> > txin_info_container;
+    typedef std::set<detail::tx_priority_key, detail::tx_priority_less> priority_index_container;
+    
+    // the txs the last fill_block_template() picked. while the tip stays the same, txs added to or taken
+    // from the pool since are applied to the pick instead of walking the whole pool again
+    struct block_template_txs
+    {
+      bool valid;
+      crypto::hash prev_id;
+      size_t median_size;
+      priority_index_container picked;
+      size_t total_size;
+      uint64_t fee;
+      std::unique_ptr<tx_input_compat_checker> picked_inputs;
+      bool inputs_stale;                         // a picked tx was taken since
+      bool skipped_ready;                        // a tx was left out for lack of room or a conflict
+      std::vector<crypto::hash> added;           // added to the pool since, not looked at yet
+      std::unordered_set<crypto::hash> not_ready;
+      uint64_t not_ready_checked_time;
+      
+      block_template_txs() : valid(false), prev_id(null_hash), median_size(0), total_size(0), fee(0),
+                             picked_inputs(new tx_input_compat_checker()), inputs_stale(false), skipped_ready(false),
+                             not_ready_checked_time(0) { }
+    };
     
     mutable epee::critical_section m_transactions_lock;
     transactions_container m_transactions;
     txin_info_container m_txin_infos;
+    priority_index_container m_priority_index; // every tx in m_transactions, in block template order
+    block_template_txs m_template_txs;
 
     //transactions_container m_alternative_transactions;
 
@@ -299,6 +361,11 @@ namespace boost
       ar & td.max_used_block_id;
       ar & td.last_failed_height;
       ar & td.last_failed_id;
+      if (archive_t::is_loading::value)
+      {
+        td.last_verified_height = 0;
+        td.last_verified_id = cryptonote::null_hash;
+      }
     }
 
     template<class archive_t>
@@ -7,21 +7,27 @@
 #include "cryptonote_basic.h"
 
 namespace cryptonote {
-  
-  // non-const access to vin/vout to help testing
+
+  // non-const access to a tx's fields to help testing. references taken through it are often used after
+  // the tester is gone, so the tx stops caching its hashes for good rather than until the tester is done.
   class tx_tester
   {
   public:
     transaction& tx;
-    
+
     std::vector<txin_v>& vin;
     std::vector<tx_out>& vout;
     std::vector<coin_type>& vin_coin_types;
     std::vector<coin_type>& vout_coin_types;
-    
+    std::vector<uint8_t>& extra;
+    std::vector<std::vector<crypto::signature> >& signatures;
+
     tx_tester(transaction& tx_in) : tx(tx_in), vin(tx.vin), vout(tx.vout)
                                   , vin_coin_types(tx.vin_coin_types), vout_coin_types(tx.vout_coin_types)
-    { }
+                                  , extra(tx.extra), signatures(tx.signatures)
+    {
+      tx.m_hash_cache.disable();
+    }
   };
-  
+
 }
@@ -0,0 +1,173 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <ctime>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/uuid/uuid.hpp>
+
+#include "syncobj.h"
+
+#include "crypto/hash.h"
+#include "cryptonote_protocol_defs.h"
+
+namespace cryptonote
+{
+  // a downloaded block, parsed and hashed ahead of being added to the chain
+  struct prepared_block
+  {
+    block_complete_entry entry;
+    crypto::hash id;
+    crypto::hash prev_id;
+  };
+
+  // blocks being downloaded during sync, shared by all synchronizing connections. a block id is only
+  // requested from one connection at a time, so connections fetch disjoint spans of the chain. spans that
+  // arrive before the span they build on wait here until their parent block is known.
+  // a connection's reservations are dropped when it closes, anything left over by expire().
+  class block_queue
+  {
+  public:
+    struct span
+    {
+      boost::uuids::uuid connection_id;
+      std::vector<prepared_block> blocks;
+      time_t added;
+    };
+
+    explicit block_queue(time_t timeout) : m_timeout(timeout) { }
+
+    // reserves the block for the connection, false if another connection already has it
+    bool reserve(const boost::uuids::uuid& connection_id, const crypto::hash& id, time_t now)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      if (m_waiting.count(id))
+        return false;
+
+      auto it = m_reserved.find(id);
+      if (it != m_reserved.end() && it->second.connection_id != connection_id && it->second.time + m_timeout > now)
+        return false;
+
+      reservation& r = m_reserved[id];
+      r.connection_id = connection_id;
+      r.time = now;
+      return true;
+    }
+
+    // the downloaded blocks stop being reserved and wait for pop_ready()
+    void add_span(const boost::uuids::uuid& connection_id, std::vector<prepared_block>&& blocks, time_t now)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      if (blocks.empty())
+        return;
+
+      for (const auto& pb : blocks)
+      {
+        m_reserved.erase(pb.id);
+        m_waiting.insert(pb.id);
+      }
+
+      m_spans.push_back(span());
+      m_spans.back().connection_id = connection_id;
+      m_spans.back().blocks = std::move(blocks);
+      m_spans.back().added = now;
+    }
+
+    // takes out a waiting span whose first block builds on a block is_known(prev_id) says we have
+    template<class is_known_t>
+    bool pop_ready(is_known_t is_known, span& s)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      for (auto it = m_spans.begin(); it != m_spans.end(); ++it)
+      {
+        if (!is_known(it->blocks.front().prev_id))
+          continue;
+
+        s = std::move(*it);
+        m_spans.erase(it);
+        for (const auto& pb : s.blocks)
+          m_waiting.erase(pb.id);
+        return true;
+      }
+      return false;
+    }
+
+    // other connections can fetch what the connection reserved but didn't download, e.g. when it closes
+    void release_reservations(const boost::uuids::uuid& connection_id)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      for (auto it = m_reserved.begin(); it != m_reserved.end(); )
+      {
+        if (it->second.connection_id == connection_id)
+          it = m_reserved.erase(it);
+        else
+          ++it;
+      }
+    }
+
+    // forget everything the connection reserved or downloaded, e.g. when it sent bad blocks
+    void release(const boost::uuids::uuid& connection_id)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      release_reservations(connection_id);
+
+      for (auto it = m_spans.begin(); it != m_spans.end(); )
+      {
+        if (it->connection_id == connection_id)
+          it = erase_span(it);
+        else
+          ++it;
+      }
+    }
+
+    // drop reservations and waiting spans older than the timeout, so other connections can fetch them
+    void expire(time_t now)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      for (auto it = m_reserved.begin(); it != m_reserved.end(); )
+      {
+        if (it->second.time + m_timeout <= now)
+          it = m_reserved.erase(it);
+        else
+          ++it;
+      }
+
+      for (auto it = m_spans.begin(); it != m_spans.end(); )
+      {
+        if (it->added + m_timeout <= now)
+          it = erase_span(it);
+        else
+          ++it;
+      }
+    }
+
+    size_t reserved_count() const { CRITICAL_REGION_LOCAL(m_lock); return m_reserved.size(); }
+    size_t span_count() const { CRITICAL_REGION_LOCAL(m_lock); return m_spans.size(); }
+
+  private:
+    struct reservation
+    {
+      boost::uuids::uuid connection_id;
+      time_t time;
+    };
+
+    std::list<span>::iterator erase_span(std::list<span>::iterator it)
+    {
+      for (const auto& pb : it->blocks)
+        m_waiting.erase(pb.id);
+      return m_spans.erase(it);
+    }
+
+    mutable epee::critical_section m_lock;
+    time_t m_timeout;
+    std::unordered_map<crypto::hash, reservation> m_reserved;
+    std::unordered_set<crypto::hash> m_waiting;
+    std::list<span> m_spans;
+  };
+}
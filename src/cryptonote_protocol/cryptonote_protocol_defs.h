@@ -53,6 +53,61 @@ namespace cryptonote
     };
   };
 
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  // a new block without its transactions, which the receiver takes from its pool or asks for with
+  // NOTIFY_REQUEST_BLOCK_TXS. only sent to peers that set supports_compact_blocks in their sync data
+  struct NOTIFY_NEW_COMPACT_BLOCK
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 8;
+
+    struct request
+    {
+      blobdata block;
+      uint64_t current_blockchain_height;
+      uint32_t hop;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block)
+        KV_SERIALIZE(current_blockchain_height)
+        KV_SERIALIZE(hop)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct NOTIFY_REQUEST_BLOCK_TXS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 9;
+
+    struct request
+    {
+      crypto::hash block_id;
+      std::list<crypto::hash> txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_id)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct NOTIFY_RESPONSE_BLOCK_TXS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 10;
+
+    struct request
+    {
+      crypto::hash block_id;
+      std::list<blobdata> txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_id)
+        KV_SERIALIZE(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
@@ -70,6 +125,40 @@ namespace cryptonote
     };
   };
   
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  // ids of new pool transactions, the receiver fetches the ones it lacks with NOTIFY_REQUEST_TRANSACTIONS.
+  // only sent to peers that set supports_tx_announcements in their sync data
+  struct NOTIFY_NEW_TRANSACTION_HASHES
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 11;
+
+    struct request
+    {
+      std::list<crypto::hash> txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  // answered with NOTIFY_NEW_TRANSACTIONS carrying the ones still in the pool
+  struct NOTIFY_REQUEST_TRANSACTIONS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 12;
+
+    struct request
+    {
+      std::list<crypto::hash> txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
@@ -140,10 +229,14 @@ namespace cryptonote
   {
     uint64_t current_height;
     crypto::hash  top_id;
+    bool supports_compact_blocks;
+    bool supports_tx_announcements;
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(current_height)
       KV_SERIALIZE_VAL_POD_AS_BLOB(top_id)
+      KV_SERIALIZE(supports_compact_blocks)
+      KV_SERIALIZE(supports_tx_announcements)
     END_KV_SERIALIZE_MAP()
   };
 
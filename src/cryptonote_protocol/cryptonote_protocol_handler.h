@@ -15,6 +15,9 @@
 #include "cryptonote_core/verification_context.h"
 #include "cryptonote_protocol_defs.h"
 #include "cryptonote_protocol_handler_common.h"
+#include "block_queue.h"
+#include "tx_requests.h"
+#include "common/worker_pool.h"
 
 PUSH_WARNINGS
 DISABLE_VS_WARNINGS(4355)
@@ -35,7 +38,12 @@ namespace cryptonote
 
     BEGIN_INVOKE_MAP2(cryptonote_protocol_handler)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_BLOCK, &cryptonote_protocol_handler::handle_notify_new_block)
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_COMPACT_BLOCK, &cryptonote_protocol_handler::handle_notify_new_compact_block)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_BLOCK_TXS, &cryptonote_protocol_handler::handle_request_block_txs)
+      HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_BLOCK_TXS, &cryptonote_protocol_handler::handle_response_block_txs)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_TRANSACTIONS, &cryptonote_protocol_handler::handle_notify_new_transactions)
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_TRANSACTION_HASHES, &cryptonote_protocol_handler::handle_notify_new_transaction_hashes)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_TRANSACTIONS, &cryptonote_protocol_handler::handle_request_transactions)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_SIGNED_HASH, &cryptonote_protocol_handler::handle_notify_new_signed_hash)
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_GET_OBJECTS, &cryptonote_protocol_handler::handle_request_get_objects)
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_GET_OBJECTS, &cryptonote_protocol_handler::handle_response_get_objects)
@@ -53,13 +61,19 @@ namespace cryptonote
     bool get_payload_sync_data(CORE_SYNC_DATA& hshd);
     bool get_stat_info(core_stat_info& stat_inf);
     bool on_callback(cryptonote_connection_context& context);
+    void on_connection_close(cryptonote_connection_context& context);
     t_core& get_core(){return m_core;}
     bool is_synchronized(){return m_synchronized;}
     void log_connections();
   private:
     //----------------- commands handlers ----------------------------------------------
     int handle_notify_new_block(int command, NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context);
+    int handle_request_block_txs(int command, NOTIFY_REQUEST_BLOCK_TXS::request& arg, cryptonote_connection_context& context);
+    int handle_response_block_txs(int command, NOTIFY_RESPONSE_BLOCK_TXS::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_transactions(int command, NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_transaction_hashes(int command, NOTIFY_NEW_TRANSACTION_HASHES::request& arg, cryptonote_connection_context& context);
+    int handle_request_transactions(int command, NOTIFY_REQUEST_TRANSACTIONS::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_signed_hash(int command, NOTIFY_NEW_SIGNED_HASH::request& arg, cryptonote_connection_context& context);
     int handle_request_get_objects(int command, NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context);
     int handle_response_get_objects(int command, NOTIFY_RESPONSE_GET_OBJECTS::request& arg, cryptonote_connection_context& context);
@@ -73,8 +87,19 @@ namespace cryptonote
     virtual bool relay_signed_hash(NOTIFY_NEW_SIGNED_HASH::request& arg, cryptonote_connection_context& exclude_context);
     //----------------------------------------------------------------------------------
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, cryptonote_connection_context& context);
+    int process_new_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& context);
+    // for a compact block whose txs we couldn't all get
+    void request_full_block(const crypto::hash& block_id, cryptonote_connection_context& context);
+    void announce_transactions();
+    void retry_waiting_connections();
     bool request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks,
                                  bool signed_hashes_only);
+    bool prepare_blocks(std::list<block_complete_entry>& entries, std::vector<prepared_block>& blocks,
+                        cryptonote_connection_context& context);
+    bool add_span_to_chain(const block_queue::span& s, bool& missing_longhash);
+    bool add_ready_spans(cryptonote_connection_context& context);
+    // for connections that sent bad blocks, so their reservations and downloads don't hold up the others
+    void drop_sync_connection(cryptonote_connection_context& context);
     size_t get_synchronizing_connections_count();
     bool on_connection_synchronized();
     t_core& m_core;
@@ -83,6 +108,12 @@ namespace cryptonote
     nodetool::i_p2p_endpoint<connection_context>* m_p2p;
     std::atomic<uint32_t> m_syncronized_connections_count;
     std::atomic<bool> m_synchronized;
+    block_queue m_block_queue;
+    tools::worker_pool m_prepare_workers;
+    epee::critical_section m_add_blocks_lock;
+    epee::critical_section m_tx_relay_lock;
+    std::vector<crypto::hash> m_tx_announcements; //announced to peers on the next on_idle
+    tx_requests m_requested_txs; //announced txs we asked a peer for
 
     template<class t_parametr>
       bool post_notify(typename t_parametr::request& arg, cryptonote_connection_context& context)
@@ -19,7 +19,12 @@ namespace cryptonote
     t_cryptonote_protocol_handler<t_core>::t_cryptonote_protocol_handler(t_core& rcore, nodetool::i_p2p_endpoint<connection_context>* p_net_layout):m_core(rcore), 
                                                                                                               m_p2p(p_net_layout),
                                                                                                               m_syncronized_connections_count(0),
-                                                                                                              m_synchronized(false)
+                                                                                                              m_synchronized(false),
+                                                                                                              m_block_queue(BLOCKS_SYNCHRONIZING_SPAN_TIMEOUT),
+                                                                                                              m_requested_txs(CRYPTONOTE_PROTOCOL_TX_REQUEST_TIMEOUT,
+                                                                                                                              CRYPTONOTE_PROTOCOL_REQUESTED_TXS_MAX_COUNT,
+                                                                                                                              CRYPTONOTE_PROTOCOL_TX_ANNOUNCERS_MAX_COUNT),
+                                                                                                              m_prepare_workers("block parsing")
 
   {
     if(!m_p2p)
@@ -48,6 +53,21 @@ namespace cryptonote
     else
       m_p2p = &m_p2p_stub;
   }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::on_connection_close(cryptonote_connection_context& context)
+  {
+    // blocks it downloaded can still be added, blocks it was going to download are left to others
+    m_block_queue.release_reservations(context.m_connection_id);
+    m_requested_txs.connection_closed(context.m_connection_id);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::drop_sync_connection(cryptonote_connection_context& context)
+  {
+    m_block_queue.release(context.m_connection_id);
+    m_p2p->drop_connection(context);
+  }
   //------------------------------------------------------------------------------------------------------------------------  
   template<class t_core> 
   bool t_cryptonote_protocol_handler<t_core>::on_callback(cryptonote_connection_context& context)
@@ -56,7 +76,12 @@ namespace cryptonote
     CHECK_AND_ASSERT_MES_CC( context.m_callback_request_count > 0, false, "false callback fired, but context.m_callback_request_count=" << context.m_callback_request_count);
     --context.m_callback_request_count;
 
-    if(context.m_state == cryptonote_connection_context::state_synchronizing)
+    if(context.m_state == cryptonote_connection_context::state_synchronizing && context.m_waiting_for_blocks)
+    {
+      // see whether the blocks other connections were fetching arrived or got released
+      request_missing_objects(context, true, false);
+    }
+    else if(context.m_state == cryptonote_connection_context::state_synchronizing)
     {
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
       m_core.get_short_chain_history(r.block_ids);
@@ -100,6 +125,9 @@ namespace cryptonote
   template<class t_core> 
   bool t_cryptonote_protocol_handler<t_core>::process_payload_sync_data(const CORE_SYNC_DATA& hshd, cryptonote_connection_context& context, bool is_inital)
   {
+    context.m_supports_compact_blocks = hshd.supports_compact_blocks;
+    context.m_supports_tx_announcements = hshd.supports_tx_announcements;
+
     if(context.m_state == cryptonote_connection_context::state_befor_handshake && !is_inital)
       return true;
 
@@ -149,6 +177,8 @@ namespace cryptonote
   {
     m_core.get_blockchain_top(hshd.current_height, hshd.top_id);
     hshd.current_height +=1;
+    hshd.supports_compact_blocks = true;
+    hshd.supports_tx_announcements = true;
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------  
@@ -177,6 +207,133 @@ namespace cryptonote
       return 1;
     }
 
+    return process_new_block(arg, context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_NEW_COMPACT_BLOCK (hop " << arg.hop << ")");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+    {
+      if (!cryptonote::config::do_boulderhash)
+      {
+        LOG_PRINT_CCONTEXT_L2("Requesting callback to ask for signed hashes");
+        ++context.m_callback_request_count;
+        m_p2p->request_callback(context);
+      }
+      
+      return 1;
+    }
+
+    block b;
+    if(!parse_and_validate_block_from_blob(arg.block, b))
+    {
+      LOG_PRINT_CCONTEXT_L0("Failed to parse compact block, dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+
+    crypto::hash block_id = get_block_hash(b);
+    if(m_core.have_block(block_id))
+      return 1;
+
+    //the block header already lists its tx hashes, only ask for the ones our pool doesn't have
+    NOTIFY_REQUEST_BLOCK_TXS::request req;
+    req.block_id = block_id;
+    BOOST_FOREACH(const auto& tx_hash, b.tx_hashes)
+    {
+      if(!m_core.have_pool_transaction(tx_hash))
+        req.txs.push_back(tx_hash);
+    }
+
+    if(req.txs.empty())
+    {
+      NOTIFY_NEW_BLOCK::request full = AUTO_VAL_INIT(full);
+      full.b.block = std::move(arg.block);
+      full.current_blockchain_height = arg.current_blockchain_height;
+      full.hop = arg.hop;
+      return process_new_block(full, context);
+    }
+
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_BLOCK_TXS: " << req.txs.size() << " of " << b.tx_hashes.size() << " txs");
+    context.m_pending_compact_block = std::move(arg);
+    post_notify<NOTIFY_REQUEST_BLOCK_TXS>(req, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_block_txs(int command, NOTIFY_REQUEST_BLOCK_TXS::request& arg, cryptonote_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_REQUEST_BLOCK_TXS: txs.size()=" << arg.txs.size());
+    NOTIFY_RESPONSE_BLOCK_TXS::request rsp;
+    if(!m_core.handle_get_block_txs(arg, rsp, context))
+    {
+      LOG_ERROR_CCONTEXT("failed to handle request NOTIFY_REQUEST_BLOCK_TXS, dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_BLOCK_TXS: txs.size()=" << rsp.txs.size());
+    post_notify<NOTIFY_RESPONSE_BLOCK_TXS>(rsp, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_response_block_txs(int command, NOTIFY_RESPONSE_BLOCK_TXS::request& arg, cryptonote_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_RESPONSE_BLOCK_TXS: txs.size()=" << arg.txs.size());
+    NOTIFY_NEW_COMPACT_BLOCK::request pending = std::move(context.m_pending_compact_block);
+    context.m_pending_compact_block = AUTO_VAL_INIT(context.m_pending_compact_block);
+
+    block b;
+    if(pending.block.empty() || !parse_and_validate_block_from_blob(pending.block, b) || get_block_hash(b) != arg.block_id)
+    {
+      //a later compact block replaced the one these txs were for
+      LOG_PRINT_CCONTEXT_L1("NOTIFY_RESPONSE_BLOCK_TXS for a block we're not waiting on, ignoring");
+      return 1;
+    }
+
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+
+    //the peer leaves out txs it no longer has, and the pool may have dropped some since we asked
+    std::unordered_set<crypto::hash> sent_txs;
+    BOOST_FOREACH(const auto& tx_blob, arg.txs)
+      sent_txs.insert(get_blob_hash(tx_blob));
+    BOOST_FOREACH(const auto& tx_hash, b.tx_hashes)
+    {
+      if(!sent_txs.count(tx_hash) && !m_core.have_pool_transaction(tx_hash))
+      {
+        LOG_PRINT_CCONTEXT_L1("NOTIFY_RESPONSE_BLOCK_TXS is missing tx " << tx_hash << ", requesting the full block");
+        context.m_pending_compact_block = std::move(pending);
+        request_full_block(arg.block_id, context);
+        return 1;
+      }
+    }
+
+    NOTIFY_NEW_BLOCK::request full = AUTO_VAL_INIT(full);
+    full.b.block = std::move(pending.block);
+    full.b.txs = std::move(arg.txs);
+    full.current_blockchain_height = pending.current_blockchain_height;
+    full.hop = pending.hop;
+    return process_new_block(full, context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::request_full_block(const crypto::hash& block_id, cryptonote_connection_context& context)
+  {
+    //handle_response_get_objects() passes the block to process_new_block() since we're not synchronizing
+    NOTIFY_REQUEST_GET_OBJECTS::request req;
+    req.blocks.push_back(block_id);
+    req.require_signed_hashes = !cryptonote::config::do_boulderhash;
+    context.m_requested_objects.insert(block_id);
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_GET_OBJECTS: blocks.size()=1");
+    post_notify<NOTIFY_REQUEST_GET_OBJECTS>(req, context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::process_new_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& context)
+  {
     for(auto tx_blob_it = arg.b.txs.begin(); tx_blob_it!=arg.b.txs.end();tx_blob_it++)
     {
       cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
@@ -232,6 +389,10 @@ namespace cryptonote
 
     for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end();)
     {
+      crypto::hash tx_hash = get_blob_hash(*tx_blob_it);
+      context.m_known_txs.insert(tx_hash);
+      m_requested_txs.received(tx_hash);
+
       cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
       m_core.handle_incoming_tx(*tx_blob_it, tvc, false);
       if(tvc.m_verifivation_failed)
@@ -254,6 +415,58 @@ namespace cryptonote
 
     return true;
   }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transaction_hashes(int command, NOTIFY_NEW_TRANSACTION_HASHES::request& arg, cryptonote_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_NEW_TRANSACTION_HASHES: txs.size()=" << arg.txs.size());
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+
+    //ask for the ones we don't have, unless another peer is already sending them
+    NOTIFY_REQUEST_TRANSACTIONS::request req;
+    time_t now = time(NULL);
+    BOOST_FOREACH(const auto& tx_hash, arg.txs)
+    {
+      context.m_known_txs.insert(tx_hash);
+      if(m_core.have_pool_transaction(tx_hash))
+        continue;
+
+      if(m_requested_txs.announced(context.m_connection_id, tx_hash, now))
+        req.txs.push_back(tx_hash);
+    }
+
+    if(req.txs.size())
+    {
+      LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_TRANSACTIONS: txs.size()=" << req.txs.size());
+      post_notify<NOTIFY_REQUEST_TRANSACTIONS>(req, context);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_transactions(int command, NOTIFY_REQUEST_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_REQUEST_TRANSACTIONS: txs.size()=" << arg.txs.size());
+    NOTIFY_NEW_TRANSACTIONS::request rsp;
+    if(!m_core.handle_get_pool_transactions(arg, rsp, context))
+    {
+      LOG_ERROR_CCONTEXT("failed to handle request NOTIFY_REQUEST_TRANSACTIONS, dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+
+    BOOST_FOREACH(const auto& tx_hash, arg.txs)
+      context.m_known_txs.insert(tx_hash);
+
+    //txs that left the pool since they were announced come with their block
+    if(rsp.txs.size())
+    {
+      LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_NEW_TRANSACTIONS: txs.size()=" << rsp.txs.size());
+      post_notify<NOTIFY_NEW_TRANSACTIONS>(rsp, context);
+    }
+    return 1;
+  }
   //------------------------------------------------------------------------------------------------------------------------
     template<class t_core> 
     int t_cryptonote_protocol_handler<t_core>::handle_notify_new_signed_hash(int command, NOTIFY_NEW_SIGNED_HASH::request& arg, cryptonote_connection_context& context)
@@ -304,7 +517,7 @@ namespace cryptonote
     {
       LOG_ERROR_CCONTEXT("sent wrong NOTIFY_HAVE_OBJECTS: arg.m_current_blockchain_height=" << arg.current_blockchain_height 
         << " < m_last_response_height=" << context.m_last_response_height << ", dropping connection");
-      m_p2p->drop_connection(context);
+      drop_sync_connection(context);
       return 1;
     }
     
@@ -313,48 +526,28 @@ namespace cryptonote
       if (!crypto::g_hash_cache.add_signed_longhash(entry))
       {
         LOG_ERROR_CCONTEXT("NOTIFY_RESPONSE_GET_OBJECTS sent invalid signed longhash entry, dropping connection");
-        m_p2p->drop_connection(context);
+        drop_sync_connection(context);
         return 1;
       }
     }
 
     context.m_remote_blockchain_height = arg.current_blockchain_height;
 
-    size_t count = 0;
-    BOOST_FOREACH(const block_complete_entry& block_entry, arg.blocks)
+    std::vector<prepared_block> blocks;
+    if (!prepare_blocks(arg.blocks, blocks, context))
     {
-      ++count;
-      block b;
-      if(!parse_and_validate_block_from_blob(block_entry.block, b))
-      {
-        LOG_ERROR_CCONTEXT("sent wrong block: failed to parse and validate block: \r\n" 
-          << epee::string_tools::buff_to_hex_nodelimer(block_entry.block) << "\r\n dropping connection");
-        m_p2p->drop_connection(context);
-        return 1;
-      }      
-      //to avoid concurrency in core between connections, suspend connections which delivered block later then first one
-      if(count == 2)
-      { 
-        if(m_core.have_block(get_block_hash(b)))
-        {
-          context.enter_idle_state();
-          return 1;
-        }
-      }
-      
-      auto req_it = context.m_requested_objects.find(get_block_hash(b));
+      drop_sync_connection(context);
+      return 1;
+    }
+
+    BOOST_FOREACH(const prepared_block& pb, blocks)
+    {
+      auto req_it = context.m_requested_objects.find(pb.id);
       if(req_it == context.m_requested_objects.end())
       {
-        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: block with id=" << epee::string_tools::pod_to_hex(get_blob_hash(block_entry.block)) 
+        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: block with id=" << pb.id
           << " wasn't requested, dropping connection");
-        m_p2p->drop_connection(context);
-        return 1;
-      }
-      if(b.tx_hashes.size() != block_entry.txs.size()) 
-      {
-        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: block with id=" << epee::string_tools::pod_to_hex(get_blob_hash(block_entry.block)) 
-          << ", tx_hashes.size()=" << b.tx_hashes.size() << " mismatch with block_complete_entry.m_txs.size()=" << block_entry.txs.size() << ", dropping connection");
-        m_p2p->drop_connection(context);
+        drop_sync_connection(context);
         return 1;
       }
 
@@ -367,7 +560,7 @@ namespace cryptonote
     {
       if (cryptonote::config::do_boulderhash) {
         LOG_PRINT_CCONTEXT_RED("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: didn't send blocks but not relying on signed hashes, dropping connection", LOG_LEVEL_0);
-        m_p2p->drop_connection(context);
+        drop_sync_connection(context);
         return 1;
       }
       
@@ -381,7 +574,7 @@ namespace cryptonote
       if (req_it == context.m_requested_objects.end())
       {
         LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: didn't send block_id=" << block_id << ", yet not in requested_objects, dropping connection");
-        m_p2p->drop_connection(context);
+        drop_sync_connection(context);
         return 1;
       }
       
@@ -392,81 +585,278 @@ namespace cryptonote
     {
       LOG_PRINT_CCONTEXT_RED("returned not all requested objects (context.m_requested_objects.size()="
                              << context.m_requested_objects.size() << "), dropping connection", LOG_LEVEL_0);
-      m_p2p->drop_connection(context);
+      drop_sync_connection(context);
       return 1;
     }
 
+    if (context.m_state == cryptonote_connection_context::state_normal)
     {
-      m_core.pause_mine();
-      epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler(
-        boost::bind(&t_core::resume_mine, &m_core));
+      //a block request_full_block() asked for, the compact block it replaces has the hop count
+      BOOST_FOREACH(prepared_block& pb, blocks)
+      {
+        NOTIFY_NEW_BLOCK::request full = AUTO_VAL_INIT(full);
+        full.b = std::move(pb.entry);
+        full.current_blockchain_height = arg.current_blockchain_height;
+        full.hop = context.m_pending_compact_block.hop;
+        context.m_pending_compact_block = AUTO_VAL_INIT(context.m_pending_compact_block);
+        process_new_block(full, context);
+      }
+      if (enter_idle)
+      {
+        LOG_PRINT_CCONTEXT_L0("Didn't send the block due to no signed hashes, entering idle state");
+        context.enter_idle_state();
+      }
+      return 1;
+    }
 
-      BOOST_FOREACH(const block_complete_entry& block_entry, arg.blocks)
+    m_block_queue.add_span(context.m_connection_id, std::move(blocks), time(NULL));
+    if (!add_ready_spans(context))
+      return 1;
+    
+    if (enter_idle)
+    {
+      LOG_PRINT_CCONTEXT_L0("Didn't send some blocks due to no signed hashes, entering idle state");
+      context.enter_idle_state();
+      return 1;
+    }
+    
+    request_missing_objects(context, true, false);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core> 
+  bool t_cryptonote_protocol_handler<t_core>::prepare_blocks(std::list<block_complete_entry>& entries, std::vector<prepared_block>& blocks,
+                                                             cryptonote_connection_context& context)
+  {
+    blocks.resize(entries.size());
+    size_t i = 0;
+    BOOST_FOREACH(auto& entry, entries)
+    {
+      blocks[i++].entry = std::move(entry);
+    }
+
+    // parse and hash the blocks and their transactions on all cores, the chain only takes them one at a time
+    std::vector<std::string> errors(blocks.size());
+    m_prepare_workers.run(blocks.size(), [&](size_t begin, size_t end) {
+      for (size_t k = begin; k < end; k++)
       {
-        //process transactions
-        TIME_MEASURE_START(transactions_process_time);
-        BOOST_FOREACH(auto& tx_blob, block_entry.txs)
+        prepared_block& pb = blocks[k];
+        block b;
+        if (!parse_and_validate_block_from_blob(pb.entry.block, b))
         {
-          tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-          m_core.handle_incoming_tx(tx_blob, tvc, true);
-          if(tvc.m_verifivation_failed)
+          errors[k] = "failed to parse and validate block: \r\n" + epee::string_tools::buff_to_hex_nodelimer(pb.entry.block);
+          continue;
+        }
+        pb.id = get_block_hash(b);
+        pb.prev_id = b.prev_id;
+
+        if (b.tx_hashes.size() != pb.entry.txs.size())
+        {
+          errors[k] = "block with id=" + epee::string_tools::pod_to_hex(pb.id) + " has tx_hashes.size()=" + std::to_string(b.tx_hashes.size())
+              + " mismatch with block_complete_entry.m_txs.size()=" + std::to_string(pb.entry.txs.size());
+          continue;
+        }
+
+        size_t j = 0;
+        BOOST_FOREACH(const auto& tx_blob, pb.entry.txs)
+        {
+          transaction tx;
+          crypto::hash tx_hash, tx_prefix_hash;
+          if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefix_hash) || tx_hash != b.tx_hashes[j])
           {
-            LOG_ERROR_CCONTEXT("transaction verification failed on NOTIFY_RESPONSE_GET_OBJECTS, \r\ntx_id = " 
-              << epee::string_tools::pod_to_hex(get_blob_hash(tx_blob)) << ", dropping connection");
-            m_p2p->drop_connection(context);
-            return 1;
+            errors[k] = "block with id=" + epee::string_tools::pod_to_hex(pb.id) + " has a transaction that doesn't match tx_hashes[" + std::to_string(j) + "]";
+            break;
           }
+          ++j;
+        }
+      }
+      return true;
+    });
+
+    for (size_t k = 0; k < errors.size(); k++)
+    {
+      if (!errors[k].empty())
+      {
+        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: " << errors[k] << ", dropping connection");
+        return false;
+      }
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::add_span_to_chain(const block_queue::span& s, bool& missing_longhash)
+  {
+    missing_longhash = false;
+    BOOST_FOREACH(const prepared_block& pb, s.blocks)
+    {
+      //process transactions
+      TIME_MEASURE_START(transactions_process_time);
+      BOOST_FOREACH(auto& tx_blob, pb.entry.txs)
+      {
+        tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+        m_core.handle_incoming_tx(tx_blob, tvc, true);
+        if(tvc.m_verifivation_failed)
+        {
+          LOG_PRINT_L0("transaction verification failed on NOTIFY_RESPONSE_GET_OBJECTS, tx_id = "
+            << epee::string_tools::pod_to_hex(get_blob_hash(tx_blob)));
+          return false;
         }
-        TIME_MEASURE_FINISH(transactions_process_time);
+      }
+      TIME_MEASURE_FINISH(transactions_process_time);
+
+      //process block
+      TIME_MEASURE_START(block_process_time);
+      block_verification_context bvc = boost::value_initialized<block_verification_context>();
+
+      m_core.handle_incoming_block(pb.entry.block, bvc, false);
+
+      if(bvc.m_missing_longhash)
+      {
+        LOG_PRINT_L0("Block verification failed, missing long-hash");
+        missing_longhash = true;
+        return false;
+      }
+      if(bvc.m_verifivation_failed)
+      {
+        LOG_PRINT_L0("Block verification failed");
+        return false;
+      }
+      if(bvc.m_marked_as_orphaned)
+      {
+        LOG_PRINT_L0("Block received at sync phase was marked as orphaned");
+        return false;
+      }
 
-        //process block
-        TIME_MEASURE_START(block_process_time);
-        block_verification_context bvc = boost::value_initialized<block_verification_context>();
+      TIME_MEASURE_FINISH(block_process_time);
+      LOG_PRINT_L2("Block process time: " << block_process_time + transactions_process_time << "(" << transactions_process_time << "/" << block_process_time << ")ms");
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::add_ready_spans(cryptonote_connection_context& context)
+  {
+    //to avoid concurrency in core between connections, one connection at a time adds whatever spans are ready
+    CRITICAL_REGION_LOCAL(m_add_blocks_lock);
 
-        m_core.handle_incoming_block(block_entry.block, bvc, false);
+    m_core.pause_mine();
+    epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler(
+      boost::bind(&t_core::resume_mine, &m_core));
 
-        if(bvc.m_missing_longhash)
+    block_queue::span s;
+    while (m_block_queue.pop_ready([this](const crypto::hash& id) { return m_core.have_block(id); }, s))
+    {
+      bool missing_longhash = false;
+      if (add_span_to_chain(s, missing_longhash))
+        continue;
+
+      m_block_queue.release(s.connection_id);
+      if (s.connection_id == context.m_connection_id)
+      {
+        if (missing_longhash)
         {
-          LOG_PRINT_CCONTEXT_L0("Block verification failed, missing long-hash, entering idle state");
+          LOG_PRINT_CCONTEXT_L0("Blocks need a missing long-hash, entering idle state");
           context.enter_idle_state();
-          return 1;
-        }
-        if(bvc.m_verifivation_failed)
-        {
-          LOG_PRINT_CCONTEXT_L0("Block verification failed, dropping connection");
-          m_p2p->drop_connection(context);
-          return 1;
         }
-        if(bvc.m_marked_as_orphaned)
+        else
         {
-          LOG_PRINT_CCONTEXT_L0("Block received at sync phase was marked as orphaned, dropping connection");
-          m_p2p->drop_connection(context);
-          return 1;
+          LOG_PRINT_CCONTEXT_L0("Blocks failed to verify, dropping connection");
+          drop_sync_connection(context);
         }
+        return false;
+      }
 
-        TIME_MEASURE_FINISH(block_process_time);
-        LOG_PRINT_CCONTEXT_L2("Block process time: " << block_process_time + transactions_process_time << "(" << transactions_process_time << "/" << block_process_time << ")ms");
+      if (!missing_longhash)
+      {
+        LOG_PRINT_CCONTEXT_L0("Blocks from connection " << s.connection_id << " failed to verify, dropping that connection");
+        m_p2p->drop_connection(epee::net_utils::connection_context_base(s.connection_id, 0, 0, false));
       }
     }
-    
-    if (enter_idle)
-    {
-      LOG_PRINT_CCONTEXT_L0("Didn't send some blocks due to no signed hashes, entering idle state");
-      context.enter_idle_state();
-      return 1;
-    }
-    
-    request_missing_objects(context, true, false);
-    return 1;
+    return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
   bool t_cryptonote_protocol_handler<t_core>::on_idle()
   {
+    m_block_queue.expire(time(NULL));
+    retry_waiting_connections();
+    announce_transactions();
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::retry_waiting_connections()
+  {
+    // the retry runs in a callback, so it doesn't race with the connection's own handlers
+    std::list<boost::uuids::uuid> waiting;
+    m_p2p->for_each_connection([&](cryptonote_connection_context& cntxt, nodetool::peerid_type peer_id)
+    {
+      if(cntxt.m_waiting_for_blocks && cntxt.m_callback_request_count == 0)
+      {
+        ++cntxt.m_callback_request_count;
+        waiting.push_back(cntxt.m_connection_id);
+      }
+      return true;
+    });
+
+    BOOST_FOREACH(const auto& connection_id, waiting)
+    {
+      m_p2p->request_callback(epee::net_utils::connection_context_base(connection_id, 0, 0, false));
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::announce_transactions()
+  {
+    //announced txs that didn't arrive in time are asked from the next peer that announced them
+    tx_requests::retry_map retries;
+    m_requested_txs.expire(time(NULL), [this](const crypto::hash& tx_hash) { return m_core.have_pool_transaction(tx_hash); }, retries);
+    BOOST_FOREACH(auto& retry, retries)
+    {
+      NOTIFY_REQUEST_TRANSACTIONS::request req;
+      req.txs = std::move(retry.second);
+      std::string blob;
+      epee::serialization::store_t_to_binary(req, blob);
+      LOG_PRINT_L2("-->>NOTIFY_REQUEST_TRANSACTIONS retry: txs.size()=" << req.txs.size());
+      m_p2p->invoke_notify_to_peer(NOTIFY_REQUEST_TRANSACTIONS::ID, blob, epee::net_utils::connection_context_base(retry.first, 0, 0, false));
+    }
+
+    std::vector<crypto::hash> tx_hashes;
+    {
+      CRITICAL_REGION_LOCAL(m_tx_relay_lock);
+      tx_hashes.swap(m_tx_announcements);
+    }
+
+    if(tx_hashes.empty())
+      return;
+
+    std::list<std::pair<boost::uuids::uuid, NOTIFY_NEW_TRANSACTION_HASHES::request> > announcements;
+    m_p2p->for_each_connection([&](cryptonote_connection_context& cntxt, nodetool::peerid_type peer_id)
+    {
+      if(!peer_id || !cntxt.m_supports_tx_announcements)
+        return true;
+
+      NOTIFY_NEW_TRANSACTION_HASHES::request req;
+      BOOST_FOREACH(const auto& tx_hash, tx_hashes)
+      {
+        if(cntxt.m_known_txs.insert(tx_hash))
+          req.txs.push_back(tx_hash);
+      }
+      if(req.txs.size())
+        announcements.push_back(std::make_pair(cntxt.m_connection_id, std::move(req)));
+      return true;
+    });
+
+    BOOST_FOREACH(auto& announcement, announcements)
+    {
+      std::string blob;
+      epee::serialization::store_t_to_binary(announcement.second, blob);
+      m_p2p->invoke_notify_to_peer(NOTIFY_NEW_TRANSACTION_HASHES::ID, blob, epee::net_utils::connection_context_base(announcement.first, 0, 0, false));
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_request_chain(int command, NOTIFY_REQUEST_CHAIN::request& arg, cryptonote_connection_context& context)
   {
     LOG_PRINT_CCONTEXT_L2("NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << arg.block_ids.size());
@@ -513,6 +903,8 @@ namespace cryptonote
   template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks, bool signed_hashes_only)
   {
+    context.m_waiting_for_blocks.store(0);
+    
     // filter needed objects first
     if (check_having_blocks)
     {
@@ -541,6 +933,7 @@ namespace cryptonote
     
     bool need_objects = !context.m_needed_objects.empty();
     bool need_signed_hashes = !context.m_needed_signed_hashes.empty();
+    size_t skipped_blocks = 0;
     
     if(need_objects || need_signed_hashes)
     {
@@ -550,14 +943,25 @@ namespace cryptonote
       req.require_signed_hashes = !cryptonote::config::do_boulderhash;
       
       {
+        // blocks another connection is already downloading are left to it, but stay needed here in case
+        // it goes away before they arrive
         size_t count = 0;
+        time_t now = time(NULL);
         auto it = context.m_needed_objects.begin();
         while(it != context.m_needed_objects.end() && count < BLOCKS_SYNCHRONIZING_DEFAULT_COUNT)
         {
-          req.blocks.push_back(*it);
-          ++count;
-          context.m_requested_objects.insert(*it);
-          context.m_needed_objects.erase(it++);
+          if (m_block_queue.reserve(context.m_connection_id, *it, now))
+          {
+            req.blocks.push_back(*it);
+            ++count;
+            context.m_requested_objects.insert(*it);
+            context.m_needed_objects.erase(it++);
+          }
+          else
+          {
+            ++skipped_blocks;
+            ++it;
+          }
         }
       }
       
@@ -572,6 +976,14 @@ namespace cryptonote
         }
       }
       
+      if (req.blocks.empty() && req.signed_hashes.empty())
+      {
+        context.m_waiting_for_blocks.store(1);
+        // everything we needed is coming from other connections, on_idle() checks back
+        LOG_PRINT_CCONTEXT_L2("All " << skipped_blocks << " needed blocks are being downloaded by other connections, waiting for them");
+        return true;
+      }
+      
       LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_GET_OBJECTS: blocks.size()=" << req.blocks.size() << ", txs.size()=" << req.txs.size() << ", signed_hashes.size()=" << req.signed_hashes.size() << ", require_signed_hashes=" << req.require_signed_hashes);
       post_notify<NOTIFY_REQUEST_GET_OBJECTS>(req, context);    
     }
@@ -691,13 +1103,82 @@ namespace cryptonote
   template<class t_core> 
   bool t_cryptonote_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context)
   {
-    return relay_post_notify<NOTIFY_NEW_BLOCK>(arg, exclude_context);
+    std::list<boost::uuids::uuid> compact_peers, full_peers;
+    m_p2p->for_each_connection([&](cryptonote_connection_context& cntxt, nodetool::peerid_type peer_id)
+    {
+      if(peer_id && cntxt.m_connection_id != exclude_context.m_connection_id)
+        (cntxt.m_supports_compact_blocks ? compact_peers : full_peers).push_back(cntxt.m_connection_id);
+      return true;
+    });
+
+    if(compact_peers.size())
+    {
+      NOTIFY_NEW_COMPACT_BLOCK::request compact = AUTO_VAL_INIT(compact);
+      compact.block = arg.b.block;
+      compact.current_blockchain_height = arg.current_blockchain_height;
+      compact.hop = arg.hop;
+      std::string compact_buff;
+      epee::serialization::store_t_to_binary(compact, compact_buff);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_COMPACT_BLOCK::ID, compact_buff, compact_peers);
+    }
+
+    if(full_peers.size())
+    {
+      //a block that came in compact only carries the txs we were missing, the rest are in the chain now
+      block b;
+      CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(arg.b.block, b), false, "failed to parse relayed block");
+      if(arg.b.txs.size() != b.tx_hashes.size())
+      {
+        NOTIFY_REQUEST_BLOCK_TXS::request req;
+        req.block_id = get_block_hash(b);
+        req.txs.assign(b.tx_hashes.begin(), b.tx_hashes.end());
+        NOTIFY_RESPONSE_BLOCK_TXS::request rsp;
+        CHECK_AND_ASSERT_MES(m_core.handle_get_block_txs(req, rsp, exclude_context) && rsp.txs.size() == b.tx_hashes.size(), false,
+                             "failed to get txs of relayed block " << req.block_id);
+        arg.b.txs = std::move(rsp.txs);
+      }
+
+      std::string full_buff;
+      epee::serialization::store_t_to_binary(arg, full_buff);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_BLOCK::ID, full_buff, full_peers);
+    }
+    return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
   bool t_cryptonote_protocol_handler<t_core>::relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context)
   {
-    return relay_post_notify<NOTIFY_NEW_TRANSACTIONS>(arg, exclude_context);
+    std::vector<crypto::hash> tx_hashes;
+    BOOST_FOREACH(const auto& tx_blob, arg.txs)
+      tx_hashes.push_back(get_blob_hash(tx_blob));
+
+    //peers that take announcements get the ids in the next batch
+    {
+      CRITICAL_REGION_LOCAL(m_tx_relay_lock);
+      m_tx_announcements.insert(m_tx_announcements.end(), tx_hashes.begin(), tx_hashes.end());
+    }
+
+    std::list<boost::uuids::uuid> full_peers;
+    m_p2p->for_each_connection([&](cryptonote_connection_context& cntxt, nodetool::peerid_type peer_id)
+    {
+      if(!peer_id || cntxt.m_supports_tx_announcements || cntxt.m_connection_id == exclude_context.m_connection_id)
+        return true;
+
+      bool knows_all = true;
+      BOOST_FOREACH(const auto& tx_hash, tx_hashes)
+        knows_all = !cntxt.m_known_txs.insert(tx_hash) && knows_all;
+      if(!knows_all)
+        full_peers.push_back(cntxt.m_connection_id);
+      return true;
+    });
+
+    if(full_peers.size())
+    {
+      std::string arg_buff;
+      epee::serialization::store_t_to_binary(arg, arg_buff);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, arg_buff, full_peers);
+    }
+    return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
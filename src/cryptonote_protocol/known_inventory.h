@@ -0,0 +1,84 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <deque>
+#include <unordered_set>
+
+#include "syncobj.h"
+
+#include "crypto/hash.h"
+#include "cryptonote_config.h"
+
+namespace cryptonote
+{
+  // ids a peer is known to have, because it sent or announced them or we did. only the most recent
+  // max_count are remembered, so forgetting one just means it may be announced to the peer again.
+  // the connection's own thread and the relay timer both use it, so it locks itself.
+  class known_inventory
+  {
+  public:
+    explicit known_inventory(size_t max_count = CRYPTONOTE_PROTOCOL_KNOWN_TXS_MAX_COUNT) : m_max_count(max_count) { }
+
+    known_inventory(const known_inventory& rhs) : m_max_count(0)
+    {
+      *this = rhs;
+    }
+
+    known_inventory& operator=(const known_inventory& rhs)
+    {
+      if (this == &rhs)
+        return *this;
+
+      std::deque<crypto::hash> order;
+      size_t max_count;
+      {
+        CRITICAL_REGION_LOCAL(rhs.m_lock);
+        order = rhs.m_order;
+        max_count = rhs.m_max_count;
+      }
+
+      CRITICAL_REGION_LOCAL(m_lock);
+      m_max_count = max_count;
+      m_order = std::move(order);
+      m_ids = std::unordered_set<crypto::hash>(m_order.begin(), m_order.end());
+      return *this;
+    }
+
+    // true if the id wasn't known yet
+    bool insert(const crypto::hash& id)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      if (!m_ids.insert(id).second)
+        return false;
+
+      m_order.push_back(id);
+      while (m_order.size() > m_max_count)
+      {
+        m_ids.erase(m_order.front());
+        m_order.pop_front();
+      }
+      return true;
+    }
+
+    bool contains(const crypto::hash& id) const
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      return m_ids.count(id) > 0;
+    }
+
+    size_t size() const
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      return m_ids.size();
+    }
+
+  private:
+    mutable epee::critical_section m_lock;
+    size_t m_max_count;
+    std::unordered_set<crypto::hash> m_ids;
+    std::deque<crypto::hash> m_order;
+  };
+}
@@ -0,0 +1,168 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <algorithm>
+#include <ctime>
+#include <list>
+#include <map>
+#include <unordered_map>
+
+#include <boost/uuid/nil_generator.hpp>
+#include <boost/uuid/uuid.hpp>
+
+#include "syncobj.h"
+
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  // announced txs we asked a peer for. a tx is only asked from one peer at a time, the other peers that
+  // announced it are remembered and the next one is asked if the tx doesn't arrive in time. a peer only
+  // gets so many requests at once, announcements beyond that are ignored until it answers some.
+  class tx_requests
+  {
+  public:
+    typedef std::map<boost::uuids::uuid, std::list<crypto::hash> > retry_map;
+
+    tx_requests(time_t timeout, size_t max_per_connection, size_t max_announcers)
+      : m_timeout(timeout), m_max_per_connection(max_per_connection), m_max_announcers(max_announcers) { }
+
+    // true if the connection should be asked for the tx now
+    bool announced(const boost::uuids::uuid& connection_id, const crypto::hash& tx_hash, time_t now)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      auto it = m_requests.find(tx_hash);
+      if (it == m_requests.end())
+      {
+        if (!has_room(connection_id))
+          return false;
+
+        request& r = m_requests[tx_hash];
+        ask(r, connection_id, now);
+        return true;
+      }
+
+      request& r = it->second;
+      if (r.asked == connection_id)
+        return false;
+      if (r.announcers.size() < m_max_announcers &&
+          std::find(r.announcers.begin(), r.announcers.end(), connection_id) == r.announcers.end())
+      {
+        r.announcers.push_back(connection_id);
+      }
+      return false;
+    }
+
+    // the tx arrived, from whichever peer
+    void received(const crypto::hash& tx_hash)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      auto it = m_requests.find(tx_hash);
+      if (it == m_requests.end())
+        return;
+
+      unask(it->second);
+      m_requests.erase(it);
+    }
+
+    // what was asked from the connection goes to the next announcer on the next expire()
+    void connection_closed(const boost::uuids::uuid& connection_id)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      for (auto& entry : m_requests)
+      {
+        request& r = entry.second;
+        r.announcers.remove(connection_id);
+        if (r.asked == connection_id)
+        {
+          unask(r);
+          r.time = 0;
+        }
+      }
+      m_outstanding.erase(connection_id);
+    }
+
+    // requests older than the timeout move on to the next announcer that has room, which are added to
+    // retries. requests nobody else can answer are dropped, as are those for txs have_tx(tx_hash) says
+    // already came in some other way, e.g. in a block.
+    template<class have_tx_t>
+    void expire(time_t now, have_tx_t have_tx, retry_map& retries)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      for (auto it = m_requests.begin(); it != m_requests.end(); )
+      {
+        request& r = it->second;
+        if (r.time + m_timeout > now)
+        {
+          ++it;
+          continue;
+        }
+
+        unask(r);
+        auto next = std::find_if(r.announcers.begin(), r.announcers.end(),
+                                 [this](const boost::uuids::uuid& id) { return has_room(id); });
+        if (next == r.announcers.end() || have_tx(it->first))
+        {
+          it = m_requests.erase(it);
+          continue;
+        }
+
+        ask(r, *next, now);
+        r.announcers.erase(next);
+        retries[r.asked].push_back(it->first);
+        ++it;
+      }
+    }
+
+    size_t size() const { CRITICAL_REGION_LOCAL(m_lock); return m_requests.size(); }
+
+    size_t requested_count(const boost::uuids::uuid& connection_id) const
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      auto it = m_outstanding.find(connection_id);
+      return it == m_outstanding.end() ? 0 : it->second;
+    }
+
+  private:
+    struct request
+    {
+      boost::uuids::uuid asked; // nil once the peer closed or timed out
+      time_t time;
+      std::list<boost::uuids::uuid> announcers;
+    };
+
+    bool has_room(const boost::uuids::uuid& connection_id) const
+    {
+      auto it = m_outstanding.find(connection_id);
+      return it == m_outstanding.end() || it->second < m_max_per_connection;
+    }
+
+    void ask(request& r, const boost::uuids::uuid& connection_id, time_t now)
+    {
+      r.asked = connection_id;
+      r.time = now;
+      ++m_outstanding[connection_id];
+    }
+
+    void unask(request& r)
+    {
+      if (r.asked.is_nil())
+        return;
+
+      auto it = m_outstanding.find(r.asked);
+      if (it != m_outstanding.end() && --it->second == 0)
+        m_outstanding.erase(it);
+      r.asked = boost::uuids::nil_uuid();
+    }
+
+    mutable epee::critical_section m_lock;
+    time_t m_timeout;
+    size_t m_max_per_connection;
+    size_t m_max_announcers;
+    std::unordered_map<crypto::hash, request> m_requests;
+    std::map<boost::uuids::uuid, size_t> m_outstanding;
+  };
+}
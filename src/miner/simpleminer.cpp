@@ -87,6 +87,7 @@ namespace mining
     m_login = command_line::get_arg(vm, arg_login);
     m_pass = command_line::get_arg(vm, arg_pass);
     crypto::pc_init_threadpool(vm);
+    crypto::pc_set_state_options(vm);
     m_state = crypto::pc_malloc_state();
     
     return true;
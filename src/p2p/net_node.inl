@@ -939,10 +939,13 @@ namespace nodetool
       return true;
     });
 
-    BOOST_FOREACH(const auto& c_id, connections)
-    {
-      m_net_server.get_config_object().notify(command, data_buff, c_id);
-    }
+    return relay_notify_to_list(command, data_buff, connections);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::relay_notify_to_list(int command, const std::string& data_buff, const std::list<net_connection_id>& connections)
+  {
+    m_net_server.get_config_object().relay_notify(command, data_buff, connections);
     return true;
   }
   //-----------------------------------------------------------------------------------
@@ -1181,6 +1184,7 @@ namespace nodetool
   void node_server<t_payload_net_handler>::on_connection_close(p2p_connection_context& context)
   {
     LOG_PRINT_L2("["<< epee::net_utils::print_connection_context(context) << "] CLOSE CONNECTION");
+    m_payload_handler.on_connection_close(context);
     uiInterface.NotifyNumConnectionsChanged(get_connections_count());
   }
 
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <list>
+
 #include <boost/uuid/uuid.hpp>
 #include "net/net_utils_base.h"
 #include "p2p_protocol_defs.h"
@@ -18,6 +20,7 @@ namespace nodetool
   struct i_p2p_endpoint
   {
     virtual bool relay_notify_to_all(int command, const std::string& data_buff, const epee::net_utils::connection_context_base& context, bool only_if_state, typename t_connection_context::state s)=0;
+    virtual bool relay_notify_to_list(int command, const std::string& data_buff, const std::list<net_connection_id>& connections)=0;
     virtual bool invoke_command_to_peer(int command, const std::string& req_buff, std::string& resp_buff, const epee::net_utils::connection_context_base& context)=0;
     virtual bool invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context)=0;
     virtual bool drop_connection(const epee::net_utils::connection_context_base& context)=0;
@@ -33,6 +36,10 @@ namespace nodetool
     {
       return false;
     }
+    virtual bool relay_notify_to_list(int command, const std::string& data_buff, const std::list<net_connection_id>& connections)
+    {
+      return false;
+    }
     virtual bool invoke_command_to_peer(int command, const std::string& req_buff, std::string& resp_buff, const epee::net_utils::connection_context_base& context)
     {
       return false;
@@ -0,0 +1,258 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/* binary_blob_archive.h
+ *
+ * Same format as binary_archive, but reads straight from a contiguous buffer and writes by
+ * appending to a string, without going through iostreams. */
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <ios>
+#include <string>
+
+#include "serialization.h"
+#include "binary_archive.h"
+
+namespace serialization
+{
+  // the subset of std::ios state handling the serializers use on ar.stream()
+  class blob_stream_state
+  {
+  public:
+    blob_stream_state() : state_(std::ios_base::goodbit) { }
+
+    bool good() const { return state_ == std::ios_base::goodbit; }
+    bool fail() const { return (state_ & (std::ios_base::failbit | std::ios_base::badbit)) != 0; }
+    std::ios_base::iostate rdstate() const { return state_; }
+    void setstate(std::ios_base::iostate s) { state_ |= s; }
+    void clear(std::ios_base::iostate s = std::ios_base::goodbit) { state_ = s; }
+
+  protected:
+    std::ios_base::iostate state_;
+  };
+
+  class blob_istream : public blob_stream_state
+  {
+  public:
+    blob_istream(const char *data, size_t size) : cur_(data), end_(data + size) { }
+
+    int peek()
+    {
+      if (!good())
+        return EOF;
+      if (cur_ == end_)
+      {
+        setstate(std::ios_base::eofbit);
+        return EOF;
+      }
+      return (unsigned char)*cur_;
+    }
+
+    // reads what is available, failing like std::istream::read if that's less than len
+    void read(char *buf, size_t len)
+    {
+      size_t avail = end_ - cur_;
+      if (!good() || avail < len)
+      {
+        if (good())
+          memcpy(buf, cur_, avail);
+        cur_ = end_;
+        setstate(std::ios_base::eofbit | std::ios_base::failbit);
+        return;
+      }
+      memcpy(buf, cur_, len);
+      cur_ += len;
+    }
+
+    const char *&cur() { return cur_; }
+    const char *end() const { return end_; }
+    size_t remaining() const { return end_ - cur_; }
+
+  private:
+    const char *cur_;
+    const char *end_;
+  };
+
+  class blob_ostream : public blob_stream_state
+  {
+  public:
+    explicit blob_ostream(std::string& buf) : buf_(buf) { }
+
+    void put(char c) { buf_.push_back(c); }
+    void write(const char *buf, size_t len) { buf_.append(buf, len); }
+
+    std::string& buffer() { return buf_; }
+
+  private:
+    std::string& buf_;
+  };
+}
+
+template <bool W>
+struct binary_blob_archive;
+
+template <>
+struct binary_blob_archive<false> : public binary_archive_base< ::serialization::blob_istream, false>
+{
+  explicit binary_blob_archive(stream_type &s) : base_type(s), canonical_(true) { }
+
+  template <class T>
+  void serialize_int(T &v)
+  {
+    serialize_uint(*(typename boost::make_unsigned<T>::type *)&v);
+  }
+
+  template <class T>
+  void serialize_uint(T &v, size_t width = sizeof(T))
+  {
+    if (!stream_.good() || stream_.remaining() < width)
+    {
+      stream_.cur() = stream_.end();
+      stream_.setstate(std::ios_base::eofbit | std::ios_base::failbit);
+      return;
+    }
+
+    const unsigned char *p = (const unsigned char *)stream_.cur();
+    T ret = 0;
+    unsigned shift = 0;
+    for (size_t i = 0; i < width; i++) {
+      T b = p[i];
+      ret += (b << shift);
+      shift += 8;
+    }
+    stream_.cur() += width;
+    v = ret;
+  }
+  void serialize_blob(const void *buf, size_t len, const char *delimiter="") { stream_.read((char *)buf, len); }
+
+  template <class T>
+  void serialize_varint(T &v)
+  {
+    serialize_uvarint(*(typename boost::make_unsigned<T>::type *)(&v));
+  }
+
+  template <class T>
+  void serialize_uvarint(T &v)
+  {
+    // same leniency as binary_archive<false>
+    const char *end = stream_.end();
+    int read = tools::read_varint<std::numeric_limits<T>::digits>(stream_.cur(), end, v); // XXX handle failure
+    if (read <= 0 || (stream_.cur()[-1] & 0x80))
+      canonical_ = false;
+  }
+  void begin_array(size_t &s)
+  {
+    serialize_varint(s);
+  }
+  void begin_array() { }
+
+  void delimit_array() { }
+  void end_array() { }
+
+  void begin_string(const char *delimiter="\"") { }
+  void end_string(const char *delimiter="\"") { }
+
+  void read_variant_tag(variant_tag_type &t) {
+    serialize_int(t);
+  }
+
+  size_t remaining_bytes() {
+    if (!stream_.good())
+      return 0;
+    return stream_.remaining();
+  }
+
+  // false if a varint was overlong, overflowed or cut off, in which case the object won't
+  // serialize back to the bytes it was read from
+  bool canonical() const { return canonical_; }
+
+private:
+  bool canonical_;
+};
+
+template <>
+struct binary_blob_archive<true> : public binary_archive_base< ::serialization::blob_ostream, true>
+{
+  explicit binary_blob_archive(stream_type &s) : base_type(s) { }
+
+  template <class T>
+  void serialize_int(T v)
+  {
+    serialize_uint(static_cast<typename boost::make_unsigned<T>::type>(v));
+  }
+
+  // split into two cases to avoid warnings with `v >>= 8` for 1-byte types on clang
+  template <class T>
+  typename std::enable_if<(sizeof(T) == 1)>::type serialize_uint(T v)
+  {
+    stream_.put((char)(v & 0xff));
+  }
+
+  template <class T>
+  typename std::enable_if<(sizeof(T) > 1)>::type serialize_uint(T v)
+  {
+    char buf[sizeof(T)];
+    for (size_t i = 0; i < sizeof(T); i++) {
+      buf[i] = (char)(v & 0xff);
+      v >>= 8;
+    }
+    stream_.write(buf, sizeof(T));
+  }
+
+  void serialize_blob(const void *buf, size_t len, const char *delimiter="") { stream_.write((const char *)buf, len); }
+
+  template <class T>
+  void serialize_varint(T &v)
+  {
+    serialize_uvarint(*(typename boost::make_unsigned<T>::type *)(&v));
+  }
+
+  template <class T>
+  void serialize_uvarint(T &v)
+  {
+    tools::write_varint(std::back_inserter(stream_.buffer()), v);
+  }
+  void begin_array(size_t s)
+  {
+    serialize_varint(s);
+  }
+  void begin_array() { }
+  void delimit_array() { }
+  void end_array() { }
+
+  void begin_string(const char *delimiter="\"") { }
+  void end_string(const char *delimiter="\"") { }
+
+  void write_variant_tag(variant_tag_type t) {
+    serialize_int(t);
+  }
+};
+
+// same wire format, so same variant tags
+template <bool W, class T>
+struct variant_serialization_traits<binary_blob_archive<W>, T> : public variant_serialization_traits<binary_archive<W>, T>
+{
+};
+
+namespace serialization
+{
+  template <class T>
+  bool parse_blob(const char *data, size_t size, T &v)
+  {
+    blob_istream s(data, size);
+    binary_blob_archive<false> ar(s);
+    return ::serialization::serialize(ar, v);
+  }
+
+  template <class T>
+  bool dump_blob(const T &v, std::string &blob)
+  {
+    blob.clear();
+    blob_ostream s(blob);
+    binary_blob_archive<true> ar(s);
+    return ::serialization::serialize(ar, v);
+  }
+}
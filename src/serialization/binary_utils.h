@@ -7,16 +7,14 @@
 #include "include_base_utils.h"
 
 #include "serialization.h"
-#include "binary_archive.h"
+#include "binary_blob_archive.h"
 
 namespace serialization {
 
 template <class T>
 bool _parse_binary(const std::string &blob, T &v)
 {
-  std::istringstream istr(blob);
-  binary_archive<false> iar(istr);
-  return ::serialization::serialize(iar, v);
+  return ::serialization::parse_blob(blob.data(), blob.size(), v);
 }
 
 template <class T>
@@ -38,11 +36,7 @@ bool parse_binary(const std::string &blob, T &v)
 template<class T>
 bool dump_binary(const T& v, std::string& blob)
 {
-  std::stringstream ostr;
-  binary_archive<true> oar(ostr);
-  bool success = ::serialization::serialize(oar, v);
-  blob = ostr.str();
-  return success && ostr.good();
+  return ::serialization::dump_blob(v, blob);
 };
 
 } // namespace serialization
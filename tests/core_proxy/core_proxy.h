@@ -59,6 +59,9 @@ namespace tests
     bool on_idle(){return true;}
     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp){return true;}
     bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote::cryptonote_connection_context& context){return true;}
+    bool handle_get_block_txs(cryptonote::NOTIFY_REQUEST_BLOCK_TXS::request& arg, cryptonote::NOTIFY_RESPONSE_BLOCK_TXS::request& rsp, cryptonote::cryptonote_connection_context& context){return true;}
+    bool handle_get_pool_transactions(cryptonote::NOTIFY_REQUEST_TRANSACTIONS::request& arg, cryptonote::NOTIFY_NEW_TRANSACTIONS::request& rsp, cryptonote::cryptonote_connection_context& context){return true;}
+    bool have_pool_transaction(const crypto::hash& id){return false;}
     crypto::hash get_block_id_by_height(uint64_t height);
     bool get_block_by_hash(const crypto::hash &h, cryptonote::block &blk);
     bool is_in_checkpoint_zone(uint64_t height);
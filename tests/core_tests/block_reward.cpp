@@ -5,6 +5,7 @@
 #include "chaingen.h"
 
 #include "block_reward.h"
+#include "cryptonote_core/tx_tester.h"
 
 using namespace epee;
 using namespace cryptonote;
@@ -30,14 +31,14 @@ namespace
       {
         size_t diff = current_size - target_tx_size;
         if (diff <= miner_tx.extra.size())
-          miner_tx.extra.resize(miner_tx.extra.size() - diff);
+          tx_tester(miner_tx).extra.resize(miner_tx.extra.size() - diff);
         else
           return false;
       }
       else
       {
         size_t diff = target_tx_size - current_size;
-        miner_tx.extra.resize(miner_tx.extra.size() + diff);
+        tx_tester(miner_tx).extra.resize(miner_tx.extra.size() + diff);
       }
 
       current_size = get_object_blobsize(miner_tx);
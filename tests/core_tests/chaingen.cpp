@@ -19,6 +19,7 @@
 #include "cryptonote_core/contract_grading.h"
 #include "cryptonote_core/nulls.h"
 #include "cryptonote_core/keypair.h"
+#include "cryptonote_core/tx_tester.h"
 
 #include "chaingen.h"
 
@@ -116,7 +117,7 @@ bool make_miner_tx(transaction& miner_tx_res, size_t txs_size, size_t height, st
     else if (actual_block_size < target_block_size)
     {
       size_t delta = target_block_size - actual_block_size;
-      miner_tx.extra.resize(miner_tx.extra.size() + delta, 0);
+      tx_tester(miner_tx).extra.resize(miner_tx.extra.size() + delta, 0);
       actual_block_size = txs_size + get_object_blobsize(miner_tx);
       if (actual_block_size == target_block_size)
       {
@@ -126,7 +127,7 @@ bool make_miner_tx(transaction& miner_tx_res, size_t txs_size, size_t height, st
       {
         CHECK_AND_ASSERT_MES(target_block_size < actual_block_size, false, "Unexpected block size");
         delta = actual_block_size - target_block_size;
-        miner_tx.extra.resize(miner_tx.extra.size() - delta);
+        tx_tester(miner_tx).extra.resize(miner_tx.extra.size() - delta);
         actual_block_size = txs_size + get_object_blobsize(miner_tx);
         if (actual_block_size == target_block_size)
         {
@@ -135,7 +136,7 @@ bool make_miner_tx(transaction& miner_tx_res, size_t txs_size, size_t height, st
         else
         {
           CHECK_AND_ASSERT_MES(actual_block_size < target_block_size, false, "Unexpected block size");
-          miner_tx.extra.resize(miner_tx.extra.size() + delta, 0);
+          tx_tester(miner_tx).extra.resize(miner_tx.extra.size() + delta, 0);
           target_block_size = txs_size + get_object_blobsize(miner_tx);
         }
       }
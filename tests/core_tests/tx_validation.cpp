@@ -502,9 +502,10 @@ bool gen_tx_key_image_not_derive_from_tx_key::generate(std::vector<test_event_en
   builder.step4_calc_hash();
 
   // Tx with invalid key image can't be subscribed, so create empty signature
-  builder.m_tx.signatures.resize(1);
-  builder.m_tx.signatures[0].resize(1);
-  builder.m_tx.signatures[0][0] = boost::value_initialized<crypto::signature>();
+  tx_tester txt(builder.m_tx);
+  txt.signatures.resize(1);
+  txt.signatures[0].resize(1);
+  txt.signatures[0][0] = boost::value_initialized<crypto::signature>();
 
   DO_CALLBACK(events, "mark_invalid_tx");
   events.push_back(builder.m_tx);
@@ -536,9 +537,10 @@ bool gen_tx_key_image_is_invalid::generate(std::vector<test_event_entry>& events
   builder.step4_calc_hash();
 
   // Tx with invalid key image can't be subscribed, so create empty signature
-  builder.m_tx.signatures.resize(1);
-  builder.m_tx.signatures[0].resize(1);
-  builder.m_tx.signatures[0][0] = boost::value_initialized<crypto::signature>();
+  tx_tester txt(builder.m_tx);
+  txt.signatures.resize(1);
+  txt.signatures[0].resize(1);
+  txt.signatures[0][0] = boost::value_initialized<crypto::signature>();
 
   DO_CALLBACK(events, "mark_invalid_tx");
   events.push_back(builder.m_tx);
@@ -0,0 +1,106 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// measures how fast async_protocol_handler::handle_recv splits a stream of notifications into packets.
+// no sockets are involved, the stream is fed to the handler in read sized chunks like a connection does.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "include_base_utils.h"
+#include "misc_log_ex.h"
+
+#include "net_load_tests.h"
+
+using namespace net_load_tests;
+
+namespace
+{
+  const int bench_command = 1;
+
+  struct counting_commands_handler : public test_levin_commands_handler
+  {
+    counting_commands_handler() : m_notify_count(0), m_notify_bytes(0) { }
+
+    virtual int notify(int command, const std::string& in_buff, test_connection_context& context)
+    {
+      ++m_notify_count;
+      m_notify_bytes += in_buff.size();
+      return LEVIN_OK;
+    }
+
+    size_t m_notify_count;
+    size_t m_notify_bytes;
+  };
+
+  class null_endpoint : public epee::net_utils::i_service_endpoint
+  {
+  public:
+    virtual bool do_send(const void* ptr, size_t cb)  { return true; }
+    virtual bool close()                              { return true; }
+    virtual bool call_run_once_service_io()           { return true; }
+    virtual bool request_callback()                   { return true; }
+    virtual boost::asio::io_service& get_io_service() { return m_io_service; }
+    virtual bool add_ref()                            { return true; }
+    virtual bool release()                            { return true; }
+
+  private:
+    boost::asio::io_service m_io_service;
+  };
+
+  bool run_bench(const char* name, size_t payload_size, size_t message_count, size_t read_size)
+  {
+    std::string stream;
+    {
+      boost::shared_ptr<const std::string> packet = test_levin_protocol_handler::make_notify_packet(bench_command, std::string(payload_size, 'x'));
+      stream.reserve(packet->size() * message_count);
+      for (size_t i = 0; i < message_count; ++i)
+        stream += *packet;
+    }
+
+    counting_commands_handler commands_handler;
+    test_levin_protocol_handler_config config;
+    config.m_pcommands_handler = &commands_handler;
+    null_endpoint endpoint;
+    test_connection_context context;
+    test_levin_protocol_handler handler(&endpoint, config, context);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < stream.size(); offset += read_size)
+    {
+      if (!handler.handle_recv(stream.data() + offset, (std::min)(read_size, stream.size() - offset)))
+      {
+        LOG_ERROR("handle_recv failed in " << name);
+        return false;
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (commands_handler.m_notify_count != message_count || commands_handler.m_notify_bytes != payload_size * message_count)
+    {
+      LOG_ERROR(name << ": got " << commands_handler.m_notify_count << " messages of " << message_count);
+      return false;
+    }
+
+    std::cout << name << ": payload " << payload_size << " bytes, reads of " << read_size << " bytes, "
+      << static_cast<uint64_t>(message_count / seconds) << " messages/sec, "
+      << static_cast<uint64_t>(stream.size() / seconds / (1024 * 1024)) << " MB/sec" << std::endl;
+    return true;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  epee::log_space::get_set_log_detalisation_level(true, LOG_LEVEL_0);
+  epee::log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+
+  bool r = true;
+  // 8192 is the size of a connection's read buffer, larger reads are what a busy peer coalesces into one
+  r = run_bench("small", 32, 1000000, 8192) && r;
+  r = run_bench("small coalesced", 32, 1000000, 1024 * 1024) && r;
+  r = run_bench("large", 256 * 1024, 2000, 8192) && r;
+  r = run_bench("large coalesced", 256 * 1024, 2000, 4 * 1024 * 1024) && r;
+  return r ? 0 : 1;
+}
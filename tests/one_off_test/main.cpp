@@ -1,5 +1,6 @@
-#include "stxxl/vector"
-#include "stxxl/io"
+#include "common/mapped_vector.h"
+
+#include <boost/filesystem.hpp>
 
 #include <iostream>
 #include <cstdint>
@@ -23,17 +24,6 @@ struct entry_72
   uint64_t field4;
 };
 
-struct entry_128
-{
-  uint8_t data[32];
-  uint64_t field1;
-  uint64_t field_extra;
-  uint64_t field2;
-  uint64_t field3;
-  uint64_t field4;
-  uint8_t padding[56];
-};
-
 template <typename T>
 void fill_entry(T& e) {
   memset(e.data, 0x66, sizeof(e.data));
@@ -44,7 +34,7 @@ void fill_entry(T& e) {
 }
 
 template <typename T>
-void check_entry(T& e)
+void check_entry(const T& e)
 {
   for (int j=0; j < 32; j++) {
     if (e.data[j] != 0x66) {
@@ -53,53 +43,47 @@ void check_entry(T& e)
   }
 }
 
-int main(int argc, char *argv[])
+template <typename T>
+void check_vec(const char *filename, T& e1)
 {
-  typedef stxxl::VECTOR_GENERATOR<entry_64>::result vec_64;
-  typedef stxxl::VECTOR_GENERATOR<entry_72, 4, 8, 2 * 1024 * 1024 * 72 / 64>::result vec_72;
-  typedef stxxl::VECTOR_GENERATOR<entry_128>::result vec_128;
-  
-  stxxl::config::get_instance()->add_disk(stxxl::disk_config("memory_no_use", 1, "memory autogrow"));
+  boost::filesystem::remove(filename);
+  {
+    tools::mapped_vector<T> the_vec;
+    the_vec.open(filename);
+    for (int i=0; i < 128; i++) {
+      the_vec.push_back(e1);
+    }
+    the_vec.commit();
+  }
 
+  tools::mapped_vector<T> the_vec;
+  the_vec.open(filename);
+  if (the_vec.size() != 128) {
+    std::cout << "size " << the_vec.size() << " != 128" << std::endl;
+  }
+  for (size_t i=0; i < the_vec.size(); i++) {
+    check_entry(the_vec[i]);
+  }
+}
+
+int main(int argc, char *argv[])
+{
   std::cout << "checking vec_64" << std::endl;
   {
-    auto *f1 = new stxxl::syscall_file("vec_64.tmp", stxxl::file::RDWR | stxxl::file::CREAT | stxxl::file::TRUNC);
-    vec_64 the_vec(f1);
-    
     entry_64 e1;
     fill_entry(e1);
-    for (int i=0; i < 128; i++) {
-      the_vec.push_back(e1);
-    }
-    the_vec.flush();
-    
-    for (int i=0; i < 128; i++) {
-      check_entry(the_vec[i]);
-    }
+    check_vec("vec_64.tmp", e1);
   }
 
   std::cout << "checking vec_72" << std::endl;
   {
-    auto *f1 = new stxxl::syscall_file("vec_72.tmp", stxxl::file::RDWR | stxxl::file::CREAT | stxxl::file::TRUNC);
-    vec_72 the_vec(f1);
-    
     entry_72 e1;
     fill_entry(e1);
     e1.field_extra = UINT64_C(0x1111111111111111);
-    for (int i=0; i < 128; i++) {
-      the_vec.push_back(e1);
-    }
-    the_vec.flush();
-    
-    for (int i=0; i < 128; i++) {
-      check_entry(the_vec[i]);
-    }
+    check_vec("vec_72.tmp", e1);
   }
   
   std::cout << "done" << std::endl;
   
   return 0;
 }
-
-
-
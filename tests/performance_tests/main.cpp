@@ -17,6 +17,8 @@
 #include "generate_key_image.h"
 #include "generate_key_image_helper.h"
 #include "is_out_to_acc.h"
+#include "protocol_pack.h"
+#include "serialize_tx.h"
 
 int main(int argc, char** argv)
 {
@@ -61,6 +63,24 @@ int main(int argc, char** argv)
 
   TEST_PERFORMANCE0(test_cn_slow_hash);
 
+  TEST_PERFORMANCE1(test_parse_tx, 1);
+  TEST_PERFORMANCE1(test_parse_tx, 10);
+  TEST_PERFORMANCE1(test_parse_tx, 100);
+  TEST_PERFORMANCE1(test_serialize_tx, 1);
+  TEST_PERFORMANCE1(test_serialize_tx, 10);
+  TEST_PERFORMANCE1(test_serialize_tx, 100);
+  TEST_PERFORMANCE1(test_get_tx_hash, 1);
+  TEST_PERFORMANCE1(test_get_tx_hash, 100);
+
+  TEST_PERFORMANCE2(test_store_protocol_objects, true, 10);
+  TEST_PERFORMANCE2(test_store_protocol_objects, false, 10);
+  TEST_PERFORMANCE2(test_store_protocol_objects, true, 200);
+  TEST_PERFORMANCE2(test_store_protocol_objects, false, 200);
+  TEST_PERFORMANCE2(test_load_protocol_objects, true, 10);
+  TEST_PERFORMANCE2(test_load_protocol_objects, false, 10);
+  TEST_PERFORMANCE2(test_load_protocol_objects, true, 200);
+  TEST_PERFORMANCE2(test_load_protocol_objects, false, 200);
+
   std::cout << "Tests finished. Elapsed time: " << timer.elapsed_ms() / 1000 << " sec" << std::endl;
 
   return 0;
@@ -0,0 +1,104 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <string>
+
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "storages/portable_storage_template_helper.h"
+
+// a_block_count blocks of 2 txs each, roughly what a peer sends back per request during sync
+template<size_t a_block_count>
+class protocol_pack_test_base
+{
+public:
+  bool init()
+  {
+    for (size_t i = 0; i < a_block_count; ++i)
+    {
+      cryptonote::block_complete_entry bce;
+      bce.block = make_blob(120);
+      bce.txs.push_back(make_blob(300));
+      bce.txs.push_back(make_blob(1500));
+      m_objects.blocks.push_back(bce);
+    }
+    m_objects.current_blockchain_height = 500000;
+
+    return epee::serialization::store_t_to_binary(m_objects, m_objects_blob);
+  }
+
+protected:
+  static std::string make_blob(size_t size)
+  {
+    std::string blob;
+    while (blob.size() < size)
+    {
+      crypto::hash h = crypto::rand<crypto::hash>();
+      blob.append(reinterpret_cast<const char*>(&h), sizeof(h));
+    }
+    blob.resize(size);
+    return blob;
+  }
+
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request m_objects;
+  std::string m_objects_blob;
+};
+
+// a_dom selects the portable_storage section tree that store_t_to_binary and load_t_from_binary used to go through
+template<bool a_dom, size_t a_block_count>
+class test_store_protocol_objects : private protocol_pack_test_base<a_block_count>
+{
+public:
+  static const size_t loop_count = a_block_count < 100 ? 10000 : 1000;
+
+  typedef protocol_pack_test_base<a_block_count> base_class;
+
+  bool init() { return base_class::init(); }
+
+  bool test()
+  {
+    std::string blob;
+    if (a_dom)
+    {
+      epee::serialization::portable_storage ps;
+      this->m_objects.store(ps);
+      if (!ps.store_to_binary(blob))
+        return false;
+    }
+    else if (!epee::serialization::store_t_to_binary(this->m_objects, blob))
+    {
+      return false;
+    }
+    return blob.size() == this->m_objects_blob.size();
+  }
+};
+
+template<bool a_dom, size_t a_block_count>
+class test_load_protocol_objects : private protocol_pack_test_base<a_block_count>
+{
+public:
+  static const size_t loop_count = a_block_count < 100 ? 10000 : 1000;
+
+  typedef protocol_pack_test_base<a_block_count> base_class;
+
+  bool init() { return base_class::init(); }
+
+  bool test()
+  {
+    cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request objects;
+    if (a_dom)
+    {
+      epee::serialization::portable_storage ps;
+      if (!ps.load_from_binary(this->m_objects_blob) || !objects.load(ps))
+        return false;
+    }
+    else if (!epee::serialization::load_t_from_binary(objects, this->m_objects_blob))
+    {
+      return false;
+    }
+    return objects.blocks.size() == a_block_count;
+  }
+};
@@ -0,0 +1,96 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <vector>
+
+#include "cryptonote_core/account.h"
+#include "cryptonote_core/cryptonote_basic.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "crypto/crypto.h"
+
+#include "multi_tx_test_base.h"
+
+template<size_t a_ring_size>
+class serialize_tx_test_base : protected multi_tx_test_base<a_ring_size>
+{
+public:
+  typedef multi_tx_test_base<a_ring_size> base_class;
+
+  bool init()
+  {
+    using namespace cryptonote;
+
+    if (!base_class::init())
+      return false;
+
+    m_alice.generate();
+
+    std::vector<tx_destination_entry> destinations;
+    destinations.push_back(tx_destination_entry(CP_XPB, this->m_source_amount, m_alice.get_keys().m_account_address));
+
+    if (!construct_tx(this->m_miners[this->real_source_idx].get_keys(), this->m_sources, destinations, std::vector<uint8_t>(), m_tx, 0))
+      return false;
+
+    m_tx_blob = tx_to_blob(m_tx);
+    return true;
+  }
+
+protected:
+  cryptonote::account_base m_alice;
+  cryptonote::transaction m_tx;
+  cryptonote::blobdata m_tx_blob;
+};
+
+template<size_t a_ring_size>
+class test_parse_tx : private serialize_tx_test_base<a_ring_size>
+{
+public:
+  static const size_t loop_count = a_ring_size < 100 ? 10000 : 1000;
+
+  typedef serialize_tx_test_base<a_ring_size> base_class;
+
+  bool init() { return base_class::init(); }
+
+  bool test()
+  {
+    cryptonote::transaction tx;
+    return cryptonote::parse_and_validate_tx_from_blob(this->m_tx_blob, tx);
+  }
+};
+
+template<size_t a_ring_size>
+class test_serialize_tx : private serialize_tx_test_base<a_ring_size>
+{
+public:
+  static const size_t loop_count = a_ring_size < 100 ? 10000 : 1000;
+
+  typedef serialize_tx_test_base<a_ring_size> base_class;
+
+  bool init() { return base_class::init(); }
+
+  bool test()
+  {
+    cryptonote::blobdata blob;
+    return cryptonote::tx_to_blob(this->m_tx, blob) && blob.size() == this->m_tx_blob.size();
+  }
+};
+
+template<size_t a_ring_size>
+class test_get_tx_hash : private serialize_tx_test_base<a_ring_size>
+{
+public:
+  static const size_t loop_count = a_ring_size < 100 ? 10000 : 1000;
+
+  typedef serialize_tx_test_base<a_ring_size> base_class;
+
+  bool init() { return base_class::init(); }
+
+  bool test()
+  {
+    crypto::hash h;
+    return cryptonote::get_transaction_hash(this->m_tx, h);
+  }
+};
@@ -0,0 +1,126 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <unordered_set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <boost/uuid/random_generator.hpp>
+
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/block_queue.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  // a chain of n blocks following prev
+  std::vector<prepared_block> make_span(const crypto::hash& prev, size_t n)
+  {
+    std::vector<prepared_block> blocks;
+    crypto::hash last = prev;
+    for (size_t i = 0; i < n; i++)
+    {
+      prepared_block pb;
+      pb.id = crypto::rand<crypto::hash>();
+      pb.prev_id = last;
+      last = pb.id;
+      blocks.push_back(pb);
+    }
+    return blocks;
+  }
+}
+
+TEST(block_queue, connections_reserve_disjoint_blocks)
+{
+  block_queue q(60);
+  boost::uuids::uuid a = boost::uuids::random_generator()();
+  boost::uuids::uuid b = boost::uuids::random_generator()();
+  crypto::hash id = crypto::rand<crypto::hash>();
+
+  ASSERT_TRUE(q.reserve(a, id, 100));
+  ASSERT_TRUE(q.reserve(a, id, 101));
+  ASSERT_FALSE(q.reserve(b, id, 102));
+
+  // a went quiet, so b can have it
+  ASSERT_TRUE(q.reserve(b, id, 161));
+  ASSERT_FALSE(q.reserve(a, id, 162));
+
+  q.release(b);
+  ASSERT_TRUE(q.reserve(a, id, 163));
+}
+
+TEST(block_queue, spans_wait_for_their_parent)
+{
+  block_queue q(60);
+  boost::uuids::uuid a = boost::uuids::random_generator()();
+  boost::uuids::uuid b = boost::uuids::random_generator()();
+
+  crypto::hash top = crypto::rand<crypto::hash>();
+  std::vector<prepared_block> first = make_span(top, 3);
+  std::vector<prepared_block> second = make_span(first.back().id, 3);
+  crypto::hash second_id = second.front().id;
+
+  std::unordered_set<crypto::hash> chain;
+  chain.insert(top);
+  auto is_known = [&](const crypto::hash& h) { return chain.count(h) > 0; };
+
+  // the later span arrives first and can't be added yet
+  q.add_span(b, std::move(second), 100);
+  ASSERT_FALSE(q.reserve(a, second_id, 100));
+  block_queue::span s;
+  ASSERT_FALSE(q.pop_ready(is_known, s));
+
+  q.add_span(a, std::move(first), 101);
+  ASSERT_TRUE(q.pop_ready(is_known, s));
+  ASSERT_EQ(a, s.connection_id);
+  ASSERT_EQ(top, s.blocks.front().prev_id);
+  for (const auto& pb : s.blocks)
+    chain.insert(pb.id);
+
+  ASSERT_TRUE(q.pop_ready(is_known, s));
+  ASSERT_EQ(b, s.connection_id);
+  ASSERT_EQ(second_id, s.blocks.front().id);
+  ASSERT_EQ(0, q.span_count());
+  ASSERT_TRUE(q.reserve(a, second_id, 102));
+}
+
+TEST(block_queue, expire_drops_stale_spans)
+{
+  block_queue q(60);
+  boost::uuids::uuid a = boost::uuids::random_generator()();
+  std::vector<prepared_block> blocks = make_span(crypto::rand<crypto::hash>(), 2);
+  crypto::hash id = blocks.front().id;
+
+  q.add_span(a, std::move(blocks), 100);
+  q.expire(159);
+  ASSERT_EQ(1, q.span_count());
+  q.expire(160);
+  ASSERT_EQ(0, q.span_count());
+  ASSERT_TRUE(q.reserve(a, id, 160));
+}
+
+TEST(block_queue, closed_connection_keeps_its_downloads)
+{
+  block_queue q(60);
+  boost::uuids::uuid a = boost::uuids::random_generator()();
+  boost::uuids::uuid b = boost::uuids::random_generator()();
+  std::vector<prepared_block> blocks = make_span(crypto::rand<crypto::hash>(), 2);
+  crypto::hash downloaded = blocks.front().id;
+  crypto::hash reserved = crypto::rand<crypto::hash>();
+
+  ASSERT_TRUE(q.reserve(a, reserved, 100));
+  q.add_span(a, std::move(blocks), 100);
+
+  // another connection can fetch what a didn't get to, but not what it already sent
+  q.release_reservations(a);
+  ASSERT_TRUE(q.reserve(b, reserved, 101));
+  ASSERT_FALSE(q.reserve(b, downloaded, 101));
+  ASSERT_EQ(1, q.span_count());
+
+  q.release(a);
+  ASSERT_EQ(0, q.span_count());
+  ASSERT_TRUE(q.reserve(b, downloaded, 102));
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "common/boost_serialization_helper.h"
+#include "cryptonote_config.h"
+#include "cryptonote_core/account.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "cryptonote_core/blockchain_storage.h"
+#include "cryptonote_core/account_boost_serialization.h"
+#include "cryptonote_core/cryptonote_boost_serialization.h"
+#include "cryptonote_core/blockchain_storage_boost_serialization.h"
+#include "cryptonote_core/blockchain_storage_db_serialization.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  block make_block(transaction& miner_tx)
+  {
+    account_base acc;
+    acc.generate();
+    miner_tx = transaction();
+    construct_miner_tx(0, 0, 10000000000000, 1000, DEFAULT_FEE, acc.get_keys().m_account_address, miner_tx, blobdata(), 1);
+
+    block b = AUTO_VAL_INIT(b);
+    b.miner_tx = miner_tx;
+    b.timestamp = 1400000000;
+    b.tx_hashes.push_back(crypto::rand<crypto::hash>());
+    return b;
+  }
+
+  blockchain_storage::transaction_chain_entry make_tx_chain_entry(const transaction& tx)
+  {
+    blockchain_storage::transaction_chain_entry ce = AUTO_VAL_INIT(ce);
+    ce.tx = tx;
+    ce.m_keeper_block_height = 123456;
+    ce.m_blob_size = get_object_blobsize(tx);
+    ce.m_global_output_indexes.push_back(0);
+    ce.m_global_output_indexes.push_back(300);
+    ce.m_global_output_indexes.push_back(1ull << 40);
+    return ce;
+  }
+}
+
+TEST(blockchain_storage_db_serialization, block_is_stored_as_blob)
+{
+  transaction tx;
+  block b = make_block(tx);
+
+  std::string stored = block_to_db(b);
+  ASSERT_EQ(block_to_blob(b), stored);
+  ASSERT_FALSE(tools::is_boost_binary_archive(stored.data(), stored.size()));
+
+  ASSERT_EQ(get_block_hash(b), get_block_hash(block_from_db(stored)));
+
+  blobdata blob;
+  ASSERT_TRUE(block_blob_from_db(stored.data(), stored.size(), blob));
+  ASSERT_EQ(stored, blob);
+}
+
+TEST(blockchain_storage_db_serialization, tx_chain_entry_round_trip)
+{
+  transaction tx;
+  make_block(tx);
+  auto ce = make_tx_chain_entry(tx);
+
+  std::string stored = tx_chain_entry_to_db(ce);
+  auto loaded = tx_chain_entry_from_db(stored);
+  ASSERT_EQ(get_transaction_hash(tx), get_transaction_hash(loaded.tx));
+  ASSERT_EQ(ce.m_keeper_block_height, loaded.m_keeper_block_height);
+  ASSERT_EQ(ce.m_blob_size, loaded.m_blob_size);
+  ASSERT_EQ(ce.m_global_output_indexes, loaded.m_global_output_indexes);
+
+  // the tx blob is the tail of the stored entry
+  blobdata blob;
+  ASSERT_TRUE(tx_blob_from_db(stored.data(), stored.size(), blob));
+  ASSERT_EQ(tx_to_blob(tx), blob);
+  ASSERT_EQ(0, stored.compare(stored.size() - blob.size(), blob.size(), blob));
+
+  // truncated headers are rejected
+  ASSERT_FALSE(tx_blob_from_db(stored.data(), 3, blob));
+  ASSERT_THROW(tx_chain_entry_from_db(stored.substr(0, 3)), std::runtime_error);
+}
+
+TEST(blockchain_storage_db_serialization, reads_legacy_boost_archives)
+{
+  transaction tx;
+  block b = make_block(tx);
+  auto ce = make_tx_chain_entry(tx);
+
+  std::string stored_block = tools::boost_serialize_to_string(b);
+  ASSERT_TRUE(tools::is_boost_binary_archive(stored_block.data(), stored_block.size()));
+  ASSERT_EQ(get_block_hash(b), get_block_hash(block_from_db(stored_block)));
+  blobdata blob;
+  ASSERT_TRUE(block_blob_from_db(stored_block.data(), stored_block.size(), blob));
+  ASSERT_EQ(block_to_blob(b), blob);
+
+  std::string stored_ce = tools::boost_serialize_to_string(ce);
+  ASSERT_TRUE(tools::is_boost_binary_archive(stored_ce.data(), stored_ce.size()));
+  auto loaded = tx_chain_entry_from_db(stored_ce);
+  ASSERT_EQ(get_transaction_hash(tx), get_transaction_hash(loaded.tx));
+  ASSERT_EQ(ce.m_global_output_indexes, loaded.m_global_output_indexes);
+  ASSERT_TRUE(tx_blob_from_db(stored_ce.data(), stored_ce.size(), blob));
+  ASSERT_EQ(tx_to_blob(tx), blob);
+}
+
+TEST(blockchain_storage_db_serialization, vote_history_round_trip)
+{
+  std::vector<blockchain_storage::vote_instance> hist(2);
+  hist[0].voting_for_height = 1000;
+  hist[0].expected_vote = 5000000000000;
+  hist[0].votes[1] = 5000000000000;
+  hist[0].votes[65535] = 4000000000000;
+  hist[1].voting_for_height = 2000;
+  hist[1].expected_vote = 1;
+
+  std::string stored = vote_history_to_db(hist);
+  auto loaded = vote_history_from_db(stored);
+  ASSERT_EQ(2, loaded.size());
+  for (size_t i = 0; i < hist.size(); i++)
+  {
+    ASSERT_EQ(hist[i].voting_for_height, loaded[i].voting_for_height);
+    ASSERT_EQ(hist[i].expected_vote, loaded[i].expected_vote);
+    ASSERT_EQ(hist[i].votes, loaded[i].votes);
+  }
+
+  ASSERT_THROW(vote_history_from_db(stored.substr(0, stored.size() - 1)), std::runtime_error);
+  ASSERT_THROW(vote_history_from_db(stored + "x"), std::runtime_error);
+}
@@ -0,0 +1,163 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <cstdlib>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_config.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+
+namespace
+{
+  uint64_t transform(uint64_t val)
+  {
+    return UINT64_C(0x5851f42d4c957f2d) * val + UINT64_C(0x14057b7ef767814f);
+  }
+
+  struct small_boulderhash_guard
+  {
+    bool prev;
+    small_boulderhash_guard() : prev(crypto::g_hash_ops_small_boulderhash) { crypto::g_hash_ops_small_boulderhash = true; }
+    ~small_boulderhash_guard() { crypto::g_hash_ops_small_boulderhash = prev; }
+  };
+
+  struct do_boulderhash_guard
+  {
+    bool prev;
+    do_boulderhash_guard() : prev(cryptonote::config::do_boulderhash) { cryptonote::config::do_boulderhash = true; }
+    ~do_boulderhash_guard() { cryptonote::config::do_boulderhash = prev; }
+  };
+
+  crypto::hash full_v1_hash(const std::string& data)
+  {
+    std::vector<std::vector<uint64_t> > states(crypto::get_boulderhash_states(),
+                                               std::vector<uint64_t>(crypto::get_boulderhash_state_size()));
+    std::vector<uint64_t *> state_ptrs;
+    for (auto& state : states)
+      state_ptrs.push_back(state.data());
+
+    crypto::hash h;
+    crypto::pc_boulderhash(BOULDERHASH_VERSION_REGULAR_1, data.data(), data.size(), reinterpret_cast<char *>(&h), state_ptrs.data());
+    return h;
+  }
+
+  crypto::hash light_v1_hash(const std::string& data)
+  {
+    crypto::hash h;
+    crypto::pc_boulderhash_v1_light(data.data(), data.size(), reinterpret_cast<char *>(&h));
+    return h;
+  }
+}
+
+TEST(boulderhash_v1, state_word_matches_fill)
+{
+  for (int n=0; n < 4; n++)
+  {
+    uint64_t state0 = crypto::rand<uint64_t>();
+    uint64_t val = state0;
+    for (uint64_t j=0; j < BOULDERHASH_REGULAR_STATE_SIZE; j++)
+    {
+      if (j < 4096 || j % 65537 == 0 || j == BOULDERHASH_REGULAR_STATE_SIZE - 1)
+      {
+        ASSERT_EQ(val, crypto::pc_boulderhash_v1_state_word(state0, j)) << "state0=" << state0 << ", j=" << j;
+      }
+      val = transform(val);
+    }
+  }
+}
+
+TEST(boulderhash_v1, light_matches_full)
+{
+  small_boulderhash_guard guard;
+
+  std::vector<std::string> inputs;
+  inputs.push_back("");
+  inputs.push_back("pebblecoin");
+  inputs.push_back(std::string(76, '\0'));
+  for (int i=0; i < 20; i++)
+  {
+    std::string data(1 + crypto::rand<uint8_t>(), ' ');
+    for (auto& c : data)
+      c = crypto::rand<char>();
+    inputs.push_back(data);
+  }
+
+  for (const auto& data : inputs)
+  {
+    ASSERT_EQ(full_v1_hash(data), light_v1_hash(data));
+  }
+}
+
+TEST(boulderhash_v1, pc_boulderhash_v1_needs_no_state)
+{
+  small_boulderhash_guard guard;
+
+  std::string data("pebblecoin");
+  ASSERT_EQ(full_v1_hash(data), crypto::pc_boulderhash(BOULDERHASH_VERSION_REGULAR_1, data.data(), data.size(), NULL));
+  ASSERT_THROW(crypto::pc_boulderhash(BOULDERHASH_VERSION_REGULAR_2, data.data(), data.size(), NULL), std::runtime_error);
+}
+
+TEST(boulderhash_state, mapped_state_matches_vector_state)
+{
+  small_boulderhash_guard guard;
+  do_boulderhash_guard do_guard;
+
+  uint64_t **state = crypto::pc_malloc_state();
+  ASSERT_TRUE(state != NULL);
+  for (size_t i=1; i < crypto::get_boulderhash_states(); i++)
+  {
+    ASSERT_EQ(state[i-1] + crypto::get_boulderhash_state_size(), state[i]);
+  }
+
+  std::vector<std::vector<uint64_t> > states(crypto::get_boulderhash_states(),
+                                             std::vector<uint64_t>(crypto::get_boulderhash_state_size()));
+  std::vector<uint64_t *> state_ptrs;
+  for (auto& s : states)
+    state_ptrs.push_back(s.data());
+
+  std::string data("pebblecoin");
+  crypto::hash h1, h2;
+  crypto::pc_boulderhash(BOULDERHASH_VERSION_REGULAR_2, data.data(), data.size(), reinterpret_cast<char *>(&h1), state);
+  crypto::pc_boulderhash(BOULDERHASH_VERSION_REGULAR_2, data.data(), data.size(), reinterpret_cast<char *>(&h2), state_ptrs.data());
+  ASSERT_EQ(h1, h2);
+
+  crypto::pc_free_state(state);
+}
+
+#ifndef WIN32
+TEST(boulderhash_state, frees_with_the_size_it_was_mapped_with)
+{
+  do_boulderhash_guard do_guard;
+  uint64_t **state;
+  size_t region_size;
+  {
+    small_boulderhash_guard guard;
+    state = crypto::pc_malloc_state();
+    ASSERT_TRUE(state != NULL);
+    size_t huge_page_size = 2 * 1024 * 1024;
+    region_size = crypto::get_boulderhash_states() * crypto::get_boulderhash_state_size() * sizeof(uint64_t);
+    region_size = (region_size + huge_page_size - 1) & ~(huge_page_size - 1);
+  }
+
+  // map a page right after the state, freeing with the full sized options used to unmap it too
+  char *after = (char *)state[0] + region_size;
+  void *page = mmap(after, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(MAP_FAILED, page);
+  crypto::pc_free_state(state);
+
+  if (page == after)
+  {
+    unsigned char vec;
+    ASSERT_EQ(0, mincore(page, 4096, &vec));
+  }
+  munmap(page, 4096);
+}
+#endif
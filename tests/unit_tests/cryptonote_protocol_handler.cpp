@@ -0,0 +1,422 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <boost/uuid/random_generator.hpp>
+
+#include "crypto/crypto.h"
+#include "cryptonote_core/cryptonote_basic.h"
+#include "cryptonote_core/cryptonote_basic_impl.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "cryptonote_core/nulls.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  // just enough of a core for the protocol handler: blocks are added if all their txs are known,
+  // and txs are kept without verifying them
+  class test_core
+  {
+  public:
+    std::unordered_map<crypto::hash, blobdata> blocks;
+    std::unordered_map<crypto::hash, blobdata> pool;
+    std::unordered_map<crypto::hash, blobdata> chain_txs;
+
+    bool have_block(const crypto::hash& id) { return blocks.count(id) > 0; }
+    bool have_pool_transaction(const crypto::hash& id) { return pool.count(id) > 0; }
+
+    bool handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool keeped_by_block)
+    {
+      pool[get_blob_hash(tx_blob)] = tx_blob;
+      return true;
+    }
+
+    bool handle_incoming_block(const blobdata& block_blob, block_verification_context& bvc, bool update_miner_blocktemplate = true)
+    {
+      block b;
+      if (!parse_and_validate_block_from_blob(block_blob, b))
+      {
+        bvc.m_verifivation_failed = true;
+        return false;
+      }
+      BOOST_FOREACH(const auto& tx_hash, b.tx_hashes)
+      {
+        if (!pool.count(tx_hash))
+        {
+          bvc.m_verifivation_failed = true;
+          return false;
+        }
+      }
+      BOOST_FOREACH(const auto& tx_hash, b.tx_hashes)
+      {
+        chain_txs[tx_hash] = pool[tx_hash];
+        pool.erase(tx_hash);
+      }
+      blocks[get_block_hash(b)] = block_blob;
+      bvc.m_added_to_main_chain = true;
+      return true;
+    }
+
+    // like core, txs it doesn't have are left out
+    bool handle_get_block_txs(NOTIFY_REQUEST_BLOCK_TXS::request& arg, NOTIFY_RESPONSE_BLOCK_TXS::request& rsp, cryptonote_connection_context& context)
+    {
+      rsp.block_id = arg.block_id;
+      BOOST_FOREACH(const auto& tx_hash, arg.txs)
+      {
+        if (chain_txs.count(tx_hash))
+          rsp.txs.push_back(chain_txs[tx_hash]);
+        else if (pool.count(tx_hash))
+          rsp.txs.push_back(pool[tx_hash]);
+      }
+      return true;
+    }
+
+    bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote_connection_context& context)
+    {
+      BOOST_FOREACH(const auto& id, arg.blocks)
+      {
+        block b;
+        if (!blocks.count(id) || !parse_and_validate_block_from_blob(blocks[id], b))
+        {
+          rsp.missed_ids.push_back(id);
+          continue;
+        }
+        block_complete_entry e;
+        e.block = blocks[id];
+        BOOST_FOREACH(const auto& tx_hash, b.tx_hashes)
+          e.txs.push_back(chain_txs[tx_hash]);
+        rsp.blocks.push_back(e);
+      }
+      rsp.current_blockchain_height = blocks.size();
+      return true;
+    }
+
+    bool handle_get_pool_transactions(NOTIFY_REQUEST_TRANSACTIONS::request& arg, NOTIFY_NEW_TRANSACTIONS::request& rsp, cryptonote_connection_context& context)
+    {
+      BOOST_FOREACH(const auto& tx_hash, arg.txs)
+      {
+        if (pool.count(tx_hash))
+          rsp.txs.push_back(pool[tx_hash]);
+      }
+      return true;
+    }
+
+    void pause_mine() { }
+    void resume_mine() { }
+    bool get_short_chain_history(std::list<crypto::hash>& ids) { return true; }
+    uint64_t get_current_blockchain_height() { return blocks.size(); }
+    bool get_blockchain_top(uint64_t& height, crypto::hash& top_id) { height = blocks.size(); top_id = null_hash; return true; }
+    crypto::hash get_block_id_by_height(uint64_t height) { return null_hash; }
+    bool get_block_by_hash(const crypto::hash& h, block& blk) { return blocks.count(h) && parse_and_validate_block_from_blob(blocks[h], blk); }
+    bool is_in_checkpoint_zone(uint64_t height) { return false; }
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) { return true; }
+    bool get_stat_info(core_stat_info& st_inf) { return true; }
+    bool on_idle() { return true; }
+    void on_synchronized() { }
+  };
+
+  struct sent_notify
+  {
+    int command;
+    std::string blob;
+    boost::uuids::uuid connection_id;
+  };
+
+  // keeps what the handler sends so the test can deliver it to the other side
+  class test_endpoint : public nodetool::p2p_endpoint_stub<cryptonote_connection_context>
+  {
+  public:
+    std::list<sent_notify> sent;
+    std::list<sent_notify> relayed;
+    std::list<cryptonote_connection_context*> connections;
+    size_t drops;
+
+    test_endpoint() : drops(0) { }
+
+    virtual bool invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context)
+    {
+      sent.push_back(sent_notify{command, req_buff, context.m_connection_id});
+      return true;
+    }
+    virtual bool relay_notify_to_list(int command, const std::string& data_buff, const std::list<nodetool::net_connection_id>& connections)
+    {
+      relayed.push_back(sent_notify{command, data_buff, boost::uuids::uuid()});
+      return true;
+    }
+    virtual bool drop_connection(const epee::net_utils::connection_context_base& context)
+    {
+      ++drops;
+      return true;
+    }
+    virtual void for_each_connection(std::function<bool(cryptonote_connection_context&, nodetool::peerid_type)> f)
+    {
+      nodetool::peerid_type peer_id = 0;
+      BOOST_FOREACH(auto pcontext, connections)
+      {
+        if (!f(*pcontext, ++peer_id))
+          break;
+      }
+    }
+  };
+
+  cryptonote_connection_context make_context()
+  {
+    cryptonote_connection_context context = AUTO_VAL_INIT(context);
+    context.m_connection_id = boost::uuids::random_generator()();
+    context.m_state = cryptonote_connection_context::state_normal;
+    context.m_supports_compact_blocks = true;
+    context.m_supports_tx_announcements = true;
+    return context;
+  }
+
+  // one node, talking to a single peer over context
+  struct test_node
+  {
+    test_core core;
+    test_endpoint endpoint;
+    t_cryptonote_protocol_handler<test_core> handler;
+    cryptonote_connection_context context;
+
+    test_node() : handler(core, &endpoint), context(make_context()) { }
+
+    template<class t_notify>
+    void receive(typename t_notify::request& arg)
+    {
+      receive<t_notify>(arg, context);
+    }
+
+    // from another peer than the one on context
+    template<class t_notify>
+    void receive(typename t_notify::request& arg, cryptonote_connection_context& from)
+    {
+      std::string blob, out;
+      epee::serialization::store_t_to_binary(arg, blob);
+      bool handled = false;
+      handler.handle_invoke_map(true, t_notify::ID, blob, out, from, handled);
+      ASSERT_TRUE(handled);
+    }
+
+    // passes the oldest notify this node sent to the other node
+    int deliver_to(test_node& other)
+    {
+      if (endpoint.sent.empty())
+        return 0;
+      sent_notify n = endpoint.sent.front();
+      endpoint.sent.pop_front();
+      std::string out;
+      bool handled = false;
+      other.handler.handle_invoke_map(true, n.command, n.blob, out, other.context, handled);
+      EXPECT_TRUE(handled);
+      return n.command;
+    }
+  };
+
+  blobdata make_tx(uint64_t n)
+  {
+    transaction tx;
+    tx.set_null();
+    tx.version = VANILLA_TRANSACTION_VERSION;
+    tx.unlock_time = n;
+    return tx_to_blob(tx);
+  }
+
+  blobdata make_block(const std::vector<blobdata>& txs)
+  {
+    block b = AUTO_VAL_INIT(b);
+    b.major_version = 1;
+    b.prev_id = crypto::rand<crypto::hash>();
+    b.miner_tx.set_null();
+    b.miner_tx.version = VANILLA_TRANSACTION_VERSION;
+    BOOST_FOREACH(const auto& tx_blob, txs)
+      b.tx_hashes.push_back(get_blob_hash(tx_blob));
+    return block_to_blob(b);
+  }
+
+  // the sender has the block in its chain
+  crypto::hash add_to_chain(test_core& core, const blobdata& block_blob, const std::vector<blobdata>& txs)
+  {
+    BOOST_FOREACH(const auto& tx_blob, txs)
+      core.chain_txs[get_blob_hash(tx_blob)] = tx_blob;
+    block b;
+    parse_and_validate_block_from_blob(block_blob, b);
+    crypto::hash id = get_block_hash(b);
+    core.blocks[id] = block_blob;
+    return id;
+  }
+
+  NOTIFY_NEW_COMPACT_BLOCK::request make_compact(const blobdata& block_blob)
+  {
+    NOTIFY_NEW_COMPACT_BLOCK::request compact = AUTO_VAL_INIT(compact);
+    compact.block = block_blob;
+    compact.current_blockchain_height = 1;
+    compact.hop = 1;
+    return compact;
+  }
+}
+
+TEST(protocol_compact_block, requests_only_txs_missing_from_pool)
+{
+  test_node sender, receiver;
+  std::vector<blobdata> txs = { make_tx(1), make_tx(2), make_tx(3) };
+  blobdata block_blob = make_block(txs);
+  crypto::hash id = add_to_chain(sender.core, block_blob, txs);
+  receiver.core.pool[get_blob_hash(txs[0])] = txs[0];
+
+  auto compact = make_compact(block_blob);
+  receiver.receive<NOTIFY_NEW_COMPACT_BLOCK>(compact);
+  ASSERT_EQ(1, receiver.endpoint.sent.size());
+  NOTIFY_REQUEST_BLOCK_TXS::request req;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(req, receiver.endpoint.sent.front().blob));
+  ASSERT_EQ(id, req.block_id);
+  ASSERT_EQ(2, req.txs.size());
+  ASSERT_EQ(get_blob_hash(txs[1]), req.txs.front());
+  ASSERT_EQ(get_blob_hash(txs[2]), req.txs.back());
+
+  ASSERT_EQ(static_cast<int>(NOTIFY_REQUEST_BLOCK_TXS::ID), receiver.deliver_to(sender));
+  ASSERT_EQ(static_cast<int>(NOTIFY_RESPONSE_BLOCK_TXS::ID), sender.deliver_to(receiver));
+  ASSERT_TRUE(receiver.core.have_block(id));
+  ASSERT_TRUE(receiver.endpoint.sent.empty());
+  ASSERT_EQ(0, receiver.endpoint.drops);
+  ASSERT_EQ(0, sender.endpoint.drops);
+}
+
+TEST(protocol_compact_block, all_txs_in_pool_adds_block_directly)
+{
+  test_node receiver;
+  std::vector<blobdata> txs = { make_tx(1), make_tx(2) };
+  blobdata block_blob = make_block(txs);
+  BOOST_FOREACH(const auto& tx_blob, txs)
+    receiver.core.pool[get_blob_hash(tx_blob)] = tx_blob;
+
+  auto compact = make_compact(block_blob);
+  receiver.receive<NOTIFY_NEW_COMPACT_BLOCK>(compact);
+  ASSERT_TRUE(receiver.endpoint.sent.empty());
+  ASSERT_EQ(1, receiver.core.blocks.size());
+  ASSERT_EQ(0, receiver.endpoint.drops);
+}
+
+TEST(protocol_compact_block, omitted_tx_falls_back_to_full_block)
+{
+  test_node sender, receiver;
+  std::vector<blobdata> txs = { make_tx(1), make_tx(2) };
+  blobdata block_blob = make_block(txs);
+  crypto::hash id = add_to_chain(sender.core, block_blob, txs);
+  // the sender can't answer for the second tx, so it leaves it out of the response
+  sender.core.chain_txs.erase(get_blob_hash(txs[1]));
+
+  auto compact = make_compact(block_blob);
+  receiver.receive<NOTIFY_NEW_COMPACT_BLOCK>(compact);
+  ASSERT_EQ(static_cast<int>(NOTIFY_REQUEST_BLOCK_TXS::ID), receiver.deliver_to(sender));
+  ASSERT_EQ(static_cast<int>(NOTIFY_RESPONSE_BLOCK_TXS::ID), sender.deliver_to(receiver));
+  ASSERT_FALSE(receiver.core.have_block(id));
+  ASSERT_EQ(0, receiver.endpoint.drops);
+
+  ASSERT_EQ(1, receiver.endpoint.sent.size());
+  NOTIFY_REQUEST_GET_OBJECTS::request req;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(req, receiver.endpoint.sent.front().blob));
+  ASSERT_EQ(1, req.blocks.size());
+  ASSERT_EQ(id, req.blocks.front());
+
+  // by the time the full block is asked for, the sender has the tx again
+  sender.core.chain_txs[get_blob_hash(txs[1])] = txs[1];
+  ASSERT_EQ(static_cast<int>(NOTIFY_REQUEST_GET_OBJECTS::ID), receiver.deliver_to(sender));
+  ASSERT_EQ(static_cast<int>(NOTIFY_RESPONSE_GET_OBJECTS::ID), sender.deliver_to(receiver));
+  ASSERT_TRUE(receiver.core.have_block(id));
+  ASSERT_EQ(0, receiver.endpoint.drops);
+  ASSERT_EQ(0, sender.endpoint.drops);
+  ASSERT_EQ(cryptonote_connection_context::state_normal, receiver.context.m_state);
+  ASSERT_TRUE(receiver.context.m_requested_objects.empty());
+}
+
+TEST(protocol_compact_block, tx_dropped_from_pool_falls_back_to_full_block)
+{
+  test_node sender, receiver;
+  std::vector<blobdata> txs = { make_tx(1), make_tx(2) };
+  blobdata block_blob = make_block(txs);
+  crypto::hash id = add_to_chain(sender.core, block_blob, txs);
+  receiver.core.pool[get_blob_hash(txs[0])] = txs[0];
+
+  auto compact = make_compact(block_blob);
+  receiver.receive<NOTIFY_NEW_COMPACT_BLOCK>(compact);
+  // the pool lets go of the tx we didn't ask for before the response comes in
+  receiver.core.pool.clear();
+  ASSERT_EQ(static_cast<int>(NOTIFY_REQUEST_BLOCK_TXS::ID), receiver.deliver_to(sender));
+  ASSERT_EQ(static_cast<int>(NOTIFY_RESPONSE_BLOCK_TXS::ID), sender.deliver_to(receiver));
+  ASSERT_FALSE(receiver.core.have_block(id));
+
+  ASSERT_EQ(static_cast<int>(NOTIFY_REQUEST_GET_OBJECTS::ID), receiver.deliver_to(sender));
+  ASSERT_EQ(static_cast<int>(NOTIFY_RESPONSE_GET_OBJECTS::ID), sender.deliver_to(receiver));
+  ASSERT_TRUE(receiver.core.have_block(id));
+  ASSERT_EQ(0, receiver.endpoint.drops);
+}
+
+TEST(protocol_tx_announce, asks_one_announcer_then_the_next)
+{
+  test_node node;
+  cryptonote_connection_context other = make_context();
+  blobdata tx_blob = make_tx(1);
+  NOTIFY_NEW_TRANSACTION_HASHES::request announce;
+  announce.txs.push_back(get_blob_hash(tx_blob));
+
+  node.receive<NOTIFY_NEW_TRANSACTION_HASHES>(announce);
+  ASSERT_EQ(1, node.endpoint.sent.size());
+  ASSERT_EQ(static_cast<int>(NOTIFY_REQUEST_TRANSACTIONS::ID), node.endpoint.sent.front().command);
+  ASSERT_EQ(node.context.m_connection_id, node.endpoint.sent.front().connection_id);
+  NOTIFY_REQUEST_TRANSACTIONS::request req;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(req, node.endpoint.sent.front().blob));
+  ASSERT_EQ(1, req.txs.size());
+  ASSERT_EQ(get_blob_hash(tx_blob), req.txs.front());
+  node.endpoint.sent.clear();
+
+  // already asked the first peer
+  node.receive<NOTIFY_NEW_TRANSACTION_HASHES>(announce, other);
+  ASSERT_TRUE(node.endpoint.sent.empty());
+  node.handler.on_idle();
+  ASSERT_TRUE(node.endpoint.sent.empty());
+
+  // the first peer goes away without sending it
+  node.handler.on_connection_close(node.context);
+  node.handler.on_idle();
+  ASSERT_EQ(1, node.endpoint.sent.size());
+  ASSERT_EQ(static_cast<int>(NOTIFY_REQUEST_TRANSACTIONS::ID), node.endpoint.sent.front().command);
+  ASSERT_EQ(other.m_connection_id, node.endpoint.sent.front().connection_id);
+  node.endpoint.sent.clear();
+
+  NOTIFY_NEW_TRANSACTIONS::request txs;
+  txs.txs.push_back(tx_blob);
+  node.receive<NOTIFY_NEW_TRANSACTIONS>(txs, other);
+  ASSERT_TRUE(node.core.have_pool_transaction(get_blob_hash(tx_blob)));
+  node.handler.on_idle();
+  ASSERT_TRUE(node.endpoint.sent.empty());
+  ASSERT_EQ(0, node.endpoint.drops);
+}
+
+TEST(protocol_tx_announce, requests_per_peer_are_bounded)
+{
+  test_node node;
+  NOTIFY_NEW_TRANSACTION_HASHES::request announce;
+  for (size_t i = 0; i < CRYPTONOTE_PROTOCOL_REQUESTED_TXS_MAX_COUNT + 10; i++)
+    announce.txs.push_back(crypto::rand<crypto::hash>());
+
+  node.receive<NOTIFY_NEW_TRANSACTION_HASHES>(announce);
+  ASSERT_EQ(1, node.endpoint.sent.size());
+  NOTIFY_REQUEST_TRANSACTIONS::request req;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(req, node.endpoint.sent.front().blob));
+  ASSERT_EQ(CRYPTONOTE_PROTOCOL_REQUESTED_TXS_MAX_COUNT, req.txs.size());
+  node.endpoint.sent.clear();
+
+  // nothing more until it answers
+  NOTIFY_NEW_TRANSACTION_HASHES::request more;
+  more.txs.push_back(crypto::rand<crypto::hash>());
+  node.receive<NOTIFY_NEW_TRANSACTION_HASHES>(more);
+  ASSERT_TRUE(node.endpoint.sent.empty());
+}
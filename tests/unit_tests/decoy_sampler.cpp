@@ -0,0 +1,125 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/decoy_sampler.h"
+
+using cryptonote::decoy_sampler;
+
+TEST(decoy_sampler, distinct_indexes_in_range)
+{
+  decoy_sampler sampler(1);
+  std::set<size_t> picked;
+  size_t accepted = sampler.sample(1000000, 100, [&](size_t i) {
+    EXPECT_LT(i, 1000000);
+    EXPECT_TRUE(picked.insert(i).second);
+    return true;
+  });
+  ASSERT_EQ(100, accepted);
+  ASSERT_EQ(100, picked.size());
+}
+
+TEST(decoy_sampler, offers_each_index_once_when_rejecting)
+{
+  decoy_sampler sampler(2);
+  std::vector<size_t> offered;
+  // only even indexes are usable, and there aren't enough of them
+  size_t accepted = sampler.sample(20, 15, [&](size_t i) {
+    offered.push_back(i);
+    return i % 2 == 0;
+  });
+  ASSERT_EQ(10, accepted);
+  ASSERT_EQ(20, offered.size());
+  ASSERT_EQ(20, std::set<size_t>(offered.begin(), offered.end()).size());
+}
+
+TEST(decoy_sampler, covers_the_whole_range)
+{
+  decoy_sampler sampler(3);
+  std::vector<size_t> hits(10, 0);
+  for (size_t round = 0; round < 2000; round++)
+  {
+    sampler.sample(10, 3, [&](size_t i) { ++hits[i]; return true; });
+  }
+  // 600 expected each
+  for (size_t h : hits)
+  {
+    ASSERT_GT(h, 450);
+    ASSERT_LT(h, 750);
+  }
+}
+
+TEST(decoy_sampler, empty_range)
+{
+  decoy_sampler sampler;
+  ASSERT_EQ(0, sampler.sample(0, 5, [](size_t) { return true; }));
+}
+
+TEST(decoy_sampler, by_age_distinct_indexes_in_range)
+{
+  decoy_sampler sampler(4);
+  // a few outputs per block
+  auto height_of = [](size_t i) { return i / 3; };
+  std::set<size_t> picked;
+  size_t accepted = sampler.sample_by_age(30000, 9999, 120, 100, height_of, [&](size_t i) {
+    EXPECT_LT(i, 30000);
+    EXPECT_TRUE(picked.insert(i).second);
+    return true;
+  });
+  ASSERT_EQ(100, accepted);
+  ASSERT_EQ(100, picked.size());
+}
+
+TEST(decoy_sampler, by_age_favours_recent_outputs)
+{
+  decoy_sampler sampler(5);
+  auto height_of = [](size_t i) { return i; };
+  size_t recent = 0;
+  for (size_t round = 0; round < 2000; round++)
+  {
+    sampler.sample_by_age(10000, 9999, 120, 1, height_of, [&](size_t i) {
+      if (i >= 7000)
+        ++recent;
+      return true;
+    });
+  }
+  // 600 if they were picked uniformly
+  ASSERT_GT(recent, 1000);
+}
+
+TEST(decoy_sampler, by_age_offers_each_index_once_when_rejecting)
+{
+  decoy_sampler sampler(6);
+  std::vector<size_t> offered;
+  size_t accepted = sampler.sample_by_age(20, 19, 120, 15, [](size_t i) { return i; }, [&](size_t i) {
+    offered.push_back(i);
+    return i % 2 == 0;
+  });
+  ASSERT_EQ(10, accepted);
+  ASSERT_EQ(20, offered.size());
+  ASSERT_EQ(20, std::set<size_t>(offered.begin(), offered.end()).size());
+}
+
+TEST(decoy_sampler, by_age_picks_uniformly_when_the_chain_is_too_short)
+{
+  decoy_sampler sampler(7);
+  // any age drawn goes back past the genesis block
+  std::set<size_t> picked;
+  size_t accepted = sampler.sample_by_age(50, 0, 120, 10, [](size_t) { return 0; }, [&](size_t i) {
+    EXPECT_TRUE(picked.insert(i).second);
+    return true;
+  });
+  ASSERT_EQ(10, accepted);
+  ASSERT_EQ(10, picked.size());
+}
+
+TEST(decoy_sampler, by_age_empty_range)
+{
+  decoy_sampler sampler;
+  ASSERT_EQ(0, sampler.sample_by_age(0, 100, 120, 5, [](size_t i) { return i; }, [](size_t) { return true; }));
+}
@@ -7,6 +7,7 @@
 
 #include <boost/asio/deadline_timer.hpp>
 #include <boost/bind.hpp>
+#include <boost/uuid/random_generator.hpp>
 
 #include "gtest/gtest.h"
 
@@ -129,6 +130,12 @@ namespace
       return m_send_return;
     }
 
+    virtual bool do_send_shared(const boost::shared_ptr<const std::string>& buff)
+    {
+      m_last_shared_buff = buff;
+      return do_send(buff->data(), buff->size());
+    }
+
     virtual bool close()                              { /*std::cout << "test_connection::close()" << std::endl; */return true; }
     virtual bool call_run_once_service_io()           { std::cout << "test_connection::call_run_once_service_io()" << std::endl; return true; }
     virtual bool request_callback()                   { std::cout << "test_connection::request_callback()" << std::endl; return true; }
@@ -139,6 +146,7 @@ namespace
     size_t send_counter() const { return m_send_counter.get(); }
 
     const std::string& last_send_data() const { return m_last_send_data; }
+    const boost::shared_ptr<const std::string>& last_shared_buff() const { return m_last_shared_buff; }
     void reset_last_send_data() { std::unique_lock<std::mutex> lock(m_mutex); m_last_send_data.clear(); }
 
     bool send_return() const { return m_send_return; }
@@ -155,6 +163,7 @@ namespace
     std::mutex m_mutex;
 
     std::string m_last_send_data;
+    boost::shared_ptr<const std::string> m_last_shared_buff;
 
     bool m_send_return;
   };
@@ -390,6 +399,44 @@ TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_process
   ASSERT_TRUE(conn->last_send_data().empty());
 }
 
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, relay_notify_sends_one_shared_packet)
+{
+  // Setup
+  const int expected_command = 2794350;
+  const size_t connection_count = 3;
+
+  std::string in_data(256, 'r');
+  std::list<boost::uuids::uuid> connection_ids;
+  std::vector<test_connection_ptr> connections;
+  for (size_t i = 0; i < connection_count; ++i)
+  {
+    connections.push_back(create_connection(false));
+    connection_ids.push_back(boost::uuids::random_generator()());
+    static_cast<epee::net_utils::connection_context_base&>(connections.back()->m_protocol_handler.get_context_ref()) =
+      epee::net_utils::connection_context_base(connection_ids.back(), 0, 0, false);
+    connections.back()->start();
+  }
+
+  // Test
+  ASSERT_EQ(connection_count, m_handler_config.relay_notify(expected_command, in_data, connection_ids));
+
+  // Check every connection queued the same framed packet
+  for (const auto& conn : connections)
+  {
+    ASSERT_EQ(1, conn->send_counter());
+    ASSERT_EQ(connections.front()->last_shared_buff(), conn->last_shared_buff());
+
+    const std::string& out_data = conn->last_send_data();
+    ASSERT_EQ(sizeof(epee::levin::bucket_head2) + in_data.size(), out_data.size());
+    const epee::levin::bucket_head2& head = *reinterpret_cast<const epee::levin::bucket_head2*>(out_data.data());
+    ASSERT_EQ(LEVIN_SIGNATURE, head.m_signature);
+    ASSERT_EQ(in_data.size(), head.m_cb);
+    ASSERT_EQ(expected_command, head.m_command);
+    ASSERT_FALSE(head.m_have_to_return_data);
+    ASSERT_EQ(in_data, out_data.substr(sizeof(head)));
+  }
+}
+
 TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_processes_qued_callback)
 {
   test_connection_ptr conn = create_connection();
@@ -503,6 +550,29 @@ TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_two_re
   ASSERT_EQ(2, m_commands_handler.invoke_counter());
 }
 
+TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_requests_split_at_any_offset)
+{
+  const size_t request_count = 5;
+  prepare_buf();
+  std::string stream;
+  for (size_t i = 0; i < request_count; ++i)
+    stream += m_buf;
+
+  // reads that end mid header, mid body and across several packets
+  const size_t read_sizes[] = {3, sizeof(m_req_head) + 10, 2 * m_buf.size() + 7, 1};
+  size_t offset = 0;
+  for (size_t i = 0; offset < stream.size(); ++i)
+  {
+    size_t read_size = (std::min)(read_sizes[i % 4], stream.size() - offset);
+    ASSERT_TRUE(m_conn->m_protocol_handler.handle_recv(stream.data() + offset, read_size));
+    offset += read_size;
+    ASSERT_EQ(offset / m_buf.size(), m_commands_handler.invoke_counter());
+  }
+
+  ASSERT_EQ(request_count, m_commands_handler.invoke_counter());
+  ASSERT_EQ(m_in_data, m_commands_handler.last_in_buf());
+}
+
 TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_unexpected_response)
 {
   m_req_head.m_flags = LEVIN_PACKET_RESPONSE;
@@ -0,0 +1,185 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+
+#include "cryptonote_config.h"
+#include "crypto/crypto.h"
+#include "crypto/hash_cache.h"
+#include "serialization/binary_utils.h"
+#include "file_io_utils.h"
+
+namespace
+{
+  struct temp_dir
+  {
+    std::string path;
+    temp_dir() : path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string()) {}
+    ~temp_dir() { boost::system::error_code ec; boost::filesystem::remove_all(path, ec); }
+  };
+
+  // what hashcache.bin used to hold
+  struct legacy_hash_cache
+  {
+    std::unordered_map<crypto::hash, crypto::hash> m_hash_cache;
+    std::unordered_map<crypto::hash, crypto::hash_cache::signed_hash_entry> m_signed_hash_cache;
+
+    BEGIN_SERIALIZE_OBJECT()
+      FIELD(m_hash_cache)
+      FIELD(m_signed_hash_cache)
+    END_SERIALIZE()
+  };
+}
+
+TEST(hash_cache, in_memory_before_init)
+{
+  crypto::hash_cache cache;
+  crypto::hash id = crypto::rand<crypto::hash>(), work = crypto::rand<crypto::hash>(), res;
+
+  ASSERT_FALSE(cache.get_cached_longhash(id, res));
+  ASSERT_TRUE(cache.add_cached_longhash(id, work));
+  ASSERT_TRUE(cache.get_cached_longhash(id, res));
+  ASSERT_EQ(work, res);
+  ASSERT_TRUE(cache.store());
+}
+
+TEST(hash_cache, persists_across_reopen)
+{
+  temp_dir dir;
+  std::vector<std::pair<crypto::hash, crypto::hash> > hashes;
+  size_t base_hashes, base_signed;
+  {
+    crypto::hash_cache cache;
+    // added before init, has to be carried into the files
+    hashes.push_back(std::make_pair(crypto::rand<crypto::hash>(), crypto::rand<crypto::hash>()));
+    ASSERT_TRUE(cache.add_cached_longhash(hashes.back().first, hashes.back().second));
+
+    ASSERT_TRUE(cache.init(dir.path));
+    base_hashes = cache.hashes_count() - 1;
+    base_signed = cache.signed_hashes_count();
+
+    // enough to grow both the records file and the index several times
+    for (size_t i=0; i < 20000; i++)
+    {
+      hashes.push_back(std::make_pair(crypto::rand<crypto::hash>(), crypto::rand<crypto::hash>()));
+      ASSERT_TRUE(cache.add_cached_longhash(hashes.back().first, hashes.back().second));
+    }
+    // only the trusted key can sign hashes
+    crypto::hash_cache::signed_hash_entry entry;
+    entry.block_id = crypto::rand<crypto::hash>();
+    entry.work_hash = crypto::rand<crypto::hash>();
+    entry.sig = crypto::rand<crypto::signature>();
+    ASSERT_FALSE(cache.add_signed_longhash(entry));
+
+    // re-adding replaces without changing the counts
+    hashes[5].second = crypto::rand<crypto::hash>();
+    ASSERT_TRUE(cache.add_cached_longhash(hashes[5].first, hashes[5].second));
+    ASSERT_TRUE(cache.add_cached_longhash(hashes[6].first, hashes[6].second));
+    ASSERT_EQ(base_hashes + hashes.size(), cache.hashes_count());
+
+    ASSERT_TRUE(cache.deinit());
+  }
+
+  crypto::hash_cache cache;
+  ASSERT_TRUE(cache.init(dir.path));
+  ASSERT_EQ(base_hashes + hashes.size(), cache.hashes_count());
+  ASSERT_EQ(base_signed, cache.signed_hashes_count());
+
+  for (const auto& item : hashes)
+  {
+    crypto::hash res;
+    ASSERT_TRUE(cache.get_cached_longhash(item.first, res));
+    ASSERT_EQ(item.second, res);
+  }
+
+  // work hashes and signed hashes are kept apart
+  crypto::hash res;
+  ASSERT_FALSE(cache.get_signed_longhash(hashes[0].first, res));
+  ASSERT_FALSE(cache.have_signed_longhash_for(hashes[0].first));
+  cache.deinit();
+}
+
+TEST(hash_cache, rebuilds_missing_index)
+{
+  temp_dir dir;
+  crypto::hash id = crypto::rand<crypto::hash>(), work = crypto::rand<crypto::hash>(), res;
+  {
+    crypto::hash_cache cache;
+    ASSERT_TRUE(cache.init(dir.path));
+    ASSERT_TRUE(cache.add_cached_longhash(id, work));
+    ASSERT_TRUE(cache.deinit());
+  }
+
+  boost::filesystem::remove(dir.path + "/" + CRYPTONOTE_HASHCACHE_INDEX_FILENAME);
+
+  crypto::hash_cache cache;
+  ASSERT_TRUE(cache.init(dir.path));
+  ASSERT_TRUE(cache.get_cached_longhash(id, res));
+  ASSERT_EQ(work, res);
+  cache.deinit();
+}
+
+TEST(hash_cache, drops_records_that_were_not_completely_written)
+{
+  temp_dir dir;
+  crypto::hash stored_id = crypto::rand<crypto::hash>(), stored_work = crypto::rand<crypto::hash>(), res;
+  crypto::hash torn_id = crypto::rand<crypto::hash>(), after_id = crypto::rand<crypto::hash>();
+  size_t stored_hashes;
+  {
+    crypto::hash_cache cache;
+    ASSERT_TRUE(cache.init(dir.path));
+    ASSERT_TRUE(cache.add_cached_longhash(stored_id, stored_work));
+    ASSERT_TRUE(cache.store());
+    stored_hashes = cache.hashes_count();
+
+    // added after the last store, the files are closed without storing again like after a crash
+    ASSERT_TRUE(cache.add_cached_longhash(torn_id, crypto::rand<crypto::hash>()));
+    ASSERT_TRUE(cache.add_cached_longhash(after_id, crypto::rand<crypto::hash>()));
+  }
+
+  // the count got to disk but one of the record's pages didn't
+  const std::string records_filename = dir.path + "/" + CRYPTONOTE_HASHCACHE_RECORDS_FILENAME;
+  std::string buf;
+  ASSERT_TRUE(epee::file_io_utils::load_file_to_string(records_filename, buf));
+  size_t pos = buf.find(std::string(reinterpret_cast<const char *>(&torn_id), sizeof(torn_id)));
+  ASSERT_NE(std::string::npos, pos);
+  buf[pos + sizeof(torn_id)] ^= 0x01;
+  ASSERT_TRUE(epee::file_io_utils::save_string_to_file(records_filename, buf));
+
+  crypto::hash_cache cache;
+  ASSERT_TRUE(cache.init(dir.path));
+  ASSERT_EQ(stored_hashes, cache.hashes_count());
+  ASSERT_TRUE(cache.get_cached_longhash(stored_id, res));
+  ASSERT_EQ(stored_work, res);
+  ASSERT_FALSE(cache.get_cached_longhash(torn_id, res));
+  ASSERT_FALSE(cache.get_cached_longhash(after_id, res));
+
+  // appending carries on from where the file was cut
+  ASSERT_TRUE(cache.add_cached_longhash(torn_id, stored_work));
+  ASSERT_TRUE(cache.get_cached_longhash(torn_id, res));
+  ASSERT_EQ(stored_work, res);
+  cache.deinit();
+}
+
+TEST(hash_cache, imports_and_removes_legacy_file)
+{
+  temp_dir dir;
+  ASSERT_TRUE(boost::filesystem::create_directories(dir.path));
+  legacy_hash_cache legacy;
+  crypto::hash id = crypto::rand<crypto::hash>(), work = crypto::rand<crypto::hash>(), res;
+  legacy.m_hash_cache[id] = work;
+  std::string buf;
+  ASSERT_TRUE(::serialization::dump_binary(legacy, buf));
+  const std::string legacy_filename = dir.path + "/" + CRYPTONOTE_HASHCACHEDATA_FILENAME;
+  ASSERT_TRUE(epee::file_io_utils::save_string_to_file(legacy_filename, buf));
+
+  crypto::hash_cache cache;
+  ASSERT_TRUE(cache.init(dir.path));
+  ASSERT_TRUE(cache.get_cached_longhash(id, res));
+  ASSERT_EQ(work, res);
+  ASSERT_FALSE(boost::filesystem::exists(legacy_filename));
+  cache.deinit();
+}
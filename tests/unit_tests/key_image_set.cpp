@@ -0,0 +1,182 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <cstring>
+#include <unordered_set>
+
+#include <boost/filesystem.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "cryptonote_core/key_image_set.h"
+
+using cryptonote::key_image_set;
+
+namespace
+{
+  // key images that all want the same home slot, to exercise probing and backward-shift erase
+  crypto::key_image colliding_key_image(uint64_t n)
+  {
+    crypto::key_image ki = crypto::rand<crypto::key_image>();
+    uint64_t low = 5;
+    memcpy(&ki, &low, sizeof(low));
+    memcpy(reinterpret_cast<char *>(&ki) + 8, &n, sizeof(n));
+    return ki;
+  }
+}
+
+TEST(key_image_set, insert_contains_erase)
+{
+  key_image_set s;
+  ASSERT_TRUE(s.empty());
+
+  std::vector<crypto::key_image> kis;
+  for (size_t i = 0; i < 1000; i++)
+    kis.push_back(crypto::rand<crypto::key_image>());
+
+  for (const auto& ki : kis)
+    ASSERT_TRUE(s.insert(ki));
+  ASSERT_FALSE(s.insert(kis[10]));
+  ASSERT_EQ(1000, s.size());
+  ASSERT_GE(s.capacity() * 7, s.size() * 8);
+
+  for (const auto& ki : kis)
+    ASSERT_TRUE(s.contains(ki));
+  ASSERT_FALSE(s.contains(crypto::rand<crypto::key_image>()));
+
+  for (size_t i = 0; i < kis.size(); i += 2)
+    ASSERT_EQ(1, s.erase(kis[i]));
+  ASSERT_EQ(0, s.erase(kis[0]));
+  ASSERT_EQ(500, s.size());
+  for (size_t i = 0; i < kis.size(); i++)
+    ASSERT_EQ(i % 2 == 1, s.contains(kis[i]));
+}
+
+TEST(key_image_set, null_key_image)
+{
+  key_image_set s;
+  crypto::key_image null_ki = crypto::key_image();
+  ASSERT_FALSE(s.contains(null_ki));
+  ASSERT_TRUE(s.insert(null_ki));
+  ASSERT_FALSE(s.insert(null_ki));
+  ASSERT_TRUE(s.contains(null_ki));
+  ASSERT_EQ(1, s.size());
+  ASSERT_EQ(1, s.erase(null_ki));
+  ASSERT_TRUE(s.empty());
+}
+
+TEST(key_image_set, erase_within_collision_cluster)
+{
+  key_image_set s;
+  std::vector<crypto::key_image> kis;
+  for (uint64_t i = 0; i < 10; i++)
+  {
+    kis.push_back(colliding_key_image(i));
+    ASSERT_TRUE(s.insert(kis.back()));
+  }
+
+  // removing from the middle of the cluster must keep the later ones reachable
+  ASSERT_EQ(1, s.erase(kis[3]));
+  ASSERT_EQ(1, s.erase(kis[0]));
+  for (size_t i = 0; i < kis.size(); i++)
+    ASSERT_EQ(i != 3 && i != 0, s.contains(kis[i]));
+
+  ASSERT_TRUE(s.insert(kis[3]));
+  ASSERT_TRUE(s.contains(kis[3]));
+  ASSERT_EQ(9, s.size());
+}
+
+TEST(key_image_set, cluster_wrapping_around_the_end)
+{
+  // home slot is the last one whatever the capacity, so the cluster spans several groups of tags
+  // and wraps around to the front
+  key_image_set s;
+  std::vector<crypto::key_image> kis;
+  for (uint64_t i = 0; i < 40; i++)
+  {
+    crypto::key_image ki = colliding_key_image(i % 4);
+    uint64_t low = ~0ULL;
+    memcpy(&ki, &low, sizeof(low));
+    kis.push_back(ki);
+    ASSERT_TRUE(s.insert(ki));
+  }
+  for (const auto& ki : kis)
+    ASSERT_TRUE(s.contains(ki));
+
+  for (size_t i = 0; i < kis.size(); i += 3)
+    ASSERT_EQ(1, s.erase(kis[i]));
+  for (size_t i = 0; i < kis.size(); i++)
+    ASSERT_EQ(i % 3 != 0, s.contains(kis[i]));
+}
+
+TEST(key_image_set, store_and_load)
+{
+  const std::string filename = "key_image_set_test.bin";
+  crypto::hash stamp = crypto::rand<crypto::hash>();
+
+  key_image_set s;
+  std::vector<crypto::key_image> kis;
+  for (size_t i = 0; i < 1000; i++)
+  {
+    kis.push_back(i % 5 == 0 ? colliding_key_image(i) : crypto::rand<crypto::key_image>());
+    s.insert(kis.back());
+  }
+  s.insert(crypto::key_image());
+  ASSERT_TRUE(s.store_to_file(filename, stamp));
+
+  key_image_set loaded;
+  ASSERT_FALSE(loaded.load_from_file(filename, crypto::rand<crypto::hash>()));
+  ASSERT_TRUE(loaded.empty());
+  ASSERT_TRUE(loaded.load_from_file(filename, stamp));
+  ASSERT_EQ(s.size(), loaded.size());
+  ASSERT_EQ(s.capacity(), loaded.capacity());
+  for (const auto& ki : kis)
+    ASSERT_TRUE(loaded.contains(ki));
+  ASSERT_TRUE(loaded.contains(crypto::key_image()));
+  ASSERT_FALSE(loaded.contains(crypto::rand<crypto::key_image>()));
+
+  // still works as a set after loading
+  ASSERT_EQ(1, loaded.erase(kis[0]));
+  ASSERT_FALSE(loaded.contains(kis[0]));
+  ASSERT_TRUE(loaded.insert(kis[0]));
+
+  boost::filesystem::resize_file(filename, boost::filesystem::file_size(filename) - 1);
+  ASSERT_FALSE(loaded.load_from_file(filename, stamp));
+  ASSERT_TRUE(loaded.empty());
+
+  // an empty set has no slots but loads all the same
+  ASSERT_TRUE(key_image_set().store_to_file(filename, stamp));
+  ASSERT_TRUE(loaded.load_from_file(filename, stamp));
+  ASSERT_TRUE(loaded.empty());
+  ASSERT_FALSE(loaded.contains(kis[1]));
+  ASSERT_TRUE(loaded.insert(kis[1]));
+  ASSERT_TRUE(loaded.contains(kis[1]));
+
+  boost::filesystem::remove(filename);
+  ASSERT_FALSE(loaded.load_from_file(filename, stamp));
+}
+
+TEST(key_image_set, matches_unordered_set)
+{
+  key_image_set s;
+  std::unordered_set<crypto::key_image> expected;
+  std::vector<crypto::key_image> kis;
+  for (size_t i = 0; i < 200; i++)
+    kis.push_back(i % 3 == 0 ? colliding_key_image(i) : crypto::rand<crypto::key_image>());
+
+  for (size_t round = 0; round < 20000; round++)
+  {
+    const crypto::key_image& ki = kis[crypto::rand<size_t>() % kis.size()];
+    if (crypto::rand<uint8_t>() % 2)
+      ASSERT_EQ(expected.insert(ki).second, s.insert(ki));
+    else
+      ASSERT_EQ(expected.erase(ki), s.erase(ki));
+    ASSERT_EQ(expected.size(), s.size());
+  }
+
+  for (const auto& ki : kis)
+    ASSERT_EQ(expected.count(ki), s.contains(ki) ? 1 : 0);
+}
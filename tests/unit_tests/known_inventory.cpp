@@ -0,0 +1,58 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/known_inventory.h"
+
+using cryptonote::known_inventory;
+
+TEST(known_inventory, insert_reports_new_ids)
+{
+  known_inventory known(10);
+  crypto::hash id = crypto::rand<crypto::hash>();
+  ASSERT_FALSE(known.contains(id));
+  ASSERT_TRUE(known.insert(id));
+  ASSERT_FALSE(known.insert(id));
+  ASSERT_TRUE(known.contains(id));
+  ASSERT_EQ(1, known.size());
+}
+
+TEST(known_inventory, forgets_oldest_past_max_count)
+{
+  known_inventory known(3);
+  std::vector<crypto::hash> ids;
+  for (size_t i = 0; i < 5; i++)
+  {
+    ids.push_back(crypto::rand<crypto::hash>());
+    ASSERT_TRUE(known.insert(ids.back()));
+  }
+
+  ASSERT_EQ(3, known.size());
+  ASSERT_FALSE(known.contains(ids[0]));
+  ASSERT_FALSE(known.contains(ids[1]));
+  for (size_t i = 2; i < 5; i++)
+    ASSERT_TRUE(known.contains(ids[i]));
+
+  // a forgotten id counts as new again
+  ASSERT_TRUE(known.insert(ids[0]));
+  ASSERT_FALSE(known.contains(ids[2]));
+}
+
+TEST(known_inventory, copies_are_independent)
+{
+  known_inventory known(3);
+  crypto::hash a = crypto::rand<crypto::hash>();
+  crypto::hash b = crypto::rand<crypto::hash>();
+  known.insert(a);
+
+  known_inventory copy = known;
+  copy.insert(b);
+  ASSERT_TRUE(copy.contains(a));
+  ASSERT_TRUE(copy.contains(b));
+  ASSERT_FALSE(known.contains(b));
+}
@@ -0,0 +1,221 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+
+#include "common/mapped_vector.h"
+
+namespace
+{
+  struct temp_file
+  {
+    std::string path;
+    temp_file() : path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string()) {}
+    ~temp_file()
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove(path, ec);
+      boost::filesystem::remove(path + ".undo", ec);
+    }
+  };
+
+  struct entry
+  {
+    uint64_t height;
+    uint64_t value;
+  };
+
+  entry make_entry(uint64_t height, uint64_t value)
+  {
+    entry e;
+    e.height = height;
+    e.value = value;
+    return e;
+  }
+}
+
+TEST(mapped_vector, in_memory_without_file)
+{
+  tools::mapped_vector<entry> v;
+  ASSERT_TRUE(v.empty());
+  v.push_back(make_entry(0, 10));
+  v.push_back(make_entry(1, 11));
+  ASSERT_EQ(2, v.size());
+  ASSERT_EQ(11, v.back().value);
+  v.pop_back();
+  ASSERT_EQ(1, v.size());
+  ASSERT_FALSE(v.commit());
+}
+
+TEST(mapped_vector, only_committed_elements_persist)
+{
+  temp_file f;
+  {
+    tools::mapped_vector<entry> v;
+    ASSERT_TRUE(v.open(f.path));
+    // enough to grow the file a few times
+    for (uint64_t i = 0; i < 5000; i++)
+      v.push_back(make_entry(i, i * 3));
+    ASSERT_TRUE(v.commit());
+    v.push_back(make_entry(5000, 0));
+  }
+
+  tools::mapped_vector<entry> v;
+  ASSERT_TRUE(v.open(f.path));
+  ASSERT_EQ(5000, v.size());
+  for (uint64_t i = 0; i < 5000; i++)
+  {
+    ASSERT_EQ(i, v[i].height);
+    ASSERT_EQ(i * 3, v[i].value);
+  }
+}
+
+TEST(mapped_vector, popping_committed_elements_keeps_file_until_commit)
+{
+  temp_file f;
+  {
+    tools::mapped_vector<entry> v;
+    ASSERT_TRUE(v.open(f.path));
+    for (uint64_t i = 0; i < 10; i++)
+      v.push_back(make_entry(i, 100 + i));
+    ASSERT_TRUE(v.commit());
+
+    // reorg: drop the top 3 and add 4 different ones
+    for (int i = 0; i < 3; i++)
+      v.pop_back();
+    for (uint64_t i = 7; i < 11; i++)
+      v.push_back(make_entry(i, 200 + i));
+    ASSERT_EQ(11, v.size());
+    ASSERT_EQ(106, v[6].value);
+    ASSERT_EQ(207, v[7].value);
+  }
+
+  {
+    // wasn't committed, so the old chain is still there
+    tools::mapped_vector<entry> v;
+    ASSERT_TRUE(v.open(f.path));
+    ASSERT_EQ(10, v.size());
+    ASSERT_EQ(109, v.back().value);
+
+    for (int i = 0; i < 3; i++)
+      v.pop_back();
+    for (uint64_t i = 7; i < 11; i++)
+      v.push_back(make_entry(i, 200 + i));
+    ASSERT_TRUE(v.commit());
+  }
+
+  tools::mapped_vector<entry> v;
+  ASSERT_TRUE(v.open(f.path));
+  ASSERT_EQ(11, v.size());
+  ASSERT_EQ(106, v[6].value);
+  ASSERT_EQ(207, v[7].value);
+  ASSERT_EQ(210, v.back().value);
+}
+
+TEST(mapped_vector, rejects_other_element_size)
+{
+  temp_file f;
+  {
+    tools::mapped_vector<entry> v;
+    ASSERT_TRUE(v.open(f.path));
+    v.push_back(make_entry(0, 1));
+    ASSERT_TRUE(v.commit());
+  }
+
+  tools::mapped_vector<uint64_t> other;
+  ASSERT_FALSE(other.open(f.path));
+
+  // starting over removes the undo file too, so nothing of the old elements is restored into the new file
+  {
+    tools::mapped_vector<entry> v;
+    ASSERT_TRUE(v.open(f.path));
+    v.pop_back();
+    v.push_back(make_entry(0, 2));
+    ASSERT_TRUE(v.write_tail());
+  }
+  ASSERT_TRUE(boost::filesystem::exists(f.path + ".undo"));
+  ASSERT_TRUE(tools::mapped_vector<uint64_t>::remove(f.path));
+  ASSERT_FALSE(boost::filesystem::exists(f.path));
+  ASSERT_FALSE(boost::filesystem::exists(f.path + ".undo"));
+  ASSERT_TRUE(other.open(f.path));
+  ASSERT_TRUE(other.empty());
+}
+
+TEST(mapped_vector, written_tail_persists_only_after_sync)
+{
+  temp_file f;
+  {
+    tools::mapped_vector<entry> v;
+    ASSERT_TRUE(v.open(f.path));
+    for (uint64_t i = 0; i < 3000; i++)
+      v.push_back(make_entry(i, i + 1));
+    ASSERT_TRUE(v.write_tail());
+    // readable from the file while the sync is pending, and can keep growing
+    ASSERT_EQ(2001, v[2000].value);
+    v.push_back(make_entry(3000, 0));
+  }
+
+  {
+    tools::mapped_vector<entry> v;
+    ASSERT_TRUE(v.open(f.path));
+    ASSERT_EQ(0, v.size());
+
+    for (uint64_t i = 0; i < 3000; i++)
+      v.push_back(make_entry(i, i + 1));
+    ASSERT_TRUE(v.write_tail());
+    v.push_back(make_entry(3000, 0));
+    ASSERT_TRUE(v.sync());
+  }
+
+  tools::mapped_vector<entry> v;
+  ASSERT_TRUE(v.open(f.path));
+  ASSERT_EQ(3000, v.size());
+  ASSERT_EQ(3000, v.back().value);
+}
+
+TEST(mapped_vector, overwritten_elements_are_restored_if_sync_does_not_finish)
+{
+  temp_file f;
+  {
+    tools::mapped_vector<entry> v;
+    ASSERT_TRUE(v.open(f.path));
+    for (uint64_t i = 0; i < 10; i++)
+      v.push_back(make_entry(i, 100 + i));
+    ASSERT_TRUE(v.commit());
+
+    // the new branch is written over the old one, then closing writes every dirty page back like a crash could
+    for (int i = 0; i < 3; i++)
+      v.pop_back();
+    for (uint64_t i = 7; i < 9; i++)
+      v.push_back(make_entry(i, 200 + i));
+    ASSERT_TRUE(v.write_tail());
+    // and again before the first one was synced
+    v.pop_back();
+    v.push_back(make_entry(8, 300));
+    ASSERT_TRUE(v.write_tail());
+    ASSERT_EQ(207, v[7].value);
+  }
+
+  {
+    tools::mapped_vector<entry> v;
+    ASSERT_TRUE(v.open(f.path));
+    ASSERT_EQ(10, v.size());
+    for (uint64_t i = 0; i < 10; i++)
+      ASSERT_EQ(100 + i, v[i].value);
+
+    for (int i = 0; i < 3; i++)
+      v.pop_back();
+    v.push_back(make_entry(7, 207));
+    ASSERT_TRUE(v.commit());
+  }
+
+  // a finished commit leaves nothing to undo
+  tools::mapped_vector<entry> v;
+  ASSERT_TRUE(v.open(f.path));
+  ASSERT_EQ(8, v.size());
+  ASSERT_EQ(106, v[6].value);
+  ASSERT_EQ(207, v.back().value);
+}
@@ -0,0 +1,185 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <list>
+#include <map>
+#include <memory>
+
+#include <boost/filesystem.hpp>
+
+#include "gtest/gtest.h"
+
+#include "common/mapped_vector.h"
+#include "common/ntp_time.h"
+#include "cryptonote_config.h"
+#include "cryptonote_core/account.h"
+#include "cryptonote_core/blockchain_storage.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "cryptonote_core/difficulty.h"
+#include "cryptonote_core/tx_pool.h"
+#include "../test_genesis_config.h"
+
+extern const char *CRYPTONOTE_BLOCKCHAINDB_MAPPED_OUTPUTS_FILENAME;
+
+namespace
+{
+  const char *DATA_DIR = "output_index_test_data";
+  const size_t BLOCK_COUNT = 5;
+
+  typedef std::map<std::pair<cryptonote::coin_type, uint64_t>, std::list<crypto::public_key> > outs_by_amount;
+
+  // a blockchain_storage and its pool, wired up like the core does
+  struct test_chain
+  {
+    test_chain(tools::ntp_time& ntp_time) : m_pbs(new cryptonote::blockchain_storage(m_pool, ntp_time)), m_pool(*m_pbs) { }
+
+    std::unique_ptr<cryptonote::blockchain_storage> m_pbs;
+    cryptonote::tx_memory_pool m_pool;
+  };
+
+  class output_index : public ::testing::Test
+  {
+  protected:
+    output_index() : m_ntp_time(60*60, 1) { }
+
+    virtual void SetUp()
+    {
+      set_test_genesis_config();
+      boost::filesystem::remove_all(DATA_DIR);
+    }
+
+    virtual void TearDown()
+    {
+      close();
+      boost::filesystem::remove_all(DATA_DIR);
+    }
+
+    bool open()
+    {
+      m_chain.reset(new test_chain(m_ntp_time));
+      return get_bs().init(DATA_DIR);
+    }
+
+    void close()
+    {
+      if (m_chain)
+      {
+        get_bs().deinit();
+        m_chain.reset();
+      }
+    }
+
+    // the genesis block has no outputs, so mine a few blocks on top of it
+    bool mine_blocks()
+    {
+      cryptonote::account_base miner;
+      miner.generate();
+
+      for (size_t i = 0; i < BLOCK_COUNT; i++)
+      {
+        cryptonote::block b;
+        cryptonote::difficulty_type diffic;
+        uint64_t height;
+        if (!get_bs().create_block_template(b, miner.get_keys().m_account_address, diffic, height, cryptonote::blobdata(), false))
+          return false;
+
+        for (;; b.nonce++)
+        {
+          crypto::hash h;
+          if (!cryptonote::get_block_longhash(b, h, height, NULL, false))
+            return false;
+          if (cryptonote::check_hash(h, diffic))
+            break;
+        }
+
+        cryptonote::block_verification_context bvc = AUTO_VAL_INIT(bvc);
+        if (!get_bs().add_new_block(b, bvc) || !bvc.m_added_to_main_chain)
+          return false;
+      }
+      return true;
+    }
+
+    // the miner outputs, in global index order per amount
+    outs_by_amount expected_outs()
+    {
+      std::list<cryptonote::block> blocks;
+      get_bs().get_blocks(0, get_bs().get_current_blockchain_height(), blocks);
+
+      outs_by_amount outs;
+      for (const auto& b : blocks)
+      {
+        const cryptonote::transaction& tx = b.miner_tx;
+        for (size_t i = 0; i < tx.outs().size(); i++)
+        {
+          outs[std::make_pair(tx.out_cp(i), tx.outs()[i].amount)].push_back(
+            boost::get<cryptonote::txout_to_key>(tx.outs()[i].target).key);
+        }
+      }
+      return outs;
+    }
+
+    void check_outs(const outs_by_amount& expected)
+    {
+      for (const auto& item : expected)
+      {
+        std::list<crypto::public_key> pkeys;
+        ASSERT_TRUE(get_bs().get_outs(item.first.first, item.first.second, pkeys));
+        ASSERT_EQ(item.second, pkeys);
+      }
+
+      std::list<crypto::public_key> pkeys;
+      ASSERT_TRUE(get_bs().get_outs(cryptonote::CP_XPB, 1, pkeys));
+      ASSERT_TRUE(pkeys.empty());
+    }
+
+    cryptonote::blockchain_storage& get_bs() { return *m_chain->m_pbs; }
+
+    tools::ntp_time m_ntp_time;
+    std::unique_ptr<test_chain> m_chain;
+  };
+}
+
+TEST_F(output_index, positions_are_indexed_from_the_records_on_load)
+{
+  ASSERT_TRUE(open());
+  ASSERT_TRUE(mine_blocks());
+  outs_by_amount expected = expected_outs();
+  ASSERT_FALSE(expected.empty());
+  check_outs(expected);
+
+  close();
+  ASSERT_TRUE(open());
+  check_outs(expected);
+}
+
+TEST_F(output_index, rebuild_output_index)
+{
+  ASSERT_TRUE(open());
+  ASSERT_TRUE(mine_blocks());
+  outs_by_amount expected = expected_outs();
+  close();
+
+  // without the records they are built again from the transactions on load
+  boost::filesystem::remove(std::string(DATA_DIR) + "/" + CRYPTONOTE_BLOCKCHAINDB_MAPPED_OUTPUTS_FILENAME);
+  ASSERT_TRUE(open());
+  check_outs(expected);
+
+  // and stored, so the next load indexes them again
+  close();
+  ASSERT_TRUE(open());
+  check_outs(expected);
+  close();
+
+  // records stored with another layout are started over, not misread
+  const std::string records_path = std::string(DATA_DIR) + "/" + CRYPTONOTE_BLOCKCHAINDB_MAPPED_OUTPUTS_FILENAME;
+  {
+    tools::mapped_vector<uint64_t> other_layout;
+    ASSERT_TRUE(tools::mapped_vector<uint64_t>::remove(records_path));
+    ASSERT_TRUE(other_layout.open(records_path));
+    other_layout.push_back(0);
+    ASSERT_TRUE(other_layout.commit());
+  }
+  ASSERT_TRUE(open());
+  check_outs(expected);
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "cryptonote_core/ring_signature_verifier.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  ring_signature_job make_job(size_t ring_size, size_t real_index)
+  {
+    ring_signature_job job;
+    job.input_index = 0;
+    job.tx_id = crypto::rand<crypto::hash>();
+    job.prefix_hash = crypto::rand<crypto::hash>();
+
+    crypto::secret_key real_sec;
+    for (size_t i=0; i < ring_size; i++)
+    {
+      crypto::public_key pub;
+      crypto::secret_key sec;
+      crypto::generate_keys(pub, sec);
+      job.keys.push_back(pub);
+      if (i == real_index)
+        real_sec = sec;
+    }
+    crypto::generate_key_image(job.keys[real_index], real_sec, job.k_image);
+
+    std::vector<const crypto::public_key*> vec_pkeys;
+    for (const auto& key : job.keys)
+      vec_pkeys.push_back(&key);
+    job.sigs.resize(ring_size);
+    crypto::generate_ring_signature(job.prefix_hash, job.k_image, vec_pkeys, real_sec, real_index, job.sigs.data());
+    return job;
+  }
+
+  std::vector<ring_signature_job> make_jobs(size_t n)
+  {
+    std::vector<ring_signature_job> jobs;
+    for (size_t i=0; i < n; i++)
+      jobs.push_back(make_job(1 + i % 4, i % (1 + i % 4)));
+    return jobs;
+  }
+}
+
+TEST(ring_signature_verifier, empty_batch)
+{
+  ring_signature_verifier v;
+  ASSERT_TRUE(v.verify(std::vector<ring_signature_job>()));
+}
+
+TEST(ring_signature_verifier, single_job)
+{
+  ring_signature_verifier v;
+  auto jobs = make_jobs(1);
+  ASSERT_TRUE(ring_signature_verifier::verify_one(jobs[0]));
+  ASSERT_TRUE(v.verify(jobs));
+
+  jobs[0].prefix_hash = crypto::rand<crypto::hash>();
+  ASSERT_FALSE(v.verify(jobs));
+}
+
+TEST(ring_signature_verifier, valid_batch)
+{
+  ring_signature_verifier v;
+  auto jobs = make_jobs(50);
+  ASSERT_TRUE(v.verify(jobs));
+  // workers are reused for the next batch
+  ASSERT_TRUE(v.verify(jobs));
+}
+
+TEST(ring_signature_verifier, one_bad_job_fails_batch)
+{
+  ring_signature_verifier v;
+  auto jobs = make_jobs(50);
+
+  for (size_t bad_i : {size_t(0), size_t(17), jobs.size() - 1})
+  {
+    auto bad_jobs = jobs;
+    bad_jobs[bad_i].sigs[0] = crypto::rand<crypto::signature>();
+    ASSERT_FALSE(v.verify(bad_jobs));
+  }
+}
+
+TEST(ring_signature_verifier, mismatched_keys_and_sigs)
+{
+  ring_signature_verifier v;
+  auto jobs = make_jobs(8);
+  jobs[3].sigs.pop_back();
+  ASSERT_FALSE(v.verify(jobs));
+}
@@ -22,6 +22,7 @@
 #include "cryptonote_core/keypair.h"
 #include "serialization/serialization.h"
 #include "serialization/binary_archive.h"
+#include "serialization/binary_blob_archive.h"
 #include "serialization/json_archive.h"
 #include "serialization/debug_archive.h"
 #include "serialization/binary_utils.h"
@@ -135,6 +136,46 @@ TEST(Serialization, BinaryArchiveVarInts) {
   ASSERT_EQ(x, x1);
 }
 
+TEST(Serialization, BinaryBlobArchiveMatchesBinaryArchive) {
+  uint64_t x = 0xff00000000, v = 0xff00000000, x1, v1;
+  std::string name = "abc";
+
+  ostringstream oss;
+  binary_archive<true> oar(oss);
+  oar.serialize_int(x);
+  oar.serialize_varint(v);
+  ASSERT_TRUE(::do_serialize(oar, name));
+
+  string blob;
+  serialization::blob_ostream bos(blob);
+  binary_blob_archive<true> bar(bos);
+  bar.serialize_int(x);
+  bar.serialize_varint(v);
+  ASSERT_TRUE(::do_serialize(bar, name));
+  ASSERT_TRUE(bos.good());
+  ASSERT_EQ(oss.str(), blob);
+
+  serialization::blob_istream bis(blob.data(), blob.size());
+  binary_blob_archive<false> iar(bis);
+  std::string name1;
+  iar.serialize_int(x1);
+  iar.serialize_varint(v1);
+  ASSERT_TRUE(::do_serialize(iar, name1));
+  ASSERT_TRUE(serialization::check_stream_state(iar));
+  ASSERT_EQ(x, x1);
+  ASSERT_EQ(v, v1);
+  ASSERT_EQ(name, name1);
+
+  // reading past the end fails the stream
+  iar.serialize_int(x1);
+  ASSERT_FALSE(bis.good());
+
+  serialization::blob_istream short_bis(blob.data(), 7);
+  binary_blob_archive<false> short_iar(short_bis);
+  short_iar.serialize_int(x1);
+  ASSERT_FALSE(short_bis.good());
+}
+
 TEST(Serialization, Test1) {
   ostringstream str;
   binary_archive<true> ar(str);
@@ -19,6 +19,8 @@
 
 #include "gtest/gtest.h"
 
+#include <chrono>
+
 #include <boost/filesystem.hpp>
 
 
@@ -292,6 +294,101 @@ TEST(sqlite3, boost_serialization)
   }
 }
 
+TEST(sqlite3, load_visit)
+{
+  clear_file("foo.dat");
+  sqlite3_map<int, double> map("foo.dat", load_pod<int>, store_pod<int>, load_pod<double>, store_pod<double>,
+                               load_pod_view<double>);
+  map.store(5, 13.5);
+  map.store(10, 12);
+  
+  double d = -1;
+  ASSERT_TRUE(map.load(5, d));
+  ASSERT_EQ(d, 13.5);
+  ASSERT_FALSE(map.load(6, d));
+  ASSERT_EQ(d, 13.5);
+  ASSERT_TRUE(map.load(10, d));
+  ASSERT_EQ(d, 12);
+  
+  size_t visited_size = 0;
+  ASSERT_TRUE(map.visit(5, [&](const char *data, size_t size) { visited_size = size; }));
+  ASSERT_EQ(visited_size, sizeof(double));
+  ASSERT_FALSE(map.visit(6, [&](const char *data, size_t size) { visited_size = 0; }));
+  ASSERT_EQ(visited_size, sizeof(double));
+  
+  // the statement gets reset even if the visitor throws
+  ASSERT_THROW(map.visit(5, [](const char *data, size_t size) { throw std::runtime_error("visitor"); }), std::runtime_error);
+  ASSERT_TRUE(map.load(5, d));
+  ASSERT_EQ(d, 13.5);
+  
+  // still works with the cached statements across reopen() and erase()
+  map.reopen("foo.dat");
+  ASSERT_TRUE(map.load(10, d));
+  ASSERT_EQ(d, 12);
+  ASSERT_EQ(map.erase(10), 1);
+  ASSERT_EQ(map.erase(10), 0);
+  ASSERT_FALSE(map.load(10, d));
+  ASSERT_EQ(map.load(5), 13.5);
+  ASSERT_EQ(map.size(), 1);
+  
+  // without a view loader it goes through load_value
+  sqlite3_map<int, double> map2(nullptr, load_pod<int>, store_pod<int>, load_pod<double>, store_pod<double>);
+  map2.store(1, 2.5);
+  ASSERT_TRUE(map2.load(1, d));
+  ASSERT_EQ(d, 2.5);
+  ASSERT_EQ(map2.load(2), 0);
+}
+
+TEST(sqlite3, multi_load_store)
+{
+  clear_file("foo.dat");
+  sqlite3_map<int, double> map("foo.dat", load_pod<int>, store_pod<int>, load_pod<double>, store_pod<double>,
+                               load_pod_view<double>);
+  
+  // more than one statement batch, with a repeated key
+  std::vector<std::pair<int, double> > items;
+  for (int i=0; i < 300; i++) {
+    items.push_back(std::make_pair(i * 2, i + 0.5));
+  }
+  items.push_back(std::make_pair(4, -1.0));
+  map.multi_store(items);
+  ASSERT_EQ(map.size(), 300);
+  ASSERT_EQ(map.load(4), -1.0);
+  ASSERT_EQ(map.load(6), 3.5);
+  
+  std::vector<int> keys;
+  for (int i=599; i >= 0; i--) {
+    keys.push_back(i);
+  }
+  keys.push_back(10);
+  keys.push_back(1000);
+  
+  std::vector<double> values;
+  std::vector<bool> found;
+  ASSERT_EQ(map.multi_load(keys, values, found), 301);
+  ASSERT_EQ(values.size(), keys.size());
+  for (size_t i=0; i < keys.size(); i++) {
+    int key = keys[i];
+    if (key % 2 == 0 && key < 600) {
+      ASSERT_TRUE(found[i]) << key;
+      ASSERT_EQ(values[i], key == 4 ? -1.0 : key / 2 + 0.5) << key;
+    } else {
+      ASSERT_FALSE(found[i]) << key;
+    }
+  }
+  
+  ASSERT_EQ(map.multi_load(std::vector<int>(), values, found), 0);
+  ASSERT_TRUE(values.empty());
+  
+  size_t visited = 0;
+  ASSERT_EQ(map.multi_visit(std::vector<int>{2, 3, 2}, [&](size_t i, const char *data, size_t size) {
+    ASSERT_NE(i, 1);
+    ASSERT_EQ(size, sizeof(double));
+    visited++;
+  }), 2);
+  ASSERT_EQ(visited, 2);
+}
+
 TEST(sqlite3, iterator)
 {
   auto make_map = [](const char *fn="strs.dat") {
@@ -726,6 +823,51 @@ TEST(sqlite3, autocommit)
   }
 }
 
+TEST(sqlite3, checkpoint_file)
+{
+  auto make_map = [](const char *fn="strs.dat") {
+    auto map = sqlite3_map<std::string, std::string>(fn, load_string, store_string, load_string, store_string);
+    map.set_autocommit(false, false);
+    map.set_deferred_sync(true);
+    map.reopen(fn);
+    return map;
+  };
+
+  clear_file("strs.dat");
+  clear_file("strs.dat-wal");
+  clear_file("strs.dat-shm");
+
+  {
+    auto writer = make_map();
+    writer.store("1", "one");
+    writer.commit();
+
+    // the reader's transaction keeps the frames committed after it started in the log
+    auto reader = make_map();
+    ASSERT_EQ(reader.load("1"), "one");
+    writer.store("2", "two");
+    writer.commit();
+    ASSERT_FALSE(checkpoint_file("strs.dat"));
+
+    reader.commit();
+    ASSERT_TRUE(checkpoint_file("strs.dat"));
+
+    writer.store("3", "three");
+    writer.commit();
+    ASSERT_TRUE(checkpoint_file("strs.dat", CHECKPOINT_TRUNCATE));
+    ASSERT_EQ(boost::filesystem::file_size("strs.dat-wal"), 0);
+  }
+
+  {
+    auto map = make_map();
+    ASSERT_EQ(map.load("1"), "one");
+    ASSERT_EQ(map.load("2"), "two");
+    ASSERT_EQ(map.load("3"), "three");
+  }
+
+  ASSERT_THROW(checkpoint_file("does_not_exist.dat"), std::runtime_error);
+}
+
 TEST(sqlite3, stresstest)
 {
   auto make_map = [](const char *fn="strs.dat") {
@@ -822,3 +964,72 @@ TEST(sqlite3, speedtest)
     }
   }
 }
+
+TEST(sqlite3, lookup_speedtest)
+{
+  using namespace cryptonote;
+  
+  transaction tx;
+  {
+    tx.set_null();
+    tx.version = VANILLA_TRANSACTION_VERSION;
+    for (int i=0; i < 4; i++) {
+      tx.add_out(tx_out(999, txout_to_key(keypair::generate().pub)), CP_XPB);
+    }
+    tx.add_in(txin_gen(), CP_XPB);
+  }
+  
+  auto make_map = []() {
+    return sqlite3_map<crypto::hash, transaction>("txs.dat",
+                                                  load_pod<crypto::hash>, store_pod<crypto::hash>,
+                                                  tools::boost_unserialize_from_string<transaction>,
+                                                  tools::boost_serialize_to_string<transaction>,
+                                                  tools::boost_unserialize_from_buffer<transaction>);
+  };
+  
+  const size_t num_items = 20000;
+  std::vector<crypto::hash> keys;
+  clear_file("txs.dat");
+  {
+    auto txmap = make_map();
+    txmap.set_autocommit(false, true);
+    for (size_t i=0; i < num_items; i++) {
+      keys.push_back(crypto::rand<crypto::hash>());
+      txmap.store(keys.back(), tx);
+    }
+  }
+  
+  auto txmap = make_map();
+  auto lookups_per_sec = [&](const char *name, std::function<bool(const crypto::hash&)> lookup) {
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& key : keys) {
+      ASSERT_TRUE(lookup(key));
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_PRINT_L0(name << ": " << (uint64_t)(keys.size() / secs) << " lookups/s");
+  };
+  
+  lookups_per_sec("find()", [&](const crypto::hash& key) {
+    auto it = txmap.find(key);
+    return it != txmap.end() && it->second.outs().size() == 4;
+  });
+  lookups_per_sec("load(key, value)", [&](const crypto::hash& key) {
+    transaction loaded;
+    return txmap.load(key, loaded) && loaded.outs().size() == 4;
+  });
+  lookups_per_sec("contains()", [&](const crypto::hash& key) {
+    return txmap.contains(key);
+  });
+  lookups_per_sec("visit()", [&](const crypto::hash& key) {
+    return txmap.visit(key, [](const char *data, size_t size) { });
+  });
+  
+  {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<transaction> loaded;
+    std::vector<bool> found;
+    ASSERT_EQ(txmap.multi_load(keys, loaded, found), keys.size());
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_PRINT_L0("multi_load(): " << (uint64_t)(keys.size() / secs) << " lookups/s");
+  }
+}
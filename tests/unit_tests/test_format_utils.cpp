@@ -11,6 +11,7 @@
 #include "cryptonote_core/cryptonote_basic.h"
 #include "cryptonote_core/cryptonote_format_utils.h"
 #include "cryptonote_core/nulls.h"
+#include "cryptonote_core/tx_tester.h"
 
 
 TEST(parse_tx_extra, handles_empty_extra)
@@ -312,3 +313,79 @@ TEST(nth_sorted_item_after, nth_sorted_item_after_str)
 }
 
 #endif
+
+TEST(transaction_cached_hashes, parsed_from_blob)
+{
+  cryptonote::transaction tx;
+  cryptonote::account_base acc;
+  acc.generate();
+  ASSERT_TRUE(cryptonote::construct_miner_tx(0, 0, 10000000000000, 1000, DEFAULT_FEE, acc.get_keys().m_account_address, tx, cryptonote::blobdata(), 1));
+  cryptonote::blobdata blob = cryptonote::tx_to_blob(tx);
+  crypto::hash blob_hash = cryptonote::get_blob_hash(blob);
+  ASSERT_EQ(blob_hash, cryptonote::get_transaction_hash(tx));
+
+  cryptonote::transaction parsed;
+  ASSERT_TRUE(cryptonote::parse_and_validate_tx_from_blob(blob, parsed));
+  crypto::hash h;
+  size_t blob_size;
+  ASSERT_TRUE(parsed.hash_cache().hash.get(h));
+  ASSERT_EQ(blob_hash, h);
+  ASSERT_TRUE(parsed.hash_cache().blob_size.get(blob_size));
+  ASSERT_EQ(blob.size(), blob_size);
+
+  // copies carry the cache, modifying drops it
+  cryptonote::transaction copy = parsed;
+  ASSERT_TRUE(copy.hash_cache().hash.get(h));
+  cryptonote::tx_out out;
+  out.amount = 1;
+  out.target = cryptonote::txout_to_key(crypto::rand<crypto::public_key>());
+  copy.add_out(out, cryptonote::CP_XPB);
+  ASSERT_FALSE(copy.hash_cache().hash.get(h));
+  ASSERT_FALSE(copy.hash_cache().prefix_hash.get(h));
+  ASSERT_EQ(cryptonote::get_blob_hash(cryptonote::tx_to_blob(copy)), cryptonote::get_transaction_hash(copy));
+  ASSERT_EQ(cryptonote::tx_to_blob(copy).size(), cryptonote::get_object_blobsize(copy));
+}
+
+TEST(transaction_cached_hashes, not_taken_from_non_canonical_blob)
+{
+  cryptonote::transaction tx;
+  cryptonote::account_base acc;
+  acc.generate();
+  ASSERT_TRUE(cryptonote::construct_miner_tx(0, 0, 10000000000000, 1000, DEFAULT_FEE, acc.get_keys().m_account_address, tx, cryptonote::blobdata(), 1));
+  cryptonote::blobdata blob = cryptonote::tx_to_blob(tx);
+
+  // the version varint, padded with a redundant zero byte
+  ASSERT_GT(0x80, (unsigned char)blob[0]);
+  cryptonote::blobdata padded = blob;
+  padded[0] = blob[0] | 0x80;
+  padded.insert(1, 1, '\0');
+
+  cryptonote::transaction parsed;
+  ASSERT_TRUE(cryptonote::parse_and_validate_tx_from_blob(padded, parsed));
+  crypto::hash h;
+  ASSERT_FALSE(parsed.hash_cache().hash.get(h));
+  ASSERT_EQ(cryptonote::get_blob_hash(blob), cryptonote::get_transaction_hash(parsed));
+  ASSERT_EQ(blob.size(), cryptonote::get_object_blobsize(parsed));
+}
+
+TEST(transaction_cached_hashes, tx_tester_stops_caching)
+{
+  cryptonote::transaction tx;
+  cryptonote::account_base acc;
+  acc.generate();
+  ASSERT_TRUE(cryptonote::construct_miner_tx(0, 0, 10000000000000, 1000, DEFAULT_FEE, acc.get_keys().m_account_address, tx, cryptonote::blobdata(), 1));
+  cryptonote::get_transaction_hash(tx);
+
+  // the reference outlives the tester, the tx is modified after it's gone
+  uint64_t& amount = cryptonote::tx_tester(tx).vout[0].amount;
+  crypto::hash h;
+  ASSERT_FALSE(tx.hash_cache().hash.get(h));
+  cryptonote::get_transaction_hash(tx);
+  amount += 1;
+  ASSERT_EQ(cryptonote::get_blob_hash(cryptonote::tx_to_blob(tx)), cryptonote::get_transaction_hash(tx));
+
+  // nor do copies of it
+  cryptonote::transaction copy = tx;
+  cryptonote::get_transaction_hash(copy);
+  ASSERT_FALSE(copy.hash_cache().hash.get(h));
+}
@@ -5,10 +5,12 @@
 #include "gtest/gtest.h"
 
 #include "include_base_utils.h"
+#include "crypto/crypto.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "p2p/p2p_protocol_defs.h"
 #include "storages/portable_storage_template_helper.h"
 
-TEST(protocol_pack, protocol_pack_command) 
+TEST(protocol_pack, protocol_pack_command)
 {
   std::string buff;
   cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request r;
@@ -27,3 +29,195 @@ TEST(protocol_pack, protocol_pack_command)
     ASSERT_TRUE(r.total_height == 3);
   }
 }
+
+namespace
+{
+  typedef nodetool::COMMAND_HANDSHAKE_T<cryptonote::CORE_SYNC_DATA>::response handshake_response;
+
+  // the section tree portable_storage builds is sorted by name, so its output compares structs field by field
+  template<class t_struct>
+  std::string store_with_portable_storage(const t_struct& s)
+  {
+    epee::serialization::portable_storage ps;
+    s.store(ps);
+    std::string buff;
+    ps.store_to_binary(buff);
+    return buff;
+  }
+
+  template<class t_struct>
+  bool load_with_portable_storage(t_struct& s, const std::string& buff)
+  {
+    epee::serialization::portable_storage ps;
+    return ps.load_from_binary(buff) && s.load(ps);
+  }
+
+  // checks the codec against portable_storage both ways round
+  template<class t_struct>
+  void check_wire_compatible(const t_struct& s)
+  {
+    std::string expected = store_with_portable_storage(s);
+
+    std::string buff;
+    ASSERT_TRUE(epee::serialization::store_t_to_binary(s, buff));
+    t_struct by_old = AUTO_VAL_INIT(by_old);
+    ASSERT_TRUE(load_with_portable_storage(by_old, buff));
+    ASSERT_EQ(expected, store_with_portable_storage(by_old));
+
+    t_struct by_new = AUTO_VAL_INIT(by_new);
+    ASSERT_TRUE(epee::serialization::load_t_from_binary(by_new, expected));
+    ASSERT_EQ(expected, store_with_portable_storage(by_new));
+
+    t_struct round_trip = AUTO_VAL_INIT(round_trip);
+    ASSERT_TRUE(epee::serialization::load_t_from_binary(round_trip, buff));
+    ASSERT_EQ(expected, store_with_portable_storage(round_trip));
+  }
+
+  std::string random_blob(size_t size)
+  {
+    std::string blob;
+    for (size_t i = 0; i < size; ++i)
+      blob.push_back(crypto::rand<char>());
+    return blob;
+  }
+
+  struct old_core_sync_data
+  {
+    uint64_t current_height;
+    crypto::hash top_id;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(current_height)
+      KV_SERIALIZE_VAL_POD_AS_BLOB(top_id)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct wide_hop
+  {
+    uint64_t hop;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(hop)
+    END_KV_SERIALIZE_MAP()
+  };
+}
+
+TEST(protocol_pack, handshake_is_wire_compatible)
+{
+  handshake_response r = AUTO_VAL_INIT(r);
+  r.node_data.network_id = boost::uuids::uuid();
+  r.node_data.local_time = 1400000000;
+  r.node_data.my_port = 18080;
+  r.node_data.peer_id = 0x0123456789abcdefULL;
+  r.payload_data.current_height = 123456;
+  r.payload_data.top_id = crypto::rand<crypto::hash>();
+  r.payload_data.supports_compact_blocks = true;
+  for (uint32_t i = 0; i < 3; ++i)
+  {
+    nodetool::peerlist_entry pe = AUTO_VAL_INIT(pe);
+    pe.adr.ip = 0x0100007f + i;
+    pe.adr.port = 18080 + i;
+    pe.id = i;
+    pe.last_seen = 1400000000 - i;
+    r.local_peerlist.push_back(pe);
+  }
+
+  check_wire_compatible(r);
+
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+  handshake_response r2 = AUTO_VAL_INIT(r2);
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(r2, buff));
+  ASSERT_EQ(r.node_data.peer_id, r2.node_data.peer_id);
+  ASSERT_EQ(r.payload_data.top_id, r2.payload_data.top_id);
+  ASSERT_TRUE(r2.payload_data.supports_compact_blocks);
+  ASSERT_FALSE(r2.payload_data.supports_tx_announcements);
+  ASSERT_EQ(3, r2.local_peerlist.size());
+  ASSERT_EQ(r.local_peerlist.back().adr, r2.local_peerlist.back().adr);
+}
+
+TEST(protocol_pack, long_arrays_are_wire_compatible)
+{
+  // more than 63 entries need wider counts than the byte the writer reserves
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r = AUTO_VAL_INIT(r);
+  for (size_t i = 0; i < 100; ++i)
+    r.txs.push_back(random_blob(i));
+  for (size_t i = 0; i < 70; ++i)
+  {
+    cryptonote::block_complete_entry bce;
+    bce.block = random_blob(80);
+    for (size_t j = 0; j < i % 3; ++j)
+      bce.txs.push_back(random_blob(200));
+    r.blocks.push_back(bce);
+  }
+  for (size_t i = 0; i < 5; ++i)
+    r.missed_ids.push_back(crypto::rand<crypto::hash>());
+  r.current_blockchain_height = 1000000;
+
+  check_wire_compatible(r);
+
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r2 = AUTO_VAL_INIT(r2);
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(r2, buff));
+  ASSERT_EQ(r.txs, r2.txs);
+  ASSERT_EQ(70, r2.blocks.size());
+  ASSERT_EQ(r.blocks.back().block, r2.blocks.back().block);
+  ASSERT_EQ(r.blocks.back().txs, r2.blocks.back().txs);
+  ASSERT_EQ(r.missed_ids, r2.missed_ids);
+  ASSERT_TRUE(r2.blocks_not_sent.empty());
+}
+
+TEST(protocol_pack, missing_fields_keep_defaults_and_unknown_ones_are_ignored)
+{
+  old_core_sync_data old_data = AUTO_VAL_INIT(old_data);
+  old_data.current_height = 42;
+  old_data.top_id = crypto::rand<crypto::hash>();
+
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(old_data, buff));
+  cryptonote::CORE_SYNC_DATA new_data = AUTO_VAL_INIT(new_data);
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(new_data, buff));
+  ASSERT_EQ(42, new_data.current_height);
+  ASSERT_EQ(old_data.top_id, new_data.top_id);
+  ASSERT_FALSE(new_data.supports_compact_blocks);
+
+  new_data.supports_tx_announcements = true;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(new_data, buff));
+  old_core_sync_data old_data2 = AUTO_VAL_INIT(old_data2);
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(old_data2, buff));
+  ASSERT_EQ(old_data.top_id, old_data2.top_id);
+}
+
+TEST(protocol_pack, integers_convert_like_portable_storage)
+{
+  wide_hop wide = AUTO_VAL_INIT(wide);
+  wide.hop = 5;
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(wide, buff));
+  cryptonote::NOTIFY_NEW_BLOCK::request r = AUTO_VAL_INIT(r);
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(r, buff));
+  ASSERT_EQ(5, r.hop);
+
+  wide.hop = 1ULL << 40;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(wide, buff));
+  ASSERT_FALSE(epee::serialization::load_t_from_binary(r, buff));
+  ASSERT_FALSE(load_with_portable_storage(r, buff));
+}
+
+TEST(protocol_pack, truncated_buffers_are_rejected)
+{
+  cryptonote::NOTIFY_NEW_BLOCK::request r = AUTO_VAL_INIT(r);
+  r.b.block = random_blob(100);
+  r.b.txs.push_back(random_blob(50));
+  r.current_blockchain_height = 7;
+  r.hop = 1;
+
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+  for (size_t size = 0; size < buff.size(); ++size)
+  {
+    cryptonote::NOTIFY_NEW_BLOCK::request r2 = AUTO_VAL_INIT(r2);
+    ASSERT_FALSE(epee::serialization::load_t_from_binary(r2, buff.substr(0, size))) << "size " << size;
+  }
+}
@@ -0,0 +1,352 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "gtest/gtest.h"
+
+#include "common/ntp_time.h"
+#include "cryptonote_config.h"
+#include "cryptonote_core/account.h"
+#include "cryptonote_core/blockchain_storage.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "cryptonote_core/difficulty.h"
+#include "cryptonote_core/tx_pool.h"
+#include "../test_genesis_config.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  const char *DATA_DIR = "tx_pool_test_data";
+  const size_t SPENDABLE_BLOCKS = 3;
+
+  // a blockchain_storage and its pool, wired up like the core does
+  struct test_chain
+  {
+    test_chain(tools::ntp_time& ntp_time) : m_pbs(new blockchain_storage(m_pool, ntp_time)), m_pool(*m_pbs) { }
+
+    std::unique_ptr<blockchain_storage> m_pbs;
+    tx_memory_pool m_pool;
+  };
+
+  class tx_pool : public ::testing::Test
+  {
+  protected:
+    tx_pool() : m_ntp_time(60*60, 1) { }
+
+    virtual void SetUp()
+    {
+      set_test_genesis_config();
+      config::no_reward_ramp = true;
+      boost::filesystem::remove_all(DATA_DIR);
+      m_miner.generate();
+      m_chain.reset(new test_chain(m_ntp_time));
+      ASSERT_TRUE(bs().init(DATA_DIR));
+
+      // mined money unlocks after CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW blocks, leave a few blocks' worth spendable
+      for (size_t i = 0; i < CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW + SPENDABLE_BLOCKS; i++)
+        ASSERT_TRUE(mine_block());
+    }
+
+    virtual void TearDown()
+    {
+      if (m_chain)
+      {
+        bs().deinit();
+        m_chain.reset();
+      }
+      boost::filesystem::remove_all(DATA_DIR);
+      config::no_reward_ramp = false;
+    }
+
+    // blocks come a target apart so the difficulty stays low
+    bool mine_block(block* pb = NULL)
+    {
+      m_ntp_time.apply_manual_delta(config::difficulty_target());
+
+      block b;
+      difficulty_type diffic;
+      uint64_t height;
+      if (!bs().create_block_template(b, m_miner.get_keys().m_account_address, diffic, height, blobdata(), false))
+        return false;
+
+      block_verification_context bvc = AUTO_VAL_INIT(bvc);
+      if (!find_nonce(b, diffic, height) || !bs().add_new_block(b, bvc) || !bvc.m_added_to_main_chain)
+        return false;
+      if (pb)
+        *pb = b;
+      return true;
+    }
+
+    // mines a block with just the given txs on any block, which needn't be the tip
+    bool mine_block_on(const crypto::hash& prev_id, const std::vector<crypto::hash>& tx_hashes, uint64_t fee,
+                       block_verification_context& bvc, block* pb = NULL)
+    {
+      m_ntp_time.apply_manual_delta(config::difficulty_target());
+
+      block b;
+      difficulty_type diffic;
+      uint64_t height;
+      if (!bs().create_block_template(b, m_miner.get_keys().m_account_address, diffic, height, blobdata(), false))
+        return false;
+
+      block prev;
+      if (!bs().get_block_by_hash(prev_id, prev))
+        return false;
+      height = get_block_height(prev) + 1;
+      b.prev_id = prev_id;
+      b.tx_hashes = tx_hashes;
+      if (!construct_miner_tx(height, bs().get_current_comulative_blocksize_limit() / 2, bs().already_generated_coins(height - 1),
+                              0, fee, m_miner.get_keys().m_account_address, b.miner_tx))
+        return false;
+
+      // a side chain's difficulty is worked out from its own blocks, so leave some room
+      bvc = block_verification_context();
+      if (!find_nonce(b, diffic * 2, height) || !bs().add_new_block(b, bvc))
+        return false;
+      if (pb)
+        *pb = b;
+      return true;
+    }
+
+    bool find_nonce(block& b, difficulty_type diffic, uint64_t height)
+    {
+      for (;; b.nonce++)
+      {
+        crypto::hash h;
+        if (!get_block_longhash(b, h, height, NULL, false))
+          return false;
+        if (check_hash(h, diffic))
+          return true;
+      }
+    }
+
+    // the txs a block template would have
+    std::vector<crypto::hash> template_txs()
+    {
+      block b;
+      difficulty_type diffic;
+      uint64_t height;
+      EXPECT_TRUE(bs().create_block_template(b, m_miner.get_keys().m_account_address, diffic, height, blobdata(), false));
+      return b.tx_hashes;
+    }
+
+    // a tx sending output out_index of src, which is in the chain, back to the miner less the fee
+    transaction spend(const transaction& src, size_t out_index, uint64_t unlock_time = 0)
+    {
+      std::vector<uint64_t> global_indexes;
+      EXPECT_TRUE(bs().get_tx_outputs_gindexs(get_transaction_hash(src), global_indexes));
+
+      tx_source_entry se;
+      se.outputs.push_back(std::make_pair(global_indexes[out_index], boost::get<txout_to_key>(src.outs()[out_index].target).key));
+      se.real_output = 0;
+      se.real_out_tx_key = get_tx_pub_key_from_extra(src);
+      se.real_output_in_tx_index = out_index;
+      se.cp = src.out_cp(out_index);
+      se.amount_in = se.amount_out = src.outs()[out_index].amount;
+
+      std::vector<tx_source_entry> sources(1, se);
+      std::vector<tx_destination_entry> destinations(1, tx_destination_entry(se.cp, se.amount_in - DEFAULT_FEE, m_miner.get_keys().m_account_address));
+      transaction tx;
+      EXPECT_TRUE(construct_tx(m_miner.get_keys(), sources, destinations, std::vector<uint8_t>(), tx, unlock_time));
+      return tx;
+    }
+
+    // the index of the largest output of a miner tx
+    size_t largest_out(const transaction& miner_tx)
+    {
+      size_t largest = 0;
+      for (size_t i = 1; i < miner_tx.outs().size(); i++)
+      {
+        if (miner_tx.outs()[i].amount > miner_tx.outs()[largest].amount)
+          largest = i;
+      }
+      return largest;
+    }
+
+    transaction miner_tx(uint64_t height)
+    {
+      block b;
+      EXPECT_TRUE(bs().get_block_by_hash(bs().get_block_id_by_height(height), b));
+      return b.miner_tx;
+    }
+
+    // spends the largest output mined at height, which has to be unlocked
+    transaction spend_mined(uint64_t height)
+    {
+      transaction src = miner_tx(height);
+      return spend(src, largest_out(src));
+    }
+
+    bool add_to_pool(const transaction& tx, bool kept_by_block = false)
+    {
+      tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      return pool().add_tx(tx, tvc, kept_by_block) && tvc.m_added_to_pool && !tvc.m_verifivation_failed;
+    }
+
+    static bool contains(const std::vector<crypto::hash>& hashes, const transaction& tx)
+    {
+      return std::find(hashes.begin(), hashes.end(), get_transaction_hash(tx)) != hashes.end();
+    }
+
+    // the height of the tip at which a pool tx last passed the full input checks, as print_pool shows it
+    uint64_t last_verified_height(const transaction& tx)
+    {
+      std::stringstream id;
+      id << "id: " << get_transaction_hash(tx);
+      std::string pool_str = pool().print_pool(true);
+      size_t pos = pool_str.find(id.str());
+      EXPECT_NE(std::string::npos, pos);
+      const std::string field = "last_verified_height: ";
+      pos = pool_str.find(field, pos);
+      EXPECT_NE(std::string::npos, pos);
+      return boost::lexical_cast<uint64_t>(pool_str.substr(pos + field.size(), pool_str.find_first_of("\r\n", pos) - pos - field.size()));
+    }
+
+    blockchain_storage& bs() { return *m_chain->m_pbs; }
+    tx_memory_pool& pool() { return m_chain->m_pool; }
+
+    tools::ntp_time m_ntp_time;
+    account_base m_miner;
+    std::unique_ptr<test_chain> m_chain;
+  };
+}
+
+TEST_F(tx_pool, template_follows_txs_added_and_taken)
+{
+  ASSERT_TRUE(template_txs().empty());
+
+  transaction a = spend_mined(1);
+  ASSERT_TRUE(add_to_pool(a));
+  auto txs = template_txs();
+  ASSERT_EQ(1, txs.size());
+  ASSERT_TRUE(contains(txs, a));
+
+  transaction b = spend_mined(2);
+  transaction c = spend_mined(3);
+  ASSERT_TRUE(add_to_pool(b));
+  ASSERT_TRUE(add_to_pool(c));
+  txs = template_txs();
+  ASSERT_EQ(3, txs.size());
+  ASSERT_TRUE(contains(txs, a) && contains(txs, b) && contains(txs, c));
+
+  transaction taken;
+  size_t blob_size;
+  uint64_t fee;
+  ASSERT_TRUE(pool().take_tx(get_transaction_hash(b), taken, blob_size, fee));
+  txs = template_txs();
+  ASSERT_EQ(2, txs.size());
+  ASSERT_FALSE(contains(txs, b));
+
+  // a new tip picks again from the pool
+  block mined;
+  ASSERT_TRUE(mine_block(&mined));
+  ASSERT_EQ(2, mined.tx_hashes.size());
+  ASSERT_TRUE(template_txs().empty());
+}
+
+TEST_F(tx_pool, template_picks_tx_once_its_inputs_unlock_by_time)
+{
+  // an output locked for a while past the allowed delta, mined into the chain
+  const uint64_t lock_seconds = 1000;
+  uint64_t unlock_time = bs().get_adjusted_time() + config::cryptonote_locked_tx_allowed_delta_seconds() + lock_seconds;
+  ASSERT_LE(CRYPTONOTE_MAX_BLOCK_NUMBER, unlock_time);
+  transaction src = miner_tx(1);
+  transaction locked = spend(src, largest_out(src), unlock_time);
+  ASSERT_TRUE(add_to_pool(locked));
+  block mined;
+  ASSERT_TRUE(mine_block(&mined));
+  ASSERT_EQ(1, mined.tx_hashes.size());
+
+  // its spend can't go in a block yet, it's only in the pool because a popped block had it
+  transaction spending = spend(locked, 0);
+  ASSERT_FALSE(add_to_pool(spending));
+  tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+  ASSERT_TRUE(pool().add_tx(spending, tvc, true));
+  ASSERT_TRUE(tvc.m_added_to_pool);
+  ASSERT_TRUE(template_txs().empty());
+  ASSERT_TRUE(template_txs().empty());
+
+  // same tip and pool, only the time moved on
+  m_ntp_time.apply_manual_delta(lock_seconds + CRYPTONOTE_POOL_LOCKED_TX_RECHECK_INTERVAL);
+  auto txs = template_txs();
+  ASSERT_EQ(1, txs.size());
+  ASSERT_TRUE(contains(txs, spending));
+}
+
+TEST_F(tx_pool, verified_tx_skips_input_checks_while_its_tip_is_in_the_chain)
+{
+  transaction a = spend_mined(1);
+  ASSERT_TRUE(add_to_pool(a));
+  uint64_t verified_height = bs().get_current_blockchain_height() - 1;
+  ASSERT_TRUE(contains(template_txs(), a));
+  ASSERT_EQ(verified_height, last_verified_height(a));
+
+  // blocks that leave the tx in the pool don't make it check its inputs again
+  block_verification_context bvc = AUTO_VAL_INIT(bvc);
+  ASSERT_TRUE(mine_block_on(bs().get_tail_id(), std::vector<crypto::hash>(), 0, bvc));
+  ASSERT_TRUE(bvc.m_added_to_main_chain);
+  ASSERT_TRUE(mine_block_on(bs().get_tail_id(), std::vector<crypto::hash>(), 0, bvc));
+  ASSERT_TRUE(bvc.m_added_to_main_chain);
+  ASSERT_TRUE(contains(template_txs(), a));
+  ASSERT_EQ(verified_height, last_verified_height(a));
+}
+
+TEST_F(tx_pool, reorg_makes_verified_tx_check_its_inputs_again)
+{
+  transaction a = spend_mined(1);
+  ASSERT_TRUE(add_to_pool(a));
+  uint64_t verified_height = bs().get_current_blockchain_height() - 1;
+  crypto::hash verified_id = bs().get_tail_id();
+  ASSERT_TRUE(contains(template_txs(), a));
+  ASSERT_EQ(verified_height, last_verified_height(a));
+
+  // a longer chain from below the tip it was verified at
+  crypto::hash fork_id = bs().get_block_id_by_height(verified_height - 1);
+  block alt;
+  block_verification_context bvc = AUTO_VAL_INIT(bvc);
+  ASSERT_TRUE(mine_block_on(fork_id, std::vector<crypto::hash>(), 0, bvc, &alt));
+  ASSERT_FALSE(bvc.m_added_to_main_chain);
+  ASSERT_FALSE(bvc.m_verifivation_failed);
+  ASSERT_TRUE(mine_block_on(get_block_hash(alt), std::vector<crypto::hash>(), 0, bvc, &alt));
+  ASSERT_TRUE(bvc.m_added_to_main_chain);
+  ASSERT_EQ(get_block_hash(alt), bs().get_tail_id());
+  ASSERT_NE(verified_id, bs().get_block_id_by_height(verified_height));
+
+  ASSERT_TRUE(contains(template_txs(), a));
+  ASSERT_EQ(verified_height + 1, last_verified_height(a));
+}
+
+TEST_F(tx_pool, verified_tx_is_left_out_once_its_key_image_is_spent)
+{
+  // two spends of the same output, the block only takes one
+  transaction src = miner_tx(1);
+  transaction a = spend(src, largest_out(src));
+  transaction b = spend(src, largest_out(src));
+  ASSERT_NE(get_transaction_hash(a), get_transaction_hash(b));
+  ASSERT_TRUE(add_to_pool(a));
+  ASSERT_TRUE(contains(template_txs(), a));
+  uint64_t verified_height = bs().get_current_blockchain_height() - 1;
+  crypto::hash verified_id = bs().get_tail_id();
+  ASSERT_EQ(verified_height, last_verified_height(a));
+
+  tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+  ASSERT_TRUE(pool().add_tx(b, tvc, true));
+  block_verification_context bvc = AUTO_VAL_INIT(bvc);
+  ASSERT_TRUE(mine_block_on(bs().get_tail_id(), std::vector<crypto::hash>(1, get_transaction_hash(b)), DEFAULT_FEE, bvc));
+  ASSERT_TRUE(bvc.m_added_to_main_chain);
+
+  // the tip a was verified at is still in the chain, but its input is gone
+  ASSERT_EQ(verified_id, bs().get_block_id_by_height(verified_height));
+  ASSERT_FALSE(contains(template_txs(), a));
+  ASSERT_TRUE(template_txs().empty());
+}
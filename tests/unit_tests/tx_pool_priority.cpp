@@ -0,0 +1,70 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <limits>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "cryptonote_core/tx_pool.h"
+
+using namespace cryptonote::detail;
+
+namespace
+{
+  tx_priority_key make_key(bool grading, uint64_t fee, size_t blob_size)
+  {
+    return tx_priority_key(grading, fee, blob_size, crypto::rand<crypto::hash>());
+  }
+
+  std::vector<tx_priority_key> in_order(const std::vector<tx_priority_key>& keys)
+  {
+    std::set<tx_priority_key, tx_priority_less> index(keys.begin(), keys.end());
+    return std::vector<tx_priority_key>(index.begin(), index.end());
+  }
+}
+
+TEST(tx_pool_priority, grading_then_fee_per_byte)
+{
+  std::vector<tx_priority_key> keys;
+  keys.push_back(make_key(false, 100, 1000)); // 0.1 per byte
+  keys.push_back(make_key(false, 300, 1000)); // 0.3
+  keys.push_back(make_key(true,  1, 5000));
+  keys.push_back(make_key(false, 50, 100));   // 0.5
+  keys.push_back(make_key(false, 200, 1000)); // 0.2
+
+  auto ordered = in_order(keys);
+  ASSERT_EQ(5, ordered.size());
+  ASSERT_TRUE(ordered[0].grading);
+  ASSERT_EQ(50, ordered[1].fee);
+  ASSERT_EQ(300, ordered[2].fee);
+  ASSERT_EQ(200, ordered[3].fee);
+  ASSERT_EQ(100, ordered[4].fee);
+}
+
+TEST(tx_pool_priority, same_rate_keeps_distinct_txs)
+{
+  std::vector<tx_priority_key> keys;
+  keys.push_back(make_key(false, 200, 2000));
+  keys.push_back(make_key(false, 100, 1000));
+  keys.push_back(make_key(false, 100, 1000));
+
+  auto ordered = in_order(keys);
+  ASSERT_EQ(3, ordered.size());
+  ASSERT_EQ(1000, ordered[0].blob_size);
+  ASSERT_EQ(1000, ordered[1].blob_size);
+  ASSERT_EQ(2000, ordered[2].blob_size);
+}
+
+TEST(tx_pool_priority, large_fees_dont_overflow)
+{
+  std::vector<tx_priority_key> keys;
+  keys.push_back(make_key(false, std::numeric_limits<uint64_t>::max() / 2, 3000));
+  keys.push_back(make_key(false, std::numeric_limits<uint64_t>::max(), 5000));
+
+  auto ordered = in_order(keys);
+  ASSERT_EQ(std::numeric_limits<uint64_t>::max(), ordered[0].fee);
+}
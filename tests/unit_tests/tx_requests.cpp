@@ -0,0 +1,178 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <boost/uuid/random_generator.hpp>
+
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/tx_requests.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  bool have_none(const crypto::hash&) { return false; }
+
+  boost::uuids::uuid new_id() { return boost::uuids::random_generator()(); }
+}
+
+TEST(tx_requests, asks_the_first_announcer_only)
+{
+  tx_requests r(30, 10, 4);
+  boost::uuids::uuid a = new_id(), b = new_id();
+  crypto::hash tx = crypto::rand<crypto::hash>();
+
+  ASSERT_TRUE(r.announced(a, tx, 100));
+  ASSERT_FALSE(r.announced(a, tx, 101));
+  ASSERT_FALSE(r.announced(b, tx, 102));
+  ASSERT_EQ(1, r.size());
+  ASSERT_EQ(1, r.requested_count(a));
+  ASSERT_EQ(0, r.requested_count(b));
+}
+
+TEST(tx_requests, timeout_asks_the_next_announcer)
+{
+  tx_requests r(30, 10, 4);
+  boost::uuids::uuid a = new_id(), b = new_id(), c = new_id();
+  crypto::hash tx = crypto::rand<crypto::hash>();
+  r.announced(a, tx, 100);
+  r.announced(b, tx, 101);
+  r.announced(c, tx, 102);
+
+  tx_requests::retry_map retries;
+  r.expire(129, have_none, retries);
+  ASSERT_TRUE(retries.empty());
+
+  r.expire(130, have_none, retries);
+  ASSERT_EQ(1, retries.size());
+  ASSERT_EQ(1, retries[b].size());
+  ASSERT_EQ(tx, retries[b].front());
+  ASSERT_EQ(0, r.requested_count(a));
+  ASSERT_EQ(1, r.requested_count(b));
+
+  retries.clear();
+  r.expire(160, have_none, retries);
+  ASSERT_EQ(1, retries[c].size());
+
+  // nobody left to ask
+  retries.clear();
+  r.expire(190, have_none, retries);
+  ASSERT_TRUE(retries.empty());
+  ASSERT_EQ(0, r.size());
+  ASSERT_EQ(0, r.requested_count(c));
+}
+
+TEST(tx_requests, received_tx_is_not_asked_again)
+{
+  tx_requests r(30, 10, 4);
+  boost::uuids::uuid a = new_id(), b = new_id();
+  crypto::hash tx = crypto::rand<crypto::hash>();
+  r.announced(a, tx, 100);
+  r.announced(b, tx, 100);
+  r.received(tx);
+  ASSERT_EQ(0, r.size());
+  ASSERT_EQ(0, r.requested_count(a));
+
+  tx_requests::retry_map retries;
+  r.expire(200, have_none, retries);
+  ASSERT_TRUE(retries.empty());
+}
+
+TEST(tx_requests, tx_we_already_have_is_dropped_on_timeout)
+{
+  tx_requests r(30, 10, 4);
+  boost::uuids::uuid a = new_id(), b = new_id();
+  crypto::hash tx = crypto::rand<crypto::hash>();
+  r.announced(a, tx, 100);
+  r.announced(b, tx, 100);
+
+  tx_requests::retry_map retries;
+  r.expire(130, [&](const crypto::hash& h) { return h == tx; }, retries);
+  ASSERT_TRUE(retries.empty());
+  ASSERT_EQ(0, r.size());
+}
+
+TEST(tx_requests, closed_connection_passes_its_requests_on)
+{
+  tx_requests r(30, 10, 4);
+  boost::uuids::uuid a = new_id(), b = new_id();
+  crypto::hash tx1 = crypto::rand<crypto::hash>(), tx2 = crypto::rand<crypto::hash>();
+  r.announced(a, tx1, 100);
+  r.announced(b, tx1, 100);
+  r.announced(a, tx2, 100);
+
+  r.connection_closed(a);
+  ASSERT_EQ(0, r.requested_count(a));
+
+  // no need to wait for the timeout
+  tx_requests::retry_map retries;
+  r.expire(101, have_none, retries);
+  ASSERT_EQ(1, retries.size());
+  ASSERT_EQ(1, retries[b].size());
+  ASSERT_EQ(tx1, retries[b].front());
+  ASSERT_EQ(1, r.size());
+}
+
+TEST(tx_requests, announcements_past_the_limit_are_ignored)
+{
+  tx_requests r(30, 2, 4);
+  boost::uuids::uuid a = new_id(), b = new_id();
+  crypto::hash tx1 = crypto::rand<crypto::hash>(), tx2 = crypto::rand<crypto::hash>(), tx3 = crypto::rand<crypto::hash>();
+
+  ASSERT_TRUE(r.announced(a, tx1, 100));
+  ASSERT_TRUE(r.announced(a, tx2, 100));
+  ASSERT_FALSE(r.announced(a, tx3, 100));
+  ASSERT_EQ(2, r.size());
+  ASSERT_EQ(2, r.requested_count(a));
+
+  // another peer can still be asked for it, and a answering frees room
+  ASSERT_TRUE(r.announced(b, tx3, 100));
+  r.received(tx1);
+  ASSERT_EQ(1, r.requested_count(a));
+  crypto::hash tx4 = crypto::rand<crypto::hash>();
+  ASSERT_TRUE(r.announced(a, tx4, 100));
+}
+
+TEST(tx_requests, retries_skip_announcers_without_room)
+{
+  tx_requests r(30, 1, 4);
+  boost::uuids::uuid a = new_id(), b = new_id(), c = new_id();
+  crypto::hash tx1 = crypto::rand<crypto::hash>(), tx2 = crypto::rand<crypto::hash>();
+  r.announced(a, tx1, 100);
+  r.announced(b, tx2, 120);
+  r.announced(b, tx1, 100);
+  r.announced(c, tx1, 100);
+
+  tx_requests::retry_map retries;
+  r.expire(130, have_none, retries);
+  ASSERT_EQ(1, retries.size());
+  ASSERT_EQ(1, retries[c].size());
+  ASSERT_EQ(1, r.requested_count(b));
+}
+
+TEST(tx_requests, announcers_are_capped)
+{
+  tx_requests r(30, 10, 2);
+  boost::uuids::uuid a = new_id();
+  crypto::hash tx = crypto::rand<crypto::hash>();
+  r.announced(a, tx, 100);
+  std::vector<boost::uuids::uuid> others;
+  for (size_t i = 0; i < 5; i++)
+  {
+    others.push_back(new_id());
+    r.announced(others.back(), tx, 100);
+  }
+
+  tx_requests::retry_map retries;
+  r.expire(130, have_none, retries);
+  r.expire(160, have_none, retries);
+  r.expire(190, have_none, retries);
+  ASSERT_EQ(2, retries.size());
+  ASSERT_EQ(1, retries.count(others[0]));
+  ASSERT_EQ(1, retries.count(others[1]));
+  ASSERT_EQ(0, r.size());
+}
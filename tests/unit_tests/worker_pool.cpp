@@ -0,0 +1,63 @@
+// Copyright (c) 2014-2015 The Pebblecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <atomic>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+#include "gtest/gtest.h"
+
+#include "common/worker_pool.h"
+
+TEST(worker_pool, covers_every_item_once)
+{
+  tools::worker_pool pool("test");
+  for (size_t count : {0, 1, 2, 7, 1000})
+  {
+    std::vector<std::atomic<int> > hits(count);
+    ASSERT_TRUE(pool.run(count, [&](size_t begin, size_t end) {
+      EXPECT_LE(begin, end);
+      EXPECT_LE(end, count);
+      for (size_t i = begin; i < end; i++)
+        ++hits[i];
+      return true;
+    }));
+    for (size_t i = 0; i < count; i++)
+      ASSERT_EQ(1, hits[i]);
+  }
+}
+
+TEST(worker_pool, fails_if_any_range_fails)
+{
+  tools::worker_pool pool("test");
+  std::atomic<size_t> done(0);
+  ASSERT_FALSE(pool.run(100, [&](size_t begin, size_t end) {
+    done += end - begin;
+    return !(begin <= 50 && 50 < end);
+  }));
+  // the other ranges still ran
+  ASSERT_EQ(100, done);
+}
+
+TEST(worker_pool, runs_batches_from_several_threads)
+{
+  tools::worker_pool pool("test");
+  std::atomic<size_t> done(0);
+  boost::thread_group callers;
+  for (int t = 0; t < 4; t++)
+  {
+    callers.create_thread([&]() {
+      for (int batch = 0; batch < 50; batch++)
+      {
+        EXPECT_TRUE(pool.run(10, [&](size_t begin, size_t end) {
+          done += end - begin;
+          return true;
+        }));
+      }
+    });
+  }
+  callers.join_all();
+  ASSERT_EQ(4 * 50 * 10, done);
+}